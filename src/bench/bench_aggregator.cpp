@@ -0,0 +1,429 @@
+// Aggregator::process_packet on a recorded wfb-ng stream, the way WfbngReceiver feeds it. The stream comes from
+// SyntheticTransmitter, so the packets are encrypted and FEC encoded as the drone sends them, with the loss and the
+// duplicate copies of one or two adapters. Prints the packets one core gets through per second. After a warm-up the
+// receive path must not allocate, the allocations of the replay are counted and the benchmark exits with 1 if there
+// are any, or if packets come out out of order.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../wifi/transmitter.h"
+#include "../wifi/wfb-ng/rx.hpp"
+#include "bench_keys.h"
+
+namespace {
+
+std::atomic<bool> count_allocations{false};
+std::atomic<uint64_t> allocation_count{0};
+
+void note_allocation() {
+    if (count_allocations.load(std::memory_order_relaxed)) {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+} // namespace
+
+// Counts the allocations of everything in the process, libsodium and zfex included. Elsewhere only operator new
+// is counted.
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) noexcept {
+    note_allocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept {
+    note_allocation();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept {
+    note_allocation();
+    return __libc_realloc(ptr, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept {
+    note_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) noexcept {
+    note_allocation();
+    void *p = __libc_memalign(alignment, size);
+    if (!p) {
+        return ENOMEM;
+    }
+    *ptr = p;
+    return 0;
+}
+
+void free(void *ptr) noexcept {
+    __libc_free(ptr);
+}
+}
+#else
+void *operator new(size_t size) {
+    note_allocation();
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+#endif
+
+namespace {
+
+/// The default link ID of wfb-ng, video port.
+constexpr uint32_t CHANNEL_ID = (7669206 << 8) + 0;
+
+/// Follows the payload of an 802.11 frame.
+constexpr size_t FCS_SIZE = 4;
+
+struct Scenario {
+    const char *name;
+    std::vector<SyntheticTransmitter::Source> sources;
+};
+
+const std::vector<Scenario> SCENARIOS = {
+    {"1 adapter", {{0.0}}},
+    {"1 adapter, 5% loss", {{0.05}}},
+    {"2 adapters", {{0.0}, {0.0}}},
+    {"2 adapters, 10% loss", {{0.1}, {0.1}}},
+};
+
+struct Options {
+    int k = 8;
+    int n = 12;
+    size_t size = 1400;
+    int packets = 20000;
+    int warmup = 2000;
+    int runs = 5;
+    uint32_t seed = 1;
+};
+
+/// What the adapters received, in the order the receiver gets it.
+struct Stream {
+    struct Frame {
+        size_t offset;
+        uint16_t size;
+        uint8_t wlan_idx;
+    };
+
+    std::vector<uint8_t> bytes;
+    std::vector<Frame> frames;
+
+    const uint8_t *data(const Frame &frame) const {
+        return bytes.data() + frame.offset;
+    }
+};
+
+Stream record_stream(const Scenario &scenario, const Options &options, const BenchKeyFiles &keys) {
+    Stream stream;
+    stream.bytes.reserve((options.size + 64) * options.packets * options.n / options.k);
+
+    const auto capture = [&](const Packet &packet, uint8_t wlan_idx) {
+        // What WfbngReceiver::handle_80211_frame passes on.
+        const uint8_t *payload = packet.Data.data() + sizeof(ieee80211_header);
+        const size_t size = packet.Data.size() - sizeof(ieee80211_header) - FCS_SIZE;
+
+        // Every adapter gets the same frame, keep one copy of it.
+        if (!stream.frames.empty()) {
+            const Stream::Frame &last = stream.frames.back();
+            if (last.size == size && std::memcmp(stream.data(last), payload, size) == 0) {
+                stream.frames.push_back({last.offset, last.size, wlan_idx});
+                return;
+            }
+        }
+
+        stream.frames.push_back({stream.bytes.size(), static_cast<uint16_t>(size), wlan_idx});
+        stream.bytes.insert(stream.bytes.end(), payload, payload + size);
+    };
+
+    SyntheticTransmitter transmitter(options.k,
+                                     options.n,
+                                     keys.drone,
+                                     0,
+                                     CHANNEL_ID,
+                                     scenario.sources,
+                                     capture,
+                                     options.seed);
+
+    // A few times, so that the loss does not take the session away.
+    for (int i = 0; i < 5; i++) {
+        transmitter.sendSessionKey();
+    }
+
+    std::vector<uint8_t> payload(options.size);
+    for (int i = 0; i < options.packets; i++) {
+        for (size_t j = 0; j < payload.size(); j++) {
+            payload[j] = static_cast<uint8_t>(i + j);
+        }
+        // The sequence number, to check the order on the way out.
+        std::memcpy(payload.data(), &i, sizeof(i));
+        transmitter.sendPacket(payload.data(), payload.size(), 0);
+    }
+
+    return stream;
+}
+
+/// Counts what the aggregator hands on and checks that it comes in order.
+class CheckingAggregator final : public Aggregator {
+public:
+    using Aggregator::Aggregator;
+
+    uint32_t delivered = 0;
+    uint32_t out_of_order = 0;
+
+protected:
+    void send_to_socket(const uint8_t *payload, uint16_t packet_size) override {
+        int32_t sequence = -1;
+        if (packet_size >= sizeof(sequence)) {
+            std::memcpy(&sequence, payload, sizeof(sequence));
+        }
+        if (sequence <= last_sequence_) {
+            out_of_order += 1;
+        }
+        last_sequence_ = sequence;
+        delivered += 1;
+    }
+
+private:
+    int32_t last_sequence_ = -1;
+};
+
+struct Totals {
+    uint64_t recovered = 0;
+    uint64_t lost = 0;
+    uint64_t skipped = 0;
+    uint64_t errors = 0;
+};
+
+/// Passes frames [begin, end) of the stream to the aggregator, as WfbngReceiver::process_video_packet does.
+void replay(CheckingAggregator &aggregator, const Stream &stream, size_t begin, size_t end, Totals &totals) {
+    const uint8_t antenna[RX_ANT_MAX] = {0, 1, 0xff, 0xff};
+    const int8_t rssi[RX_ANT_MAX] = {-40, -42, SCHAR_MIN, SCHAR_MIN};
+    const int8_t noise[RX_ANT_MAX] = {-70, -72, SCHAR_MAX, SCHAR_MAX};
+
+    for (size_t i = begin; i < end; i++) {
+        const Stream::Frame &frame = stream.frames[i];
+        aggregator.process_packet(stream.data(frame),
+                                  frame.size,
+                                  frame.wlan_idx,
+                                  antenna,
+                                  rssi,
+                                  noise,
+                                  0,
+                                  0,
+                                  0,
+                                  nullptr);
+
+        totals.recovered += aggregator.count_p_fec_recovered;
+        totals.lost += aggregator.count_p_lost;
+        totals.skipped += aggregator.count_p_dec_skipped;
+        totals.errors += aggregator.count_p_dec_err + aggregator.count_p_bad;
+        aggregator.clear_stats();
+    }
+}
+
+struct Result {
+    uint32_t delivered = 0;
+    Totals totals;
+    uint64_t allocations = 0;
+    bool ok = false;
+
+    /// Of the fastest run, after the warm-up. Frames include the copies of every adapter.
+    double frames_per_second = 0;
+    double payload_mb_per_second = 0;
+};
+
+/// Replays the whole stream, counting the allocations after the warm-up.
+Result check_scenario(const Scenario &scenario,
+                      const Stream &stream,
+                      const Options &options,
+                      const BenchKeyFiles &keys) {
+    CheckingAggregator aggregator(keys.gs, 0, CHANNEL_ID);
+    Result result;
+
+    const size_t warmup = std::min<size_t>(options.warmup, stream.frames.size());
+    replay(aggregator, stream, 0, warmup, result.totals);
+
+    allocation_count.store(0, std::memory_order_relaxed);
+    count_allocations.store(true, std::memory_order_relaxed);
+    replay(aggregator, stream, warmup, stream.frames.size(), result.totals);
+    count_allocations.store(false, std::memory_order_relaxed);
+    result.allocations = allocation_count.load(std::memory_order_relaxed);
+    result.delivered = aggregator.delivered;
+
+    // Without loss everything has to come out. With loss, only what FEC could not recover and the last block, which
+    // nothing comes after to release it, may be missing.
+    const auto sent = static_cast<uint64_t>(options.packets);
+    const bool lossless = std::ranges::all_of(scenario.sources, [](const auto &s) { return s.lossRate == 0.0; });
+    const bool complete = lossless ? result.delivered == sent
+                                   : result.delivered + result.totals.lost + options.k >= sent;
+
+    result.ok = result.allocations == 0 && aggregator.out_of_order == 0 && result.totals.errors == 0 && complete;
+
+    return result;
+}
+
+/// Times the replay after the warm-up on fresh aggregators, the fastest of options.runs.
+void measure_scenario(const Stream &stream, const Options &options, const BenchKeyFiles &keys, Result &result) {
+    using Clock = std::chrono::steady_clock;
+
+    const size_t warmup = std::min<size_t>(options.warmup, stream.frames.size());
+
+    for (int run = 0; run < options.runs; run++) {
+        CheckingAggregator aggregator(keys.gs, 0, CHANNEL_ID);
+        Totals totals;
+        replay(aggregator, stream, 0, warmup, totals);
+        const uint32_t delivered_before = aggregator.delivered;
+
+        const auto start = Clock::now();
+        replay(aggregator, stream, warmup, stream.frames.size(), totals);
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        const double frames_per_second = static_cast<double>(stream.frames.size() - warmup) / seconds;
+        if (frames_per_second > result.frames_per_second) {
+            result.frames_per_second = frames_per_second;
+            result.payload_mb_per_second =
+                static_cast<double>(aggregator.delivered - delivered_before) * options.size / seconds / 1e6;
+        }
+    }
+}
+
+void print_usage(const char *program) {
+    std::printf(
+        "Usage: %s [options]\n"
+        "\n"
+        "      --fec <k>/<n>         FEC of the stream (default 8/12)\n"
+        "      --size <bytes>        Payload of a packet (default 1400)\n"
+        "      --packets <n>         Packets the drone sends per scenario (default 20000)\n"
+        "      --warmup <n>          Frames replayed before counting allocations and timing (default 2000)\n"
+        "      --runs <n>            Timed replays per scenario, the fastest counts (default 5)\n"
+        "      --seed <n>            Seed of the simulated loss (default 1)\n"
+        "  -h, --help                Show this message\n",
+        program);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        } else if (arg == "--fec") {
+            if (std::sscanf(value().c_str(), "%d/%d", &options.k, &options.n) != 2 || options.k < 1 ||
+                options.n < options.k || options.n > 255) {
+                std::fprintf(stderr, "Invalid FEC, expected k/n with 1 <= k <= n <= 255\n");
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--size") {
+            options.size = std::strtoul(value().c_str(), nullptr, 10);
+            if (options.size < sizeof(int32_t) || options.size > MAX_PAYLOAD_SIZE) {
+                std::fprintf(stderr, "The size has to be within 4..%zu\n", MAX_PAYLOAD_SIZE);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--packets") {
+            options.packets = std::atoi(value().c_str());
+        } else if (arg == "--warmup") {
+            options.warmup = std::atoi(value().c_str());
+        } else if (arg == "--runs") {
+            options.runs = std::atoi(value().c_str());
+        } else if (arg == "--seed") {
+            options.seed = static_cast<uint32_t>(std::strtoul(value().c_str(), nullptr, 10));
+        } else {
+            std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (sodium_init() < 0) {
+        std::fprintf(stderr, "Unable to initialize libsodium\n");
+        return EXIT_FAILURE;
+    }
+
+    const BenchKeyFiles keys("bench_aggregator");
+
+    // The aggregators print their sessions while they run, so the table comes after.
+    std::vector<Result> results;
+    for (const Scenario &scenario : SCENARIOS) {
+        const Stream stream = record_stream(scenario, options, keys);
+        results.push_back(check_scenario(scenario, stream, options, keys));
+        measure_scenario(stream, options, keys, results.back());
+    }
+
+    std::printf("\nFEC %d/%d, %zu byte payloads, %d packets, counted and timed after %d frames, on one core\n",
+                options.k,
+                options.n,
+                options.size,
+                options.packets,
+                options.warmup);
+    std::printf("%-22s %10s %10s %8s %9s %12s %12s %9s %9s\n",
+                "scenario",
+                "delivered",
+                "recovered",
+                "lost",
+                "skipped",
+                "allocations",
+                "kframes/s",
+                "ns/frame",
+                "MB/s");
+
+    bool ok = true;
+    for (size_t i = 0; i < SCENARIOS.size(); i++) {
+        const Result &result = results[i];
+        std::printf("%-22s %10u %10llu %8llu %9llu %12llu %12.0f %9.0f %9.0f  %s\n",
+                    SCENARIOS[i].name,
+                    result.delivered,
+                    static_cast<unsigned long long>(result.totals.recovered),
+                    static_cast<unsigned long long>(result.totals.lost),
+                    static_cast<unsigned long long>(result.totals.skipped),
+                    static_cast<unsigned long long>(result.allocations),
+                    result.frames_per_second / 1e3,
+                    1e9 / result.frames_per_second,
+                    result.payload_mb_per_second,
+                    result.ok ? "ok" : "FAILED");
+        ok = ok && result.ok;
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,412 @@
+// Annex B start code scanning of FfmpegDecoder::parseNalUnits, per scanner, on H.264/H.265 elementary streams.
+// Captures are split into access units the way the RTP depacketizer hands them to the decoder; without any, a
+// synthetic 30 Mbit/s stream is used. Every scanner is first checked against the scalar one, exits with 1 on mismatch.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../player/ffmpeg/start_code.h"
+
+namespace {
+
+struct Options {
+    std::optional<StartCodeScanner> scanner;
+    std::optional<bool> hevc;
+    std::vector<std::string> captures;
+    int verify_rounds = 20000;
+    std::chrono::milliseconds duration{300};
+    uint32_t seed = 1;
+};
+
+using Packet = std::vector<uint8_t>;
+
+struct Stream {
+    std::string name;
+    bool hevc = false;
+    std::vector<Packet> packets;
+    size_t bytes = 0;
+};
+
+/// find_start_code() as it was before the SIMD scanners, the baseline of the benchmark.
+const uint8_t *legacy_find_start_code(const uint8_t *p, const uint8_t *end) {
+    while (p + 3 < end) {
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1) return p;
+        if (p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1) return p;
+        p++;
+    }
+    return nullptr;
+}
+
+bool is_vcl(const uint8_t header, const bool hevc) {
+    if (hevc) {
+        return ((header >> 1) & 0x3F) < 32;
+    }
+    const int type = header & 0x1F;
+    return type >= 1 && type <= 5;
+}
+
+/// Whether the NAL unit is one of those parseNalUnits looks for (SPS, PPS, IDR/IRAP).
+bool is_interesting(const uint8_t header, const bool hevc) {
+    if (hevc) {
+        const int type = (header >> 1) & 0x3F;
+        return type == 33 || type == 34 || (type >= 16 && type <= 21);
+    }
+    const int type = header & 0x1F;
+    return type == 7 || type == 8 || type == 5;
+}
+
+/// The work parseNalUnits does on a packet while it waits for a keyframe.
+template <typename Find>
+int scan_packet(const Packet &packet, const bool hevc, Find find) {
+    const uint8_t *p = packet.data();
+    const uint8_t *end = p + packet.size();
+    int found = 0;
+    while (p < end) {
+        p = find(p, end);
+        if (!p) break;
+        p += p[2] == 1 ? 3 : 4;
+        if (p >= end) break;
+        found += is_interesting(p[0], hevc);
+    }
+    return found;
+}
+
+/// The work parseNalUnits does once decoding has started.
+int scan_packet_start(const Packet &packet, const bool hevc) {
+    const uint8_t *data = packet.data();
+    const uint8_t *p = find_start_code(data, data + std::min<size_t>(packet.size(), 5));
+    return p && p + 3 < data + packet.size() && is_interesting(p[3], hevc);
+}
+
+/// Splits an elementary stream after every VCL NAL unit. With one slice per frame, as the cameras send it,
+/// these are the access units the depacketizer produces.
+std::vector<Packet> split_access_units(const std::vector<uint8_t> &data, const bool hevc) {
+    std::vector<Packet> packets;
+    const uint8_t *begin = data.data();
+    const uint8_t *end = begin + data.size();
+
+    const uint8_t *unit_start = begin;
+    const uint8_t *p = find_start_code(begin, end);
+    while (p) {
+        const uint8_t *next = p + 3 < end ? find_start_code(p + 3, end) : nullptr;
+        if (p + 3 < end && is_vcl(p[3], hevc)) {
+            // Keep the leading zero of a four-byte start code with the NAL unit that follows.
+            const uint8_t *cut = next ? (next > begin && next[-1] == 0 ? next - 1 : next) : end;
+            packets.emplace_back(unit_start, cut);
+            unit_start = cut;
+        }
+        p = next;
+    }
+    if (unit_start < end) {
+        packets.emplace_back(unit_start, end);
+    }
+    return packets;
+}
+
+std::optional<Stream> load_capture(const std::string &path, const Options &options) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return std::nullopt;
+    }
+    const std::vector<uint8_t> data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    Stream stream;
+    stream.name = path.substr(path.find_last_of("/\\") + 1);
+    const std::string ext = path.substr(path.find_last_of('.') + 1);
+    stream.hevc = options.hevc.value_or(ext == "h265" || ext == "hevc" || ext == "265");
+    stream.packets = split_access_units(data, stream.hevc);
+    for (const auto &packet : stream.packets) {
+        stream.bytes += packet.size();
+    }
+    return stream;
+}
+
+/// Random slice data with emulation prevention, so that start codes only occur where NAL units begin.
+void append_nal(Packet &packet, const uint8_t header, const size_t size, std::mt19937 &rng) {
+    packet.insert(packet.end(), {0, 0, 0, 1, header});
+    int zeros = 0;
+    for (size_t i = 0; i < size; i++) {
+        auto byte = static_cast<uint8_t>(rng());
+        if (zeros == 2 && byte <= 3) {
+            packet.push_back(3);
+            zeros = 0;
+        }
+        packet.push_back(byte);
+        zeros = byte == 0 ? zeros + 1 : 0;
+    }
+}
+
+/// Two seconds of 1080p60 H.264 at 30 Mbit/s, one IDR per second that is four times the size of a P frame.
+Stream synthetic_stream(const Options &options) {
+    constexpr int FPS = 60;
+    constexpr size_t BYTES_PER_SECOND = 30'000'000 / 8;
+    constexpr size_t P_FRAME = BYTES_PER_SECOND / (FPS + 3);
+
+    std::mt19937 rng(options.seed);
+    Stream stream;
+    stream.name = "synthetic";
+    for (int frame = 0; frame < 2 * FPS; frame++) {
+        Packet packet;
+        if (frame % FPS == 0) {
+            append_nal(packet, 0x67, 20, rng); // SPS
+            append_nal(packet, 0x68, 4, rng);  // PPS
+            append_nal(packet, 0x65, 4 * P_FRAME, rng);
+        } else {
+            append_nal(packet, 0x41, P_FRAME, rng);
+        }
+        stream.bytes += packet.size();
+        stream.packets.push_back(std::move(packet));
+    }
+    return stream;
+}
+
+std::vector<const uint8_t *> all_start_codes(const uint8_t *p, const uint8_t *end) {
+    std::vector<const uint8_t *> found;
+    while ((p = find_start_code(p, end))) {
+        found.push_back(p);
+        p++;
+    }
+    return found;
+}
+
+std::vector<StartCodeScanner> scanners_to_run(const Options &options) {
+    std::vector<StartCodeScanner> scanners;
+    for (int i = 0; i < static_cast<int>(StartCodeScanner::Count); i++) {
+        const auto scanner = static_cast<StartCodeScanner>(i);
+        if (start_code_scanner_supported(scanner) && (!options.scanner || *options.scanner == scanner)) {
+            scanners.push_back(scanner);
+        }
+    }
+    return scanners;
+}
+
+/// Start codes found in random buffers of mostly 0 and 1 bytes, at every alignment and with every tail length,
+/// and in the streams, have to be the same as those of the scalar scanner.
+bool verify(const StartCodeScanner scanner, const std::vector<Stream> &streams, const Options &options) {
+    std::mt19937 rng(options.seed);
+    int failures = 0;
+
+    const auto check = [&](const uint8_t *p, const uint8_t *end, const char *what) {
+        select_start_code_scanner(StartCodeScanner::Scalar);
+        const auto expected = all_start_codes(p, end);
+        select_start_code_scanner(scanner);
+        if (all_start_codes(p, end) != expected) {
+            std::fprintf(stderr,
+                         "%s: mismatch in %s of %td bytes (seed %u)\n",
+                         start_code_scanner_name(scanner),
+                         what,
+                         end - p,
+                         options.seed);
+            failures++;
+        }
+    };
+
+    std::vector<uint8_t> buffer(256 + 64);
+    for (int round = 0; round < options.verify_rounds; round++) {
+        const uint32_t density = 2 + rng() % 8;
+        for (auto &byte : buffer) {
+            const uint32_t r = rng() % density;
+            byte = r < 2 ? static_cast<uint8_t>(r) : static_cast<uint8_t>(rng());
+        }
+        const size_t offset = rng() % 64;
+        const size_t size = rng() % 256;
+        check(buffer.data() + offset, buffer.data() + offset + size, "a random buffer");
+    }
+
+    for (const Stream &stream : streams) {
+        for (const Packet &packet : stream.packets) {
+            check(packet.data(), packet.data() + packet.size(), stream.name.c_str());
+        }
+    }
+
+    return failures == 0;
+}
+
+/// Seconds per pass over all packets of the stream, repeating passes for at least the configured duration.
+template <typename F>
+double seconds_per_pass(const Options &options, F pass) {
+    using Clock = std::chrono::steady_clock;
+
+    size_t passes = 0;
+    const auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    while (elapsed < options.duration) {
+        pass();
+        passes++;
+        elapsed = Clock::now() - start;
+    }
+    return std::chrono::duration<double>(elapsed).count() / static_cast<double>(passes);
+}
+
+void benchmark(const std::vector<StartCodeScanner> &scanners,
+               const std::vector<Stream> &streams,
+               const Options &options) {
+    std::printf("%-20s %-6s %8s %9s %-18s %10s %10s\n",
+                "stream",
+                "codec",
+                "packets",
+                "KB/packet",
+                "scan",
+                "MB/s",
+                "ns/packet");
+
+    for (const Stream &stream : streams) {
+        // Keeps the compiler from dropping the scans.
+        volatile int sink = 0;
+
+        const auto report = [&](const std::string &what, const double seconds) {
+            std::printf("%-20.20s %-6s %8zu %9.1f %-18s %10.0f %10.0f\n",
+                        stream.name.c_str(),
+                        stream.hevc ? "H.265" : "H.264",
+                        stream.packets.size(),
+                        static_cast<double>(stream.bytes) / static_cast<double>(stream.packets.size()) / 1024,
+                        what.c_str(),
+                        static_cast<double>(stream.bytes) / seconds / 1e6,
+                        seconds * 1e9 / static_cast<double>(stream.packets.size()));
+        };
+
+        report("legacy",
+               seconds_per_pass(options, [&] {
+                   for (const Packet &packet : stream.packets) {
+                       sink = sink + scan_packet(packet, stream.hevc, legacy_find_start_code);
+                   }
+               }));
+
+        for (const StartCodeScanner scanner : scanners) {
+            select_start_code_scanner(scanner);
+            report(start_code_scanner_name(scanner),
+                   seconds_per_pass(options, [&] {
+                       for (const Packet &packet : stream.packets) {
+                           sink = sink + scan_packet(packet, stream.hevc, find_start_code);
+                       }
+                   }));
+        }
+
+        report("packet start only",
+               seconds_per_pass(options, [&] {
+                   for (const Packet &packet : stream.packets) {
+                       sink = sink + scan_packet_start(packet, stream.hevc);
+                   }
+               }));
+    }
+}
+
+void print_usage(const char *program) {
+    std::printf(
+        "Usage: %s [options] [capture.h264|capture.h265 ...]\n"
+        "\n"
+        "Captures are Annex B elementary streams, e.g. from\n"
+        "  ffmpeg -i record.mp4 -c:v copy -bsf:v h264_mp4toannexb -f h264 capture.h264\n"
+        "\n"
+        "      --scanner <name>      Only this scanner (scalar, SSE2, AVX2, NEON)\n"
+        "      --hevc, --h264        Codec of the captures (default: from the file extension)\n"
+        "      --verify <rounds>     Random buffers per scanner before timing, 0 to skip (default 20000)\n"
+        "      --verify-only         Check the scanners and exit\n"
+        "      --duration <ms>       Time per measurement (default 300)\n"
+        "      --seed <n>            Seed of the random data (default 1)\n"
+        "  -h, --help                Show this message\n",
+        program);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    bool verify_only = false;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        } else if (arg == "--scanner") {
+            const std::string name = value();
+            for (int s = 0; s < static_cast<int>(StartCodeScanner::Count); s++) {
+                if (name == start_code_scanner_name(static_cast<StartCodeScanner>(s))) {
+                    options.scanner = static_cast<StartCodeScanner>(s);
+                }
+            }
+            if (!options.scanner) {
+                std::fprintf(stderr, "Unknown scanner: %s\n", name.c_str());
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--hevc") {
+            options.hevc = true;
+        } else if (arg == "--h264") {
+            options.hevc = false;
+        } else if (arg == "--verify") {
+            options.verify_rounds = std::atoi(value().c_str());
+        } else if (arg == "--verify-only") {
+            verify_only = true;
+        } else if (arg == "--duration") {
+            options.duration = std::chrono::milliseconds(std::atoi(value().c_str()));
+        } else if (arg == "--seed") {
+            options.seed = static_cast<uint32_t>(std::strtoul(value().c_str(), nullptr, 10));
+        } else if (arg.starts_with("-")) {
+            std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            options.captures.push_back(arg);
+        }
+    }
+
+    const StartCodeScanner default_scanner = selected_start_code_scanner();
+    std::printf("Default scanner: %s\n", start_code_scanner_name(default_scanner));
+
+    const auto scanners = scanners_to_run(options);
+    if (scanners.empty()) {
+        std::fprintf(stderr, "The scanner is not supported by this build or CPU\n");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Stream> streams;
+    for (const std::string &path : options.captures) {
+        auto stream = load_capture(path, options);
+        if (!stream || stream->packets.empty()) {
+            std::fprintf(stderr, "Cannot read %s\n", path.c_str());
+            return EXIT_FAILURE;
+        }
+        streams.push_back(std::move(*stream));
+    }
+    if (streams.empty()) {
+        streams.push_back(synthetic_stream(options));
+    }
+
+    bool ok = true;
+    if (options.verify_rounds > 0) {
+        for (const StartCodeScanner scanner : scanners) {
+            const bool scanner_ok = verify(scanner, streams, options);
+            std::printf("Verify %-8s %s (%d random buffers, %zu streams)\n",
+                        start_code_scanner_name(scanner),
+                        scanner_ok ? "ok" : "FAILED",
+                        options.verify_rounds,
+                        streams.size());
+            ok = ok && scanner_ok;
+        }
+    }
+
+    if (ok && !verify_only) {
+        benchmark(scanners, streams, options);
+    }
+
+    select_start_code_scanner(default_scanner);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,365 @@
+// Software decode speed and latency of every decoder threading mode, on a capture of the local RTP test stream
+// (see test-local-rtp). For each mode the capture is first decoded as fast as possible, then once more with the
+// access units fed in at the frame rate as they arrive from the air, timing how long each takes to come out.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../player/ffmpeg/decoder_threading.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string capture;
+    std::optional<bool> hevc;
+    std::optional<float> fps;
+    int maxFrameDelay = 3;
+    std::chrono::milliseconds duration{3000};
+};
+
+struct Stream {
+    AVCodecID codecId = AV_CODEC_ID_H264;
+    std::vector<AVPacket *> accessUnits;
+    int width = 0;
+    int height = 0;
+    float fps = 0;
+
+    ~Stream() {
+        for (AVPacket *packet : accessUnits) {
+            av_packet_free(&packet);
+        }
+    }
+};
+
+struct Mode {
+    std::string name;
+    DecoderThreading threading;
+    int maxFrameDelay;
+};
+
+struct Result {
+    DecoderThreads threads;
+    double decodeFps = 0;
+    double latencyP50Ms = 0;
+    double latencyP99Ms = 0;
+};
+
+/// Cuts the elementary stream into access units the way libavformat would, and reads the stream format on the way.
+bool load_capture(const Options &options, Stream &stream) {
+    std::ifstream file(options.capture, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::vector<uint8_t> data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    const int size = static_cast<int>(data.size());
+    data.resize(data.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+
+    const std::string ext = options.capture.substr(options.capture.find_last_of('.') + 1);
+    const bool hevc = options.hevc.value_or(ext == "h265" || ext == "hevc" || ext == "265");
+    stream.codecId = hevc ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264;
+
+    AVCodecParserContext *parser = av_parser_init(stream.codecId);
+    AVCodecContext *ctx = avcodec_alloc_context3(nullptr);
+    if (!parser || !ctx) {
+        av_parser_close(parser);
+        avcodec_free_context(&ctx);
+        return false;
+    }
+
+    const auto add = [&](const uint8_t *unit, int unitSize) {
+        AVPacket *packet = av_packet_alloc();
+        if (av_new_packet(packet, unitSize) < 0) {
+            av_packet_free(&packet);
+            return;
+        }
+        memcpy(packet->data, unit, unitSize);
+        stream.accessUnits.push_back(packet);
+        if (stream.width == 0 && parser->width > 0) {
+            stream.width = parser->width;
+            stream.height = parser->height;
+        }
+    };
+
+    const uint8_t *p = data.data();
+    int left = size;
+    while (left > 0) {
+        uint8_t *unit = nullptr;
+        int unitSize = 0;
+        const int used = av_parser_parse2(parser, ctx, &unit, &unitSize, p, left, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+        if (used <= 0 && unitSize == 0) {
+            break;
+        }
+        p += used;
+        left -= used;
+        if (unitSize > 0) {
+            add(unit, unitSize);
+        }
+    }
+    // The last access unit is only out once the parser knows the stream ended.
+    uint8_t *unit = nullptr;
+    int unitSize = 0;
+    av_parser_parse2(parser, ctx, &unit, &unitSize, nullptr, 0, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+    if (unitSize > 0) {
+        add(unit, unitSize);
+    }
+
+    if (ctx->framerate.num > 0 && ctx->framerate.den > 0) {
+        stream.fps = static_cast<float>(av_q2d(ctx->framerate));
+    }
+    stream.fps = options.fps.value_or(stream.fps > 0 ? stream.fps : 60);
+
+    av_parser_close(parser);
+    avcodec_free_context(&ctx);
+
+    return !stream.accessUnits.empty();
+}
+
+/// A software decoder set up like FfmpegDecoder does for the in-process RTP stream.
+AVCodecContext *open_decoder(const Stream &stream, const DecoderThreads &threads) {
+    const AVCodec *codec = avcodec_find_decoder(stream.codecId);
+    AVCodecContext *ctx = codec ? avcodec_alloc_context3(codec) : nullptr;
+    if (!ctx) {
+        return nullptr;
+    }
+    ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    apply_decoder_threads(ctx, threads);
+    if (avcodec_open2(ctx, codec, nullptr) < 0) {
+        avcodec_free_context(&ctx);
+    }
+    return ctx;
+}
+
+/// Frames per second when the decoder never waits for input.
+double measure_decode_fps(AVCodecContext *ctx, const Stream &stream, const Options &options, AVFrame *frame) {
+    size_t frames = 0;
+    const auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+
+    while (elapsed < options.duration) {
+        for (AVPacket *packet : stream.accessUnits) {
+            if (avcodec_send_packet(ctx, packet) < 0) {
+                continue;
+            }
+            while (avcodec_receive_frame(ctx, frame) == 0) {
+                frames++;
+                av_frame_unref(frame);
+            }
+        }
+        // Drain, then start over from the first keyframe.
+        avcodec_send_packet(ctx, nullptr);
+        while (avcodec_receive_frame(ctx, frame) == 0) {
+            frames++;
+            av_frame_unref(frame);
+        }
+        avcodec_flush_buffers(ctx);
+        elapsed = Clock::now() - start;
+    }
+
+    return static_cast<double>(frames) / std::chrono::duration<double>(elapsed).count();
+}
+
+/// Time from avcodec_send_packet() to the frame coming out, with the access units paced at the frame rate.
+std::vector<double> measure_latency_ms(AVCodecContext *ctx, const Stream &stream, AVFrame *frame) {
+    const auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1 / stream.fps));
+
+    std::vector<Clock::time_point> sent(stream.accessUnits.size());
+    std::vector<double> latencies;
+
+    const auto collect = [&] {
+        const auto now = Clock::now();
+        const auto index = static_cast<size_t>(frame->pts);
+        if (frame->pts >= 0 && index < sent.size()) {
+            latencies.push_back(std::chrono::duration<double, std::milli>(now - sent[index]).count());
+        }
+        av_frame_unref(frame);
+    };
+
+    const auto start = Clock::now();
+    for (size_t i = 0; i < stream.accessUnits.size(); i++) {
+        std::this_thread::sleep_until(start + interval * static_cast<int64_t>(i));
+
+        AVPacket *packet = stream.accessUnits[i];
+        packet->pts = static_cast<int64_t>(i);
+        packet->dts = packet->pts;
+        sent[i] = Clock::now();
+        if (avcodec_send_packet(ctx, packet) < 0) {
+            continue;
+        }
+        while (avcodec_receive_frame(ctx, frame) == 0) {
+            collect();
+        }
+    }
+    avcodec_send_packet(ctx, nullptr);
+    while (avcodec_receive_frame(ctx, frame) == 0) {
+        collect();
+    }
+
+    for (AVPacket *packet : stream.accessUnits) {
+        packet->pts = AV_NOPTS_VALUE;
+        packet->dts = AV_NOPTS_VALUE;
+    }
+
+    return latencies;
+}
+
+double percentile(std::vector<double> values, const double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::ranges::sort(values);
+    const auto index = static_cast<size_t>(p / 100 * static_cast<double>(values.size() - 1));
+    return values[index];
+}
+
+std::optional<Result> run_mode(const Mode &mode, const Stream &stream, const Options &options) {
+    const DecoderThreads threads = choose_decoder_threads(mode.threading,
+                                                          stream.codecId,
+                                                          stream.width,
+                                                          stream.height,
+                                                          stream.fps,
+                                                          mode.maxFrameDelay);
+
+    AVFrame *frame = av_frame_alloc();
+    AVCodecContext *ctx = open_decoder(stream, threads);
+    if (!ctx || !frame) {
+        av_frame_free(&frame);
+        return std::nullopt;
+    }
+
+    Result result;
+    result.threads = active_decoder_threads(ctx);
+    result.decodeFps = measure_decode_fps(ctx, stream, options, frame);
+    avcodec_free_context(&ctx);
+
+    // A fresh decoder, so that the first keyframe is decoded again.
+    ctx = open_decoder(stream, threads);
+    if (ctx) {
+        const auto latencies = measure_latency_ms(ctx, stream, frame);
+        result.latencyP50Ms = percentile(latencies, 50);
+        result.latencyP99Ms = percentile(latencies, 99);
+        avcodec_free_context(&ctx);
+    }
+
+    av_frame_free(&frame);
+    return result;
+}
+
+void print_usage(const char *program) {
+    std::printf(
+        "Usage: %s [options] <capture.h264|capture.h265>\n"
+        "\n"
+        "Captures are Annex B elementary streams, e.g. the input of test-local-rtp encoded like the camera does:\n"
+        "  ffmpeg -i input.mp4 -an -c:v libx265 -tune zerolatency -b:v 8M -f hevc capture.h265\n"
+        "\n"
+        "      --hevc, --h264        Codec of the capture (default: from the file extension)\n"
+        "      --fps <n>             Frame rate to feed the capture at (default: from the SPS, else 60)\n"
+        "      --max-delay <n>       Frame threading is measured with 1 to n frames of delay (default 3)\n"
+        "      --duration <ms>       Time to measure the decode speed of each mode for (default 3000)\n"
+        "  -h, --help                Show this message\n",
+        program);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        } else if (arg == "--hevc") {
+            options.hevc = true;
+        } else if (arg == "--h264") {
+            options.hevc = false;
+        } else if (arg == "--fps") {
+            options.fps = std::strtof(value().c_str(), nullptr);
+        } else if (arg == "--max-delay") {
+            options.maxFrameDelay = std::max(1, std::atoi(value().c_str()));
+        } else if (arg == "--duration") {
+            options.duration = std::chrono::milliseconds(std::atoi(value().c_str()));
+        } else if (arg.starts_with("-") || !options.capture.empty()) {
+            std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            options.capture = arg;
+        }
+    }
+
+    if (options.capture.empty()) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+
+    Stream stream;
+    if (!load_capture(options, stream)) {
+        std::fprintf(stderr, "Cannot read %s\n", options.capture.c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::printf("%s: %s %dx%d@%.0f, %zu access units, %u cores\n",
+                options.capture.c_str(),
+                stream.codecId == AV_CODEC_ID_HEVC ? "H.265" : "H.264",
+                stream.width,
+                stream.height,
+                stream.fps,
+                stream.accessUnits.size(),
+                std::thread::hardware_concurrency());
+
+    std::vector<Mode> modes = {{"single thread", DecoderThreading::Frame, 0}, {"slice", DecoderThreading::Slice, 0}};
+    for (int delay = 1; delay <= options.maxFrameDelay; delay++) {
+        modes.push_back({"frame, delay " + std::to_string(delay), DecoderThreading::Frame, delay});
+    }
+    modes.push_back({"auto", DecoderThreading::Auto, 2});
+
+    std::printf("%-16s %-12s %12s %16s %16s %16s\n",
+                "mode",
+                "threads",
+                "decode fps",
+                "latency p50 ms",
+                "latency p99 ms",
+                "reported add ms");
+
+    for (const Mode &mode : modes) {
+        const auto result = run_mode(mode, stream, options);
+        if (!result) {
+            std::fprintf(stderr, "%s: cannot open the decoder\n", mode.name.c_str());
+            return EXIT_FAILURE;
+        }
+
+        const std::string threads = std::to_string(result->threads.count) +
+                                    (result->threads.type == FF_THREAD_FRAME ? " frame" : " slice");
+        std::printf("%-16s %-12s %12.0f %16.2f %16.2f %16.2f\n",
+                    mode.name.c_str(),
+                    threads.c_str(),
+                    result->decodeFps,
+                    result->latencyP50Ms,
+                    result->latencyP99Ms,
+                    result->threads.addedFrames() * 1000 / stream.fps);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,318 @@
+// Diversity receive without hardware: SyntheticTransmitter sends one wfb-ng video stream to 1 to 4 simulated
+// adapters, each missing frames at its own loss rate, and WfbngReceiver::handle_80211_frame merges what they got.
+// Prints the frame loss left after merging and the work left to FEC, per number of adapters.
+// Exits with 1 if merging misbehaves: the merged frame loss has to match the product of the adapter loss rates,
+// more adapters must leave less to FEC, and the RTP packets have to come out in order.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../wifi/link_events.h"
+#include "../wifi/transmitter.h"
+#include "../wifi/wfbng_link.h"
+#include "bench_keys.h"
+
+namespace {
+
+/// The default link ID of wfb-ng, the video stream is on radio port 0.
+constexpr uint32_t LINK_ID = 7669206;
+
+constexpr size_t RTP_HEADER_SIZE = 12;
+
+struct Options {
+    /// Loss rate of each adapter, the first N are used for N adapters.
+    std::vector<double> loss = {0.2, 0.25, 0.3, 0.35};
+    int k = 8;
+    int n = 12;
+    size_t size = 1400;
+    int packets = 40000;
+    uint32_t seed = 1;
+};
+
+/// Counts the RTP packets the receiver delivers and checks their order.
+class BenchEvents final : public LinkEvents {
+public:
+    std::atomic<uint64_t> delivered{0};
+    std::atomic<uint64_t> out_of_order{0};
+
+    void EmitLog(LogLevel level, std::string msg) override {
+        if (level == LogLevel::Warn || level == LogLevel::Error) {
+            std::fprintf(stderr, "%s\n", msg.c_str());
+        }
+    }
+
+    void ShowTip(std::string msg, bool bad_news) override {}
+
+    void EmitWifiStopped() override {}
+
+    void NotifyRtpStream(int pt, uint16_t ssrc, int port, const std::string &codec) override {}
+
+    void NotifyInProcessRtpStream(const std::string &codec) override {}
+
+    // Only the video worker calls this.
+    void PushRtpPacket(const uint8_t *data, size_t size, const LatencyStamps &stamps) override {
+        if (size < RTP_HEADER_SIZE) {
+            return;
+        }
+        const uint16_t seq = static_cast<uint16_t>(data[2] << 8 | data[3]);
+        const auto step = static_cast<uint16_t>(seq - last_seq_);
+        if (delivered > 0 && (step == 0 || step >= 0x8000)) {
+            out_of_order += 1;
+        }
+        last_seq_ = seq;
+        delivered += 1;
+    }
+
+private:
+    uint16_t last_seq_ = 0;
+};
+
+struct Result {
+    int adapters = 0;
+    /// Product of the loss rates of the adapters.
+    double expected_loss = 0;
+    /// Frames sent and frames that reached at least one adapter.
+    uint64_t air_frames = 0;
+    uint64_t merged_frames = 0;
+    uint64_t delivered = 0;
+    uint64_t skipped = 0;
+    uint64_t recovered = 0;
+    uint64_t lost = 0;
+    uint64_t timeouts = 0;
+    uint64_t errors = 0;
+    uint64_t out_of_order = 0;
+
+    double merged_loss() const {
+        return 1.0 - static_cast<double>(merged_frames) / static_cast<double>(air_frames);
+    }
+};
+
+/// Sends the stream to `adapters` simulated adapters that all feed one receiver.
+Result run(int adapters, const Options &options, const BenchKeyFiles &keys) {
+    Result result;
+    result.adapters = adapters;
+    result.expected_loss = 1.0;
+
+    std::vector<SyntheticTransmitter::Source> sources;
+    for (int i = 0; i < adapters; i++) {
+        const double loss = options.loss[i];
+        // A weaker signal for the adapters that lose more, for the per-adapter RSSI/SNR accounting.
+        sources.push_back({loss, static_cast<uint8_t>(100 - 40 * loss), static_cast<int8_t>(30 - 20 * loss)});
+        result.expected_loss *= loss;
+    }
+
+    // About 2 MB, see LinkEvents::link_metrics_.
+    auto events = std::make_unique<BenchEvents>();
+    auto receiver = std::make_unique<WfbngReceiver>(keys.gs, LINK_ID, false, *events);
+
+    // Copies from several adapters of one frame come one after another, a frame that differs from the last one is
+    // one more frame that got through.
+    std::vector<uint8_t> last_frame;
+
+    const auto sink = [&](const Packet &packet, uint8_t wlan_idx) {
+        if (!std::ranges::equal(packet.Data, last_frame)) {
+            last_frame.assign(packet.Data.begin(), packet.Data.end());
+            result.merged_frames += 1;
+
+            // The adapters hear a frame at the same time. Replayed at full speed, the queues of the adapters would
+            // drift apart instead, and a block would be completed by FEC from one adapter before the data packets
+            // from another one are read.
+            receiver->wait_for_backlog(0);
+        }
+        receiver->handle_80211_frame(packet, wlan_idx);
+    };
+
+    SyntheticTransmitter transmitter(options.k,
+                                     options.n,
+                                     keys.drone,
+                                     0,
+                                     (LINK_ID << 8) + 0,
+                                     sources,
+                                     sink,
+                                     options.seed);
+
+    // Once a second at 60 fps and 8 packets per frame, as the drone does.
+    constexpr int SESSION_INTERVAL = 480;
+
+    std::vector<uint8_t> payload(options.size);
+    for (int i = 0; i < options.packets; i++) {
+        if (i % SESSION_INTERVAL == 0) {
+            transmitter.sendSessionKey();
+            result.air_frames += 1;
+        }
+
+        for (size_t j = 0; j < payload.size(); j++) {
+            payload[j] = static_cast<uint8_t>(i + j);
+        }
+        // RTP version 2, payload type 96, H.264 FU-A, so that the receiver takes it for video.
+        payload[0] = 0x80;
+        payload[1] = 96;
+        payload[2] = static_cast<uint8_t>(i >> 8);
+        payload[3] = static_cast<uint8_t>(i);
+        payload[RTP_HEADER_SIZE] = 28;
+
+        transmitter.sendPacket(payload.data(), payload.size(), 0);
+    }
+    result.air_frames += static_cast<uint64_t>(options.packets) / options.k * options.n;
+
+    receiver->wait_for_backlog(0);
+    receiver.reset();
+
+    const LinkStats &stats = events->link_stats_;
+    result.delivered = events->delivered;
+    result.out_of_order = events->out_of_order;
+    result.skipped = stats.decryptsSkipped.load();
+    result.recovered = stats.fecRecovered.load();
+    result.lost = stats.fecLost.load();
+    result.timeouts = stats.fecTimeoutBlocks.load();
+    result.errors = stats.decryptErrors.load() + stats.queueDrops.load();
+
+    return result;
+}
+
+/// Whether the merged frame loss is within 5 standard deviations of the expected one.
+bool matches_expected_loss(const Result &result) {
+    const double p = result.expected_loss;
+    const double sigma = std::sqrt(p * (1 - p) / static_cast<double>(result.air_frames));
+    return std::abs(result.merged_loss() - p) <= 5 * sigma + 1.0 / static_cast<double>(result.air_frames);
+}
+
+std::vector<double> parse_loss(const std::string &list) {
+    std::vector<double> loss;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        loss.push_back(std::atof(item.c_str()));
+    }
+    return loss;
+}
+
+void print_usage(const char *program) {
+    std::printf(
+        "Usage: %s [options]\n"
+        "\n"
+        "      --loss <list>         Loss rate of each adapter, 1 to 4 of them (default 0.2,0.25,0.3,0.35)\n"
+        "      --fec <k>/<n>         FEC of the stream (default 8/12)\n"
+        "      --size <bytes>        Payload of a packet (default 1400)\n"
+        "      --packets <n>         Packets the drone sends per run, a multiple of k (default 40000)\n"
+        "      --seed <n>            Seed of the simulated loss (default 1)\n"
+        "  -h, --help                Show this message\n",
+        program);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        } else if (arg == "--loss") {
+            options.loss = parse_loss(value());
+            const bool valid = std::ranges::all_of(options.loss, [](double loss) { return loss >= 0 && loss < 1; });
+            if (options.loss.empty() || options.loss.size() > MAX_ADAPTER_COUNT || !valid) {
+                std::fprintf(stderr, "Expected 1 to %d loss rates within [0, 1)\n", MAX_ADAPTER_COUNT);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--fec") {
+            if (std::sscanf(value().c_str(), "%d/%d", &options.k, &options.n) != 2 || options.k < 1 ||
+                options.n < options.k || options.n > 255) {
+                std::fprintf(stderr, "Invalid FEC, expected k/n with 1 <= k <= n <= 255\n");
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--size") {
+            options.size = std::strtoul(value().c_str(), nullptr, 10);
+            if (options.size <= RTP_HEADER_SIZE || options.size > MAX_PAYLOAD_SIZE) {
+                std::fprintf(stderr, "The size has to be within 13..%zu\n", MAX_PAYLOAD_SIZE);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--packets") {
+            options.packets = std::atoi(value().c_str());
+        } else if (arg == "--seed") {
+            options.seed = static_cast<uint32_t>(std::strtoul(value().c_str(), nullptr, 10));
+        } else {
+            std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Whole blocks only, the last one would be left open otherwise.
+    options.packets -= options.packets % options.k;
+
+    if (sodium_init() < 0) {
+        std::fprintf(stderr, "Unable to initialize libsodium\n");
+        return EXIT_FAILURE;
+    }
+
+    const BenchKeyFiles keys("bench_diversity");
+
+    // The aggregators print their sessions while they run, so the table comes after.
+    std::vector<Result> results;
+    for (int adapters = 1; adapters <= static_cast<int>(options.loss.size()); adapters++) {
+        results.push_back(run(adapters, options, keys));
+    }
+
+    std::printf("\nFEC %d/%d, %zu byte payloads, %d packets, adapter loss",
+                options.k,
+                options.n,
+                options.size,
+                options.packets);
+    for (const double loss : options.loss) {
+        std::printf(" %.0f%%", loss * 100);
+    }
+    std::printf("\n%-9s %10s %10s %10s %10s %9s %8s %9s\n",
+                "adapters",
+                "merged",
+                "expected",
+                "delivered",
+                "skipped",
+                "FEC load",
+                "lost",
+                "timeouts");
+
+    bool ok = true;
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &result = results[i];
+
+        // FEC load: packets FEC had to restore, per packet sent.
+        const double fec_load = static_cast<double>(result.recovered) / options.packets;
+        const bool less_fec = i == 0 || result.recovered < results[i - 1].recovered || results[i - 1].recovered == 0;
+        const bool result_ok =
+            matches_expected_loss(result) && less_fec && result.out_of_order == 0 && result.errors == 0;
+
+        std::printf("%-9d %9.3f%% %9.3f%% %10llu %10llu %8.2f%% %8llu %9llu  %s\n",
+                    result.adapters,
+                    result.merged_loss() * 100,
+                    result.expected_loss * 100,
+                    static_cast<unsigned long long>(result.delivered),
+                    static_cast<unsigned long long>(result.skipped),
+                    fec_load * 100,
+                    static_cast<unsigned long long>(result.lost),
+                    static_cast<unsigned long long>(result.timeouts),
+                    result_ok ? "ok" : "FAILED");
+        ok = ok && result_ok;
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,390 @@
+// Hand-off of the recovered RTP packets from the video aggregator to the decoder: through the in-process PacketRing
+// (what GuiInterface::PushRtpPacket and FfmpegDecoder::ReadInProcessPacket do), and through a loopback UDP socket
+// (what the link does with forward_port_ set and the SDP demuxer reads). The aggregator releases a frame's packets in
+// a burst, the producer sends them the same way, at a given bitrate and frame rate.
+// Prints the latency per packet from release to reception, the CPU time of the process per packet and the packets
+// lost. Exits with 1 if the ring loses or reorders packets.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+    #include <sys/resource.h>
+#endif
+
+#include "../wifi/latency_stamps.h"
+#include "../wifi/net_compat.h"
+#include "../wifi/packet_ring.h"
+
+namespace {
+
+constexpr size_t RTP_HEADER_SIZE = 12;
+
+/// Offset of the release time in the RTP payload, for the UDP hop, which has no room for a header of its own.
+constexpr size_t STAMP_OFFSET = RTP_HEADER_SIZE;
+
+/// What FFmpeg's udp protocol asks for on the sockets it reads.
+constexpr int UDP_RCV_BUF_SIZE = 384 * 1024;
+
+enum class Mode {
+    Ring,
+    Udp,
+};
+
+const char *mode_name(const Mode mode) {
+    return mode == Mode::Ring ? "ring" : "udp";
+}
+
+struct Options {
+    /// Mbit/s of RTP payload, one run per bitrate.
+    std::vector<double> bitrates = {10, 30, 100};
+    int fps = 60;
+    size_t size = 1400;
+    std::chrono::milliseconds duration{3000};
+};
+
+struct Result {
+    Mode mode = Mode::Ring;
+    double bitrate = 0;
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    uint64_t out_of_order = 0;
+    /// Release to reception, in ns, sorted.
+    std::vector<int64_t> latency;
+    /// CPU time of the process (both threads, user and system), in ns.
+    int64_t cpu_ns = 0;
+
+    double latency_us(const double quantile) const {
+        if (latency.empty()) {
+            return 0;
+        }
+        const auto index = static_cast<size_t>(quantile * static_cast<double>(latency.size() - 1));
+        return static_cast<double>(latency[index]) / 1000.0;
+    }
+};
+
+/// User and system CPU time of the process so far.
+int64_t process_cpu_ns() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+    const auto ticks = [](const FILETIME &time) {
+        return static_cast<int64_t>(static_cast<uint64_t>(time.dwHighDateTime) << 32 | time.dwLowDateTime);
+    };
+    // 100 ns ticks.
+    return (ticks(kernel) + ticks(user)) * 100;
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    const auto ns = [](const timeval &time) {
+        return static_cast<int64_t>(time.tv_sec) * 1000000000 + static_cast<int64_t>(time.tv_usec) * 1000;
+    };
+    return ns(usage.ru_utime) + ns(usage.ru_stime);
+#endif
+}
+
+/// Counts what the consumer got and checks the order of the RTP sequence numbers.
+class Reception {
+public:
+    explicit Reception(Result &result) : result_(result) {}
+
+    void add(const uint8_t *packet, const int64_t released) {
+        const int64_t now = LatencyStamps::now();
+        const uint16_t seq = static_cast<uint16_t>(packet[2] << 8 | packet[3]);
+        if (result_.received > 0 && static_cast<uint16_t>(seq - last_seq_) >= 0x8000) {
+            result_.out_of_order += 1;
+        }
+        last_seq_ = seq;
+        result_.received += 1;
+        result_.latency.push_back(now - released);
+    }
+
+private:
+    Result &result_;
+    uint16_t last_seq_ = 0;
+};
+
+/// Releases `packets` packets in bursts of one frame, calls `send` for each with the packet and its release time.
+template <typename Send>
+void produce(const Options &options, const double bitrate, const uint64_t packets, Send send) {
+    const double packets_per_frame = bitrate * 1e6 / 8 / static_cast<double>(options.size) / options.fps;
+    const auto frame_interval = std::chrono::nanoseconds(1000000000 / options.fps);
+
+    std::vector<uint8_t> packet(options.size);
+    // RTP version 2, payload type 96.
+    packet[0] = 0x80;
+    packet[1] = 96;
+
+    auto next_frame = std::chrono::steady_clock::now();
+    double owed = 0;
+    uint64_t seq = 0;
+    while (seq < packets) {
+        std::this_thread::sleep_until(next_frame);
+        next_frame += frame_interval;
+
+        owed += packets_per_frame;
+        for (; owed >= 1 && seq < packets; owed -= 1, seq++) {
+            packet[2] = static_cast<uint8_t>(seq >> 8);
+            packet[3] = static_cast<uint8_t>(seq);
+            send(packet.data(), packet.size(), LatencyStamps::now());
+        }
+    }
+}
+
+void run_ring(const Options &options, const uint64_t packets, Result &result) {
+    PacketRing ring;
+    std::atomic<bool> done{false};
+
+    std::thread consumer([&] {
+        Reception reception(result);
+        while (true) {
+            size_t size = 0;
+            if (const uint8_t *entry = ring.front(size)) {
+                LatencyStamps stamps;
+                memcpy(&stamps, entry, sizeof(stamps));
+                reception.add(entry + sizeof(stamps), stamps[LatencyStage::FecReleased]);
+                ring.pop();
+                continue;
+            }
+            if (done.load()) {
+                break;
+            }
+            ring.wait(std::chrono::milliseconds(10));
+        }
+    });
+
+    produce(options, result.bitrate, packets, [&](uint8_t *data, const size_t size, const int64_t released) {
+        LatencyStamps stamps;
+        stamps[LatencyStage::FecReleased] = released;
+
+        result.sent += 1;
+        ring.push(&stamps, sizeof(stamps), data, size);
+    });
+
+    done = true;
+    ring.wake();
+    consumer.join();
+}
+
+/// Returns false if the sockets could not be set up.
+bool run_udp(const Options &options, const uint64_t packets, Result &result) {
+    const int rx_fd = static_cast<int>(socket(AF_INET, SOCK_DGRAM, 0));
+    const int tx_fd = static_cast<int>(socket(AF_INET, SOCK_DGRAM, 0));
+    if (rx_fd < 0 || tx_fd < 0) {
+        std::fprintf(stderr, "Socket creation failed\n");
+        return false;
+    }
+
+    wfb_setsockopt(rx_fd, SOL_SOCKET, SO_RCVBUF, &UDP_RCV_BUF_SIZE, sizeof(UDP_RCV_BUF_SIZE));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_size = sizeof(addr);
+    if (bind(rx_fd, (sockaddr *)&addr, sizeof(addr)) != 0 || getsockname(rx_fd, (sockaddr *)&addr, &addr_size) != 0) {
+        std::fprintf(stderr, "Unable to bind a loopback socket\n");
+        wfb_close(rx_fd);
+        wfb_close(tx_fd);
+        return false;
+    }
+
+    std::atomic<bool> done{false};
+
+    std::thread consumer([&] {
+        Reception reception(result);
+        std::vector<uint8_t> buffer(PacketRing::SLOT_SIZE);
+        pollfd fds = {};
+        fds.fd = rx_fd;
+        fds.events = POLLIN;
+
+        while (true) {
+            // Once the producer is done, whatever is not there within 100 ms is lost.
+            if (wfb_poll(&fds, 1, done.load() ? 100 : 10) <= 0) {
+                if (done.load()) {
+                    break;
+                }
+                continue;
+            }
+
+            const auto size = recv(rx_fd, (char *)buffer.data(), static_cast<int>(buffer.size()), 0);
+            if (size < 0 || static_cast<size_t>(size) < STAMP_OFFSET + sizeof(int64_t)) {
+                continue;
+            }
+            int64_t released;
+            memcpy(&released, buffer.data() + STAMP_OFFSET, sizeof(released));
+            reception.add(buffer.data(), released);
+        }
+    });
+
+    produce(options, result.bitrate, packets, [&](uint8_t *data, const size_t size, const int64_t released) {
+        memcpy(data + STAMP_OFFSET, &released, sizeof(released));
+        result.sent += 1;
+        wfb_sendto(tx_fd, (const char *)data, size, 0, (sockaddr *)&addr, sizeof(addr));
+    });
+
+    done = true;
+    consumer.join();
+
+    wfb_close(rx_fd);
+    wfb_close(tx_fd);
+    return true;
+}
+
+Result run(const Mode mode, const Options &options, const double bitrate) {
+    Result result;
+    result.mode = mode;
+    result.bitrate = bitrate;
+
+    const auto packets = static_cast<uint64_t>(bitrate * 1e6 / 8 / static_cast<double>(options.size) *
+                                               std::chrono::duration<double>(options.duration).count());
+    result.latency.reserve(packets);
+
+    const int64_t cpu_start = process_cpu_ns();
+    if (mode == Mode::Ring) {
+        run_ring(options, packets, result);
+    } else if (!run_udp(options, packets, result)) {
+        std::exit(EXIT_FAILURE);
+    }
+    result.cpu_ns = process_cpu_ns() - cpu_start;
+
+    std::ranges::sort(result.latency);
+    return result;
+}
+
+std::vector<double> parse_list(const std::string &list) {
+    std::vector<double> values;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        values.push_back(std::atof(item.c_str()));
+    }
+    return values;
+}
+
+void print_usage(const char *program) {
+    std::printf(
+        "Usage: %s [options]\n"
+        "\n"
+        "      --bitrate <list>      RTP bitrates in Mbit/s, one run each (default 10,30,100)\n"
+        "      --fps <n>             Frames per second, a frame's packets are released at once (default 60)\n"
+        "      --size <bytes>        Size of an RTP packet (default 1400)\n"
+        "      --duration <ms>       Length of a run (default 3000)\n"
+        "  -h, --help                Show this message\n",
+        program);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        } else if (arg == "--bitrate") {
+            options.bitrates = parse_list(value());
+            if (options.bitrates.empty() || !std::ranges::all_of(options.bitrates, [](double b) { return b > 0; })) {
+                std::fprintf(stderr, "Expected a list of positive bitrates\n");
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--fps") {
+            options.fps = std::atoi(value().c_str());
+            if (options.fps < 1) {
+                std::fprintf(stderr, "The frame rate has to be positive\n");
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--size") {
+            options.size = std::strtoul(value().c_str(), nullptr, 10);
+            if (options.size < STAMP_OFFSET + sizeof(int64_t) || options.size > PacketRing::SLOT_SIZE / 2) {
+                std::fprintf(stderr,
+                             "The size has to be within %zu..%zu\n",
+                             STAMP_OFFSET + sizeof(int64_t),
+                             PacketRing::SLOT_SIZE / 2);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--duration") {
+            options.duration = std::chrono::milliseconds(std::atoi(value().c_str()));
+        } else {
+            std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        std::fprintf(stderr, "WSAStartup failed\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    std::printf("%d fps, %zu byte packets, %lld ms per run\n",
+                options.fps,
+                options.size,
+                static_cast<long long>(options.duration.count()));
+    std::printf("%-5s %8s %8s %9s %9s %9s %9s %9s %8s\n",
+                "mode",
+                "Mbit/s",
+                "pkt/s",
+                "p50 us",
+                "p99 us",
+                "max us",
+                "CPU us",
+                "CPU %",
+                "lost");
+
+    bool ok = true;
+    for (const double bitrate : options.bitrates) {
+        for (const Mode mode : {Mode::Ring, Mode::Udp}) {
+            const Result result = run(mode, options, bitrate);
+
+            const double seconds = std::chrono::duration<double>(options.duration).count();
+            const double cpu_us_per_packet =
+                result.received > 0 ? static_cast<double>(result.cpu_ns) / 1000.0 / result.received : 0;
+            const double cpu_percent = static_cast<double>(result.cpu_ns) / 1e9 / seconds * 100;
+
+            // The ring only drops when the consumer falls a whole ring behind, which it must not do at these rates.
+            const bool result_ok =
+                mode != Mode::Ring || (result.received == result.sent && result.out_of_order == 0);
+
+            std::printf("%-5s %8.1f %8.0f %9.1f %9.1f %9.1f %9.2f %8.1f%% %8llu  %s\n",
+                        mode_name(mode),
+                        bitrate,
+                        static_cast<double>(result.sent) / seconds,
+                        result.latency_us(0.5),
+                        result.latency_us(0.99),
+                        result.latency_us(1.0),
+                        cpu_us_per_packet,
+                        cpu_percent,
+                        static_cast<unsigned long long>(result.sent - result.received),
+                        result_ok ? "ok" : "FAILED");
+            ok = ok && result_ok;
+        }
+    }
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+#include <sodium.h>
+
+/// A drone keypair and a GS keypair that go together, in temporary files, for the benchmarks that run a wfb-ng
+/// transmitter against a receiver. libsodium has to be initialized first.
+struct BenchKeyFiles {
+    std::string drone;
+    std::string gs;
+
+    /// `prefix` keeps benchmarks that run at the same time apart.
+    explicit BenchKeyFiles(const std::string &prefix) {
+        const auto dir = std::filesystem::temp_directory_path();
+        drone = (dir / (prefix + "_drone.key")).string();
+        gs = (dir / (prefix + "_gs.key")).string();
+
+        uint8_t drone_public[crypto_box_PUBLICKEYBYTES], drone_secret[crypto_box_SECRETKEYBYTES];
+        uint8_t gs_public[crypto_box_PUBLICKEYBYTES], gs_secret[crypto_box_SECRETKEYBYTES];
+        crypto_box_keypair(drone_public, drone_secret);
+        crypto_box_keypair(gs_public, gs_secret);
+
+        // Each side keeps its own secret key followed by the public key of the other side.
+        write(drone, drone_secret, gs_public);
+        write(gs, gs_secret, drone_public);
+    }
+
+    ~BenchKeyFiles() {
+        std::remove(drone.c_str());
+        std::remove(gs.c_str());
+    }
+
+    BenchKeyFiles(const BenchKeyFiles &) = delete;
+    BenchKeyFiles &operator=(const BenchKeyFiles &) = delete;
+
+private:
+    static void write(const std::string &path, const uint8_t *secret_key, const uint8_t *public_key) {
+        FILE *fp = std::fopen(path.c_str(), "wb");
+        if (!fp || std::fwrite(secret_key, crypto_box_SECRETKEYBYTES, 1, fp) != 1 ||
+            std::fwrite(public_key, crypto_box_PUBLICKEYBYTES, 1, fp) != 1) {
+            std::fprintf(stderr, "Unable to write %s: %s\n", path.c_str(), std::strerror(errno));
+            std::exit(EXIT_FAILURE);
+        }
+        std::fclose(fp);
+    }
+};
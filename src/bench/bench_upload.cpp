@@ -0,0 +1,222 @@
+// CPU cost of getting decoded frames ready for the texture upload, before and after FrameStager: the row repacking
+// YuvRenderer used to do on the GUI thread, against the staging copy on the decode thread that replaces it and the
+// check the GUI thread is left with. Frames get the row padding of a software decoder (linesize rounded up to 64
+// bytes plus 64 bytes of edge), the case that needed the repack.
+// 10-bit frames, which the renderer could not take before, are narrowed to 8 bits with each PixelPacker, checked
+// against the scalar one.
+//
+// The GPU side of the upload is not measured: write_texture() stages the data inside Pathfinder either way.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../player/ffmpeg/frame_staging.h"
+#include "../player/ffmpeg/pixel_pack.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::chrono::milliseconds duration{1000};
+};
+
+struct Size {
+    int width;
+    int height;
+};
+
+constexpr Size SIZES[] = {{1280, 720}, {1440, 1080}, {1920, 1080}, {2560, 1440}, {3840, 2160}};
+constexpr AVPixelFormat FORMATS[] = {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_P010LE, AV_PIX_FMT_YUV420P10LE};
+
+/// A frame with random pixels and padded rows.
+std::shared_ptr<AVFrame> make_padded_frame(const AVPixelFormat format, const Size size) {
+    std::shared_ptr<AVFrame> frame(av_frame_alloc(), [](AVFrame *f) { av_frame_free(&f); });
+    frame->format = format;
+    frame->width = (size.width + 63) / 64 * 64 + 64;
+    frame->height = size.height;
+    if (av_frame_get_buffer(frame.get(), 64) < 0) {
+        return nullptr;
+    }
+    // The buffers stay as large as for the padded width, only the picture gets narrower.
+    frame->width = size.width;
+
+    // High bit depth samples stay within their bits.
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    const int depth = desc->comp[0].depth;
+    for (int plane = 0; plane < AV_NUM_DATA_POINTERS && frame->buf[plane]; plane++) {
+        const size_t size = frame->buf[plane]->size;
+        if (depth > 8) {
+            auto *samples = reinterpret_cast<uint16_t *>(frame->buf[plane]->data);
+            for (size_t i = 0; i < size / 2; i++) {
+                samples[i] = static_cast<uint16_t>((std::rand() & ((1 << depth) - 1)) << desc->comp[0].shift);
+            }
+        } else {
+            for (size_t i = 0; i < size; i++) {
+                frame->buf[plane]->data[i] = static_cast<uint8_t>(std::rand());
+            }
+        }
+    }
+    return frame;
+}
+
+/// What YuvRenderer::updateTextureData() did on the GUI thread for frames with padded rows.
+void repack(const AVFrame *frame, std::vector<uint8_t> (&packed)[3]) {
+    const auto format = static_cast<AVPixelFormat>(frame->format);
+    for (int plane = 0; plane < 3 && frame->data[plane]; plane++) {
+        const int rowWidth = av_image_get_linesize(format, frame->width, plane);
+        const int height = plane == 0 ? frame->height : frame->height / 2;
+
+        packed[plane].resize(static_cast<size_t>(rowWidth) * height);
+        for (int i = 0; i < height; ++i) {
+            memcpy(packed[plane].data() + i * rowWidth, frame->data[plane] + i * frame->linesize[plane], rowWidth);
+        }
+    }
+}
+
+/// Mean time per call of `fn`, in ms.
+template <typename Fn>
+double time_per_call(const Options &options, Fn &&fn) {
+    const auto start = Clock::now();
+    const auto end = start + options.duration;
+    int calls = 0;
+    auto now = start;
+    while (now < end) {
+        fn();
+        calls++;
+        now = Clock::now();
+    }
+    return std::chrono::duration<double, std::milli>(now - start).count() / calls;
+}
+
+/// The staged frame must hold the same pixels as the repack, or the scalar narrowing for 10-bit frames.
+bool verify(const AVFrame *staged, std::vector<uint8_t> (&packed)[3]) {
+    if (!frame_is_packed(staged)) {
+        return false;
+    }
+    for (int plane = 0; plane < 3 && staged->data[plane]; plane++) {
+        if (memcmp(staged->data[plane], packed[plane].data(), packed[plane].size()) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void print_usage(const char *program) {
+    std::printf(
+        "Usage: %s [options]\n"
+        "\n"
+        "      --duration <ms>       Time to measure each case for (default 1000)\n"
+        "  -h, --help                Show this message\n",
+        program);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        } else if (arg == "--duration" && i + 1 < argc) {
+            options.duration = std::chrono::milliseconds(std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::printf("%-20s %-10s %18s %18s %18s\n",
+                "format",
+                "size",
+                "GUI repack (ms)",
+                "decode stage (ms)",
+                "GUI after (ms)");
+
+    bool ok = true;
+    for (const AVPixelFormat format : FORMATS) {
+        for (const Size size : SIZES) {
+            const std::shared_ptr<AVFrame> frame = make_padded_frame(format, size);
+            if (!frame) {
+                std::fprintf(stderr, "Cannot allocate a %dx%d frame\n", size.width, size.height);
+                return EXIT_FAILURE;
+            }
+            const std::string sizeName = std::to_string(size.width) + "x" + std::to_string(size.height);
+
+            std::vector<uint8_t> packed[3];
+            std::vector<PixelPacker> packers;
+            double repackMs = 0;
+            if (upload_format(format) == format) {
+                repackMs = time_per_call(options, [&] { repack(frame.get(), packed); });
+                packers.push_back(selected_pixel_packer());
+            } else {
+                // The reference is what the scalar packer makes of the frame.
+                select_pixel_packer(PixelPacker::Scalar);
+                FrameStager stager;
+                const std::shared_ptr<AVFrame> reference = stager.stage(frame);
+                if (!reference) {
+                    std::fprintf(stderr,
+                                 "%s %s: cannot narrow the frame\n",
+                                 av_get_pix_fmt_name(format),
+                                 sizeName.c_str());
+                    return EXIT_FAILURE;
+                }
+                repack(reference.get(), packed);
+
+                for (int i = 0; i < static_cast<int>(PixelPacker::Count); i++) {
+                    if (pixel_packer_supported(static_cast<PixelPacker>(i))) {
+                        packers.push_back(static_cast<PixelPacker>(i));
+                    }
+                }
+            }
+
+            for (const PixelPacker packer : packers) {
+                select_pixel_packer(packer);
+                std::string name = av_get_pix_fmt_name(format);
+                if (upload_format(format) != format) {
+                    name += std::string(" ") + pixel_packer_name(packer);
+                }
+
+                FrameStager stager;
+                std::shared_ptr<AVFrame> staged;
+                const double stageMs = time_per_call(options, [&] { staged = stager.stage(frame); });
+
+                if (!staged || !verify(staged.get(), packed)) {
+                    std::fprintf(stderr, "%s %s: staged frame differs\n", name.c_str(), sizeName.c_str());
+                    ok = false;
+                    continue;
+                }
+
+                // All the GUI thread does before the upload now.
+                const double afterMs = time_per_call(options, [&] { return frame_is_packed(staged.get()); });
+
+                if (upload_format(format) == format) {
+                    std::printf("%-20s %-10s %18.3f %18.3f %18.6f\n",
+                                name.c_str(),
+                                sizeName.c_str(),
+                                repackMs,
+                                stageMs,
+                                afterMs);
+                } else {
+                    // The renderer aborted on these before.
+                    std::printf("%-20s %-10s %18s %18.3f %18.6f\n",
+                                name.c_str(),
+                                sizeName.c_str(),
+                                "-",
+                                stageMs,
+                                afterMs);
+                }
+            }
+        }
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,360 @@
+// FEC throughput of every zfex kernel the CPU supports, for the k/n and fragment sizes wfb-ng uses.
+// Before anything is timed, randomized encode/decode round trips check each kernel against the scalar one, so the
+// benchmark doubles as a check for kernel work. Exits with 1 if a kernel gets something wrong.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../wifi/wfb-ng/zfex.h"
+
+namespace {
+
+/// MAX_FEC_PAYLOAD of wifibroadcast.hpp (WIFI_MTU minus the 802.11, block and AEAD headers),
+/// which cannot be included without libsodium.
+constexpr size_t MAX_FEC_PAYLOAD = 4045 - 24 - 9 - 16;
+
+struct Code {
+    int k;
+    int n;
+};
+
+constexpr Code CODES[] = {{1, 2}, {2, 3}, {4, 6}, {8, 12}, {16, 24}, {32, 48}};
+
+constexpr size_t SIZES[] = {256, 1024, 1456, MAX_FEC_PAYLOAD};
+
+struct Options {
+    std::optional<zfex_kernel_t> kernel;
+    int verify_rounds = 2000;
+    std::chrono::milliseconds duration{200};
+    uint32_t seed = 1;
+};
+
+struct AlignedDeleter {
+    void operator()(gf *p) const {
+        ::operator delete(p, std::align_val_t(ZFEX_SIMD_ALIGNMENT));
+    }
+};
+
+using Buffer = std::unique_ptr<gf, AlignedDeleter>;
+
+/// The kernels may read up to the next multiple of ZFEX_SIMD_ALIGNMENT.
+Buffer aligned_buffer(size_t size) {
+    void *p = ::operator new(ZFEX_ROUND_UP_SIMD(std::max<size_t>(size, 1)), std::align_val_t(ZFEX_SIMD_ALIGNMENT));
+    return Buffer(static_cast<gf *>(p));
+}
+
+struct FecDeleter {
+    void operator()(fec_t *p) const {
+        fec_free(p);
+    }
+};
+
+using Fec = std::unique_ptr<fec_t, FecDeleter>;
+
+Fec new_fec(int k, int n) {
+    fec_t *p = nullptr;
+    if (fec_new(static_cast<uint16_t>(k), static_cast<uint16_t>(n), &p) != ZFEX_SC_OK) {
+        std::abort();
+    }
+    return Fec(p);
+}
+
+/// The fragments of one block: k data fragments followed by n - k FEC fragments.
+struct Block {
+    int k;
+    int n;
+    size_t size;
+    std::vector<Buffer> fragments;
+    std::vector<Buffer> recovered;
+
+    Block(int k, int n, size_t size, std::mt19937 &rng) : k(k), n(n), size(size) {
+        for (int i = 0; i < n; i++) {
+            fragments.push_back(aligned_buffer(size));
+            recovered.push_back(aligned_buffer(size));
+        }
+        for (int i = 0; i < k; i++) {
+            for (size_t j = 0; j < size; j++) {
+                fragments[i].get()[j] = static_cast<gf>(rng());
+            }
+        }
+    }
+
+    gf *fragment(int i) const {
+        return fragments[i].get();
+    }
+
+    zfex_status_code_t encode(const fec_t *fec) const {
+        std::vector<const gf *> in(k);
+        std::vector<gf *> out(n - k);
+        for (int i = 0; i < k; i++) {
+            in[i] = fragment(i);
+        }
+        for (int i = k; i < n; i++) {
+            out[i - k] = fragment(i);
+        }
+        return fec_encode_simd(fec, in.data(), out.data(), size);
+    }
+
+    /// Recovers the data fragments in `lost` from the FEC fragments, into `recovered`.
+    zfex_status_code_t decode(const fec_t *fec, const std::vector<int> &lost) const {
+        std::vector<const gf *> in(k);
+        std::vector<unsigned> index(k);
+        std::vector<gf *> out;
+        int fec_idx = k;
+        for (int i = 0; i < k; i++) {
+            if (std::ranges::find(lost, i) != lost.end()) {
+                in[i] = fragment(fec_idx);
+                index[i] = fec_idx++;
+                out.push_back(recovered[i].get());
+            } else {
+                in[i] = fragment(i);
+                index[i] = i;
+            }
+        }
+        return fec_decode_simd(fec, in.data(), out.data(), index.data(), size);
+    }
+};
+
+std::vector<int> random_erasures(int k, int count, std::mt19937 &rng) {
+    std::vector<int> positions(k);
+    for (int i = 0; i < k; i++) {
+        positions[i] = i;
+    }
+    std::ranges::shuffle(positions, rng);
+    positions.resize(count);
+    std::ranges::sort(positions);
+    return positions;
+}
+
+std::vector<zfex_kernel_t> kernels_to_run(const Options &options) {
+    std::vector<zfex_kernel_t> kernels;
+    for (int i = 0; i < ZFEX_KERNEL_COUNT; i++) {
+        const auto kernel = static_cast<zfex_kernel_t>(i);
+        if (fec_kernel_supported(kernel) && (!options.kernel || *options.kernel == kernel)) {
+            kernels.push_back(kernel);
+        }
+    }
+    return kernels;
+}
+
+/// Round trips with random codes, sizes (odd ones included, for the kernel tails) and erasures.
+/// The FEC fragments have to match the scalar kernel byte for byte, and decoding has to restore the data.
+bool verify(zfex_kernel_t kernel, const Options &options) {
+    std::mt19937 rng(options.seed);
+    int failures = 0;
+
+    for (int round = 0; round < options.verify_rounds; round++) {
+        const int k = 1 + static_cast<int>(rng() % (round % 10 == 0 ? 128 : 32));
+        const int n = std::min(255, k + 1 + static_cast<int>(rng() % k));
+        const size_t size = round % 4 == 0 ? 1 + rng() % MAX_FEC_PAYLOAD
+                                           : ZFEX_ROUND_UP_SIMD(1 + rng() % MAX_FEC_PAYLOAD);
+
+        const Fec fec = new_fec(k, n);
+        Block block(k, n, size, rng);
+
+        fec_select_kernel(ZFEX_KERNEL_SCALAR);
+        block.encode(fec.get());
+        std::vector<std::vector<gf>> expected;
+        for (int i = k; i < n; i++) {
+            expected.emplace_back(block.fragment(i), block.fragment(i) + size);
+        }
+
+        fec_select_kernel(kernel);
+        bool ok = block.encode(fec.get()) == ZFEX_SC_OK;
+        for (int i = k; i < n && ok; i++) {
+            ok = std::memcmp(block.fragment(i), expected[i - k].data(), size) == 0;
+        }
+
+        // Twice, the second decode takes its matrix from the cache.
+        const auto lost = random_erasures(k, static_cast<int>(rng() % (std::min(k, n - k) + 1)), rng);
+        for (int pass = 0; pass < 2 && ok; pass++) {
+            ok = block.decode(fec.get(), lost) == ZFEX_SC_OK;
+            for (const int i : lost) {
+                ok = ok && std::memcmp(block.recovered[i].get(), block.fragment(i), size) == 0;
+            }
+        }
+
+        if (!ok) {
+            std::fprintf(stderr,
+                         "%s: mismatch with k=%d n=%d size=%zu lost=%zu (seed %u, round %d)\n",
+                         fec_kernel_name(kernel),
+                         k,
+                         n,
+                         size,
+                         lost.size(),
+                         options.seed,
+                         round);
+            failures++;
+        }
+    }
+
+    return failures == 0;
+}
+
+/// MB of data fragments per second, repeating `run` for at least the configured duration.
+template <typename F>
+double throughput(size_t bytes_per_run, const Options &options, F run) {
+    using Clock = std::chrono::steady_clock;
+
+    size_t runs = 0;
+    const auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    while (elapsed < options.duration) {
+        for (int i = 0; i < 64; i++) {
+            run();
+        }
+        runs += 64;
+        elapsed = Clock::now() - start;
+    }
+
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    return static_cast<double>(runs * bytes_per_run) / seconds / 1e6;
+}
+
+void benchmark(const std::vector<zfex_kernel_t> &kernels, const Options &options) {
+    std::mt19937 rng(options.seed);
+
+    std::printf("%-13s %5s %5s %9s %12s %12s %12s\n",
+                "kernel",
+                "k/n",
+                "size",
+                "erasures",
+                "encode MB/s",
+                "decode MB/s",
+                "us/decode");
+
+    for (const Code code : CODES) {
+        const Fec fec = new_fec(code.k, code.n);
+
+        for (const size_t size : SIZES) {
+            Block block(code.k, code.n, size, rng);
+            const size_t block_bytes = static_cast<size_t>(code.k) * size;
+
+            // One lost fragment is the common case, all FEC fragments used the worst one.
+            std::vector<int> erasure_counts = {1};
+            if (code.n - code.k > 1) {
+                erasure_counts.push_back(std::min(code.k, code.n - code.k));
+            }
+
+            for (const int erasures : erasure_counts) {
+                const auto lost = random_erasures(code.k, erasures, rng);
+
+                for (const zfex_kernel_t kernel : kernels) {
+                    fec_select_kernel(kernel);
+
+                    const double encode = throughput(block_bytes, options, [&] { block.encode(fec.get()); });
+                    const double decode = throughput(block_bytes, options, [&] { block.decode(fec.get(), lost); });
+
+                    std::printf("%-13s %2d/%-2d %5zu %9d %12.0f %12.0f %12.2f\n",
+                                fec_kernel_name(kernel),
+                                code.k,
+                                code.n,
+                                size,
+                                erasures,
+                                encode,
+                                decode,
+                                static_cast<double>(block_bytes) / decode);
+                }
+            }
+        }
+    }
+}
+
+void print_usage(const char *program) {
+    std::printf(
+        "Usage: %s [options]\n"
+        "\n"
+        "      --kernel <name>       Only this kernel (noaccel, SSSE3, NEON, AVX2, AVX2+GFNI, AVX-512+GFNI)\n"
+        "      --verify <rounds>     Random round trips per kernel before timing, 0 to skip (default 2000)\n"
+        "      --verify-only         Check the kernels and exit\n"
+        "      --duration <ms>       Time per measurement (default 200)\n"
+        "      --seed <n>            Seed of the random data and codes (default 1)\n"
+        "  -h, --help                Show this message\n",
+        program);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    bool verify_only = false;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        } else if (arg == "--kernel") {
+            const std::string name = value();
+            for (int k = 0; k < ZFEX_KERNEL_COUNT; k++) {
+                if (name == fec_kernel_name(static_cast<zfex_kernel_t>(k))) {
+                    options.kernel = static_cast<zfex_kernel_t>(k);
+                }
+            }
+            if (!options.kernel) {
+                std::fprintf(stderr, "Unknown kernel: %s\n", name.c_str());
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--verify") {
+            options.verify_rounds = std::atoi(value().c_str());
+        } else if (arg == "--verify-only") {
+            verify_only = true;
+        } else if (arg == "--duration") {
+            options.duration = std::chrono::milliseconds(std::atoi(value().c_str()));
+        } else if (arg == "--seed") {
+            options.seed = static_cast<uint32_t>(std::strtoul(value().c_str(), nullptr, 10));
+        } else {
+            std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Runs the kernel selection, so that zfex_opt names the default.
+    new_fec(1, 2);
+    const zfex_kernel_t default_kernel = fec_selected_kernel();
+    std::printf("Default kernel: %s\n", zfex_opt);
+
+    const auto kernels = kernels_to_run(options);
+    if (kernels.empty()) {
+        std::fprintf(stderr, "The kernel is not supported by this build or CPU\n");
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+    if (options.verify_rounds > 0) {
+        for (const zfex_kernel_t kernel : kernels) {
+            const bool kernel_ok = verify(kernel, options);
+            std::printf("Verify %-13s %s (%d round trips)\n",
+                        fec_kernel_name(kernel),
+                        kernel_ok ? "ok" : "FAILED",
+                        options.verify_rounds);
+            ok = ok && kernel_ok;
+        }
+    }
+
+    if (ok && !verify_only) {
+        benchmark(kernels, options);
+    }
+
+    fec_select_kernel(default_kernel);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
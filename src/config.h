@@ -0,0 +1,46 @@
+#pragma once
+
+// Keys of config.ini, shared by the app and aviateur-headless.
+
+#define CONFIG_FILE "config.ini"
+
+#define CONFIG_CONFIG "config"
+#define CONFIG_VERSION "version"
+
+#define CONFIG_WIFI "wifi"
+#define WIFI_DEVICE "pid_vid"
+#define WIFI_CHANNEL "channel"
+#define WIFI_CHANNEL_WIDTH_MODE "channel_width_mode"
+#define WIFI_GS_KEY "key"
+#define WIFI_ALINK_ENABLED "alink_enabled"
+#define WIFI_ALINK_TX_POWER "alink_tx_power"
+#define WIFI_FORWARD_PORT "forward_port"
+#define WIFI_DIVERSITY_DEVICES "diversity_devices"
+#define WIFI_CAPTURE_FRAMES "capture_frames"
+#define WIFI_REPLAY_FILE "replay_file"
+#define WIFI_REPLAY_REALTIME "replay_realtime"
+// Video blocks the FEC aggregator keeps open, 0 for the wfb-ng default of 40
+#define WIFI_FEC_RING_DEPTH "fec_ring_depth"
+
+#define CONFIG_LOCALHOST "localhost"
+#define CONFIG_LOCALHOST_PORT "port"
+#define CONFIG_LOCALHOST_CODEC "codec"
+
+#define CONFIG_SETTINGS "settings"
+#define CONFIG_SETTINGS_LANG "language"
+#define CONFIG_SETTINGS_DARK_MODE "dark_mode"
+#define CONFIG_SETTINGS_RENDER_BACKEND "render_backend"
+// Software decoder threads: auto, slice (no added latency) or frame
+#define CONFIG_SETTINGS_DECODER_THREADING "decoder_threading"
+// Frames of latency frame threading may add
+#define CONFIG_SETTINGS_DECODER_FRAME_DELAY "decoder_frame_delay"
+// Decoded frames waiting for display: mailbox (newest only) or fifo
+#define CONFIG_SETTINGS_FRAME_QUEUE "frame_queue"
+// When decoded frames go on screen: immediate (next refresh) or paced (de-jittered, at most a frame later)
+#define CONFIG_SETTINGS_PRESENT_MODE "present_mode"
+
+// Prometheus endpoint on 127.0.0.1, disabled with port 0
+#define CONFIG_METRICS "metrics"
+#define CONFIG_METRICS_PORT "port"
+// Chrome trace JSON of the glass-to-glass latency, written by the player when it stops. Empty to disable.
+#define CONFIG_METRICS_LATENCY_TRACE "latency_trace"
@@ -1,5 +1,6 @@
 #include "control_panel.h"
 
+#include <algorithm>
 #include <vecgui/resources/default_resource.h>
 
 #include "settings_tab.h"
@@ -27,6 +28,30 @@ void ControlPanel::update_dongle_list(const std::shared_ptr<vecgui::MenuButton>
     }
 }
 
+void ControlPanel::start_diversity_adapters(const std::optional<std::string> &forward_port) {
+    // Display names separated by ';', e.g. "RTL8812AU [1:11];RTL8812AU [1:12]".
+    std::stringstream names(GuiInterface::Instance().ini_[CONFIG_WIFI][WIFI_DIVERSITY_DEVICES]);
+    std::string name;
+
+    while (std::getline(names, name, ';')) {
+        if (name.empty() || (dongle_name_.has_value() && name == *dongle_name_)) {
+            continue;
+        }
+
+        auto device = std::find_if(devices_.begin(), devices_.end(), [&](const DeviceId &d) {
+            return d.matches_saved_name(name);
+        });
+        if (device == devices_.end()) {
+            GuiInterface::Instance().PutLog(LogLevel::Warn, "Diversity adapter not found: {}", name);
+            continue;
+        }
+
+        if (!GuiInterface::Start(*device, channel, channelWidthMode, keyPath, forward_port)) {
+            GuiInterface::Instance().PutLog(LogLevel::Warn, "Diversity adapter failed to start: {}", name);
+        }
+    }
+}
+
 void ControlPanel::update_adapter_start_button_looking(bool start_status) const {
     tab_container_->set_tab_disabled(!start_status);
 
@@ -352,12 +377,30 @@ void ControlPanel::on_ready() {
                     play_button_->get_text() == get_context()->translation_server->get_translation("start") + " (F5)";
 
                 GuiInterface::Instance().is_using_wifi = true;
-                GuiInterface::Instance().links_.clear();
+                {
+                    std::lock_guard lock(GuiInterface::Instance().links_mutex_);
+                    GuiInterface::Instance().links_.clear();
+                }
 
                 if (start) {
                     bool started_successfully = true;
 
-                    if (dongle_name_.has_value()) {
+                    auto &wifi_config = GuiInterface::Instance().ini_[CONFIG_WIFI];
+
+                    if (!wifi_config[WIFI_REPLAY_FILE].empty()) {
+                        std::optional<std::string> forward_port;
+                        if (!forward_con->get_collapse() && !forward_port_edit->get_text().empty()) {
+                            forward_port = forward_port_edit->get_text();
+                        }
+
+                        if (!GuiInterface::StartReplay(wifi_config[WIFI_REPLAY_FILE],
+                                                       wifi_config[WIFI_REPLAY_REALTIME] != "false",
+                                                       keyPath,
+                                                       forward_port)) {
+                            GuiInterface::Instance().ShowTip("Replay failed to start", true);
+                            started_successfully = false;
+                        }
+                    } else if (dongle_name_.has_value()) {
                         // Check if the device is available.
                         std::optional<DeviceId> target_device_id;
                         for (auto &d : devices_) {
@@ -387,6 +430,8 @@ void ControlPanel::on_ready() {
                             if (!res) {
                                 GuiInterface::Instance().ShowTip("Device failed to start", true);
                                 started_successfully = false;
+                            } else {
+                                start_diversity_adapters(forward_port);
                             }
                         } else {
                             GuiInterface::Instance().ShowTip("Null device", true);
@@ -42,6 +42,9 @@ public:
 
     void update_url_start_button_looking(bool start_status) const;
 
+    /// Start the extra adapters listed in the config, they join the stream of the selected one.
+    void start_diversity_adapters(const std::optional<std::string>& forward_port);
+
     void on_ready() override;
 
     void on_input(vecgui::InputEvent& event) override;
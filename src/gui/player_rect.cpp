@@ -1,5 +1,7 @@
 #include "player_rect.h"
 
+#include <iomanip>
+
 #include "../gui_interface.h"
 #include "src/player/ffmpeg/video_player.h"
 
@@ -104,7 +106,7 @@ void PlayerRect::on_ready() {
         lq_container->set_separation(2);
         lq_container->set_anchor_flag(vecgui::AnchorFlag::BottomWide);
 
-        for (int i = 0; i < 2; i++) {
+        for (int i = 0; i < MAX_ADAPTER_COUNT; i++) {
             for (int j = 0; j < ANTENNA_COUNT; j++) {
                 auto bar = std::make_shared<SignalBar>();
                 if (j == 0) {
@@ -179,6 +181,10 @@ void PlayerRect::on_ready() {
     fec_label_ = std::make_shared<vecgui::Label>();
     label_container_->add_child(fec_label_);
     fec_label_->set_font_size(HUD_LABEL_FONT_SIZE);
+    metrics_label_ = std::make_shared<vecgui::Label>();
+    label_container_->add_child(metrics_label_);
+    metrics_label_->set_font_size(HUD_LABEL_FONT_SIZE);
+    metrics_label_->set_visibility(false);
 
     rx_status_update_timer = std::make_shared<vecgui::Timer>();
     add_child(rx_status_update_timer);
@@ -188,12 +194,13 @@ void PlayerRect::on_ready() {
             bar->set_visibility(false);
         }
 
-        for (int i = 0; i != GuiInterface::Instance().links_.size(); ++i) {
-            auto link_score = GuiInterface::Instance().links_[i]->get_link_score();
+        const auto &links = GuiInterface::Instance().links_;
+        for (int i = 0; i != std::min<int>(links.size(), MAX_ADAPTER_COUNT); ++i) {
+            auto link_score = links[i]->get_link_score();
 
             for (int j = 0; j != ANTENNA_COUNT; ++j) {
-                link_score_bars_[i * 2 + j]->set_visibility(true);
-                link_score_bars_[i * 2 + j]->set_value(link_score[j]);
+                link_score_bars_[i * ANTENNA_COUNT + j]->set_visibility(true);
+                link_score_bars_[i * ANTENNA_COUNT + j]->set_value(link_score[j]);
             }
         }
 
@@ -210,11 +217,14 @@ void PlayerRect::on_ready() {
 
             if (GuiInterface::Instance().alink_enabled_) {
                 fec_label_->set_visibility(true);
-                fec_label_->set_text("FEC: " + std::to_string(GuiInterface::Instance().drone_fec_level_));
+                fec_label_->set_text("FEC: " + std::to_string(GuiInterface::Instance().drone_fec_level_.load()));
             }
+
+            update_metrics_label();
         } else {
             pl_label_->set_visibility(false);
             fec_label_->set_visibility(false);
+            metrics_label_->set_visibility(false);
         }
 
         rx_status_update_timer->start_timer(0.1);
@@ -296,6 +306,46 @@ void PlayerRect::on_ready() {
         button->connect_signal("toggled", callback);
     }
 
+    {
+        auto hbox_container = std::make_shared<vecgui::HBoxContainer>();
+        hbox_container->set_separation(8);
+        vbox->add_child(hbox_container);
+
+        auto label = std::make_shared<vecgui::Label>();
+        label->set_text(context->translation_server->get_translation("decoder threading"));
+        hbox_container->add_child(label);
+
+        auto threading_menu_button = std::make_shared<vecgui::MenuButton>();
+        threading_menu_button->container_sizing.flag_h = vecgui::ContainerSizingFlag::Fill;
+        hbox_container->add_child(threading_menu_button);
+
+        // In the order of DecoderThreading.
+        const std::vector<std::string> modes = {"auto", "slice", "frame"};
+
+        auto menu = threading_menu_button->get_popup_menu().lock();
+        for (const auto &mode : modes) {
+            menu->create_item(context->translation_server->get_translation("threading " + mode));
+            if (mode == GuiInterface::Instance().decoder_threading_) {
+                threading_menu_button->set_text(context->translation_server->get_translation("threading " + mode));
+            }
+        }
+
+        auto button_raw = threading_menu_button.get();
+        auto callback = [this, context, button_raw, modes](const uint32_t item_index) {
+            const std::string &mode = modes[std::min<size_t>(item_index, modes.size() - 1)];
+            button_raw->set_text(context->translation_server->get_translation("threading " + mode));
+            if (mode == GuiInterface::Instance().decoder_threading_) {
+                return;
+            }
+            GuiInterface::Instance().decoder_threading_ = mode;
+            if (playing_) {
+                player_->stop();
+                player_->play(play_url_, force_software_decoding);
+            }
+        };
+        threading_menu_button->connect_signal("item_selected", callback);
+    }
+
     // {
     //     video_stabilization_button_ = std::make_shared<vecgui::CheckButton>();
     //     video_stabilization_button_->set_text(FTR("video stab"));
@@ -361,6 +411,8 @@ void PlayerRect::on_update(double dt) {
         }
     }
 
+    GuiInterface::Instance().PublishCounts();
+
     auto context = get_context();
 
     if (player_) {
@@ -467,3 +519,57 @@ void PlayerRect::stop_playing() {
     collapse_panel_->set_visibility(false);
     hud_container_->set_visibility(false);
 }
+
+void PlayerRect::update_metrics_label() {
+    constexpr std::chrono::seconds WINDOW{1};
+
+    const auto &metrics = GuiInterface::Instance().link_metrics_;
+
+    // The antenna with the strongest median, its low tail is what the fades look like.
+    int best_antenna = -1;
+    int64_t best_rssi = -1;
+    for (int i = 0; i != static_cast<int>(metrics.rssi.size()); ++i) {
+        const auto rssi = metrics.rssi[i].summarize(WINDOW);
+        if (rssi.count > 0 && rssi.p50 > best_rssi) {
+            best_rssi = rssi.p50;
+            best_antenna = i;
+        }
+    }
+    if (best_antenna < 0) {
+        metrics_label_->set_visibility(false);
+        return;
+    }
+
+    const auto rssi_low = metrics.rssi[best_antenna].value_at_percentile(5, WINDOW).value_or(0);
+    const auto snr = metrics.snr[best_antenna].summarize(WINDOW);
+    const auto snr_low = metrics.snr[best_antenna].value_at_percentile(5, WINDOW).value_or(0);
+    const auto gap = metrics.arrival_gap_us.summarize(WINDOW);
+    const auto latency = metrics.decoder_latency_us.summarize(WINDOW);
+    const auto presented = metrics.since_usb_rx(LatencyStage::Presented).summarize(WINDOW);
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    ss << "RSSI p50/p5: " << best_rssi << "/" << rssi_low;
+    ss << " | SNR p50/p5: " << snr.p50 << "/" << snr_low;
+    ss << " | Gap p99: " << gap.p99 / 1000.0 << " ms";
+    if (latency.count > 0) {
+        ss << " | Decoder wait p99: " << latency.p99 / 1000.0 << " ms";
+    }
+    if (presented.count > 0) {
+        ss << " | Air to screen p50/p99: " << presented.p50 / 1000.0 << "/" << presented.p99 / 1000.0 << " ms";
+    }
+
+    const auto present_delay = metrics.present_delay_us.summarize(WINDOW);
+    if (present_delay.count > 0) {
+        const auto &present = GuiInterface::Instance().present_stats_;
+        ss << " | Present wait p50/p99: " << present_delay.p50 / 1000.0 << "/" << present_delay.p99 / 1000.0
+           << " ms";
+        ss << " | Jitter: " << present.jitter_us.load(std::memory_order_relaxed) / 1000.0 << " ms";
+        ss << " | Late/repeated/skipped: " << present.late.load(std::memory_order_relaxed) << "/"
+           << present.repeated.load(std::memory_order_relaxed) << "/"
+           << present.skipped.load(std::memory_order_relaxed);
+    }
+
+    metrics_label_->set_text(ss.str());
+    metrics_label_->set_visibility(true);
+}
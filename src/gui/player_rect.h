@@ -45,6 +45,9 @@ public:
 
     std::shared_ptr<vecgui::Label> fec_label_;
 
+    /// Percentiles from GuiInterface::link_metrics_, see update_metrics_label().
+    std::shared_ptr<vecgui::Label> metrics_label_;
+
     std::vector<std::shared_ptr<SignalBar>> link_score_bars_;
 
     std::shared_ptr<vecgui::Label> video_info_label_;
@@ -76,4 +79,7 @@ public:
     void start_playing(const std::string &url);
 
     void stop_playing();
+
+    /// Signal tails and latency percentiles of the last second.
+    void update_metrics_label();
 };
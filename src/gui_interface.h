@@ -5,6 +5,8 @@
 #include <vecgui/common/any_callable.h>
 #include <vecgui/servers/translation_server.h>
 
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <future>
@@ -15,32 +17,23 @@
     #include <unistd.h>
 #endif
 
+#include "config.h"
+#include "player/frame_pacer.h"
+#include "player/frame_queue.h"
+#include "wifi/link_events.h"
+#include "wifi/link_stats.h"
+#include "wifi/metrics_server.h"
+#include "wifi/packet_ring.h"
 #include "wifi/wfbng_link.h"
 
-#define CONFIG_FILE "config.ini"
-
-#define CONFIG_CONFIG "config"
-#define CONFIG_VERSION "version"
-
-#define CONFIG_WIFI "wifi"
-#define WIFI_DEVICE "pid_vid"
-#define WIFI_CHANNEL "channel"
-#define WIFI_CHANNEL_WIDTH_MODE "channel_width_mode"
-#define WIFI_GS_KEY "key"
-#define WIFI_ALINK_ENABLED "alink_enabled"
-#define WIFI_ALINK_TX_POWER "alink_tx_power"
-#define WIFI_FORWARD_PORT "forward_port"
-
-#define CONFIG_LOCALHOST "localhost"
-#define CONFIG_LOCALHOST_PORT "port"
-#define CONFIG_LOCALHOST_CODEC "codec"
+#define DEFAULT_PORT 52356
 
-#define CONFIG_SETTINGS "settings"
-#define CONFIG_SETTINGS_LANG "language"
-#define CONFIG_SETTINGS_DARK_MODE "dark_mode"
-#define CONFIG_SETTINGS_RENDER_BACKEND "render_backend"
+/// Play URL used when video is handed to the player through GuiInterface::rtp_ring_ instead of a UDP socket.
+/// The codec name follows the prefix, e.g. "inproc://H265".
+constexpr auto IN_PROCESS_URL_PREFIX = "inproc://";
 
-#define DEFAULT_PORT 52356
+/// Header of every packet in GuiInterface::rtp_ring_, the link stages it went through.
+using RtpRingHeader = LatencyStamps;
 
 constexpr auto LOGGER_MODULE = "Aviateur";
 
@@ -104,13 +97,6 @@ constexpr std::array CHANNEL_WIDTHS{
     "40 MHz",
 };
 
-enum class LogLevel {
-    Info,
-    Debug,
-    Warn,
-    Error,
-};
-
 inline std::string IniToString(const mINI::INIStructure &ini) {
     std::ostringstream oss;
 
@@ -126,7 +112,7 @@ inline std::string IniToString(const mINI::INIStructure &ini) {
 }
 
 /// Acts as an interface between GUI and core.
-class GuiInterface {
+class GuiInterface : public LinkEvents {
 public:
     static GuiInterface &Instance() {
         static GuiInterface interface;
@@ -138,6 +124,8 @@ public:
     ~GuiInterface() = default;
 
     std::vector<std::shared_ptr<WfbngLink>> links_;
+    /// Guards changes to links_ against the metrics server thread. The GUI thread may read without it.
+    std::mutex links_mutex_;
 
     void init() {
 #ifdef _WIN32
@@ -182,6 +170,92 @@ public:
             use_vulkan_ = ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_RENDER_BACKEND] == "vulkan";
             rtp_codec_ = ini_[CONFIG_LOCALHOST][CONFIG_LOCALHOST_CODEC];
             dark_mode_ = ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_DARK_MODE] == "true";
+            latency_trace_path_ = ini_[CONFIG_METRICS][CONFIG_METRICS_LATENCY_TRACE];
+            try {
+                fec_ring_depth_ = std::stoi(ini_[CONFIG_WIFI][WIFI_FEC_RING_DEPTH]);
+            } catch (const std::exception &) {
+            }
+            if (!ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_DECODER_THREADING].empty()) {
+                decoder_threading_ = ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_DECODER_THREADING];
+            }
+            try {
+                const int frame_delay = std::stoi(ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_DECODER_FRAME_DELAY]);
+                decoder_frame_delay_ = std::max(0, frame_delay);
+            } catch (const std::exception &) {
+            }
+            if (!ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_FRAME_QUEUE].empty()) {
+                frame_queue_mode_ = ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_FRAME_QUEUE];
+            }
+            if (!ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_PRESENT_MODE].empty()) {
+                present_mode_ = ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_PRESENT_MODE];
+            }
+        }
+
+        StartMetricsServer();
+    }
+
+    /// Serves the link and player telemetry if [metrics] port is set.
+    void StartMetricsServer() {
+        int port = 0;
+        try {
+            port = std::stoi(ini_[CONFIG_METRICS][CONFIG_METRICS_PORT]);
+        } catch (const std::exception &) {
+        }
+        if (port <= 0 || port > 65535) {
+            return;
+        }
+
+        metrics_server_ = std::make_unique<MetricsServer>(*this);
+
+        metrics_server_->add_collector([this](MetricsWriter &writer) {
+            {
+                std::lock_guard lock(links_mutex_);
+                write_link_metrics(writer, *this, links_);
+            }
+
+            writer.gauge("aviateur_video_bitrate_bits_per_second",
+                         "Bitrate of the video being decoded.",
+                         static_cast<double>(video_bitrate_.load(std::memory_order_relaxed)));
+            writer.gauge("aviateur_video_fps",
+                         "Frame rate of the video being decoded.",
+                         video_fps_.load(std::memory_order_relaxed));
+            writer.counter("aviateur_frames_decoded_total",
+                           "Video frames out of the decoder.",
+                           static_cast<double>(frame_queue_stats_.pushed.load(std::memory_order_relaxed)));
+            writer.counter("aviateur_frames_displayed_total",
+                           "Video frames uploaded for display.",
+                           static_cast<double>(present_stats_.presented.load(std::memory_order_relaxed)));
+            writer.counter("aviateur_frames_dropped_total",
+                           "Decoded video frames never displayed.",
+                           static_cast<double>(frame_queue_stats_.superseded.load(std::memory_order_relaxed)),
+                           "reason=\"superseded\"");
+            writer.counter("aviateur_frames_dropped_total",
+                           "Decoded video frames never displayed.",
+                           static_cast<double>(frame_queue_stats_.overflowed.load(std::memory_order_relaxed)),
+                           "reason=\"overflowed\"");
+            writer.counter("aviateur_frames_dropped_total",
+                           "Decoded video frames never displayed.",
+                           static_cast<double>(present_stats_.skipped.load(std::memory_order_relaxed)),
+                           "reason=\"skipped\"");
+            writer.counter("aviateur_frames_late_total",
+                           "Video frames displayed more than a display refresh after they were due.",
+                           static_cast<double>(present_stats_.late.load(std::memory_order_relaxed)));
+            writer.counter("aviateur_frames_repeated_total",
+                           "Display refreshes that showed the previous video frame again.",
+                           static_cast<double>(present_stats_.repeated.load(std::memory_order_relaxed)));
+            writer.gauge("aviateur_display_refresh_interval_seconds",
+                         "Time between two frames drawn by the GUI.",
+                         present_stats_.refresh_interval_us.load(std::memory_order_relaxed) * 1e-6);
+            writer.gauge("aviateur_frame_jitter_seconds",
+                         "Arrival jitter of decoded frames against their RTP timestamps (RFC 3550).",
+                         present_stats_.jitter_us.load(std::memory_order_relaxed) * 1e-6);
+            writer.gauge("aviateur_present_target_delay_seconds",
+                         "Delay paced presentation adds to absorb the jitter.",
+                         present_stats_.target_delay_us.load(std::memory_order_relaxed) * 1e-6);
+        });
+
+        if (!metrics_server_->start(static_cast<uint16_t>(port))) {
+            metrics_server_.reset();
         }
     }
 
@@ -248,6 +322,11 @@ public:
             ini[CONFIG_WIFI][WIFI_ALINK_ENABLED] = "false";
             ini[CONFIG_WIFI][WIFI_ALINK_TX_POWER] = "20";
             ini[CONFIG_WIFI][WIFI_FORWARD_PORT] = "5600";
+            ini[CONFIG_WIFI][WIFI_DIVERSITY_DEVICES] = "";
+            ini[CONFIG_WIFI][WIFI_CAPTURE_FRAMES] = "false";
+            ini[CONFIG_WIFI][WIFI_REPLAY_FILE] = "";
+            ini[CONFIG_WIFI][WIFI_REPLAY_REALTIME] = "true";
+            ini[CONFIG_WIFI][WIFI_FEC_RING_DEPTH] = "0";
 
             ini[CONFIG_LOCALHOST][CONFIG_LOCALHOST_PORT] = "5600";
             ini[CONFIG_LOCALHOST][CONFIG_LOCALHOST_CODEC] = "H264";
@@ -259,6 +338,13 @@ public:
             ini[CONFIG_SETTINGS][CONFIG_SETTINGS_RENDER_BACKEND] = "opengl";
 #endif
             ini[CONFIG_SETTINGS][CONFIG_SETTINGS_DARK_MODE] = "true";
+            ini[CONFIG_SETTINGS][CONFIG_SETTINGS_DECODER_THREADING] = "auto";
+            ini[CONFIG_SETTINGS][CONFIG_SETTINGS_DECODER_FRAME_DELAY] = "2";
+            ini[CONFIG_SETTINGS][CONFIG_SETTINGS_FRAME_QUEUE] = "mailbox";
+            ini[CONFIG_SETTINGS][CONFIG_SETTINGS_PRESENT_MODE] = "immediate";
+
+            ini[CONFIG_METRICS][CONFIG_METRICS_PORT] = "0";
+            ini[CONFIG_METRICS][CONFIG_METRICS_LATENCY_TRACE] = "";
         }
 
         if (read_success) {
@@ -282,6 +368,11 @@ public:
         Instance().ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_RENDER_BACKEND] = Instance().use_vulkan_ ? "vulkan" : "opengl";
 #endif
         Instance().ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_DARK_MODE] = Instance().dark_mode_ ? "true" : "false";
+        Instance().ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_DECODER_THREADING] = Instance().decoder_threading_;
+        Instance().ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_DECODER_FRAME_DELAY] =
+            std::to_string(Instance().decoder_frame_delay_);
+        Instance().ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_FRAME_QUEUE] = Instance().frame_queue_mode_;
+        Instance().ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_PRESENT_MODE] = Instance().present_mode_;
 
         Instance().ini_[CONFIG_LOCALHOST][CONFIG_LOCALHOST_CODEC] = Instance().rtp_codec_;
 
@@ -305,11 +396,7 @@ public:
         return write_success;
     }
 
-    static bool Start(const DeviceId &deviceId,
-                      int channel,
-                      int channelWidthMode,
-                      std::string gsKeyPath,
-                      const std::optional<std::string> &forward_port) {
+    static void SetUpPort(const std::optional<std::string> &forward_port) {
         Instance().forward_port_ = forward_port;
 
         // Set port.
@@ -322,26 +409,110 @@ public:
         }
 
         Instance().PutLog(LogLevel::Info, "Using port: {}", Instance().playerPort);
+    }
 
+    static void ResolveKeyPath(std::string &gsKeyPath) {
         // If no custom key provided by the user, use the default key.
         if (gsKeyPath.empty()) {
             gsKeyPath = vecgui::get_asset_dir("gs.key");
             Instance().PutLog(LogLevel::Info, "Using GS key: {}", gsKeyPath);
         }
+    }
+
+    /// Record the raw frames of all adapters for a later replay. Failing to do so does not stop the link.
+    static void StartCapture(const std::shared_ptr<WfbngReceiver> &receiver) {
+        const auto dir = GetCaptureDir();
+
+        try {
+            if (!std::filesystem::exists(dir)) {
+                std::filesystem::create_directories(dir);
+            }
+
+            const auto now = std::chrono::system_clock::now().time_since_epoch();
+            const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
 
-        auto link = std::make_shared<WfbngLink>();
+            receiver->start_capture(dir + "frames-" + std::to_string(ms) + ".pcap");
+        } catch (const std::exception &e) {
+            Instance().PutLog(LogLevel::Error, "Frame capture failed: {}", e.what());
+        }
+    }
+
+    /// Start receiving with an adapter. Calling it again while running adds another adapter to the same
+    /// stream (diversity receive), up to MAX_ADAPTER_COUNT.
+    static bool Start(const DeviceId &deviceId,
+                      int channel,
+                      int channelWidthMode,
+                      std::string gsKeyPath,
+                      const std::optional<std::string> &forward_port) {
+        const bool first_link = Instance().links_.empty();
+
+        if (Instance().links_.size() >= MAX_ADAPTER_COUNT) {
+            Instance().PutLog(LogLevel::Error, "Too many adapters, at most {} are supported", MAX_ADAPTER_COUNT);
+            return false;
+        }
+
+        // The other adapters feed the stream of the first one, which already has a port.
+        if (first_link) {
+            SetUpPort(forward_port);
+        }
+
+        ResolveKeyPath(gsKeyPath);
+
+        auto link = std::make_shared<WfbngLink>(Instance());
 
         // In dual adapter mode, we should have only one up link.
-        if (Instance().links_.empty()) {
+        if (first_link) {
             link->enable_alink(Instance().alink_enabled_);
             link->set_alink_tx_power(Instance().alink_tx_power_);
         } else {
             link->enable_alink(false);
         }
 
-        const bool started = link->start(deviceId, channel, channelWidthMode, gsKeyPath);
+        const bool started =
+            link->start(deviceId,
+                        channel,
+                        channelWidthMode,
+                        gsKeyPath,
+                        first_link ? nullptr : Instance().links_.front()->get_receiver(),
+                        static_cast<uint8_t>(Instance().links_.size()));
 
         if (started) {
+            {
+                std::lock_guard lock(Instance().links_mutex_);
+                Instance().links_.push_back(link);
+            }
+
+            if (first_link && Instance().ini_[CONFIG_WIFI][WIFI_CAPTURE_FRAMES] == "true") {
+                StartCapture(link->get_receiver());
+            }
+        }
+
+        return started;
+    }
+
+    /// Feed the frames of a pcap file (see WIFI_CAPTURE_FRAMES) through the receive path instead of an adapter.
+    static bool StartReplay(const std::string &pcapPath,
+                            bool realtime,
+                            std::string gsKeyPath,
+                            const std::optional<std::string> &forward_port) {
+        if (!Instance().links_.empty()) {
+            Instance().PutLog(LogLevel::Error, "Replay can not be combined with adapters");
+            return false;
+        }
+
+        SetUpPort(forward_port);
+
+        ResolveKeyPath(gsKeyPath);
+
+        auto link = std::make_shared<WfbngLink>(Instance());
+
+        // Nothing to send the link quality to.
+        link->enable_alink(false);
+
+        const bool started = link->start_replay(pcapPath, gsKeyPath, realtime);
+
+        if (started) {
+            std::lock_guard lock(Instance().links_mutex_);
             Instance().links_.push_back(link);
         }
 
@@ -352,6 +523,7 @@ public:
         for (const auto &link : Instance().links_) {
             link->stop();
         }
+        std::lock_guard lock(Instance().links_mutex_);
         Instance().links_.clear();
         return true;
     }
@@ -390,13 +562,7 @@ public:
         return sdp.str();
     }
 
-    template <typename... Args>
-    void PutLog(LogLevel level, const std::string_view message, Args... format_items) {
-        std::string str = std::vformat(message, std::make_format_args(format_items...));
-        EmitLog(level, str);
-    }
-
-    void NotifyRtpStream(int pt, uint16_t ssrc, int port, const std::string &codec) {
+    void NotifyRtpStream(int pt, uint16_t ssrc, int port, const std::string &codec) override {
         if (Instance().forward_port_.has_value()) {
             return;
         }
@@ -406,28 +572,56 @@ public:
         EmitRtpStream(sdpContent);
     }
 
-    void UpdateCount() {
-        EmitWifiFrameCountUpdated(wifiFrameCount_);
-        EmitWfbFrameCountUpdated(wfbngFrameCount_);
-        EmitRtpPktCountUpdated(rtpPktCount_);
+    /// Same as NotifyRtpStream, but for a stream that is delivered through rtp_ring_.
+    void NotifyInProcessRtpStream(const std::string &codec) override {
+        if (Instance().forward_port_.has_value()) {
+            return;
+        }
+
+        PutLog(LogLevel::Info, "In-process RTP stream, codec: {}", codec);
+
+        EmitRtpStream(IN_PROCESS_URL_PREFIX + codec);
+    }
+
+    /// Producer side of rtp_ring_, only ever called by the video worker, see LinkEvents::PushRtpPacket().
+    void PushRtpPacket(const uint8_t *data, size_t size, const LatencyStamps &stamps) override {
+        rtp_ring_.push(&stamps, sizeof(RtpRingHeader), data, size);
+    }
+
+    /// Fires the count signals for counters that changed since the last call.
+    /// Meant to be called from the GUI thread once per frame, never from the RX path.
+    void PublishCounts() {
+        const long long wifiFrameCount = GetWifiFrameCount();
+        const long long wfbngFrameCount = GetWfbngFrameCount();
+        const long long rtpPktCount = GetRtpPktCount();
+
+        if (wifiFrameCount != publishedWifiFrameCount_) {
+            publishedWifiFrameCount_ = wifiFrameCount;
+            EmitWifiFrameCountUpdated(wifiFrameCount);
+        }
+        if (wfbngFrameCount != publishedWfbngFrameCount_) {
+            publishedWfbngFrameCount_ = wfbngFrameCount;
+            EmitWfbFrameCountUpdated(wfbngFrameCount);
+        }
+        if (rtpPktCount != publishedRtpPktCount_) {
+            publishedRtpPktCount_ = rtpPktCount;
+            EmitRtpPktCountUpdated(rtpPktCount);
+        }
     }
 
     long long GetWfbngFrameCount() const {
-        return wfbngFrameCount_;
+        return static_cast<long long>(link_stats_.wfbngFrames.load());
     }
     long long GetRtpPktCount() const {
-        return rtpPktCount_;
+        return static_cast<long long>(link_stats_.rtpPackets.load());
     }
     long long GetWifiFrameCount() const {
-        return wifiFrameCount_;
+        return static_cast<long long>(link_stats_.wifiFrames.load());
     }
 
     int GetPlayerPort() const {
         return playerPort;
     }
-    std::string GetPlayerCodec() const {
-        return playerCodec;
-    }
 
     static int GetFreePort(int start_port) {
 #ifdef _WIN32
@@ -492,36 +686,54 @@ public:
 
     std::string locale_ = "en";
 
-    /// Number of received 802.11 frames
-    long long wifiFrameCount_ = 0;
-    /// Number of received wfb-ng frames
-    long long wfbngFrameCount_ = 0;
-    /// Number of received RTP packets
-    long long rtpPktCount_ = 0;
-
-    int playerPort = 0;
-    std::string playerCodec;
+    // Last values sent through the count signals.
+    long long publishedWifiFrameCount_ = -1;
+    long long publishedWfbngFrameCount_ = -1;
+    long long publishedRtpPktCount_ = -1;
 
     // Local RTP listener
     std::string rtp_codec_;
 
     bool dark_mode_ = false;
 
+    /// Software decoder threading (auto, slice or frame), read by the decoder when it opens.
+    std::string decoder_threading_ = "auto";
+    /// Frames of latency frame threading may add.
+    int decoder_frame_delay_ = 2;
+    /// Mailbox or fifo, see FrameQueueMode. Read by the player when it starts.
+    std::string frame_queue_mode_ = "mailbox";
+    /// Immediate or paced, see PresentMode. Read by the player when it starts.
+    std::string present_mode_ = "immediate";
+
     bool config_file_exists = true;
 
     bool is_using_wifi = true;
 
     // float link_quality_ = 0; // Percentage
     // float packet_loss_ = 0;  // Percentage
-    int drone_fec_level_ = 0;
 
     bool alink_enabled_ = false;
     int alink_tx_power_ = 0;
 
-    std::optional<std::string> forward_port_;
+    /// Recovered video RTP packets on their way to the decoder, when not forwarding to a UDP port.
+    /// Each one is preceded by its RtpRingHeader.
+    PacketRing rtp_ring_;
 
     bool use_vulkan_ = false;
 
+    /// Only set if [metrics] port is.
+    std::unique_ptr<MetricsServer> metrics_server_;
+    /// Last values from the decoder, for the metrics server.
+    std::atomic<uint64_t> video_bitrate_{0};
+    std::atomic<float> video_fps_{0};
+    /// What became of the decoded frames, counted by the FrameQueue of the player.
+    FrameQueueStats frame_queue_stats_;
+    /// When the frames went on screen, counted by the FramePacer of the player.
+    PresentStats present_stats_;
+
+    /// Where the player writes a Chrome trace of the frame latencies when playback stops, empty if it does not.
+    std::string latency_trace_path_;
+
     // Signals.
     std::vector<vecgui::AnyCallable<void>> logCallbacks;
     std::vector<vecgui::AnyCallable<void>> tipCallbacks;
@@ -535,7 +747,7 @@ public:
 
     std::vector<vecgui::AnyCallable<void>> urlStreamShouldStopCallbacks;
 
-    void EmitLog(LogLevel level, std::string msg) {
+    void EmitLog(LogLevel level, std::string msg) override {
         for (auto &callback : logCallbacks) {
             try {
                 callback.operator()<LogLevel, std::string>(std::move(level), std::move(msg));
@@ -544,7 +756,7 @@ public:
         }
     }
 
-    void ShowTip(std::string msg, bool bad_news) {
+    void ShowTip(std::string msg, bool bad_news) override {
         for (auto &callback : tipCallbacks) {
             try {
                 callback.operator()<std::string, bool>(std::move(msg), std::move(bad_news));
@@ -553,7 +765,7 @@ public:
         }
     }
 
-    void EmitWifiStopped() {
+    void EmitWifiStopped() override {
         for (auto &callback : wifiStopCallbacks) {
             try {
                 callback();
@@ -604,6 +816,8 @@ public:
     }
 
     void EmitBitrateUpdate(uint64_t bitrate) {
+        video_bitrate_.store(bitrate, std::memory_order_relaxed);
+
         for (auto &callback : bitrateUpdateCallbacks) {
             try {
                 callback.operator()<uint64_t>(std::move(bitrate));
@@ -614,6 +828,8 @@ public:
     }
 
     void EmitDecoderReady(uint32_t width, uint32_t height, float videoFps, std::string decoder_name) {
+        video_fps_.store(videoFps, std::memory_order_relaxed);
+
         for (auto &callback : decoderReadyCallbacks) {
             try {
                 callback.operator()<uint32_t, uint32_t, float, std::string>(std::move(width),
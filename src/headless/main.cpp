@@ -0,0 +1,536 @@
+// Ground station without GUI: receives, decrypts and FEC-decodes wfb-ng video and forwards the RTP stream to a
+// UDP port, e.g. on a relay box. Shares the link layer with the app, but does not link vecgui, SDL or FFmpeg.
+
+#include <mini/ini.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../config.h"
+#include "../wifi/link_events.h"
+#include "../wifi/metrics_server.h"
+#include "../wifi/wfbng_link.h"
+
+namespace {
+
+constexpr auto DEFAULT_FORWARD_PORT = "5600";
+
+std::atomic<bool> g_should_stop{false};
+
+void on_signal(int) {
+    g_should_stop = true;
+}
+
+/// Prints to the console, nothing is rendered.
+class ConsoleEvents final : public LinkEvents {
+public:
+    bool verbose = false;
+
+    std::atomic<bool> wifi_stopped{false};
+
+    void EmitLog(LogLevel level, std::string msg) override {
+        const char *tag = "INFO";
+        FILE *stream = stdout;
+
+        switch (level) {
+            case LogLevel::Info: {
+            } break;
+            case LogLevel::Debug: {
+                if (!verbose) {
+                    return;
+                }
+                tag = "DEBUG";
+            } break;
+            case LogLevel::Warn: {
+                tag = "WARN";
+                stream = stderr;
+            } break;
+            case LogLevel::Error: {
+                tag = "ERROR";
+                stream = stderr;
+            } break;
+            default:;
+        }
+
+        std::lock_guard lock(mutex_);
+        std::fprintf(stream, "[%s] %s\n", tag, msg.c_str());
+        std::fflush(stream);
+    }
+
+    void ShowTip(std::string msg, bool bad_news) override {
+        EmitLog(bad_news ? LogLevel::Warn : LogLevel::Info, std::move(msg));
+    }
+
+    void EmitWifiStopped() override {
+        wifi_stopped = true;
+    }
+
+    void NotifyRtpStream(int pt, uint16_t ssrc, int port, const std::string &codec) override {
+        PutLog(LogLevel::Info, "{} stream (payload type {}, SSRC {}) forwarded to port {}", codec, pt, ssrc, port);
+    }
+
+    // The stream is always forwarded, see forward_port_.
+    void NotifyInProcessRtpStream(const std::string &codec) override {}
+
+    void PushRtpPacket(const uint8_t *data, size_t size, const LatencyStamps &stamps) override {}
+
+private:
+    std::mutex mutex_;
+};
+
+struct Options {
+    std::optional<std::string> config_path;
+    /// Display names or vid:pid, the first one carries the adaptive link.
+    std::vector<std::string> devices;
+    std::optional<int> channel;
+    std::optional<int> channel_width_mode;
+    std::optional<std::string> key_path;
+    std::optional<std::string> forward_port;
+    std::optional<bool> alink_enabled;
+    std::optional<int> alink_tx_power;
+    std::optional<std::string> capture_path;
+    std::optional<std::string> replay_path;
+    bool replay_fast = false;
+    int stats_interval = 10; // Seconds
+    std::optional<int> metrics_port;
+    std::optional<int> fec_ring_depth;
+    bool list_devices = false;
+    bool verbose = false;
+};
+
+void print_usage(const char *program) {
+    std::printf(
+        "Usage: %s [options]\n"
+        "\n"
+        "  -c, --config <file>       Read the [wifi] section of an Aviateur config.ini, options below override it\n"
+        "  -d, --device <name>       Adapter display name (see --list) or vid:pid, repeat for diversity receive\n"
+        "      --channel <n>         Wi-Fi channel (default 161)\n"
+        "      --width <20|40>       Channel width in MHz (default 20)\n"
+        "  -k, --key <file>          GS key (default assets/gs.key next to the executable)\n"
+        "  -p, --forward-port <n>    UDP port on 127.0.0.1 to forward RTP to (default %s)\n"
+        "      --alink               Enable the adaptive link\n"
+        "      --alink-tx-power <n>  TX power of the adaptive link\n"
+        "      --capture <file>      Record the received frames to a pcap file\n"
+        "      --replay <file>       Replay a pcap file instead of using an adapter\n"
+        "      --replay-fast         Replay as fast as possible and report the throughput\n"
+        "      --stats <seconds>     Interval of the counter log, 0 to disable (default 10)\n"
+        "      --metrics-port <n>    Serve Prometheus metrics on http://127.0.0.1:<n>/metrics\n"
+        "      --fec-ring-depth <n>  Video blocks kept open for FEC (default 40)\n"
+        "  -l, --list                List the USB devices and exit\n"
+        "  -v, --verbose             Include debug messages\n"
+        "  -h, --help                Show this message\n",
+        program,
+        DEFAULT_FORWARD_PORT);
+}
+
+/// Returns std::nullopt after printing the reason if the arguments are invalid.
+std::optional<Options> parse_args(int argc, char **argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+
+        const auto value = [&]() -> std::optional<std::string> {
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+                return std::nullopt;
+            }
+            return std::string(argv[++i]);
+        };
+        const auto int_value = [&]() -> std::optional<int> {
+            const auto text = value();
+            if (!text) {
+                return std::nullopt;
+            }
+            try {
+                return std::stoi(*text);
+            } catch (const std::exception &) {
+                std::fprintf(stderr, "Invalid number for %s: %s\n", arg.c_str(), text->c_str());
+                return std::nullopt;
+            }
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            std::exit(EXIT_SUCCESS);
+        } else if (arg == "-l" || arg == "--list") {
+            options.list_devices = true;
+        } else if (arg == "-v" || arg == "--verbose") {
+            options.verbose = true;
+        } else if (arg == "--alink") {
+            options.alink_enabled = true;
+        } else if (arg == "--replay-fast") {
+            options.replay_fast = true;
+        } else if (arg == "-c" || arg == "--config") {
+            if (!(options.config_path = value())) {
+                return std::nullopt;
+            }
+        } else if (arg == "-d" || arg == "--device") {
+            const auto device = value();
+            if (!device) {
+                return std::nullopt;
+            }
+            options.devices.push_back(*device);
+        } else if (arg == "-k" || arg == "--key") {
+            if (!(options.key_path = value())) {
+                return std::nullopt;
+            }
+        } else if (arg == "-p" || arg == "--forward-port") {
+            if (!(options.forward_port = value())) {
+                return std::nullopt;
+            }
+        } else if (arg == "--capture") {
+            if (!(options.capture_path = value())) {
+                return std::nullopt;
+            }
+        } else if (arg == "--replay") {
+            if (!(options.replay_path = value())) {
+                return std::nullopt;
+            }
+        } else if (arg == "--channel") {
+            if (!(options.channel = int_value())) {
+                return std::nullopt;
+            }
+        } else if (arg == "--width") {
+            const auto width = int_value();
+            if (!width || (*width != 20 && *width != 40)) {
+                std::fprintf(stderr, "Channel width must be 20 or 40\n");
+                return std::nullopt;
+            }
+            options.channel_width_mode = *width == 40 ? 1 : 0;
+        } else if (arg == "--alink-tx-power") {
+            if (!(options.alink_tx_power = int_value())) {
+                return std::nullopt;
+            }
+        } else if (arg == "--stats") {
+            const auto interval = int_value();
+            if (!interval) {
+                return std::nullopt;
+            }
+            options.stats_interval = *interval;
+        } else if (arg == "--metrics-port") {
+            if (!(options.metrics_port = int_value())) {
+                return std::nullopt;
+            }
+        } else if (arg == "--fec-ring-depth") {
+            if (!(options.fec_ring_depth = int_value())) {
+                return std::nullopt;
+            }
+        } else {
+            std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            print_usage(argv[0]);
+            return std::nullopt;
+        }
+    }
+
+    return options;
+}
+
+/// Fills in what the command line left open from the config file.
+bool apply_config(Options &options) {
+    mINI::INIStructure ini;
+    if (!mINI::INIFile(*options.config_path).read(ini)) {
+        std::fprintf(stderr, "Unable to read %s\n", options.config_path->c_str());
+        return false;
+    }
+
+    auto &wifi = ini[CONFIG_WIFI];
+
+    const auto int_entry = [&](const char *key) -> std::optional<int> {
+        try {
+            return std::stoi(wifi[key]);
+        } catch (const std::exception &) {
+            return std::nullopt;
+        }
+    };
+    const auto string_entry = [&](const char *key) -> std::optional<std::string> {
+        if (wifi[key].empty()) {
+            return std::nullopt;
+        }
+        return wifi[key];
+    };
+
+    if (options.devices.empty()) {
+        if (const auto device = string_entry(WIFI_DEVICE)) {
+            options.devices.push_back(*device);
+        }
+
+        // Display names separated by ';', as in the app.
+        std::stringstream names(wifi[WIFI_DIVERSITY_DEVICES]);
+        std::string name;
+        while (std::getline(names, name, ';')) {
+            if (name.empty() || std::ranges::find(options.devices, name) != options.devices.end()) {
+                continue;
+            }
+            options.devices.push_back(name);
+        }
+    }
+
+    if (!options.channel) {
+        options.channel = int_entry(WIFI_CHANNEL);
+    }
+    if (!options.channel_width_mode) {
+        options.channel_width_mode = int_entry(WIFI_CHANNEL_WIDTH_MODE);
+    }
+    if (!options.key_path) {
+        options.key_path = string_entry(WIFI_GS_KEY);
+    }
+    if (!options.forward_port) {
+        options.forward_port = string_entry(WIFI_FORWARD_PORT);
+    }
+    if (!options.alink_enabled && wifi.has(WIFI_ALINK_ENABLED)) {
+        options.alink_enabled = wifi[WIFI_ALINK_ENABLED] == "true";
+    }
+    if (!options.alink_tx_power) {
+        options.alink_tx_power = int_entry(WIFI_ALINK_TX_POWER);
+    }
+    if (!options.capture_path && wifi[WIFI_CAPTURE_FRAMES] == "true") {
+        const auto now = std::chrono::system_clock::now().time_since_epoch();
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+        options.capture_path = "frames-" + std::to_string(ms) + ".pcap";
+    }
+    if (!options.metrics_port) {
+        try {
+            options.metrics_port = std::stoi(ini[CONFIG_METRICS][CONFIG_METRICS_PORT]);
+        } catch (const std::exception &) {
+        }
+    }
+    if (!options.fec_ring_depth) {
+        options.fec_ring_depth = int_entry(WIFI_FEC_RING_DEPTH);
+    }
+    if (!options.replay_path) {
+        options.replay_path = string_entry(WIFI_REPLAY_FILE);
+        options.replay_fast = options.replay_fast || wifi[WIFI_REPLAY_REALTIME] == "false";
+    }
+
+    return true;
+}
+
+std::optional<DeviceId> find_device(const std::vector<DeviceId> &devices, const std::string &name) {
+    for (const auto &d : devices) {
+        char vid_pid[10];
+        std::snprintf(vid_pid, sizeof(vid_pid), "%04x:%04x", d.vendor_id, d.product_id);
+
+        if (d.matches_saved_name(name) || name == vid_pid) {
+            return d;
+        }
+    }
+    return std::nullopt;
+}
+
+/// Longest window the link metrics keep.
+constexpr auto STATS_WINDOW = LinkMetrics::RssiHistogram::MAX_WINDOW;
+
+void log_stats(ConsoleEvents &events, const WfbngLink &link) {
+    const auto &stats = events.link_stats_;
+    const auto video_queue = link.get_receiver()->get_video_queue_stats();
+
+    events.PutLog(LogLevel::Info,
+                  "Frames: {} Wi-Fi, {} wfb-ng, {} RTP | Dropped: {} queue | Loss: {}% | Video queue peak: {}",
+                  stats.wifiFrames.load(),
+                  stats.wfbngFrames.load(),
+                  stats.rtpPackets.load(),
+                  stats.queueDrops.load(),
+                  link.get_packet_loss(),
+                  video_queue.peak_depth);
+
+    const auto gap = events.link_metrics_.arrival_gap_us.summarize(STATS_WINDOW);
+    const auto fec = events.link_metrics_.fec_recovered_per_block.summarize(STATS_WINDOW);
+    events.PutLog(LogLevel::Info,
+                  "Frame gap p50/p99/max: {}/{}/{} us | FEC recovered per block p50/p99: {}/{} ({} blocks)",
+                  gap.p50,
+                  gap.p99,
+                  gap.max,
+                  fec.p50,
+                  fec.p99,
+                  fec.count);
+
+    const auto decrypt = events.link_metrics_.since_usb_rx(LatencyStage::Decrypted).summarize(STATS_WINDOW);
+    const auto release = events.link_metrics_.since_usb_rx(LatencyStage::FecReleased).summarize(STATS_WINDOW);
+    events.PutLog(LogLevel::Info,
+                  "Since USB RX p50/p99: decrypted {}/{} us, released by FEC {}/{} us | FEC deadline: {} us, "
+                  "{} blocks timed out",
+                  decrypt.p50,
+                  decrypt.p99,
+                  release.p50,
+                  release.p99,
+                  link.get_receiver()->get_fec_release_deadline().count(),
+                  stats.fecTimeoutBlocks.load());
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    auto parsed = parse_args(argc, argv);
+    if (!parsed) {
+        return EXIT_FAILURE;
+    }
+    Options options = *parsed;
+
+    if (options.config_path && !apply_config(options)) {
+        return EXIT_FAILURE;
+    }
+
+    // Holds the link metrics, too big for the stack.
+    const auto events_holder = std::make_unique<ConsoleEvents>();
+    ConsoleEvents &events = *events_holder;
+    events.verbose = options.verbose;
+
+    // Initialize the default libusb context.
+    libusb_init(nullptr);
+
+    const auto devices = WfbngLink::get_device_list();
+
+    if (options.list_devices) {
+        for (const auto &d : devices) {
+            std::printf("%04x:%04x  %s%s\n",
+                        d.vendor_id,
+                        d.product_id,
+                        d.display_name.c_str(),
+                        d.known_adapter ? "" : "  (unsupported)");
+        }
+        libusb_exit(nullptr);
+        return EXIT_SUCCESS;
+    }
+
+    // There is no built-in player, so the stream always goes to a port.
+    events.forward_port_ = options.forward_port.value_or(DEFAULT_FORWARD_PORT);
+    try {
+        events.playerPort = std::stoi(*events.forward_port_);
+    } catch (const std::exception &) {
+        events.PutLog(LogLevel::Error, "Invalid forward port: {}", *events.forward_port_);
+        return EXIT_FAILURE;
+    }
+    events.fec_ring_depth_ = options.fec_ring_depth.value_or(0);
+
+    const std::string key_path = options.key_path.value_or(
+        (std::filesystem::path(argv[0]).parent_path() / "assets" / "gs.key").string());
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    std::vector<std::shared_ptr<WfbngLink>> links;
+
+    if (options.replay_path) {
+        auto link = std::make_shared<WfbngLink>(events);
+        if (!link->start_replay(*options.replay_path, key_path, !options.replay_fast)) {
+            return EXIT_FAILURE;
+        }
+        links.push_back(link);
+    } else {
+        if (options.devices.empty()) {
+            // Fall back to the first adapter devourer can drive.
+            for (const auto &d : devices) {
+                if (d.known_adapter) {
+                    options.devices.push_back(d.display_name);
+                    break;
+                }
+            }
+        }
+        if (options.devices.empty()) {
+            events.PutLog(LogLevel::Error, "No supported adapter found, see --list");
+            return EXIT_FAILURE;
+        }
+
+        for (const auto &name : options.devices) {
+            if (links.size() >= MAX_ADAPTER_COUNT) {
+                events.PutLog(LogLevel::Warn, "Too many adapters, at most {} are supported", MAX_ADAPTER_COUNT);
+                break;
+            }
+
+            const auto device = find_device(devices, name);
+            if (!device) {
+                events.PutLog(LogLevel::Warn, "Adapter not found: {}", name);
+                continue;
+            }
+
+            const bool first_link = links.empty();
+
+            auto link = std::make_shared<WfbngLink>(events);
+
+            // In dual adapter mode, we should have only one up link.
+            if (first_link) {
+                link->enable_alink(options.alink_enabled.value_or(false));
+                if (options.alink_tx_power) {
+                    link->set_alink_tx_power(*options.alink_tx_power);
+                }
+            } else {
+                link->enable_alink(false);
+            }
+
+            if (!link->start(*device,
+                             options.channel.value_or(161),
+                             options.channel_width_mode.value_or(0),
+                             key_path,
+                             first_link ? nullptr : links.front()->get_receiver(),
+                             static_cast<uint8_t>(links.size()))) {
+                events.PutLog(LogLevel::Warn, "Adapter failed to start: {}", name);
+                continue;
+            }
+
+            links.push_back(link);
+        }
+
+        if (links.empty()) {
+            return EXIT_FAILURE;
+        }
+
+        if (options.capture_path) {
+            try {
+                links.front()->get_receiver()->start_capture(*options.capture_path);
+            } catch (const std::exception &e) {
+                events.PutLog(LogLevel::Error, "Frame capture failed: {}", e.what());
+            }
+        }
+    }
+
+    // Stopped before the links go away, its collector reads them.
+    std::unique_ptr<MetricsServer> metrics_server;
+    if (options.metrics_port.value_or(0) > 0) {
+        metrics_server = std::make_unique<MetricsServer>(events);
+        metrics_server->add_collector([&](MetricsWriter &writer) { write_link_metrics(writer, events, links); });
+        if (!metrics_server->start(static_cast<uint16_t>(*options.metrics_port))) {
+            metrics_server.reset();
+        }
+    }
+
+    events.PutLog(LogLevel::Info, "Forwarding RTP to 127.0.0.1:{}, Ctrl+C to stop", events.playerPort);
+
+    auto last_stats = std::chrono::steady_clock::now();
+
+    while (!g_should_stop && !events.wifi_stopped) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        const auto now = std::chrono::steady_clock::now();
+        if (options.stats_interval > 0 && now - last_stats >= std::chrono::seconds(options.stats_interval)) {
+            log_stats(events, *links.front());
+            last_stats = now;
+        }
+    }
+
+    metrics_server.reset();
+
+    for (const auto &link : links) {
+        link->stop();
+    }
+    if (options.stats_interval > 0) {
+        log_stats(events, *links.front());
+    }
+    links.clear();
+
+    libusb_exit(nullptr);
+
+    return EXIT_SUCCESS;
+}
@@ -88,6 +88,8 @@ int main() {
 
     GuiInterface::SaveConfig();
 
+    GuiInterface::Instance().metrics_server_.reset();
+
     app.reset();
 
     libusb_exit(nullptr);
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "ffmpeg_include.h"
+
+/// How AvPool allocates, frees and empties an FFmpeg object.
+template <typename T>
+struct AvPoolTraits;
+
+template <>
+struct AvPoolTraits<AVFrame> {
+    static AVFrame *alloc() {
+        return av_frame_alloc();
+    }
+    static void free(AVFrame *frame) {
+        av_frame_free(&frame);
+    }
+    static void unref(AVFrame *frame) {
+        av_frame_unref(frame);
+    }
+};
+
+template <>
+struct AvPoolTraits<AVPacket> {
+    static AVPacket *alloc() {
+        return av_packet_alloc();
+    }
+    static void free(AVPacket *packet) {
+        av_packet_free(&packet);
+    }
+    static void unref(AVPacket *packet) {
+        av_packet_unref(packet);
+    }
+};
+
+/// Recycles AVFrames or AVPackets that are passed around as shared_ptrs, so that the decode loop does not
+/// allocate one (and its shared_ptr control block) per frame.
+///
+/// An object is free again once the pool holds the only reference to it. acquire() unreferences its buffers
+/// before handing it out, which gives them back to the buffer pools of FFmpeg.
+/// Only one thread may call acquire(), the references it hands out can be dropped on any.
+template <typename T>
+class AvPool {
+public:
+    explicit AvPool(const size_t initialSize) {
+        objects_.reserve(initialSize);
+        for (size_t i = 0; i < initialSize; i++) {
+            add();
+        }
+    }
+
+    /// An empty object. The pool grows if all of them are in use, nullptr if that fails.
+    std::shared_ptr<T> acquire() {
+        for (size_t i = 0; i < objects_.size(); i++) {
+            const size_t index = (next_ + i) % objects_.size();
+            if (objects_[index].use_count() == 1) {
+                // Whatever the last owner did with the object happens before we touch it.
+                std::atomic_thread_fence(std::memory_order_acquire);
+                next_ = (index + 1) % objects_.size();
+                AvPoolTraits<T>::unref(objects_[index].get());
+                return objects_[index];
+            }
+        }
+        return add();
+    }
+
+    /// Objects allocated so far. Stays put once the consumers hold on to a steady number of them.
+    size_t size() const {
+        return objects_.size();
+    }
+
+private:
+    std::shared_ptr<T> add() {
+        T *object = AvPoolTraits<T>::alloc();
+        if (!object) {
+            return nullptr;
+        }
+        objects_.emplace_back(object, [](T *p) { AvPoolTraits<T>::free(p); });
+        return objects_.back();
+    }
+
+    std::vector<std::shared_ptr<T>> objects_;
+    /// Where the search for a free object starts, so that they take turns.
+    size_t next_ = 0;
+};
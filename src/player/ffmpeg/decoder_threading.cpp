@@ -0,0 +1,128 @@
+#include "decoder_threading.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+/// FFmpeg does not use more for slice threading either.
+constexpr int MAX_THREADS = 16;
+
+/// Pixels per second one core decodes in software at FPV bitrates, on the low side so that Auto errs towards
+/// keeping up. 1080p60 is 124 Mpx/s.
+constexpr double H264_PIXELS_PER_CORE = 150e6;
+constexpr double HEVC_PIXELS_PER_CORE = 80e6;
+
+/// Assumed until the stream tells, the usual FPV frame rate.
+constexpr float DEFAULT_FPS = 60;
+
+} // namespace
+
+const char *decoder_threading_name(const DecoderThreading threading) {
+    switch (threading) {
+        case DecoderThreading::Slice:
+            return "slice";
+        case DecoderThreading::Frame:
+            return "frame";
+        default:
+            return "auto";
+    }
+}
+
+DecoderThreading parse_decoder_threading(const std::string &name) {
+    if (name == "slice") {
+        return DecoderThreading::Slice;
+    }
+    if (name == "frame") {
+        return DecoderThreading::Frame;
+    }
+    return DecoderThreading::Auto;
+}
+
+DecoderThreads choose_decoder_threads(const DecoderThreading threading,
+                                      const AVCodecID codecId,
+                                      const int width,
+                                      const int height,
+                                      const float fps,
+                                      const int maxFrameDelay) {
+    const int cores = std::clamp(static_cast<int>(std::thread::hardware_concurrency()), 1, MAX_THREADS);
+
+    const DecoderThreads slice{FF_THREAD_SLICE, cores};
+    DecoderThreads frame{FF_THREAD_FRAME, std::clamp(1 + maxFrameDelay, 1, cores)};
+
+    if (threading == DecoderThreading::Slice) {
+        return slice;
+    }
+    if (threading == DecoderThreading::Frame) {
+        return frame;
+    }
+
+    if (width <= 0 || height <= 0) {
+        return slice;
+    }
+
+    const double pixelRate = static_cast<double>(width) * height * (fps > 0 ? fps : DEFAULT_FPS);
+    const double perCore = codecId == AV_CODEC_ID_HEVC ? HEVC_PIXELS_PER_CORE : H264_PIXELS_PER_CORE;
+    const int neededCores = static_cast<int>(std::ceil(pixelRate / perCore));
+    if (neededCores <= 1 || frame.count == 1) {
+        return slice;
+    }
+
+    // No more frames in flight than it takes to keep up.
+    frame.count = std::min(frame.count, neededCores);
+    return frame;
+}
+
+void apply_decoder_threads(AVCodecContext *ctx, const DecoderThreads &threads) {
+    ctx->thread_type = threads.type;
+    ctx->thread_count = threads.count;
+
+    // FFmpeg falls back to a single thread for low delay decoding, frame threading is the opposite of it.
+    if (threads.type == FF_THREAD_FRAME) {
+        ctx->flags &= ~AV_CODEC_FLAG_LOW_DELAY;
+    }
+}
+
+DecoderThreads active_decoder_threads(const AVCodecContext *ctx) {
+    if (ctx->active_thread_type == 0) {
+        return {};
+    }
+    return {ctx->active_thread_type, ctx->thread_count};
+}
+
+bool probe_video_format(const AVCodecID codecId,
+                        const uint8_t *data,
+                        const int size,
+                        int &width,
+                        int &height,
+                        float &fps) {
+    AVCodecParserContext *parser = av_parser_init(codecId);
+    AVCodecContext *ctx = avcodec_alloc_context3(nullptr);
+    if (!parser || !ctx) {
+        av_parser_close(parser);
+        avcodec_free_context(&ctx);
+        return false;
+    }
+
+    // The access unit is whole, the parser does not have to wait for the start of the next one.
+    parser->flags |= PARSER_FLAG_COMPLETE_FRAMES;
+
+    uint8_t *out = nullptr;
+    int outSize = 0;
+    av_parser_parse2(parser, ctx, &out, &outSize, data, size, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+
+    const bool found = parser->width > 0 && parser->height > 0;
+    if (found) {
+        width = parser->width;
+        height = parser->height;
+    }
+    if (ctx->framerate.num > 0 && ctx->framerate.den > 0) {
+        fps = static_cast<float>(av_q2d(ctx->framerate));
+    }
+
+    av_parser_close(parser);
+    avcodec_free_context(&ctx);
+
+    return found;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+
+#include "ffmpeg_include.h"
+
+/// How the software decoder spreads its work over threads. Hardware decoders always get one.
+enum class DecoderThreading {
+    /// Slice threading if one core keeps up with the resolution and frame rate of the stream, frame threading if not.
+    Auto,
+    /// The threads share the slices (H.265 tiles/WPP rows) of a frame, no added latency.
+    /// Does nothing for streams with a single slice per frame.
+    Slice,
+    /// The threads decode consecutive frames, each thread beyond the first holds the output back by one frame.
+    Frame,
+};
+
+/// Name used in config.ini and the logs.
+const char *decoder_threading_name(DecoderThreading threading);
+
+/// Auto for anything unknown.
+DecoderThreading parse_decoder_threading(const std::string &name);
+
+/// What the decoder is opened with.
+struct DecoderThreads {
+    int type = FF_THREAD_SLICE;
+    int count = 1;
+
+    /// Frames the output lags behind the input.
+    int addedFrames() const {
+        return type == FF_THREAD_FRAME ? count - 1 : 0;
+    }
+
+    bool operator==(const DecoderThreads &) const = default;
+};
+
+/// Threads for `threading`, frame threading being limited to `maxFrameDelay` frames of added latency.
+/// `width`, `height` and `fps` are 0 while unknown, Auto then picks slice threading.
+DecoderThreads choose_decoder_threads(DecoderThreading threading,
+                                      AVCodecID codecId,
+                                      int width,
+                                      int height,
+                                      float fps,
+                                      int maxFrameDelay);
+
+/// Sets up a codec context that has not been opened yet.
+void apply_decoder_threads(AVCodecContext *ctx, const DecoderThreads &threads);
+
+/// What an opened codec runs with. FFmpeg falls back to one thread if the codec cannot do the kind asked for.
+DecoderThreads active_decoder_threads(const AVCodecContext *ctx);
+
+/// Size and frame rate from the SPS in an Annex B access unit, without decoding it.
+/// Leaves what the parameter sets do not tell untouched, returns false if the size is not found.
+/// `data` needs AV_INPUT_BUFFER_PADDING_SIZE bytes of padding, as the data of an AVPacket has.
+bool probe_video_format(AVCodecID codecId, const uint8_t *data, int size, int &width, int &height, float &fps);
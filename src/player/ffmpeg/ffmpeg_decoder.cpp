@@ -2,25 +2,18 @@
 
 #include <algorithm>
 #include <cassert>
+#include <format>
 #include <iostream>
 #include <vector>
 
+#include "../latency_trace.h"
 #include "src/gui_interface.h"
+#include "start_code.h"
 
 #undef min
 #undef max
 
 namespace {
-// Helper to find Annex B start codes (00 00 01 or 00 00 00 01)
-const uint8_t *find_start_code(const uint8_t *p, const uint8_t *end) {
-    while (p + 3 < end) {
-        if (p[0] == 0 && p[1] == 0 && p[2] == 1) return p;
-        if (p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1) return p;
-        p++;
-    }
-    return nullptr;
-}
-
 // Callback for AVIOContext to read from memory
 int read_sdp(void *opaque, uint8_t *buf, int buf_size) {
     auto *state = static_cast<SdpReadState *>(opaque);
@@ -32,11 +25,44 @@ int read_sdp(void *opaque, uint8_t *buf, int buf_size) {
     state->sizeLeft -= read_len;
     return read_len;
 }
+
+/// Sets up `dst` like `src`, an open decoder context, except for the flags and the threads.
+/// That is the stream parameters (extradata included), the timing, the callbacks and the hardware device.
+bool copy_decoder_setup(AVCodecContext *dst, const AVCodecContext *src) {
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if (!par) {
+        return false;
+    }
+    const bool copied = avcodec_parameters_from_context(par, src) >= 0 && avcodec_parameters_to_context(dst, par) >= 0;
+    avcodec_parameters_free(&par);
+    if (!copied) {
+        return false;
+    }
+
+    dst->pkt_timebase = src->pkt_timebase;
+    dst->framerate = src->framerate;
+    dst->flags2 = src->flags2;
+    dst->get_format = src->get_format;
+    dst->get_buffer2 = src->get_buffer2;
+    dst->opaque = src->opaque;
+
+    if (src->hw_device_ctx) {
+        dst->hw_device_ctx = av_buffer_ref(src->hw_device_ctx);
+        if (!dst->hw_device_ctx) {
+            return false;
+        }
+    }
+
+    return true;
+}
 } // namespace
 
 constexpr size_t MAX_AUDIO_PACKET = 2 * 1024 * 1024;
 constexpr int DEFAULT_TIMEOUT_MS = 1500;
 constexpr int AUDIO_FIFO_BUFFER_COUNT = 10; // Store up to 10 decoded audio frames
+// Row alignment of frames copied out of the hardware decoder. Keeps the fast copy out of uncached (USWC) memory,
+// and the rows packed for the usual widths, so that FrameStager does not copy them again.
+constexpr int TRANSFER_ALIGN = 16;
 
 bool FfmpegDecoder::OpenInput(std::string &inputFile, bool forceSoftwareDecoding) {
 #ifndef NDEBUG
@@ -53,6 +79,14 @@ bool FfmpegDecoder::OpenInput(std::string &inputFile, bool forceSoftwareDecoding
 
     abortRequest = false;
 
+    // Timeout control
+    startTime = std::chrono::steady_clock::now();
+
+    // RTP packets from our own aggregator, no need for probing.
+    if (inputFile.starts_with(IN_PROCESS_URL_PREFIX)) {
+        return OpenInProcessInput(inputFile.substr(std::string_view(IN_PROCESS_URL_PREFIX).size()));
+    }
+
     AVDictionary *options = nullptr;
 
     av_dict_set(&options, "buffer_size", "2097152", 0);
@@ -72,9 +106,6 @@ bool FfmpegDecoder::OpenInput(std::string &inputFile, bool forceSoftwareDecoding
     av_dict_set(&options, "probesize", "512000", 0);
     av_dict_set(&options, "analyzeduration", "500000", 0);
 
-    // Timeout control
-    startTime = std::chrono::steady_clock::now();
-
     const AVInputFormat *format = nullptr;
     int ret = 0;
 
@@ -155,7 +186,8 @@ bool FfmpegDecoder::OpenInput(std::string &inputFile, bool forceSoftwareDecoding
     // Convert time base
     if (videoStreamIndex != -1) {
         videoFramerate = static_cast<float>(av_q2d(pFormatCtx->streams[videoStreamIndex]->r_frame_rate));
-        videoBaseTime = av_q2d(pFormatCtx->streams[videoStreamIndex]->time_base);
+        videoTimeBase = pFormatCtx->streams[videoStreamIndex]->time_base;
+        videoBaseTime = av_q2d(videoTimeBase);
 
         GuiInterface::Instance().PutLog(LogLevel::Info, "Video frame rate: {}", videoFramerate);
     }
@@ -173,6 +205,36 @@ bool FfmpegDecoder::OpenInput(std::string &inputFile, bool forceSoftwareDecoding
     return true;
 }
 
+bool FfmpegDecoder::OpenInProcessInput(const std::string &codec) {
+    const AVCodecID codecId = codec == "H264" ? AV_CODEC_ID_H264 : AV_CODEC_ID_HEVC;
+
+    // Whatever was queued before (re)opening is stale.
+    GuiInterface::Instance().rtp_ring_.clear();
+
+    rtpDepacketizer.emplace(codecId);
+    inProcessInput = true;
+    decodingLatency = {};
+
+    // SPS/PPS (and VPS) arrive in-band, so the codec can be opened right away.
+    hasVideoStream = OpenVideoCodec(codecId, nullptr);
+    hasAudioStream = false;
+
+    if (!hasVideoStream) {
+        GuiInterface::Instance().PutLog(LogLevel::Error, "Opening {} decoder failed", codec);
+        CloseInput();
+        return false;
+    }
+
+    videoStreamIndex = 0;
+    videoTimeBase = RtpDepacketizer::TIME_BASE;
+    videoBaseTime = av_q2d(videoTimeBase);
+
+    sourceIsOpened = true;
+    lastCountBitrateTime = std::chrono::steady_clock::now();
+
+    return true;
+}
+
 bool FfmpegDecoder::CloseInput() {
     abortRequest = true;
 
@@ -197,6 +259,9 @@ bool FfmpegDecoder::CloseInput() {
         pAvioCtx = nullptr;
     }
 
+    inProcessInput = false;
+    rtpDepacketizer.reset();
+
     return true;
 }
 
@@ -204,10 +269,6 @@ void freeFrame(AVFrame *f) {
     av_frame_free(&f);
 }
 
-void freePkt(AVPacket *f) {
-    av_packet_free(&f);
-}
-
 void freeSwrCtx(SwrContext *s) {
     swr_free(&s);
 }
@@ -225,10 +286,14 @@ std::shared_ptr<AVFrame> FfmpegDecoder::GetNextFrame() {
         // 1. First, try to receive a frame from the decoder (drain)
         {
             std::lock_guard lck(_releaseLock);
-            if (!pFormatCtx || !sourceIsOpened) return nullptr;
+            if ((!pFormatCtx && !inProcessInput) || !sourceIsOpened) return nullptr;
 
             if (pVideoCodecCtx) {
-                std::shared_ptr<AVFrame> pFrameVideo = std::shared_ptr<AVFrame>(av_frame_alloc(), &freeFrame);
+                // Goes back to the pool if no frame comes out.
+                std::shared_ptr<AVFrame> pFrameVideo = framePool.acquire();
+                if (!pFrameVideo) {
+                    throw std::runtime_error("av_frame_alloc failed");
+                }
                 AVFrame *frameToReceive = pFrameVideo.get();
 
 #ifdef __APPLE__
@@ -256,6 +321,10 @@ std::shared_ptr<AVFrame> FfmpegDecoder::GetNextFrame() {
                     if (frameToReceive->width != width || frameToReceive->height != height) {
                         width = frameToReceive->width;
                         height = frameToReceive->height;
+                        // Without a demuxer, the frame rate is only known once the SPS has been parsed.
+                        if (inProcessInput && pVideoCodecCtx->framerate.num > 0) {
+                            videoFramerate = static_cast<float>(av_q2d(pVideoCodecCtx->framerate));
+                        }
                         GuiInterface::Instance().PutLog(LogLevel::Info,
                                                         "Video resolution updated: {}x{}",
                                                         width,
@@ -270,11 +339,12 @@ std::shared_ptr<AVFrame> FfmpegDecoder::GetNextFrame() {
                             dropCurrentVideoFrame = false;
                             continue;
                         }
-                        if (av_hwframe_transfer_data(pFrameVideo.get(), hwFrame.get(), 0) < 0) {
+                        const bool transferred = TransferHwFrame(pFrameVideo.get(), hwFrame.get());
+                        av_frame_unref(hwFrame.get());
+                        if (!transferred) {
                             GuiInterface::Instance().PutLog(LogLevel::Warn, "av_hwframe_transfer_data failed");
                             continue;
                         }
-                        av_frame_copy_props(pFrameVideo.get(), hwFrame.get());
                     } else if (hwDecoderEnabled && zeroCopyThisFrame) {
                         if (dropCurrentVideoFrame) {
                             dropCurrentVideoFrame = false;
@@ -283,6 +353,11 @@ std::shared_ptr<AVFrame> FfmpegDecoder::GetNextFrame() {
                         // Zero-copy path: pFrameVideo already contains the hardware-decoded frame
                         // No transfer needed - the CVPixelBuffer is directly accessible via data[3]
                     }
+                    if (inProcessInput) {
+                        TrackDecodedFrame(pFrameVideo.get());
+                    }
+                    // Decoders leave it unset, FramePacer needs it to place the frame on the timeline.
+                    pFrameVideo->time_base = videoTimeBase;
                     if (gotVideoFrameCallback) gotVideoFrameCallback(pFrameVideo);
                     return pFrameVideo;
                 } else if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
@@ -294,12 +369,17 @@ std::shared_ptr<AVFrame> FfmpegDecoder::GetNextFrame() {
         }
 
         // 2. If no frame available, read a new packet
-        auto packet = std::shared_ptr<AVPacket>(av_packet_alloc(), &freePkt);
+        std::shared_ptr<AVPacket> packet;
         int ret = -1;
         {
             std::lock_guard lck_io(_readMtx);
-            if (!pFormatCtx || !sourceIsOpened || abortRequest) return nullptr;
-            ret = av_read_frame(pFormatCtx, packet.get());
+            if ((!pFormatCtx && !inProcessInput) || !sourceIsOpened || abortRequest) return nullptr;
+            if (inProcessInput) {
+                ret = ReadInProcessPacket(packet);
+            } else {
+                packet = packetPool.acquire();
+                ret = packet ? av_read_frame(pFormatCtx, packet.get()) : AVERROR(ENOMEM);
+            }
         }
 
         if (ret < 0) {
@@ -335,7 +415,14 @@ std::shared_ptr<AVFrame> FfmpegDecoder::GetNextFrame() {
             std::lock_guard lck(_releaseLock);
             if (!sourceIsOpened || !pVideoCodecCtx) return nullptr;
 
+            if (threadsPendingKeyframe) {
+                ApplyAutoThreads(packet.get());
+            }
+
             if (gotPktCallback) gotPktCallback(packet);
+            if (inProcessInput) {
+                TrackDecoderInput(packet.get());
+            }
             ret = avcodec_send_packet(pVideoCodecCtx, packet.get());
             if (ret < 0) {
                 char errStr[AV_ERROR_MAX_STRING_SIZE];
@@ -367,6 +454,237 @@ std::shared_ptr<AVFrame> FfmpegDecoder::GetNextFrame() {
     }
 }
 
+bool FfmpegDecoder::TransferHwFrame(AVFrame *dst, const AVFrame *src) {
+    const auto *frames = reinterpret_cast<const AVHWFramesContext *>(src->hw_frames_ctx->data);
+
+    // av_hwframe_transfer_data() would allocate the destination with av_frame_get_buffer() every time.
+    if (!transferPool || src->width != transferWidth || src->height != transferHeight ||
+        frames->sw_format != transferSwFormat) {
+        AVPixelFormat *formats = nullptr;
+        if (av_hwframe_transfer_get_formats(src->hw_frames_ctx, AV_HWFRAME_TRANSFER_DIRECTION_FROM, &formats, 0) < 0) {
+            return false;
+        }
+        // The first one is what av_hwframe_transfer_data() picks too.
+        transferFormat = formats[0];
+        av_freep(&formats);
+
+        const int size = av_image_get_buffer_size(transferFormat, src->width, src->height, TRANSFER_ALIGN);
+        if (size < 0) {
+            return false;
+        }
+        transferPool = std::shared_ptr<AVBufferPool>(av_buffer_pool_init(size, nullptr),
+                                                     [](AVBufferPool *p) { av_buffer_pool_uninit(&p); });
+        transferWidth = src->width;
+        transferHeight = src->height;
+        transferSwFormat = frames->sw_format;
+    }
+
+    dst->format = transferFormat;
+    dst->width = src->width;
+    dst->height = src->height;
+    dst->buf[0] = av_buffer_pool_get(transferPool.get());
+    if (!dst->buf[0]) {
+        return false;
+    }
+    if (av_image_fill_arrays(dst->data,
+                             dst->linesize,
+                             dst->buf[0]->data,
+                             transferFormat,
+                             dst->width,
+                             dst->height,
+                             TRANSFER_ALIGN) < 0) {
+        return false;
+    }
+
+    if (av_hwframe_transfer_data(dst, src, 0) < 0) {
+        return false;
+    }
+    av_frame_copy_props(dst, src);
+
+    return true;
+}
+
+int FfmpegDecoder::ReadInProcessPacket(std::shared_ptr<AVPacket> &packet) {
+    auto &ring = GuiInterface::Instance().rtp_ring_;
+
+    while (true) {
+        if (abortRequest) {
+            return AVERROR_EXIT;
+        }
+
+        packet = rtpDepacketizer->pop();
+        if (packet) {
+            packet->stream_index = videoStreamIndex;
+            GuiInterface::Instance().link_metrics_.record_latency(get_latency_stamps(packet->opaque_ref),
+                                                                  LatencyStage::Depacketized);
+            return 0;
+        }
+
+        size_t size = 0;
+        if (const uint8_t *entry = ring.front(size)) {
+            RtpRingHeader stamps;
+            memcpy(&stamps, entry, sizeof(stamps));
+
+            if (stamps.is_traced()) {
+                const int64_t waited_ns = LatencyStamps::now() - stamps[LatencyStage::FecReleased];
+                GuiInterface::Instance().link_metrics_.decoder_latency_us.record(waited_ns / 1000);
+            }
+
+            rtpDepacketizer->push(entry + sizeof(stamps), size - sizeof(stamps), stamps);
+            ring.pop();
+            continue;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime).count() > DEFAULT_TIMEOUT_MS) {
+            return AVERROR_EOF;
+        }
+
+        ring.wait(std::chrono::milliseconds(10));
+    }
+}
+
+void FfmpegDecoder::TrackDecoderInput(const AVPacket *packet) {
+    LatencyStamps stamps = get_latency_stamps(packet->opaque_ref);
+    if (!stamps.is_traced()) {
+        return;
+    }
+
+    stamps.mark(LatencyStage::DecoderInput);
+    GuiInterface::Instance().link_metrics_.record_latency(stamps, LatencyStage::DecoderInput);
+
+    // The oldest entry is overwritten, its frame has been dropped by the decoder if it is still there.
+    decodingLatency[decodingLatencyNext] = {packet->pts, stamps};
+    decodingLatencyNext = (decodingLatencyNext + 1) % decodingLatency.size();
+}
+
+void FfmpegDecoder::TrackDecodedFrame(AVFrame *frame) {
+    for (auto &[pts, stamps] : decodingLatency) {
+        if (!stamps.is_traced() || pts != frame->pts) {
+            continue;
+        }
+
+        stamps.mark(LatencyStage::Decoded);
+        GuiInterface::Instance().link_metrics_.record_latency(stamps, LatencyStage::Decoded);
+        set_latency_stamps(frame->opaque_ref, stamps);
+
+        stamps = {};
+        return;
+    }
+}
+
+void FfmpegDecoder::ApplyAutoThreads(const AVPacket *keyframe) {
+    threadsPendingKeyframe = false;
+
+    int keyframeWidth = 0;
+    int keyframeHeight = 0;
+    float fps = videoFramerate;
+    if (!probe_video_format(pVideoCodecCtx->codec_id,
+                            keyframe->data,
+                            keyframe->size,
+                            keyframeWidth,
+                            keyframeHeight,
+                            fps)) {
+        GuiInterface::Instance().PutLog(LogLevel::Warn,
+                                        "No video size in the first keyframe, keeping the decoder threads");
+        return;
+    }
+
+    const DecoderThreads threads = choose_decoder_threads(threadingPolicy,
+                                                          pVideoCodecCtx->codec_id,
+                                                          keyframeWidth,
+                                                          keyframeHeight,
+                                                          fps,
+                                                          maxFrameDelay);
+    if (threads == decoderThreads) {
+        return;
+    }
+
+    // Nothing has been sent to the decoder yet, so it is replaced without losing a frame.
+    const AVCodec *codec = pVideoCodecCtx->codec;
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (!ctx) {
+        return;
+    }
+    if (!copy_decoder_setup(ctx, pVideoCodecCtx)) {
+        GuiInterface::Instance().PutLog(LogLevel::Warn, "Copying the decoder setup failed, keeping the threads");
+        avcodec_free_context(&ctx);
+        return;
+    }
+    // Not the flags of the open context: the threading chosen before may have cleared AV_CODEC_FLAG_LOW_DELAY.
+    ctx->flags = videoCodecFlags;
+    apply_decoder_threads(ctx, threads);
+
+    if (avcodec_open2(ctx, codec, nullptr) < 0) {
+        GuiInterface::Instance().PutLog(LogLevel::Warn, "avcodec_open2 failed, keeping the decoder threads");
+        avcodec_free_context(&ctx);
+        return;
+    }
+
+    avcodec_free_context(&pVideoCodecCtx);
+    pVideoCodecCtx = ctx;
+    decoderThreads = active_decoder_threads(pVideoCodecCtx);
+
+    GuiInterface::Instance().PutLog(LogLevel::Info,
+                                    "Decoder threading auto for {}x{}@{:.0f}: {} {} threads, {} frames of added latency",
+                                    keyframeWidth,
+                                    keyframeHeight,
+                                    fps,
+                                    decoderThreads.count,
+                                    decoderThreads.type == FF_THREAD_FRAME ? "frame" : "slice",
+                                    decoderThreads.addedFrames());
+}
+
+std::string FfmpegDecoder::GetDecoderDescription() const {
+    if (hwDecoderName) {
+        return *hwDecoderName;
+    }
+
+    std::string description = std::format("Software, {} {} threads",
+                                          decoderThreads.count,
+                                          decoderThreads.type == FF_THREAD_FRAME ? "frame" : "slice");
+
+    const int addedFrames = decoderThreads.addedFrames();
+    if (addedFrames > 0 && videoFramerate > 0) {
+        description += std::format(", +{:.0f} ms", addedFrames * 1000 / videoFramerate);
+    } else if (addedFrames > 0) {
+        description += std::format(", +{} frames", addedFrames);
+    }
+
+    return description;
+}
+
+bool FfmpegDecoder::GetVideoCodecParameters(AVCodecParameters *par, AVRational &timeBase) {
+    std::lock_guard lck(_releaseLock);
+
+    if (pFormatCtx && videoStreamIndex != -1) {
+        timeBase = pFormatCtx->streams[videoStreamIndex]->time_base;
+        return avcodec_parameters_copy(par, pFormatCtx->streams[videoStreamIndex]->codecpar) >= 0;
+    }
+
+    if (!inProcessInput || !pVideoCodecCtx || width <= 0 || height <= 0) {
+        return false;
+    }
+
+    if (avcodec_parameters_from_context(par, pVideoCodecCtx) < 0) {
+        return false;
+    }
+
+    // Parameter sets were sent in-band, muxers need them as extradata.
+    if (par->extradata_size == 0) {
+        const auto parameterSets = rtpDepacketizer->parameterSets();
+        par->extradata = static_cast<uint8_t *>(av_mallocz(parameterSets.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+        if (!par->extradata) {
+            return false;
+        }
+        memcpy(par->extradata, parameterSets.data(), parameterSets.size());
+        par->extradata_size = static_cast<int>(parameterSets.size());
+    }
+
+    timeBase = RtpDepacketizer::TIME_BASE;
+    return true;
+}
+
 bool FfmpegDecoder::createHwCtx(AVCodecContext *ctx, const AVHWDeviceType type) {
     if (av_hwdevice_ctx_create(&hwDeviceCtx, type, nullptr, nullptr, 0) < 0) {
         return false;
@@ -389,96 +707,142 @@ bool FfmpegDecoder::OpenVideo() {
 
             videoStreamIndex = i;
 
-            const AVCodecID codecId = pFormatCtx->streams[i]->codecpar->codec_id;
-            GuiInterface::Instance().PutLog(LogLevel::Info, "Video codec ID: {}", (int)codecId);
+            // For the decoder threads.
+            videoFramerate = static_cast<float>(av_q2d(pFormatCtx->streams[i]->r_frame_rate));
 
-            const AVCodec *codec = avcodec_find_decoder(codecId);
-            if (!codec) {
-                continue;
+            res = OpenVideoCodec(pFormatCtx->streams[i]->codecpar->codec_id, pFormatCtx->streams[i]->codecpar);
+            if (res) {
+                break;
             }
+        }
+    }
 
-            GuiInterface::Instance().PutLog(LogLevel::Info, "Video codec name: {}", codec->long_name);
+    if (!res) {
+        CloseVideo();
+    }
 
-            pVideoCodecCtx = avcodec_alloc_context3(codec);
-            if (!pVideoCodecCtx) {
-                continue;
-            }
+    return res;
+}
 
-            hwDecoderEnabled = false;
-            hwDecoderName = {};
+bool FfmpegDecoder::OpenVideoCodec(AVCodecID codecId, const AVCodecParameters *par) {
+    GuiInterface::Instance().PutLog(LogLevel::Info, "Video codec ID: {}", (int)codecId);
 
-            if (!forceSwDecoder) {
-                // Log available hardware decoder types.
-                AVHWDeviceType decoderType = AV_HWDEVICE_TYPE_NONE;
-                while ((decoderType = av_hwdevice_iterate_types(decoderType)) != AV_HWDEVICE_TYPE_NONE) {
-                    auto decoderName = std::string(av_hwdevice_get_type_name(decoderType));
-                    GuiInterface::Instance().PutLog(LogLevel::Info, "Found hardware decoder: " + decoderName);
-                }
+    const AVCodec *codec = avcodec_find_decoder(codecId);
+    if (!codec) {
+        return false;
+    }
 
-                for (int configIndex = 0;; configIndex++) {
-                    const AVCodecHWConfig *config = avcodec_get_hw_config(codec, configIndex);
-                    if (!config) {
-                        break;
-                    }
+    GuiInterface::Instance().PutLog(LogLevel::Info, "Video codec name: {}", codec->long_name);
 
-                    if (config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX) {
-                        hwDecoderEnabled = true;
+    pVideoCodecCtx = avcodec_alloc_context3(codec);
+    if (!pVideoCodecCtx) {
+        return false;
+    }
 
-                        hwPixFmt = config->pix_fmt;
-                        hwDecoderType = config->device_type;
+    hwDecoderEnabled = false;
+    hwDecoderName = {};
 
-                        auto decoderName = std::string(av_hwdevice_get_type_name(hwDecoderType));
-                        GuiInterface::Instance().PutLog(LogLevel::Info, "Configuring hardware decoder: " + decoderName);
+    if (!forceSwDecoder) {
+        // Log available hardware decoder types.
+        AVHWDeviceType decoderType = AV_HWDEVICE_TYPE_NONE;
+        while ((decoderType = av_hwdevice_iterate_types(decoderType)) != AV_HWDEVICE_TYPE_NONE) {
+            auto decoderName = std::string(av_hwdevice_get_type_name(decoderType));
+            GuiInterface::Instance().PutLog(LogLevel::Info, "Found hardware decoder: " + decoderName);
+        }
 
-                        std::ostringstream oss;
-                        oss << "Hardware acceleration pixel format: " << hwPixFmt;
-                        GuiInterface::Instance().PutLog(LogLevel::Info, oss.str());
+        for (int configIndex = 0;; configIndex++) {
+            const AVCodecHWConfig *config = avcodec_get_hw_config(codec, configIndex);
+            if (!config) {
+                break;
+            }
 
-                        hwDecoderEnabled = createHwCtx(pVideoCodecCtx, hwDecoderType);
+            if (config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX) {
+                hwDecoderEnabled = true;
 
-                        if (!hwDecoderEnabled) {
-                            GuiInterface::Instance().PutLog(LogLevel::Warn, "Creating hardware contex failed");
-                            continue;
-                        }
+                hwPixFmt = config->pix_fmt;
+                hwDecoderType = config->device_type;
 
-                        hwDecoderName = decoderName;
-                        GuiInterface::Instance().PutLog(LogLevel::Info, "Using hardware decoder: {}", decoderName);
+                auto decoderName = std::string(av_hwdevice_get_type_name(hwDecoderType));
+                GuiInterface::Instance().PutLog(LogLevel::Info, "Configuring hardware decoder: " + decoderName);
 
-                        break;
-                    }
-                }
+                std::ostringstream oss;
+                oss << "Hardware acceleration pixel format: " << hwPixFmt;
+                GuiInterface::Instance().PutLog(LogLevel::Info, oss.str());
+
+                hwDecoderEnabled = createHwCtx(pVideoCodecCtx, hwDecoderType);
 
                 if (!hwDecoderEnabled) {
-                    GuiInterface::Instance().PutLog(LogLevel::Warn,
-                                                    "No valid hardware decoder found, disabling hardware decoding");
+                    GuiInterface::Instance().PutLog(LogLevel::Warn, "Creating hardware contex failed");
+                    continue;
                 }
-            } else {
-                GuiInterface::Instance().PutLog(LogLevel::Info, "Software decoding is forced");
-            }
 
-            if (avcodec_parameters_to_context(pVideoCodecCtx, pFormatCtx->streams[i]->codecpar) >= 0) {
-                // Disable multi-threaded frame decoding to minimize latency
-                pVideoCodecCtx->thread_count = 1;
+                hwDecoderName = decoderName;
+                GuiInterface::Instance().PutLog(LogLevel::Info, "Using hardware decoder: {}", decoderName);
 
-                res = avcodec_open2(pVideoCodecCtx, codec, nullptr) >= 0;
-                if (res) {
-                    width = pVideoCodecCtx->width;
-                    height = pVideoCodecCtx->height;
-                } else {
-                    GuiInterface::Instance().PutLog(LogLevel::Warn, "avcodec_open2 failed");
-                    continue;
-                }
+                break;
             }
+        }
 
-            break;
+        if (!hwDecoderEnabled) {
+            GuiInterface::Instance().PutLog(LogLevel::Warn,
+                                            "No valid hardware decoder found, disabling hardware decoding");
         }
+    } else {
+        GuiInterface::Instance().PutLog(LogLevel::Info, "Software decoding is forced");
     }
 
-    if (!res) {
-        CloseVideo();
+    if (par) {
+        if (avcodec_parameters_to_context(pVideoCodecCtx, par) < 0) {
+            avcodec_free_context(&pVideoCodecCtx);
+            return false;
+        }
+    } else {
+        // No container, packets come straight from RTP.
+        pVideoCodecCtx->pkt_timebase = RtpDepacketizer::TIME_BASE;
+        pVideoCodecCtx->flags |= AV_CODEC_FLAG_LOW_DELAY;
     }
 
-    return res;
+    videoCodecFlags = pVideoCodecCtx->flags;
+
+    // Hardware decoders do not gain from threads, frame threading would only add latency to them.
+    DecoderThreads threads;
+    threadsPendingKeyframe = false;
+    if (!hwDecoderEnabled) {
+        threadingPolicy = parse_decoder_threading(GuiInterface::Instance().decoder_threading_);
+        maxFrameDelay = GuiInterface::Instance().decoder_frame_delay_;
+        threads = choose_decoder_threads(threadingPolicy,
+                                         codecId,
+                                         pVideoCodecCtx->width,
+                                         pVideoCodecCtx->height,
+                                         videoFramerate,
+                                         maxFrameDelay);
+        // Without a demuxer the stream format is only known from the first keyframe.
+        threadsPendingKeyframe = threadingPolicy == DecoderThreading::Auto &&
+                                 (pVideoCodecCtx->width <= 0 || pVideoCodecCtx->height <= 0);
+    }
+    apply_decoder_threads(pVideoCodecCtx, threads);
+
+    if (avcodec_open2(pVideoCodecCtx, codec, nullptr) < 0) {
+        GuiInterface::Instance().PutLog(LogLevel::Warn, "avcodec_open2 failed");
+        avcodec_free_context(&pVideoCodecCtx);
+        return false;
+    }
+
+    decoderThreads = active_decoder_threads(pVideoCodecCtx);
+    if (!hwDecoderEnabled) {
+        GuiInterface::Instance().PutLog(LogLevel::Info,
+                                        "Decoder threading {}: {} {} threads, {} frames of added latency{}",
+                                        decoder_threading_name(threadingPolicy),
+                                        decoderThreads.count,
+                                        decoderThreads.type == FF_THREAD_FRAME ? "frame" : "slice",
+                                        decoderThreads.addedFrames(),
+                                        threadsPendingKeyframe ? " until the first keyframe" : "");
+    }
+
+    width = pVideoCodecCtx->width;
+    height = pVideoCodecCtx->height;
+
+    return true;
 }
 
 bool FfmpegDecoder::OpenAudio() {
@@ -694,24 +1058,9 @@ bool FfmpegDecoder::parseNalUnits(const AVPacket *pkt) {
 
     bool containsIdr = false;
 
-    // Fast check for Annex B start codes
-    const uint8_t *p = data;
-    const uint8_t *end = data + size;
-
-    while (p < end) {
-        p = find_start_code(p, end);
-        if (!p) break;
-
-        // Skip start code
-        if (p[2] == 1)
-            p += 3;
-        else
-            p += 4;
-
-        if (p >= end) break;
-
+    const auto checkNalHeader = [&](const uint8_t header) {
         if (codecId == AV_CODEC_ID_H264) {
-            int type = p[0] & 0x1F;
+            int type = header & 0x1F;
             if (type == 7) { // SPS
                 hasSps = true;
             } else if (type == 8) { // PPS
@@ -720,7 +1069,7 @@ bool FfmpegDecoder::parseNalUnits(const AVPacket *pkt) {
                 containsIdr = true;
             }
         } else if (codecId == AV_CODEC_ID_HEVC) {
-            int type = (p[0] >> 1) & 0x3F;
+            int type = (header >> 1) & 0x3F;
             if (type == 33) { // SPS
                 hasSps = true;
             } else if (type == 34) { // PPS
@@ -729,6 +1078,31 @@ bool FfmpegDecoder::parseNalUnits(const AVPacket *pkt) {
                 containsIdr = true;
             }
         }
+    };
+
+    // Once decoding has started no packet is dropped here anymore, so the rest of the bitstream is not scanned.
+    // Only the NAL unit at the packet start is looked at (00 00 01 or 00 00 00 01, then the header).
+    if (!isWaitingForKeyframe) {
+        const uint8_t *p = find_start_code(data, data + std::min(size, 5));
+        if (p && p + 3 < data + size) {
+            checkNalHeader(p[3]);
+        }
+        return true;
+    }
+
+    const uint8_t *p = data;
+    const uint8_t *end = data + size;
+
+    while (p < end) {
+        p = find_start_code(p, end);
+        if (!p) break;
+
+        // Skip start code
+        p += 3;
+
+        if (p >= end) break;
+
+        checkNalHeader(p[0]);
     }
 
     // Keyframe flag from FFmpeg is also a good indicator
@@ -1,13 +1,21 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "../frame_pacer.h"
+#include "../frame_queue.h"
+#include "av_pool.h"
+#include "decoder_threading.h"
 #include "ffmpeg_include.h"
+#include "rtp_depacketizer.h"
 
 class ReadFrameException : public std::runtime_error {
 public:
@@ -55,6 +63,9 @@ public:
         return videoFramerate;
     }
 
+    /// Hardware decoder name, or the software decoder threads and the latency they add. For the HUD.
+    std::string GetDecoderDescription() const;
+
     bool HasAudio() const {
         return hasAudioStream;
     }
@@ -104,9 +115,33 @@ public:
     bool IsZeroCopyEnabled() const { return mZeroCopyEnabled; }
 #endif
 
+    /// Codec parameters of the video stream, for muxing (e.g. MP4 recording).
+    /// Returns false if they are not known yet.
+    bool GetVideoCodecParameters(AVCodecParameters *par, AVRational &timeBase);
+
 private:
+    bool OpenInProcessInput(const std::string &codec);
+
     bool OpenVideo();
 
+    bool OpenVideoCodec(AVCodecID codecId, const AVCodecParameters *par);
+
+    /// Opens the software decoder again with the threads Auto picks for the stream format of `keyframe`.
+    /// Only before the first packet is sent to the decoder.
+    void ApplyAutoThreads(const AVPacket *keyframe);
+
+    /// Copies a frame out of the hardware decoder into buffers from transferPool.
+    bool TransferHwFrame(AVFrame *dst, const AVFrame *src);
+
+    /// Pulls the next access unit out of the in-process RTP ring.
+    int ReadInProcessPacket(std::shared_ptr<AVPacket> &packet);
+
+    /// Stamps a traced access unit on its way into the decoder and keeps its stamps until the frame is out.
+    void TrackDecoderInput(const AVPacket *packet);
+
+    /// Hands the stamps of the access unit on to its frame, see get_latency_stamps().
+    void TrackDecodedFrame(AVFrame *frame);
+
     bool OpenAudio();
 
     void CloseVideo();
@@ -155,6 +190,9 @@ private:
 
     double videoBaseTime = 0;
 
+    /// Of the pts of video frames, also set as their AVFrame::time_base.
+    AVRational videoTimeBase{0, 1};
+
     double audioBaseTime = 0;
 
     std::mutex _releaseLock;
@@ -183,9 +221,32 @@ private:
     std::optional<std::string> hwDecoderName;
     bool forceSwDecoder = false;
     AVPixelFormat hwPixFmt;
+
+    // Software decoder threading, from [settings] decoder_threading/decoder_frame_delay
+    DecoderThreading threadingPolicy = DecoderThreading::Auto;
+    int maxFrameDelay = 2;
+    DecoderThreads decoderThreads;
+    /// Auto opened the codec before the stream format was known.
+    bool threadsPendingKeyframe = false;
+    /// AVCodecContext::flags as OpenVideoCodec() set them, before the threading cleared any.
+    int videoCodecFlags = 0;
+
     AVBufferRef *hwDeviceCtx = nullptr;
     std::atomic<bool> dropCurrentVideoFrame = false;
     std::shared_ptr<AVFrame> hwFrame;
+    /// Buffers for TransferHwFrame(), for the size and format below.
+    std::shared_ptr<AVBufferPool> transferPool;
+    int transferWidth = 0;
+    int transferHeight = 0;
+    AVPixelFormat transferSwFormat = AV_PIX_FMT_NONE;
+    AVPixelFormat transferFormat = AV_PIX_FMT_NONE;
+
+    /// Video frames handed out by GetNextFrame(). Enough for a full FrameQueue, the frames FramePacer holds back,
+    /// the frame on screen, the one whose upload is in flight and the one being decoded, so that it does not grow in
+    /// steady state.
+    AvPool<AVFrame> framePool{FrameQueue::CAPACITY + FramePacer::CAPACITY + 3};
+    /// Packets read from libavformat.
+    AvPool<AVPacket> packetPool{4};
 #ifdef __APPLE__
     bool mZeroCopyEnabled = false;
 #endif
@@ -195,6 +256,15 @@ private:
     std::vector<uint8_t> sdpBuffer;
     SdpReadState sdpReadState{};
 
+    // In-process RTP stream, bypasses libavformat altogether
+    bool inProcessInput = false;
+    std::optional<RtpDepacketizer> rtpDepacketizer;
+
+    /// Latency stamps of the access units inside the decoder, by pts. Reordering and frame threading
+    /// keep a few of them in flight.
+    std::array<std::pair<int64_t, LatencyStamps>, 32> decodingLatency{};
+    size_t decodingLatencyNext = 0;
+
     // NALU State machine for stability
     bool hasSps = false;
     bool hasPps = false;
@@ -204,6 +274,7 @@ private:
 
     /**
      * @brief Parse NAL units in the packet to detect SPS/PPS/IDR
+     * Only the whole packet is scanned while waiting for a keyframe, afterwards just the NAL unit at its start.
      * @return true if the packet should be fed to the decoder, false if it should be dropped.
      */
     bool parseNalUnits(const AVPacket *pkt);
@@ -0,0 +1,116 @@
+#include "frame_staging.h"
+
+#include <utility>
+
+#include "pixel_pack.h"
+
+namespace {
+
+/// High bit depth formats, and the 8-bit ones with the same planes they are narrowed to.
+constexpr std::pair<AVPixelFormat, AVPixelFormat> NARROWED_FORMATS[] = {
+    {AV_PIX_FMT_P010LE, AV_PIX_FMT_NV12},
+    {AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUV420P},
+    {AV_PIX_FMT_YUV444P10LE, AV_PIX_FMT_YUV444P},
+};
+
+/// Narrows the planes of `src` into `dst`, a packed frame of the same size in the upload_format() of `src`.
+void narrow_planes(AVFrame *dst, const AVFrame *src, const AVPixFmtDescriptor *desc) {
+    // The samples of all components sit at the same bits in these formats.
+    const int rightShift = desc->comp[0].shift + desc->comp[0].depth - 8;
+
+    for (int plane = 0; plane < AV_NUM_DATA_POINTERS && src->data[plane]; plane++) {
+        const int rows = plane == 0 ? src->height : AV_CEIL_RSHIFT(src->height, desc->log2_chroma_h);
+        // One byte per sample in the packed 8-bit rows, interleaved chroma included.
+        const int samples = dst->linesize[plane];
+
+        for (int row = 0; row < rows; row++) {
+            const auto *srcRow = reinterpret_cast<const uint16_t *>(src->data[plane] + row * src->linesize[plane]);
+            pack_samples_to_8bit(dst->data[plane] + row * dst->linesize[plane], srcRow, samples, rightShift);
+        }
+    }
+}
+
+} // namespace
+
+AVPixelFormat upload_format(const AVPixelFormat format) {
+    for (const auto &[narrowed, to] : NARROWED_FORMATS) {
+        if (format == narrowed) {
+            return to;
+        }
+    }
+    return format;
+}
+
+bool frame_is_packed(const AVFrame *frame) {
+    const auto format = static_cast<AVPixelFormat>(frame->format);
+    for (int plane = 0; plane < AV_NUM_DATA_POINTERS && frame->data[plane]; plane++) {
+        if (frame->linesize[plane] != av_image_get_linesize(format, frame->width, plane)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<AVFrame> FrameStager::stage(const std::shared_ptr<AVFrame> &frame) {
+    const auto format = static_cast<AVPixelFormat>(frame->format);
+
+    // Frames still in GPU memory go to the renderer as they are (zero-copy path).
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    if (!desc || desc->flags & AV_PIX_FMT_FLAG_HWACCEL) {
+        return frame;
+    }
+
+    const AVPixelFormat outFormat = upload_format(format);
+    const bool narrow = outFormat != format;
+    if (!narrow && frame_is_packed(frame.get())) {
+        return frame;
+    }
+
+    if (!bufferPool_ || frame->width != width_ || frame->height != height_ || outFormat != format_) {
+        const int size = av_image_get_buffer_size(outFormat, frame->width, frame->height, 1);
+        if (size < 0) {
+            return nullptr;
+        }
+        // Buffers still in use are freed when they come back.
+        bufferPool_ = std::shared_ptr<AVBufferPool>(av_buffer_pool_init(size, nullptr),
+                                                    [](AVBufferPool *p) { av_buffer_pool_uninit(&p); });
+        width_ = frame->width;
+        height_ = frame->height;
+        format_ = outFormat;
+    }
+
+    std::shared_ptr<AVFrame> packed = framePool_.acquire();
+    if (!packed || !bufferPool_) {
+        return nullptr;
+    }
+
+    packed->format = outFormat;
+    packed->width = frame->width;
+    packed->height = frame->height;
+    packed->buf[0] = av_buffer_pool_get(bufferPool_.get());
+    if (!packed->buf[0]) {
+        return nullptr;
+    }
+    if (av_image_fill_arrays(packed->data,
+                             packed->linesize,
+                             packed->buf[0]->data,
+                             outFormat,
+                             packed->width,
+                             packed->height,
+                             1) < 0) {
+        return nullptr;
+    }
+
+    if (narrow) {
+        narrow_planes(packed.get(), frame.get(), desc);
+    } else if (av_frame_copy(packed.get(), frame.get()) < 0) {
+        return nullptr;
+    }
+    if (av_frame_copy_props(packed.get(), frame.get()) < 0) {
+        return nullptr;
+    }
+
+    copiedFrames_.fetch_add(1, std::memory_order_relaxed);
+
+    return packed;
+}
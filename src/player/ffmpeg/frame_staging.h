@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "../frame_pacer.h"
+#include "../frame_queue.h"
+#include "av_pool.h"
+#include "ffmpeg_include.h"
+
+/// Format the frames of `format` have after FrameStager::stage(), the one the renderer is set up for.
+/// 10-bit formats (P010, yuv420p10le, yuv444p10le) become their 8-bit counterparts, others stay.
+AVPixelFormat upload_format(AVPixelFormat format);
+
+/// Whether every plane of a frame in system memory has rows without padding, the way the renderer uploads them.
+bool frame_is_packed(const AVFrame *frame);
+
+/// Gets decoded frames ready for upload on the decode thread, so that the GUI thread only hands them to the GPU.
+///
+/// Frames with padded rows (linesize above the row size, e.g. decoder output for widths that are not a multiple
+/// of its alignment) are copied into packed frames whose buffers come from a pool. 10-bit frames are narrowed to
+/// 8 bits on the way, see pack_samples_to_8bit(). Packed 8-bit frames and frames still in GPU memory pass through
+/// as they are.
+/// stage() is only called from the decode thread.
+class FrameStager {
+public:
+    /// `frame`, or a packed copy of it. nullptr if the copy fails.
+    std::shared_ptr<AVFrame> stage(const std::shared_ptr<AVFrame> &frame);
+
+    /// Frames that had to be copied or narrowed.
+    uint64_t copiedFrames() const {
+        return copiedFrames_.load(std::memory_order_relaxed);
+    }
+
+private:
+    /// Same count as FfmpegDecoder::framePool, with the frame being staged in place of the one being decoded.
+    AvPool<AVFrame> framePool_{FrameQueue::CAPACITY + FramePacer::CAPACITY + 3};
+
+    /// Buffers for the size and format below.
+    std::shared_ptr<AVBufferPool> bufferPool_;
+    int width_ = 0;
+    int height_ = 0;
+    AVPixelFormat format_ = AV_PIX_FMT_NONE;
+
+    std::atomic<uint64_t> copiedFrames_ = 0;
+};
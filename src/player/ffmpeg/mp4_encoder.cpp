@@ -15,21 +15,25 @@ Mp4Encoder::~Mp4Encoder() {
 }
 
 void Mp4Encoder::addTrack(AVStream *stream) {
+    addTrack(stream->codecpar, stream->time_base);
+}
+
+void Mp4Encoder::addTrack(const AVCodecParameters *par, AVRational timeBase) {
     AVStream *os = avformat_new_stream(formatCtx_.get(), nullptr);
     if (!os) {
         return;
     }
-    int ret = avcodec_parameters_copy(os->codecpar, stream->codecpar);
+    int ret = avcodec_parameters_copy(os->codecpar, par);
     if (ret < 0) {
         return;
     }
     os->codecpar->codec_tag = 0;
-    if (stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+    if (par->codec_type == AVMEDIA_TYPE_AUDIO) {
         audioIndex = os->index;
-        originAudioTimeBase_ = stream->time_base;
-    } else if (stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+        originAudioTimeBase_ = timeBase;
+    } else if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
         videoIndex = os->index;
-        originVideoTimeBase_ = stream->time_base;
+        originVideoTimeBase_ = timeBase;
     }
 }
 
@@ -16,6 +16,8 @@ public:
 
     void addTrack(AVStream *stream);
 
+    void addTrack(const AVCodecParameters *par, AVRational timeBase);
+
     void writePacket(const std::shared_ptr<AVPacket> &pkt, bool isVideo);
 
     int videoIndex = -1;
@@ -0,0 +1,170 @@
+#include "pixel_pack.h"
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define PIXEL_PACK_SSE2
+    #include <emmintrin.h>
+    #if defined(__GNUC__) || defined(__clang__)
+        // Built with its own target attribute, used only if the CPU has it.
+        #define PIXEL_PACK_AVX2
+        #include <immintrin.h>
+    #endif
+#endif
+
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+    #define PIXEL_PACK_NEON
+    #include <arm_neon.h>
+#endif
+
+namespace {
+
+using PackFn = void (*)(uint8_t *, const uint16_t *, size_t, int);
+
+// All of them shift by one bit less than asked and round with a halving add, (x + 1) >> 1, which cannot overflow
+// 16 bits the way adding half of the divisor to a full-range sample can. Full-range samples round up to 256 and
+// saturate to 255.
+
+void pack_scalar(uint8_t *dst, const uint16_t *src, const size_t count, const int rightShift) {
+    for (size_t i = 0; i < count; i++) {
+        const int halved = src[i] >> (rightShift - 1);
+        dst[i] = static_cast<uint8_t>(std::min((halved + 1) >> 1, 255));
+    }
+}
+
+#ifdef PIXEL_PACK_SSE2
+void pack_sse2(uint8_t *dst, const uint16_t *src, const size_t count, const int rightShift) {
+    const __m128i shift = _mm_cvtsi32_si128(rightShift - 1);
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 8));
+
+        const __m128i roundedA = _mm_avg_epu16(_mm_srl_epi16(a, shift), zero);
+        const __m128i roundedB = _mm_avg_epu16(_mm_srl_epi16(b, shift), zero);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(roundedA, roundedB));
+    }
+    pack_scalar(dst + i, src + i, count - i, rightShift);
+}
+#endif
+
+#ifdef PIXEL_PACK_AVX2
+__attribute__((target("avx2"))) void pack_avx2(uint8_t *dst,
+                                               const uint16_t *src,
+                                               const size_t count,
+                                               const int rightShift) {
+    const __m128i shift = _mm_cvtsi32_si128(rightShift - 1);
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 16));
+
+        const __m256i roundedA = _mm256_avg_epu16(_mm256_srl_epi16(a, shift), zero);
+        const __m256i roundedB = _mm256_avg_epu16(_mm256_srl_epi16(b, shift), zero);
+
+        // Packing works within each 128-bit lane, the permute puts the quarters back in order.
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(roundedA, roundedB), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+    }
+    pack_scalar(dst + i, src + i, count - i, rightShift);
+}
+#endif
+
+#ifdef PIXEL_PACK_NEON
+void pack_neon(uint8_t *dst, const uint16_t *src, const size_t count, const int rightShift) {
+    const int16x8_t shift = vdupq_n_s16(static_cast<int16_t>(1 - rightShift));
+    const uint16x8_t zero = vdupq_n_u16(0);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const uint16x8_t a = vld1q_u16(src + i);
+        const uint16x8_t b = vld1q_u16(src + i + 8);
+
+        const uint16x8_t roundedA = vrhaddq_u16(vshlq_u16(a, shift), zero);
+        const uint16x8_t roundedB = vrhaddq_u16(vshlq_u16(b, shift), zero);
+
+        vst1q_u8(dst + i, vcombine_u8(vqmovn_u16(roundedA), vqmovn_u16(roundedB)));
+    }
+    pack_scalar(dst + i, src + i, count - i, rightShift);
+}
+#endif
+
+PackFn packer_fn(const PixelPacker packer) {
+    switch (packer) {
+        case PixelPacker::Scalar:
+            return pack_scalar;
+#ifdef PIXEL_PACK_SSE2
+        case PixelPacker::Sse2:
+            return pack_sse2;
+#endif
+#ifdef PIXEL_PACK_AVX2
+        case PixelPacker::Avx2:
+            // May run before the constructors of libgcc.
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? pack_avx2 : nullptr;
+#endif
+#ifdef PIXEL_PACK_NEON
+        case PixelPacker::Neon:
+            return pack_neon;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+PixelPacker best_packer() {
+    for (int i = static_cast<int>(PixelPacker::Count) - 1; i > 0; i--) {
+        if (pixel_packer_supported(static_cast<PixelPacker>(i))) {
+            return static_cast<PixelPacker>(i);
+        }
+    }
+    return PixelPacker::Scalar;
+}
+
+std::atomic<PixelPacker> selected{best_packer()};
+std::atomic<PackFn> selected_fn{packer_fn(selected.load())};
+
+} // namespace
+
+void pack_samples_to_8bit(uint8_t *dst, const uint16_t *src, const size_t count, const int rightShift) {
+    selected_fn.load(std::memory_order_relaxed)(dst, src, count, rightShift);
+}
+
+const char *pixel_packer_name(const PixelPacker packer) {
+    switch (packer) {
+        case PixelPacker::Scalar:
+            return "scalar";
+        case PixelPacker::Sse2:
+            return "SSE2";
+        case PixelPacker::Avx2:
+            return "AVX2";
+        case PixelPacker::Neon:
+            return "NEON";
+        default:
+            return "unknown";
+    }
+}
+
+bool pixel_packer_supported(const PixelPacker packer) {
+    return packer_fn(packer) != nullptr;
+}
+
+PixelPacker selected_pixel_packer() {
+    return selected.load();
+}
+
+bool select_pixel_packer(const PixelPacker packer) {
+    const PackFn fn = packer_fn(packer);
+    if (!fn) {
+        return false;
+    }
+    selected_fn = fn;
+    selected = packer;
+    return true;
+}
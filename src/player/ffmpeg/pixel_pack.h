@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// Ways of narrowing high bit depth samples to 8 bits, fastest last. Which ones exist depends on the CPU.
+enum class PixelPacker {
+    Scalar,
+    Sse2,
+    Avx2,
+    Neon,
+    Count,
+};
+
+/// Narrows `count` 16-bit samples to 8 bits: each is shifted right by `rightShift` (1 to 8), rounding to nearest.
+/// P010 (10 bits in the high bits) takes a shift of 8, yuv420p10le (10 bits in the low bits) one of 2.
+///
+/// Runs on the packer picked by select_pixel_packer(), by default the fastest one the CPU supports.
+void pack_samples_to_8bit(uint8_t *dst, const uint16_t *src, size_t count, int rightShift);
+
+const char *pixel_packer_name(PixelPacker packer);
+
+bool pixel_packer_supported(PixelPacker packer);
+
+PixelPacker selected_pixel_packer();
+
+/// Returns false (and keeps the current one) if the packer is not supported.
+bool select_pixel_packer(PixelPacker packer);
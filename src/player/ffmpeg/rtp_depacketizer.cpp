@@ -0,0 +1,336 @@
+#include "rtp_depacketizer.h"
+
+#include <cstring>
+
+#include "../latency_trace.h"
+#include "src/wifi/rtp.h"
+
+namespace {
+constexpr uint8_t ANNEXB_START_CODE[] = {0, 0, 0, 1};
+
+constexpr size_t RTP_FIXED_HEADER_SIZE = 12;
+
+/// Packets older than this are taken as a sender restart rather than late arrivals.
+constexpr int MAX_REORDER_DISTANCE = 1000;
+
+// H.264 (RFC 6184)
+constexpr int H264_NAL_STAP_A = 24;
+constexpr int H264_NAL_FU_A = 28;
+
+// H.265 (RFC 7798)
+constexpr int H265_NAL_AP = 48;
+constexpr int H265_NAL_FU = 49;
+
+constexpr uint8_t FU_START_BIT = 0x80;
+constexpr uint8_t FU_END_BIT = 0x40;
+
+uint16_t read_u16(const uint8_t *p) {
+    return static_cast<uint16_t>(p[0] << 8 | p[1]);
+}
+} // namespace
+
+void RtpDepacketizer::reset() {
+    lastSeq_.reset();
+    fragment_.clear();
+    fragmentInProgress_ = false;
+
+    accessUnit_.clear();
+    accessUnitIsKey_ = false;
+    accessUnitIsCorrupt_ = false;
+    accessUnitLatency_ = {};
+
+    lastStamp_.reset();
+    extendedStamp_ = 0;
+
+    readyPackets_ = {};
+
+    std::lock_guard lock(parameterSetsMutex_);
+    vps_.clear();
+    sps_.clear();
+    pps_.clear();
+}
+
+std::shared_ptr<AVPacket> RtpDepacketizer::pop() {
+    if (readyPackets_.empty()) {
+        return nullptr;
+    }
+    auto packet = readyPackets_.front();
+    readyPackets_.pop();
+    return packet;
+}
+
+std::vector<uint8_t> RtpDepacketizer::parameterSets() const {
+    std::lock_guard lock(parameterSetsMutex_);
+
+    std::vector<uint8_t> out;
+    out.insert(out.end(), vps_.begin(), vps_.end());
+    out.insert(out.end(), sps_.begin(), sps_.end());
+    out.insert(out.end(), pps_.begin(), pps_.end());
+    return out;
+}
+
+void RtpDepacketizer::appendNalUnit(const uint8_t *nal, size_t size) {
+    std::vector<uint8_t> *parameterSet = nullptr;
+
+    if (codecId_ == AV_CODEC_ID_H264) {
+        const int nalType = nal[0] & 0x1F;
+        if (nalType == 5) { // IDR
+            accessUnitIsKey_ = true;
+        } else if (nalType == 7) {
+            parameterSet = &sps_;
+        } else if (nalType == 8) {
+            parameterSet = &pps_;
+        }
+    } else {
+        const int nalType = (nal[0] >> 1) & 0x3F;
+        if (nalType >= 16 && nalType <= 21) { // IRAP (IDR/CRA/BLA)
+            accessUnitIsKey_ = true;
+        } else if (nalType == 32) {
+            parameterSet = &vps_;
+        } else if (nalType == 33) {
+            parameterSet = &sps_;
+        } else if (nalType == 34) {
+            parameterSet = &pps_;
+        }
+    }
+
+    if (parameterSet) {
+        std::lock_guard lock(parameterSetsMutex_);
+        parameterSet->assign(std::begin(ANNEXB_START_CODE), std::end(ANNEXB_START_CODE));
+        parameterSet->insert(parameterSet->end(), nal, nal + size);
+    }
+
+    accessUnit_.insert(accessUnit_.end(), std::begin(ANNEXB_START_CODE), std::end(ANNEXB_START_CODE));
+    accessUnit_.insert(accessUnit_.end(), nal, nal + size);
+}
+
+bool RtpDepacketizer::allocPacketData(AVPacket *packet, const size_t size) {
+    if (size + AV_INPUT_BUFFER_PADDING_SIZE > dataPoolSize_) {
+        // Headroom for keyframes a bit larger than this one. Buffers still in use are freed when they come back.
+        dataPoolSize_ = size + size / 2 + AV_INPUT_BUFFER_PADDING_SIZE;
+        dataPool_ = std::shared_ptr<AVBufferPool>(av_buffer_pool_init(dataPoolSize_, nullptr),
+                                                  [](AVBufferPool *p) { av_buffer_pool_uninit(&p); });
+    }
+
+    packet->buf = dataPool_ ? av_buffer_pool_get(dataPool_.get()) : nullptr;
+    if (!packet->buf) {
+        dataPoolSize_ = 0;
+        return false;
+    }
+    packet->data = packet->buf->data;
+    packet->size = static_cast<int>(size);
+    memset(packet->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    return true;
+}
+
+void RtpDepacketizer::finishAccessUnit() {
+    if (!accessUnit_.empty()) {
+        std::shared_ptr<AVPacket> packet = packetPool_.acquire();
+        if (packet && allocPacketData(packet.get(), accessUnit_.size())) {
+            memcpy(packet->data, accessUnit_.data(), accessUnit_.size());
+            packet->pts = extendedStamp_;
+            packet->dts = extendedStamp_;
+            if (accessUnitIsKey_) {
+                packet->flags |= AV_PKT_FLAG_KEY;
+            }
+            if (accessUnitIsCorrupt_) {
+                packet->flags |= AV_PKT_FLAG_CORRUPT;
+            }
+            if (accessUnitLatency_.is_traced()) {
+                accessUnitLatency_.mark(LatencyStage::Depacketized);
+                set_latency_stamps(packet->opaque_ref, accessUnitLatency_);
+            }
+            readyPackets_.push(std::move(packet));
+        }
+    }
+
+    accessUnit_.clear();
+    accessUnitIsKey_ = false;
+    accessUnitIsCorrupt_ = false;
+    accessUnitLatency_ = {};
+}
+
+bool RtpDepacketizer::push(const uint8_t *rtp, size_t size, const LatencyStamps &stamps) {
+    if (size <= RTP_FIXED_HEADER_SIZE) {
+        return false;
+    }
+
+    const auto *header = reinterpret_cast<const RtpHeader *>(rtp);
+    if (header->version != 2) {
+        return false;
+    }
+
+    const ssize_t payloadSize = header->getPayloadSize(size);
+    if (payloadSize <= 0) {
+        return false;
+    }
+    const uint8_t *payload = rtp + RTP_FIXED_HEADER_SIZE + header->getPayloadOffset();
+
+    const uint16_t seq = ntohs(header->seq);
+    bool packetsLost = false;
+    if (lastSeq_.has_value()) {
+        const auto delta = static_cast<int16_t>(seq - lastSeq_.value());
+        // Duplicate or late packet, its data has either been used already or is useless by now.
+        if (delta <= 0 && delta > -MAX_REORDER_DISTANCE) {
+            return false;
+        }
+        // A gap (or a restarted sender) breaks any NAL unit that is being reassembled.
+        if (delta != 1) {
+            // The rest of that NAL unit is missing from the access unit being assembled.
+            if (fragmentInProgress_) {
+                accessUnitIsCorrupt_ = true;
+            }
+            fragment_.clear();
+            fragmentInProgress_ = false;
+            packetsLost = true;
+        }
+    }
+    lastSeq_ = seq;
+
+    const uint32_t stamp = ntohl(header->stamp);
+
+    // The packet carrying the marker bit was lost, a new timestamp is the only hint the access unit is over.
+    if (!accessUnit_.empty() && stamp != accessUnitStamp_) {
+        finishAccessUnit();
+    }
+
+    // Otherwise the lost packets are charged to the access unit of this one, which is only known now, so that a loss
+    // at an access unit boundary does not spoil the access unit before it.
+    if (packetsLost) {
+        accessUnitIsCorrupt_ = true;
+    }
+
+    if (lastStamp_.has_value()) {
+        extendedStamp_ += static_cast<int32_t>(stamp - lastStamp_.value());
+    }
+    lastStamp_ = stamp;
+
+    if (accessUnit_.empty()) {
+        accessUnitStamp_ = stamp;
+        accessUnitLatency_ = stamps;
+    } else if (stamps.is_traced()) {
+        // The access unit is only through the link once its last packet is.
+        accessUnitLatency_[LatencyStage::Decrypted] = stamps[LatencyStage::Decrypted];
+        accessUnitLatency_[LatencyStage::FecReleased] = stamps[LatencyStage::FecReleased];
+    }
+
+    bool accepted = false;
+    if (codecId_ == AV_CODEC_ID_H264) {
+        accepted = depacketizeH264(payload, payloadSize);
+    } else if (codecId_ == AV_CODEC_ID_HEVC) {
+        accepted = depacketizeH265(payload, payloadSize);
+    }
+
+    if (header->mark) {
+        finishAccessUnit();
+    }
+
+    return accepted;
+}
+
+bool RtpDepacketizer::depacketizeH264(const uint8_t *payload, size_t size) {
+    const int nalType = payload[0] & 0x1F;
+
+    if (nalType >= 1 && nalType < H264_NAL_STAP_A) {
+        appendNalUnit(payload, size);
+        return true;
+    }
+
+    if (nalType == H264_NAL_STAP_A) {
+        size_t offset = 1;
+        while (offset + 2 <= size) {
+            const uint16_t nalSize = read_u16(payload + offset);
+            offset += 2;
+            if (nalSize == 0 || offset + nalSize > size) {
+                return false;
+            }
+            appendNalUnit(payload + offset, nalSize);
+            offset += nalSize;
+        }
+        return true;
+    }
+
+    if (nalType == H264_NAL_FU_A) {
+        if (size < 3) {
+            return false;
+        }
+
+        const uint8_t fuHeader = payload[1];
+
+        if (fuHeader & FU_START_BIT) {
+            fragment_.clear();
+            fragment_.push_back((payload[0] & 0xE0) | (fuHeader & 0x1F));
+            fragmentInProgress_ = true;
+        } else if (!fragmentInProgress_) {
+            return false;
+        }
+
+        fragment_.insert(fragment_.end(), payload + 2, payload + size);
+
+        if (fuHeader & FU_END_BIT) {
+            appendNalUnit(fragment_.data(), fragment_.size());
+            fragment_.clear();
+            fragmentInProgress_ = false;
+        }
+        return true;
+    }
+
+    // STAP-B, MTAP and FU-B are not used by OpenIPC cameras.
+    return false;
+}
+
+bool RtpDepacketizer::depacketizeH265(const uint8_t *payload, size_t size) {
+    if (size < 2) {
+        return false;
+    }
+
+    const int nalType = (payload[0] >> 1) & 0x3F;
+
+    if (nalType < H265_NAL_AP) {
+        appendNalUnit(payload, size);
+        return true;
+    }
+
+    if (nalType == H265_NAL_AP) {
+        size_t offset = 2;
+        while (offset + 2 <= size) {
+            const uint16_t nalSize = read_u16(payload + offset);
+            offset += 2;
+            if (nalSize == 0 || offset + nalSize > size) {
+                return false;
+            }
+            appendNalUnit(payload + offset, nalSize);
+            offset += nalSize;
+        }
+        return true;
+    }
+
+    if (nalType == H265_NAL_FU) {
+        if (size < 4) {
+            return false;
+        }
+
+        const uint8_t fuHeader = payload[2];
+
+        if (fuHeader & FU_START_BIT) {
+            fragment_.clear();
+            fragment_.push_back((payload[0] & 0x81) | ((fuHeader & 0x3F) << 1));
+            fragment_.push_back(payload[1]);
+            fragmentInProgress_ = true;
+        } else if (!fragmentInProgress_) {
+            return false;
+        }
+
+        fragment_.insert(fragment_.end(), payload + 3, payload + size);
+
+        if (fuHeader & FU_END_BIT) {
+            appendNalUnit(fragment_.data(), fragment_.size());
+            fragment_.clear();
+            fragmentInProgress_ = false;
+        }
+        return true;
+    }
+
+    // PACI packets are not used by OpenIPC cameras.
+    return false;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <vector>
+
+#include "../../wifi/latency_stamps.h"
+#include "av_pool.h"
+#include "ffmpeg_include.h"
+
+/// Turns H.264 (RFC 6184) / H.265 (RFC 7798) RTP packets back into Annex-B access units,
+/// ready to be passed to avcodec_send_packet() without going through libavformat.
+///
+/// Handles single NAL unit packets, STAP-A/AP aggregation packets and FU-A/FU fragmentation units.
+/// Duplicated and late packets (e.g. the same RTP packet recovered by two adapters) are dropped,
+/// and a fragmented NAL unit that lost a piece is discarded as a whole.
+class RtpDepacketizer {
+public:
+    /// All timestamps are in RTP clock units.
+    static constexpr AVRational TIME_BASE = {1, 90000};
+
+    explicit RtpDepacketizer(AVCodecID codecId) : codecId_(codecId) {}
+
+    /// Feeds one RTP packet. Returns false if the packet was dropped (malformed, duplicated or out of order).
+    ///
+    /// An access unit is complete when the RTP marker bit is seen, or when a packet with a newer
+    /// timestamp shows up (i.e. the marked packet was lost). Completed access units are queued for pop().
+    /// The `stamps` of its packets are merged into those of the access unit.
+    bool push(const uint8_t *rtp, size_t size, const LatencyStamps &stamps = {});
+
+    /// Returns the oldest completed access unit, or nullptr if there is none.
+    /// Traced ones carry their LatencyStamps in opaque_ref, see get_latency_stamps().
+    std::shared_ptr<AVPacket> pop();
+
+    /// Latest VPS/SPS/PPS seen in the stream, in Annex-B format. Usable as codec extradata.
+    /// Unlike the rest of the class, safe to call from another thread.
+    std::vector<uint8_t> parameterSets() const;
+
+    void reset();
+
+private:
+    bool depacketizeH264(const uint8_t *payload, size_t size);
+
+    bool depacketizeH265(const uint8_t *payload, size_t size);
+
+    void appendNalUnit(const uint8_t *nal, size_t size);
+
+    /// Points `packet` at a buffer from dataPool_ with room for `size` bytes and the padding.
+    bool allocPacketData(AVPacket *packet, size_t size);
+
+    void finishAccessUnit();
+
+    AVCodecID codecId_;
+
+    std::optional<uint16_t> lastSeq_;
+
+    /// NAL unit being reassembled from fragmentation units.
+    std::vector<uint8_t> fragment_;
+    bool fragmentInProgress_ = false;
+
+    /// Access unit being assembled.
+    std::vector<uint8_t> accessUnit_;
+    uint32_t accessUnitStamp_ = 0;
+    bool accessUnitIsKey_ = false;
+    bool accessUnitIsCorrupt_ = false;
+    LatencyStamps accessUnitLatency_;
+
+    /// RTP timestamps extended to 64 bits, so they do not wrap around.
+    std::optional<uint32_t> lastStamp_;
+    int64_t extendedStamp_ = 0;
+
+    std::queue<std::shared_ptr<AVPacket>> readyPackets_;
+
+    /// The packets and data of the access units, recycled once the decoder is done with them.
+    AvPool<AVPacket> packetPool_{4};
+    std::shared_ptr<AVBufferPool> dataPool_;
+    /// Size of the buffers in dataPool_, padding included. Grows with the largest access unit.
+    size_t dataPoolSize_ = 0;
+
+    mutable std::mutex parameterSetsMutex_;
+    std::vector<uint8_t> vps_;
+    std::vector<uint8_t> sps_;
+    std::vector<uint8_t> pps_;
+};
@@ -0,0 +1,180 @@
+#include "start_code.h"
+
+#include <atomic>
+#include <bit>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define START_CODE_SSE2
+    #include <emmintrin.h>
+    #if defined(__GNUC__) || defined(__clang__)
+        // Built with its own target attribute, used only if the CPU has it.
+        #define START_CODE_AVX2
+        #include <immintrin.h>
+    #endif
+#endif
+
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+    #define START_CODE_NEON
+    #include <arm_neon.h>
+#endif
+
+namespace {
+
+using FindFn = const uint8_t *(*)(const uint8_t *, const uint8_t *);
+
+const uint8_t *find_scalar(const uint8_t *p, const uint8_t *end) {
+    while (end - p >= 3) {
+        // A byte above 1 cannot be part of a start code, so no start code begins at any of the three positions.
+        if (p[2] > 1) {
+            p += 3;
+        } else if (p[2] == 1 && p[1] == 0 && p[0] == 0) {
+            return p;
+        } else {
+            p++;
+        }
+    }
+    return nullptr;
+}
+
+// The vector scanners compare the block at p and the same block shifted by one and two bytes,
+// so a start code straddling two blocks is still found. Whatever is left is done by find_scalar().
+
+#ifdef START_CODE_SSE2
+const uint8_t *find_sse2(const uint8_t *p, const uint8_t *end) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+
+    while (end - p >= 16 + 2) {
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+        const __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 2));
+
+        const __m128i hits =
+            _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)), _mm_cmpeq_epi8(b2, one));
+        const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(hits));
+        if (mask) {
+            return p + std::countr_zero(mask);
+        }
+        p += 16;
+    }
+    return find_scalar(p, end);
+}
+#endif
+
+#ifdef START_CODE_AVX2
+__attribute__((target("avx2"))) const uint8_t *find_avx2(const uint8_t *p, const uint8_t *end) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+
+    while (end - p >= 32 + 2) {
+        const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1));
+        const __m256i b2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 2));
+
+        const __m256i hits = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero), _mm256_cmpeq_epi8(b1, zero)),
+                                              _mm256_cmpeq_epi8(b2, one));
+        const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+        if (mask) {
+            return p + std::countr_zero(mask);
+        }
+        p += 32;
+    }
+    return find_scalar(p, end);
+}
+#endif
+
+#ifdef START_CODE_NEON
+const uint8_t *find_neon(const uint8_t *p, const uint8_t *end) {
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t one = vdupq_n_u8(1);
+
+    while (end - p >= 16 + 2) {
+        const uint8x16_t b0 = vld1q_u8(p);
+        const uint8x16_t b1 = vld1q_u8(p + 1);
+        const uint8x16_t b2 = vld1q_u8(p + 2);
+
+        const uint8x16_t hits = vandq_u8(vandq_u8(vceqq_u8(b0, zero), vceqq_u8(b1, zero)), vceqq_u8(b2, one));
+        // NEON has no movemask, narrowing by 4 bits leaves one nibble per byte.
+        const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0);
+        if (mask) {
+            return p + std::countr_zero(mask) / 4;
+        }
+        p += 16;
+    }
+    return find_scalar(p, end);
+}
+#endif
+
+FindFn scanner_fn(const StartCodeScanner scanner) {
+    switch (scanner) {
+        case StartCodeScanner::Scalar:
+            return find_scalar;
+#ifdef START_CODE_SSE2
+        case StartCodeScanner::Sse2:
+            return find_sse2;
+#endif
+#ifdef START_CODE_AVX2
+        case StartCodeScanner::Avx2:
+            // May run before the constructors of libgcc.
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? find_avx2 : nullptr;
+#endif
+#ifdef START_CODE_NEON
+        case StartCodeScanner::Neon:
+            return find_neon;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+StartCodeScanner best_scanner() {
+    for (int i = static_cast<int>(StartCodeScanner::Count) - 1; i > 0; i--) {
+        if (start_code_scanner_supported(static_cast<StartCodeScanner>(i))) {
+            return static_cast<StartCodeScanner>(i);
+        }
+    }
+    return StartCodeScanner::Scalar;
+}
+
+std::atomic<StartCodeScanner> selected{best_scanner()};
+std::atomic<FindFn> selected_fn{scanner_fn(selected.load())};
+
+} // namespace
+
+const uint8_t *find_start_code(const uint8_t *p, const uint8_t *end) {
+    return selected_fn.load(std::memory_order_relaxed)(p, end);
+}
+
+const char *start_code_scanner_name(const StartCodeScanner scanner) {
+    switch (scanner) {
+        case StartCodeScanner::Scalar:
+            return "scalar";
+        case StartCodeScanner::Sse2:
+            return "SSE2";
+        case StartCodeScanner::Avx2:
+            return "AVX2";
+        case StartCodeScanner::Neon:
+            return "NEON";
+        default:
+            return "unknown";
+    }
+}
+
+bool start_code_scanner_supported(const StartCodeScanner scanner) {
+    return scanner_fn(scanner) != nullptr;
+}
+
+StartCodeScanner selected_start_code_scanner() {
+    return selected.load();
+}
+
+bool select_start_code_scanner(const StartCodeScanner scanner) {
+    const FindFn fn = scanner_fn(scanner);
+    if (!fn) {
+        return false;
+    }
+    selected_fn = fn;
+    selected = scanner;
+    return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+/// Ways of looking for Annex B start codes, fastest last. Which ones exist depends on the CPU.
+enum class StartCodeScanner {
+    Scalar,
+    Sse2,
+    Avx2,
+    Neon,
+    Count,
+};
+
+/// First 00 00 01 in [p, end), or nullptr if there is none. The NAL unit header follows it.
+/// A four-byte start code (00 00 00 01) is found as its last three bytes.
+///
+/// Runs on the scanner picked by select_start_code_scanner(), by default the fastest one the CPU supports.
+const uint8_t *find_start_code(const uint8_t *p, const uint8_t *end);
+
+const char *start_code_scanner_name(StartCodeScanner scanner);
+
+bool start_code_scanner_supported(StartCodeScanner scanner);
+
+StartCodeScanner selected_start_code_scanner();
+
+/// Returns false (and keeps the current one) if the scanner is not supported.
+bool select_start_code_scanner(StartCodeScanner scanner);
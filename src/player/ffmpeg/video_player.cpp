@@ -14,7 +14,9 @@
 
 VideoPlayerFfmpeg::VideoPlayerFfmpeg(const std::shared_ptr<Pathfinder::Device> &device,
                                      const std::shared_ptr<Pathfinder::Queue> &queue)
-    : VideoPlayer(device, queue) {
+    : VideoPlayer(device, queue),
+      videoFrameQueue(GuiInterface::Instance().frame_queue_stats_),
+      framePacer_(GuiInterface::Instance().present_stats_) {
     if (!SDL_InitSubSystem(SDL_INIT_AUDIO)) {
         GuiInterface::Instance().PutLog(LogLevel::Warn, "SDL init audio failed!");
     }
@@ -78,26 +80,35 @@ void VideoPlayerFfmpeg::update(float dt) {
         }
     }
 #endif
+
+    uploadedLatency_ = get_latency_stamps(frame->opaque_ref);
+    uploadedLatency_.mark(LatencyStage::Uploaded);
+    GuiInterface::Instance().link_metrics_.record_latency(uploadedLatency_, LatencyStage::Uploaded);
 }
 
 void VideoPlayerFfmpeg::render(std::shared_ptr<Pathfinder::Texture> target) {
     yuvRenderer_->render(target);
+
+    // The swap chain adds its own queueing (vsync) after this, which is not measured.
+    if (uploadedLatency_.is_traced()) {
+        uploadedLatency_.mark(LatencyStage::Presented);
+        GuiInterface::Instance().link_metrics_.record_latency(uploadedLatency_, LatencyStage::Presented);
+        if (!GuiInterface::Instance().latency_trace_path_.empty()) {
+            latencyTrace_.add(uploadedLatency_);
+        }
+        uploadedLatency_ = {};
+    }
 }
 
 std::shared_ptr<AVFrame> VideoPlayerFfmpeg::getFrame() {
-    std::lock_guard lck(mtx);
-
-    // No frame in the queue
-    if (videoFrameQueue.empty()) {
+    std::shared_ptr<AVFrame> frame = framePacer_.next(videoFrameQueue);
+    if (!frame) {
         return nullptr;
     }
 
-    // Get a frame from the queue
-    std::shared_ptr<AVFrame> frame = videoFrameQueue.front();
-
-    // Remove the frame from the queue.
-    videoFrameQueue.pop();
+    GuiInterface::Instance().link_metrics_.present_delay_us.record(framePacer_.lastWait() / 1000);
 
+    // Drops the previous frame, which goes back to the pool of the decoder.
     lastFrame_ = frame;
 
     return frame;
@@ -109,6 +120,19 @@ void VideoPlayerFfmpeg::play(const std::string &playUrl, bool forceSoftwareDecod
     should_stop_playing_ = false;
     has_emitted_ready_ = false;
     url = playUrl;
+    uploadedLatency_ = {};
+    latencyTrace_.clear();
+
+    // The pacer does the dropping in paced mode, it needs every frame.
+    framePacer_.reset();
+    framePacer_.setMode(parse_present_mode(GuiInterface::Instance().present_mode_));
+    videoFrameQueue.setMode(framePacer_.mode() == PresentMode::Paced
+                                ? FrameQueueMode::Fifo
+                                : parse_frame_queue_mode(GuiInterface::Instance().frame_queue_mode_));
+    GuiInterface::Instance().PutLog(LogLevel::Info,
+                                    "Frame queue: {}, presentation: {}",
+                                    frame_queue_mode_name(videoFrameQueue.mode()),
+                                    present_mode_name(framePacer_.mode()));
 
     decoder = std::make_shared<FfmpegDecoder>();
 
@@ -130,9 +154,6 @@ void VideoPlayerFfmpeg::play(const std::string &playUrl, bool forceSoftwareDecod
             return;
         }
 
-        current_decoder_name =
-            localDecoder->hwDecoderName.has_value() ? localDecoder->hwDecoderName.value() : "Software";
-
         if (!isMuted && localDecoder->HasAudio()) {
             enableAudio();
         }
@@ -147,10 +168,13 @@ void VideoPlayerFfmpeg::play(const std::string &playUrl, bool forceSoftwareDecod
             if (w > 0 && h > 0) {
                 // If resolution changed, re-emit ready signal to update UI labels
                 if (!has_emitted_ready_ || w != video_width() || h != video_height()) {
-                    GuiInterface::Instance().EmitDecoderReady(w, h, decoder->GetFramerate(), current_decoder_name);
+                    GuiInterface::Instance().EmitDecoderReady(w,
+                                                              h,
+                                                              decoder->GetFramerate(),
+                                                              decoder->GetDecoderDescription());
                     has_emitted_ready_ = true;
                 }
-                update_video_info(w, h, fmt);
+                update_video_info(w, h, upload_format(fmt));
             }
         };
 
@@ -186,17 +210,21 @@ void VideoPlayerFfmpeg::play(const std::string &playUrl, bool forceSoftwareDecod
                         GuiInterface::Instance().EmitDecoderReady(frame->width,
                                                                   frame->height,
                                                                   localDecoder->GetFramerate(),
-                                                                  current_decoder_name);
-                        update_video_info(frame->width, frame->height, localDecoder->GetVideoFrameFormat());
+                                                                  localDecoder->GetDecoderDescription());
+                        update_video_info(frame->width,
+                                          frame->height,
+                                          upload_format(localDecoder->GetVideoFrameFormat()));
                         has_emitted_ready_ = true;
                     }
 
-                    // Push frame to the buffer queue.
-                    std::lock_guard lck(mtx);
-                    if (videoFrameQueue.size() > 1) {
-                        videoFrameQueue.pop();
+                    // Rows are packed here rather than on the GUI thread.
+                    frame = frameStager_.stage(frame);
+                    if (!frame) {
+                        GuiInterface::Instance().PutLog(LogLevel::Warn, "Staging a frame for upload failed");
+                        continue;
                     }
-                    videoFrameQueue.push(frame);
+
+                    videoFrameQueue.push(std::move(frame));
                 }
                 // Decoder error.
                 catch (const SendPacketException &e) {
@@ -257,6 +285,8 @@ void VideoPlayerFfmpeg::stop() {
     if (decoder) {
         decoder->abortRequest = true;
     }
+    // In case the decoder is waiting for in-process RTP packets.
+    GuiInterface::Instance().rtp_ring_.wake();
 
     if (analysisThread.joinable()) {
         analysisThread.join();
@@ -265,10 +295,8 @@ void VideoPlayerFfmpeg::stop() {
         decodeThread.join();
     }
 
-    {
-        std::lock_guard lck(mtx);
-        videoFrameQueue = std::queue<std::shared_ptr<AVFrame>>();
-    }
+    videoFrameQueue.clear();
+    framePacer_.reset();
 
     // Do this before closing input.
     disableAudio();
@@ -277,6 +305,16 @@ void VideoPlayerFfmpeg::stop() {
         decoder->CloseInput();
         decoder.reset();
     }
+
+    if (const std::string &path = GuiInterface::Instance().latency_trace_path_;
+        !path.empty() && !latencyTrace_.empty()) {
+        if (latencyTrace_.write(path)) {
+            GuiInterface::Instance().PutLog(LogLevel::Info, "Latency trace written to {}", path);
+        } else {
+            GuiInterface::Instance().PutLog(LogLevel::Error, "Writing latency trace to {} failed", path);
+        }
+        latencyTrace_.clear();
+    }
 }
 
 void VideoPlayerFfmpeg::set_muted(bool muted) {
@@ -382,7 +420,18 @@ bool VideoPlayerFfmpeg::start_mp4_recording() {
 
     // Add video track.
     if (decoder->HasVideo()) {
-        mp4Encoder_->addTrack(decoder->pFormatCtx->streams[decoder->videoStreamIndex]);
+        AVCodecParameters *par = avcodec_parameters_alloc();
+        AVRational timeBase{};
+        const bool gotParameters = decoder->GetVideoCodecParameters(par, timeBase);
+        if (gotParameters) {
+            mp4Encoder_->addTrack(par, timeBase);
+        }
+        avcodec_parameters_free(&par);
+
+        // The in-process stream has no container, codec parameters are only known after the first keyframe.
+        if (!gotParameters) {
+            return false;
+        }
     }
 
     if (!mp4Encoder_->start()) {
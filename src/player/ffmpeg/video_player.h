@@ -3,12 +3,15 @@
 #include <vecgui/common/any_callable.h>
 
 #include <memory>
-#include <queue>
 #include <thread>
 
+#include "../frame_pacer.h"
+#include "../frame_queue.h"
+#include "../latency_trace.h"
 #include "../video_player.h"
 #include "../yuv_renderer.h"
 #include "ffmpeg_decoder.h"
+#include "frame_staging.h"
 #include "gif_encoder.h"
 #include "mp4_encoder.h"
 
@@ -46,7 +49,13 @@ public:
 protected:
     std::shared_ptr<FfmpegDecoder> decoder;
 
-    std::queue<std::shared_ptr<AVFrame>> videoFrameQueue;
+    FrameQueue videoFrameQueue;
+
+    /// Only used by the GUI thread, takes the frames out of videoFrameQueue.
+    FramePacer framePacer_;
+
+    /// Only used by the decode thread.
+    FrameStager frameStager_;
 
     SDL_AudioStream *stream{};
 
@@ -63,5 +72,9 @@ protected:
     bool hasAudio() const;
 
     std::atomic<bool> has_emitted_ready_ = false;
-    std::string current_decoder_name;
+
+    /// Stamps of the frame last uploaded, until it is drawn.
+    LatencyStamps uploadedLatency_;
+    /// Only filled if GuiInterface::latency_trace_path_ is set.
+    LatencyTrace latencyTrace_;
 };
@@ -0,0 +1,165 @@
+#include "frame_pacer.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "../wifi/latency_stamps.h"
+#include "ffmpeg/ffmpeg_include.h"
+
+namespace {
+
+constexpr int64_t NS_PER_US = 1'000;
+constexpr int64_t NS_PER_SECOND = 1'000'000'000;
+
+/// Until the first refreshes have been timed.
+constexpr int64_t DEFAULT_REFRESH_INTERVAL = NS_PER_SECOND / 60;
+
+/// Longer gaps between refreshes or frames are stalls (window dragged, signal lost), not part of the timing.
+constexpr int64_t MAX_INTERVAL = NS_PER_SECOND / 10;
+constexpr int64_t MAX_FRAME_GAP = NS_PER_SECOND;
+
+/// Delay added in paced mode, in units of jitter. Capped at one frame interval.
+constexpr int64_t JITTER_FACTOR = 2;
+
+} // namespace
+
+const char *present_mode_name(const PresentMode mode) {
+    return mode == PresentMode::Paced ? "paced" : "immediate";
+}
+
+PresentMode parse_present_mode(const std::string &name) {
+    return name == "paced" ? PresentMode::Paced : PresentMode::Immediate;
+}
+
+void FramePacer::setMode(const PresentMode mode) {
+    mode_ = mode;
+    scheduled_.clear();
+}
+
+std::shared_ptr<AVFrame> FramePacer::next(FrameQueue &queue) {
+    const int64_t now = LatencyStamps::now();
+    trackRefresh(now);
+
+    int64_t arrivedAt = 0;
+
+    if (mode_ == PresentMode::Immediate) {
+        std::shared_ptr<AVFrame> frame = queue.pop(&arrivedAt);
+        if (frame) {
+            trackArrival(*frame, arrivedAt);
+            countPresented(now, arrivedAt, arrivedAt);
+        }
+        return frame;
+    }
+
+    while (std::shared_ptr<AVFrame> frame = queue.pop(&arrivedAt)) {
+        const int64_t dueAt = trackArrival(*frame, arrivedAt);
+        if (scheduled_.size() == CAPACITY) {
+            stats_.skipped.fetch_add(1, std::memory_order_relaxed);
+            scheduled_.erase(scheduled_.begin());
+        }
+        scheduled_.push_back({std::move(frame), arrivedAt, dueAt});
+    }
+
+    // Each frame goes on screen at the first refresh after it is due, so the frames keep the spacing of their
+    // timestamps. Of several due at once, only the newest is shown.
+    size_t due = 0;
+    while (due < scheduled_.size() && scheduled_[due].dueAt <= now) {
+        due++;
+    }
+    if (due == 0) {
+        return nullptr;
+    }
+
+    Scheduled shown = std::move(scheduled_[due - 1]);
+    scheduled_.erase(scheduled_.begin(), scheduled_.begin() + static_cast<std::ptrdiff_t>(due));
+    stats_.skipped.fetch_add(due - 1, std::memory_order_relaxed);
+
+    countPresented(now, shown.arrivedAt, shown.dueAt);
+    return std::move(shown.frame);
+}
+
+void FramePacer::reset() {
+    scheduled_.clear();
+    lastRefreshAt_ = 0;
+    lastShownAt_ = 0;
+    lastWait_ = 0;
+    resetTimeline();
+}
+
+void FramePacer::trackRefresh(const int64_t now) {
+    const int64_t interval = now - lastRefreshAt_;
+    lastRefreshAt_ = now;
+
+    if (refreshInterval_ == 0) {
+        refreshInterval_ = DEFAULT_REFRESH_INTERVAL;
+    }
+    if (interval > 0 && interval < MAX_INTERVAL) {
+        refreshInterval_ += (interval - refreshInterval_) / 16;
+    }
+    stats_.refresh_interval_us.store(refreshInterval_ / NS_PER_US, std::memory_order_relaxed);
+}
+
+int64_t FramePacer::trackArrival(const AVFrame &frame, const int64_t arrivedAt) {
+    const int64_t pts = frame.pts != AV_NOPTS_VALUE ? frame.pts : frame.best_effort_timestamp;
+    const bool hasPts = pts != AV_NOPTS_VALUE && frame.time_base.num > 0 && frame.time_base.den > 0;
+    // Without timestamps the arrival is all there is to go by.
+    const int64_t ptsNs = hasPts ? av_rescale_q(pts, frame.time_base, {1, NS_PER_SECOND}) : arrivedAt;
+
+    const int64_t ptsDelta = ptsNs - lastPts_;
+    if (hasTimeline_ && (ptsDelta <= 0 || ptsDelta > MAX_FRAME_GAP || arrivedAt - lastArrivedAt_ > MAX_FRAME_GAP)) {
+        resetTimeline();
+    }
+
+    const int64_t transit = arrivedAt - ptsNs;
+    if (hasTimeline_) {
+        frameInterval_ = frameInterval_ == 0 ? ptsDelta : frameInterval_ + (ptsDelta - frameInterval_) / 8;
+        // RFC 3550, A.8.
+        jitter_ += (std::abs(transit - lastTransit_) - jitter_) / 16;
+    }
+    lastPts_ = ptsNs;
+    lastArrivedAt_ = arrivedAt;
+    lastTransit_ = transit;
+    hasTimeline_ = true;
+
+    transits_[transitNext_] = transit;
+    transitNext_ = (transitNext_ + 1) % transits_.size();
+    transitCount_ = std::min(transitCount_ + 1, transits_.size());
+    const int64_t minTransit =
+        *std::min_element(transits_.begin(), transits_.begin() + static_cast<std::ptrdiff_t>(transitCount_));
+
+    const int64_t targetDelay = std::min(JITTER_FACTOR * jitter_, frameInterval_);
+    stats_.jitter_us.store(jitter_ / NS_PER_US, std::memory_order_relaxed);
+    stats_.target_delay_us.store(targetDelay / NS_PER_US, std::memory_order_relaxed);
+
+    // Where the frame falls on the timeline, but never held back for more than one frame interval.
+    return std::min(ptsNs + minTransit + targetDelay, arrivedAt + frameInterval_);
+}
+
+void FramePacer::resetTimeline() {
+    hasTimeline_ = false;
+    frameInterval_ = 0;
+    jitter_ = 0;
+    transitCount_ = 0;
+    transitNext_ = 0;
+}
+
+void FramePacer::countPresented(const int64_t now, const int64_t arrivedAt, const int64_t dueAt) {
+    stats_.presented.fetch_add(1, std::memory_order_relaxed);
+
+    if (now - dueAt > refreshInterval_) {
+        stats_.late.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Refreshes the previous frame stayed on screen, against the ones a frame of this stream should last.
+    const int64_t gap = now - lastShownAt_;
+    if (lastShownAt_ != 0 && frameInterval_ > 0 && gap < MAX_FRAME_GAP) {
+        const int64_t refreshes = (gap + refreshInterval_ / 2) / refreshInterval_;
+        const int64_t expected = std::max<int64_t>(1, (frameInterval_ + refreshInterval_ / 2) / refreshInterval_);
+        if (refreshes > expected) {
+            stats_.repeated.fetch_add(refreshes - expected, std::memory_order_relaxed);
+        }
+    }
+
+    lastShownAt_ = now;
+    lastWait_ = now - arrivedAt;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "frame_queue.h"
+
+struct AVFrame;
+
+/// When a decoded frame goes on screen.
+enum class PresentMode {
+    /// At the first display refresh after it comes out of the frame queue. Adds no latency, but whatever jitter
+    /// the link and the decoder have shows as judder.
+    Immediate,
+    /// At the first refresh after its place on the stream's timeline, each frame delayed by up to one frame
+    /// interval to absorb arrival jitter. Takes every frame from the queue, whatever its FrameQueueMode.
+    Paced,
+};
+
+/// Name used in config.ini and the logs.
+const char *present_mode_name(PresentMode mode);
+
+/// Immediate for anything unknown.
+PresentMode parse_present_mode(const std::string &name);
+
+/// Totals over all playbacks and the current estimates, for the metrics server and the HUD.
+struct PresentStats {
+    /// Frames put on screen.
+    std::atomic<uint64_t> presented{0};
+    /// Frames shown more than a display refresh after they were due.
+    std::atomic<uint64_t> late{0};
+    /// Display refreshes that showed the previous frame again although the frame rate called for a new one.
+    std::atomic<uint64_t> repeated{0};
+    /// Frames never shown in paced mode because a newer one was due at the same refresh.
+    std::atomic<uint64_t> skipped{0};
+
+    /// Interval between display refreshes (GUI frames), in µs.
+    std::atomic<int64_t> refresh_interval_us{0};
+    /// Arrival jitter of decoded frames against their timestamps (RFC 3550 interarrival jitter), in µs.
+    std::atomic<int64_t> jitter_us{0};
+    /// Delay paced mode currently adds to absorb the jitter, in µs.
+    std::atomic<int64_t> target_delay_us{0};
+};
+
+/// Picks the frame to show at each display refresh.
+///
+/// The timeline of the stream comes from the frame timestamps, which are the RTP timestamps (90 kHz) for the
+/// in-process RTP input. Arrival times are those of FrameQueue::push(). Refreshes are timed from the calls to
+/// next(), which the GUI makes once per frame it draws.
+/// Only used from the GUI thread.
+class FramePacer {
+public:
+    /// A paced frame never waits longer than one frame interval, so a few slots are enough.
+    static constexpr size_t CAPACITY = FrameQueue::CAPACITY;
+
+    explicit FramePacer(PresentStats &stats) : stats_(stats) {}
+
+    void setMode(PresentMode mode);
+
+    PresentMode mode() const {
+        return mode_;
+    }
+
+    /// Called once per display refresh. Takes what `queue` holds and returns the frame to show from now on, or
+    /// nullptr to keep showing the current one.
+    std::shared_ptr<AVFrame> next(FrameQueue &queue);
+
+    /// How long the frame last returned by next() waited between the decoder and the screen, in ns.
+    int64_t lastWait() const {
+        return lastWait_;
+    }
+
+    /// Drops the frames held back and forgets the timing of the stream, e.g. when playback restarts.
+    void reset();
+
+private:
+    struct Scheduled {
+        std::shared_ptr<AVFrame> frame;
+        /// Steady clock ns, see LatencyStamps::now().
+        int64_t arrivedAt = 0;
+        int64_t dueAt = 0;
+    };
+
+    void trackRefresh(int64_t now);
+
+    /// Updates the frame interval, jitter and transit estimates with a new frame.
+    /// Returns when the frame is due in paced mode.
+    int64_t trackArrival(const AVFrame &frame, int64_t arrivedAt);
+
+    /// Forgets the timeline, after a gap or a jump in the timestamps.
+    void resetTimeline();
+
+    void countPresented(int64_t now, int64_t arrivedAt, int64_t dueAt);
+
+    PresentStats &stats_;
+
+    PresentMode mode_ = PresentMode::Immediate;
+
+    /// Frames held back in paced mode, oldest first.
+    std::vector<Scheduled> scheduled_;
+
+    int64_t lastRefreshAt_ = 0;
+    int64_t refreshInterval_ = 0;
+
+    /// Of the previous frame, timestamp in ns.
+    int64_t lastPts_ = 0;
+    int64_t lastArrivedAt_ = 0;
+    int64_t lastTransit_ = 0;
+    bool hasTimeline_ = false;
+
+    int64_t frameInterval_ = 0;
+    int64_t jitter_ = 0;
+
+    /// Transit (arrival minus timestamp) of the last frames. Their minimum is the transit of a frame that met no
+    /// delay on the way, which follows the clock drift between the camera and this machine.
+    std::array<int64_t, 64> transits_{};
+    size_t transitCount_ = 0;
+    size_t transitNext_ = 0;
+
+    int64_t lastShownAt_ = 0;
+    int64_t lastWait_ = 0;
+};
@@ -0,0 +1,69 @@
+#include "frame_queue.h"
+
+#include "../wifi/latency_stamps.h"
+
+const char *frame_queue_mode_name(const FrameQueueMode mode) {
+    return mode == FrameQueueMode::Fifo ? "fifo" : "mailbox";
+}
+
+FrameQueueMode parse_frame_queue_mode(const std::string &name) {
+    return name == "fifo" ? FrameQueueMode::Fifo : FrameQueueMode::Mailbox;
+}
+
+void FrameQueue::setMode(const FrameQueueMode mode) {
+    mode_ = mode;
+}
+
+void FrameQueue::push(std::shared_ptr<AVFrame> frame) {
+    std::lock_guard lock(mutex_);
+
+    stats_.pushed.fetch_add(1, std::memory_order_relaxed);
+
+    if (mode_ == FrameQueueMode::Mailbox) {
+        // Also empties what FIFO mode left behind.
+        stats_.superseded.fetch_add(count_, std::memory_order_relaxed);
+        while (count_ > 0) {
+            frames_[head_].reset();
+            head_ = (head_ + 1) % CAPACITY;
+            count_--;
+        }
+    } else if (count_ == CAPACITY) {
+        stats_.overflowed.fetch_add(1, std::memory_order_relaxed);
+        frames_[head_].reset();
+        head_ = (head_ + 1) % CAPACITY;
+        count_--;
+    }
+
+    frames_[(head_ + count_) % CAPACITY] = std::move(frame);
+    pushedAt_[(head_ + count_) % CAPACITY] = LatencyStamps::now();
+    count_++;
+}
+
+std::shared_ptr<AVFrame> FrameQueue::pop(int64_t *pushedAt) {
+    std::lock_guard lock(mutex_);
+
+    if (count_ == 0) {
+        return nullptr;
+    }
+
+    if (pushedAt) {
+        *pushedAt = pushedAt_[head_];
+    }
+    std::shared_ptr<AVFrame> frame = std::move(frames_[head_]);
+    head_ = (head_ + 1) % CAPACITY;
+    count_--;
+
+    stats_.popped.fetch_add(1, std::memory_order_relaxed);
+
+    return frame;
+}
+
+void FrameQueue::clear() {
+    std::lock_guard lock(mutex_);
+
+    for (auto &frame : frames_) {
+        frame.reset();
+    }
+    head_ = 0;
+    count_ = 0;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+struct AVFrame;
+
+/// What the GUI thread gets when it falls behind the decoder.
+enum class FrameQueueMode {
+    /// Only the newest frame is kept, older ones are dropped as soon as a newer one is decoded. Lowest latency.
+    Mailbox,
+    /// Frames are shown in order, up to FrameQueue::CAPACITY of them wait. Smoother, but each waiting frame
+    /// adds a frame of latency.
+    Fifo,
+};
+
+/// Name used in config.ini and the logs.
+const char *frame_queue_mode_name(FrameQueueMode mode);
+
+/// Mailbox for anything unknown.
+FrameQueueMode parse_frame_queue_mode(const std::string &name);
+
+/// Totals over all playbacks, for the metrics server.
+struct FrameQueueStats {
+    /// Frames the decoder handed over.
+    std::atomic<uint64_t> pushed{0};
+    /// Frames the GUI thread took for display.
+    std::atomic<uint64_t> popped{0};
+    /// Frames dropped in mailbox mode because a newer one came first.
+    std::atomic<uint64_t> superseded{0};
+    /// Frames dropped in FIFO mode because the queue was full.
+    std::atomic<uint64_t> overflowed{0};
+};
+
+/// Hands decoded frames from the decode thread over to the GUI thread.
+///
+/// The slots are fixed, so passing a frame allocates nothing. The frames come from the AvPool of the decoder,
+/// dropping one here gives it back.
+class FrameQueue {
+public:
+    static constexpr size_t CAPACITY = 3;
+
+    explicit FrameQueue(FrameQueueStats &stats) : stats_(stats) {}
+
+    /// Takes effect with the next push().
+    void setMode(FrameQueueMode mode);
+
+    FrameQueueMode mode() const {
+        return mode_;
+    }
+
+    void push(std::shared_ptr<AVFrame> frame);
+
+    /// The frame to show next, or nullptr if there is no new one.
+    /// `pushedAt` gets the time it was pushed, in steady_clock ns (see LatencyStamps::now()).
+    std::shared_ptr<AVFrame> pop(int64_t *pushedAt = nullptr);
+
+    /// Drops what is queued without counting it.
+    void clear();
+
+private:
+    FrameQueueStats &stats_;
+
+    std::mutex mutex_;
+    std::atomic<FrameQueueMode> mode_ = FrameQueueMode::Mailbox;
+    std::array<std::shared_ptr<AVFrame>, CAPACITY> frames_;
+    std::array<int64_t, CAPACITY> pushedAt_{};
+    /// Oldest frame.
+    size_t head_ = 0;
+    size_t count_ = 0;
+};
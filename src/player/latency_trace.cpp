@@ -0,0 +1,91 @@
+#include "latency_trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+
+void set_latency_stamps(AVBufferRef *&opaque_ref, const LatencyStamps &stamps) {
+    // Recycled packets and frames come here for every traced access unit, the pool saves the allocation.
+    static AVBufferPool *pool = av_buffer_pool_init(sizeof(LatencyStamps), nullptr);
+
+    if (!opaque_ref || !av_buffer_is_writable(opaque_ref) ||
+        static_cast<size_t>(opaque_ref->size) != sizeof(LatencyStamps)) {
+        av_buffer_unref(&opaque_ref);
+        opaque_ref = pool ? av_buffer_pool_get(pool) : nullptr;
+    }
+    if (opaque_ref) {
+        memcpy(opaque_ref->data, &stamps, sizeof(LatencyStamps));
+    }
+}
+
+LatencyStamps get_latency_stamps(const AVBufferRef *opaque_ref) {
+    LatencyStamps stamps;
+    if (opaque_ref && static_cast<size_t>(opaque_ref->size) == sizeof(LatencyStamps)) {
+        memcpy(&stamps, opaque_ref->data, sizeof(LatencyStamps));
+    }
+    return stamps;
+}
+
+void LatencyTrace::add(const LatencyStamps &stamps) {
+    if (frames_.size() < CAPACITY) {
+        frames_.push_back(stamps);
+        return;
+    }
+    frames_[oldest_] = stamps;
+    oldest_ = (oldest_ + 1) % CAPACITY;
+}
+
+void LatencyTrace::clear() {
+    frames_.clear();
+    oldest_ = 0;
+}
+
+bool LatencyTrace::write(const std::string &path) const {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+
+    // Async events of one id nest by time, see the Trace Event Format.
+    const auto event = [&](const char *name, char phase, size_t id, int64_t ns) {
+        out << std::format(
+            R"(,{{"name":"{}","cat":"latency","ph":"{}","id":{},"pid":1,"tid":1,"ts":{:.3f}}})",
+            name,
+            phase,
+            id,
+            static_cast<double>(ns) / 1000.0);
+    };
+
+    out << R"({"displayTimeUnit":"ms","traceEvents":[)";
+    out << R"({"name":"process_name","ph":"M","pid":1,"args":{"name":"Aviateur glass-to-glass latency"}})";
+
+    for (size_t i = 0; i < frames_.size(); i++) {
+        const LatencyStamps &stamps = frames_[(oldest_ + i) % frames_.size()];
+
+        const int64_t start = stamps[LatencyStage::UsbRx];
+        int64_t previous = start;
+        int64_t end = start;
+        for (int stage = 1; stage < LATENCY_STAGE_COUNT; stage++) {
+            end = std::max(end, stamps.at[stage]);
+        }
+
+        event("frame", 'b', i, start);
+        for (int stage = 1; stage < LATENCY_STAGE_COUNT; stage++) {
+            // Stages that were not measured are folded into the next one.
+            const int64_t reached = stamps.at[stage];
+            if (reached == 0) {
+                continue;
+            }
+            const char *name = latency_stage_name(static_cast<LatencyStage>(stage));
+            event(name, 'b', i, previous);
+            event(name, 'e', i, std::max(previous, reached));
+            previous = std::max(previous, reached);
+        }
+        event("frame", 'e', i, end);
+    }
+
+    out << "]}\n";
+
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../wifi/latency_stamps.h"
+#include "ffmpeg/ffmpeg_include.h"
+
+/// Attaches `stamps` to a packet or frame through its opaque_ref, replacing what was there.
+/// av_frame_copy_props() and av_packet_ref() carry it along.
+void set_latency_stamps(AVBufferRef *&opaque_ref, const LatencyStamps &stamps);
+
+/// What set_latency_stamps() attached, or stamps that are not traced.
+LatencyStamps get_latency_stamps(const AVBufferRef *opaque_ref);
+
+/// The stamps of the last frames that made it to the screen, written out as a Chrome trace
+/// (chrome://tracing or https://ui.perfetto.dev).
+///
+/// Every frame becomes an async track that spans from USB RX to present, split into one slice per stage.
+/// Only used from the GUI thread.
+class LatencyTrace {
+public:
+    /// A few minutes of video, older frames are dropped.
+    static constexpr size_t CAPACITY = 10'000;
+
+    void add(const LatencyStamps &stamps);
+
+    void clear();
+
+    bool empty() const {
+        return frames_.empty();
+    }
+
+    /// Returns false if the file cannot be written.
+    bool write(const std::string &path) const;
+
+private:
+    std::vector<LatencyStamps> frames_;
+    /// Where the next frame goes once the trace is full.
+    size_t oldest_ = 0;
+};
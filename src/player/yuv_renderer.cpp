@@ -300,12 +300,18 @@ void YuvRenderer::updateTextureInfo(int width, int height, int format) {
 }
 
 void YuvRenderer::updateTextureData(const std::shared_ptr<AVFrame>& newFrameData) {
-    if (mTexY == nullptr) {
+    mPendingFrame = newFrameData;
+}
+
+void YuvRenderer::recordUpload(Pathfinder::CommandEncoder& encoder) {
+    const std::shared_ptr<AVFrame> newFrameData = std::move(mPendingFrame);
+
+    // Decoded before the textures were resized, or in a format they are not set up for.
+    if (newFrameData->width != mTexY->get_size().x || newFrameData->height != mTexY->get_size().y ||
+        newFrameData->format != mPixFmt) {
         return;
     }
 
-    auto encoder = mDevice->create_command_encoder("upload yuv data");
-
     if (newFrameData->linesize[0]) {
         const void* texYData = newFrameData->data[0];
 
@@ -320,7 +326,7 @@ void YuvRenderer::updateTextureData(const std::shared_ptr<AVFrame>& newFrameData
             texYData = mPackedY.data();
         }
 
-        encoder->write_texture(mTexY, {}, texYData);
+        encoder.write_texture(mTexY, {}, texYData);
     }
 
     if (newFrameData->linesize[1]) {
@@ -337,7 +343,7 @@ void YuvRenderer::updateTextureData(const std::shared_ptr<AVFrame>& newFrameData
             texUData = mPackedU.data();
         }
 
-        encoder->write_texture(mTexU, {}, texUData);
+        encoder.write_texture(mTexU, {}, texUData);
     }
 
     if (newFrameData->linesize[2] && mPixFmt != AV_PIX_FMT_NV12) {
@@ -354,10 +360,11 @@ void YuvRenderer::updateTextureData(const std::shared_ptr<AVFrame>& newFrameData
             texVData = mPackedV.data();
         }
 
-        encoder->write_texture(mTexV, {}, texVData);
+        encoder.write_texture(mTexV, {}, texVData);
     }
 
-    mQueue->submit(encoder, mFence);
+    // The encoder reads the planes when it is submitted.
+    mUploadedFrame = newFrameData;
 }
 
 void YuvRenderer::render(const std::shared_ptr<Pathfinder::Texture>& outputTex) {
@@ -369,8 +376,13 @@ void YuvRenderer::render(const std::shared_ptr<Pathfinder::Texture>& outputTex)
         return;
     }
 
+    // One command encoder and submission for the upload and the draw.
     auto encoder = mDevice->create_command_encoder("render yuv");
 
+    if (mPendingFrame && mTexY) {
+        recordUpload(*encoder);
+    }
+
     FragUniformBlock uniform;
     if (mXformChanged || mPixFmtChanged) {
         uniform = {Pathfinder::Mat4::from_mat3(mXform), mPixFmt};
@@ -398,4 +410,5 @@ void YuvRenderer::render(const std::shared_ptr<Pathfinder::Texture>& outputTex)
 
 void YuvRenderer::clear() {
     mNeedClear = true;
+    mPendingFrame.reset();
 }
@@ -36,6 +36,8 @@ public:
     void init();
     void render(const std::shared_ptr<Pathfinder::Texture>& outputTex);
     void updateTextureInfo(int width, int height, int format);
+    /// Queues the frame for upload, which render() records in its own command encoder.
+    /// A frame that has not been rendered yet is replaced.
     void updateTextureData(const std::shared_ptr<AVFrame>& newFrameData);
 
     void clear();
@@ -55,6 +57,10 @@ protected:
     void initPipeline();
     void initGeometry();
 
+    /// Records the upload of mPendingFrame. Only frames with padded rows are repacked here,
+    /// FrameStager packs them on the decode thread.
+    void recordUpload(Pathfinder::CommandEncoder& encoder);
+
 private:
     std::shared_ptr<Pathfinder::RenderPipeline> mPipeline;
     std::shared_ptr<Pathfinder::Queue> mQueue;
@@ -84,6 +90,10 @@ private:
 
     std::shared_ptr<Pathfinder::Device> mDevice;
 
+    /// Waiting for render(), and the frame last uploaded, kept until its upload has been submitted.
+    std::shared_ptr<AVFrame> mPendingFrame;
+    std::shared_ptr<AVFrame> mUploadedFrame;
+
     std::vector<uint8_t> mPackedY;
     std::vector<uint8_t> mPackedU;
     std::vector<uint8_t> mPackedV;
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+/// How long the video aggregator waits for the missing fragments of a block before it releases the rest with gaps.
+///
+/// A block gets as long as receiving all of its fragments takes at the smoothed time between packets, plus four
+/// mean deviations of that time for jitter, in the manner of the TCP retransmission timeout (RFC 6298).
+/// Fed and read by the video worker, value() may be read from any thread.
+class FecDeadline {
+public:
+    static constexpr std::chrono::microseconds MIN{2'000};
+    static constexpr std::chrono::microseconds MAX{100'000};
+
+    /// Called for every video packet that was not a duplicate, with its USB RX time in steady_clock ns.
+    void add_arrival(const int64_t rx_time) {
+        if (last_arrival_ != 0) {
+            // Pauses in the stream say nothing about the spacing of packets within a block.
+            const double gap = std::clamp<double>(static_cast<double>(rx_time - last_arrival_), 0, MAX_GAP_NS);
+            if (mean_gap_ < 0) {
+                mean_gap_ = gap;
+                gap_deviation_ = gap / 2;
+            } else {
+                gap_deviation_ += (std::abs(gap - mean_gap_) - gap_deviation_) / 4;
+                mean_gap_ += (gap - mean_gap_) / 8;
+            }
+        }
+        last_arrival_ = rx_time;
+    }
+
+    /// Deadline for blocks of `fec_n` fragments, MAX until there are packets to measure.
+    std::chrono::nanoseconds update(const int fec_n) {
+        std::chrono::nanoseconds deadline = MAX;
+        if (mean_gap_ >= 0 && fec_n > 0) {
+            const auto ns = static_cast<int64_t>(fec_n * mean_gap_ + 4 * gap_deviation_);
+            deadline = std::clamp<std::chrono::nanoseconds>(std::chrono::nanoseconds(ns), MIN, MAX);
+        }
+        value_us_.store(std::chrono::duration_cast<std::chrono::microseconds>(deadline).count(),
+                        std::memory_order_relaxed);
+        return deadline;
+    }
+
+    /// The last deadline returned by update().
+    std::chrono::microseconds value() const {
+        return std::chrono::microseconds(value_us_.load(std::memory_order_relaxed));
+    }
+
+private:
+    static constexpr double MAX_GAP_NS = 1e9 * 0.1;
+
+    int64_t last_arrival_ = 0;
+    /// Negative until the first gap is measured.
+    double mean_gap_ = -1;
+    double gap_deviation_ = 0;
+
+    std::atomic<int64_t> value_us_{MAX.count()};
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+/// Points a video packet passes on its way from the air to the screen, in order.
+enum class LatencyStage : uint8_t {
+    /// 802.11 frame handed over by the USB RX callback.
+    UsbRx,
+    /// wfb-ng packet authenticated and decrypted by the aggregator.
+    Decrypted,
+    /// RTP packet released by the aggregator (Aggregator::send_packet), possibly after waiting for FEC.
+    FecReleased,
+    /// Access unit complete in the RTP depacketizer.
+    Depacketized,
+    /// Access unit passed to avcodec_send_packet().
+    DecoderInput,
+    /// Frame returned by FfmpegDecoder::GetNextFrame().
+    Decoded,
+    /// Frame uploaded to the video textures.
+    Uploaded,
+    /// First draw of the frame into the player's render target.
+    Presented,
+};
+
+constexpr int LATENCY_STAGE_COUNT = static_cast<int>(LatencyStage::Presented) + 1;
+
+/// Short name of a stage, for labels and traces.
+constexpr const char *latency_stage_name(const LatencyStage stage) {
+    constexpr const char *NAMES[LATENCY_STAGE_COUNT] = {
+        "usb_rx",
+        "decrypt",
+        "fec_release",
+        "depacketize",
+        "decoder_input",
+        "decode",
+        "upload",
+        "present",
+    };
+    return NAMES[static_cast<int>(stage)];
+}
+
+/// When a packet (and later the access unit and frame made of it) reached each stage, in steady_clock
+/// nanoseconds since its epoch. 0 means the stage was not reached, or not measured.
+///
+/// An access unit takes the USB RX time of its first packet and the later link stamps of its last packet,
+/// so that every stamp tells when the whole access unit was through that stage.
+struct LatencyStamps {
+    std::array<int64_t, LATENCY_STAGE_COUNT> at{};
+
+    static int64_t now() {
+        const auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+    }
+
+    int64_t &operator[](const LatencyStage stage) {
+        return at[static_cast<int>(stage)];
+    }
+
+    int64_t operator[](const LatencyStage stage) const {
+        return at[static_cast<int>(stage)];
+    }
+
+    /// Only packets that came in over the air are traced, e.g. not the ones of an external RTP source.
+    bool is_traced() const {
+        return (*this)[LatencyStage::UsbRx] != 0;
+    }
+
+    /// Stamps `stage` with the current time if the packet is traced.
+    void mark(const LatencyStage stage) {
+        if (is_traced()) {
+            (*this)[stage] = now();
+        }
+    }
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <format>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "latency_stamps.h"
+#include "link_metrics.h"
+#include "link_stats.h"
+
+enum class LogLevel {
+    Info,
+    Debug,
+    Warn,
+    Error,
+};
+
+/// What the link layer reports to, and reads from, the application hosting it.
+///
+/// Implemented by GuiInterface for the app and by a console sink for aviateur-headless,
+/// so that WfbngLink and WfbngReceiver do not depend on the GUI.
+/// Every method may be called from the USB and aggregation threads.
+class LinkEvents {
+public:
+    virtual ~LinkEvents() = default;
+
+    template <typename... Args>
+    void PutLog(LogLevel level, const std::string_view message, Args... format_items) {
+        std::string str = std::vformat(message, std::make_format_args(format_items...));
+        EmitLog(level, str);
+    }
+
+    virtual void EmitLog(LogLevel level, std::string msg) = 0;
+
+    /// Short message meant for the user rather than the log.
+    virtual void ShowTip(std::string msg, bool bad_news) = 0;
+
+    /// The adapter is gone or the replay has ended.
+    virtual void EmitWifiStopped() = 0;
+
+    /// First packet of a video stream forwarded to `port`.
+    virtual void NotifyRtpStream(int pt, uint16_t ssrc, int port, const std::string &codec) = 0;
+
+    /// First packet of a video stream delivered through PushRtpPacket().
+    virtual void NotifyInProcessRtpStream(const std::string &codec) = 0;
+
+    /// Only called when forward_port_ is not set, and only by the video worker of the WfbngReceiver that all links
+    /// share, so an implementation has a single producer and needs no lock.
+    /// `stamps` carries the link stages of the packet on to the player.
+    virtual void PushRtpPacket(const uint8_t *data, size_t size, const LatencyStamps &stamps) = 0;
+
+    LinkStats link_stats_;
+
+    /// Large (about 2 MB), so keep sinks off the stack.
+    LinkMetrics link_metrics_;
+
+    /// Where the video aggregator sends RTP to, unless it is delivered in process.
+    int playerPort = 0;
+
+    /// Codec of the video stream, set by the aggregation thread when a stream starts.
+    std::string GetPlayerCodec() const {
+        std::lock_guard lock(player_codec_mutex_);
+        return playerCodec;
+    }
+
+    void SetPlayerCodec(const std::string &codec) {
+        std::lock_guard lock(player_codec_mutex_);
+        playerCodec = codec;
+    }
+
+    /// Set if RTP goes to an external player on this port instead of the built-in one.
+    std::optional<std::string> forward_port_;
+
+    /// Last FEC level asked from the drone by the adaptive link.
+    std::atomic<int> drone_fec_level_{0};
+
+    /// Video blocks the FEC aggregator keeps open, 0 for the default. Deeper rings ride out longer reordering and
+    /// heavier FEC, shallower ones bound the latency a stuck block can add. Picked up while the link runs.
+    std::atomic<int> fec_ring_depth_{0};
+
+private:
+    mutable std::mutex player_codec_mutex_;
+    std::string playerCodec;
+};
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <optional>
+
+#include "latency_stamps.h"
+
+constexpr int ANTENNA_COUNT = 2;
+
+/// Adapters that can receive at the same time (diversity receive).
+constexpr int MAX_ADAPTER_COUNT = 4;
+
+namespace histogram_detail {
+
+/// Values below EXACT_LIMIT are counted exactly, above it every power of two is split into SUB_BUCKET_COUNT
+/// buckets, which keeps the error under 1/64 (HdrHistogram with about 2 significant digits).
+constexpr uint64_t SUB_BUCKET_COUNT = 64;
+constexpr uint64_t EXACT_LIMIT = 2 * SUB_BUCKET_COUNT;
+
+constexpr size_t bucket_index(uint64_t value) {
+    if (value < EXACT_LIMIT) {
+        return value;
+    }
+    const int shift = std::bit_width(value) - 1 - std::countr_zero(SUB_BUCKET_COUNT);
+    return EXACT_LIMIT + (shift - 1) * SUB_BUCKET_COUNT + ((value >> shift) - SUB_BUCKET_COUNT);
+}
+
+/// Highest value counted in bucket `index`.
+constexpr uint64_t bucket_upper_bound(size_t index) {
+    if (index < EXACT_LIMIT) {
+        return index;
+    }
+    const int shift = static_cast<int>((index - EXACT_LIMIT) / SUB_BUCKET_COUNT) + 1;
+    const uint64_t sub_bucket = (index - EXACT_LIMIT) % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+} // namespace histogram_detail
+
+/// Distribution of the values recorded over the last seconds, in fixed memory.
+///
+/// Values are counted in log-linear buckets (see histogram_detail) per time slice of SLICE_DURATION.
+/// A query merges the slices of the requested window, so any window up to MAX_WINDOW can be asked for.
+/// Recording is a few relaxed atomic operations and may happen from any thread, queries need no lock either.
+/// Values outside [Lowest, Highest] are clamped.
+template <int64_t Lowest, int64_t Highest>
+class Histogram {
+public:
+    static constexpr std::chrono::milliseconds SLICE_DURATION{250};
+    static constexpr int SLICE_COUNT = 40;
+    static constexpr std::chrono::milliseconds MAX_WINDOW = SLICE_DURATION * SLICE_COUNT;
+
+    struct Summary {
+        uint64_t count = 0;
+        int64_t min = 0;
+        int64_t p50 = 0;
+        int64_t p95 = 0;
+        int64_t p99 = 0;
+        int64_t max = 0;
+    };
+
+    static int64_t current_slice() {
+        const auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(since_epoch) / SLICE_DURATION;
+    }
+
+    void record(int64_t value) {
+        record(value, current_slice());
+    }
+
+    /// Saves looking up the clock when recording several values at once.
+    void record(int64_t value, int64_t slice_index) {
+        const uint64_t offset = static_cast<uint64_t>(std::clamp(value, Lowest, Highest) - Lowest);
+
+        Slice *slice = acquire_slice(slice_index);
+        if (!slice) {
+            return;
+        }
+
+        slice->counts[histogram_detail::bucket_index(offset)].fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t min = slice->min.load(std::memory_order_relaxed);
+        while (offset < min && !slice->min.compare_exchange_weak(min, offset, std::memory_order_relaxed)) {
+        }
+        uint64_t max = slice->max.load(std::memory_order_relaxed);
+        while (offset > max && !slice->max.compare_exchange_weak(max, offset, std::memory_order_relaxed)) {
+        }
+    }
+
+    /// Percentiles of the values recorded within the last `window`, which includes the running slice.
+    Summary summarize(std::chrono::milliseconds window) const {
+        const Merged merged = merge(window);
+
+        Summary summary;
+        if (merged.total == 0) {
+            return summary;
+        }
+
+        summary.count = merged.total;
+        summary.min = static_cast<int64_t>(merged.min) + Lowest;
+        summary.p50 = merged.value_at(50) + Lowest;
+        summary.p95 = merged.value_at(95) + Lowest;
+        summary.p99 = merged.value_at(99) + Lowest;
+        summary.max = static_cast<int64_t>(merged.max) + Lowest;
+
+        return summary;
+    }
+
+    /// Any percentile in [0, 100], e.g. the low tail of a signal. Returns std::nullopt if nothing was recorded.
+    std::optional<int64_t> value_at_percentile(double percentile, std::chrono::milliseconds window) const {
+        const Merged merged = merge(window);
+        if (merged.total == 0) {
+            return std::nullopt;
+        }
+        return merged.value_at(percentile) + Lowest;
+    }
+
+    /// Forgets everything recorded so far.
+    void reset() {
+        for (Slice &slice : slices_) {
+            slice.index.store(EMPTY, std::memory_order_release);
+        }
+    }
+
+private:
+    static constexpr size_t BUCKET_COUNT = histogram_detail::bucket_index(Highest - Lowest) + 1;
+
+    /// Slice::index of a slice that holds no period.
+    static constexpr int64_t EMPTY = -1;
+    /// Slice::index while a thread empties the slice for a new period.
+    static constexpr int64_t CLEARING = -2;
+
+    struct Slice {
+        /// Which SLICE_DURATION period since the clock's epoch the counts belong to, or EMPTY or CLEARING.
+        std::atomic<int64_t> index{EMPTY};
+
+        std::atomic<uint64_t> min{std::numeric_limits<uint64_t>::max()};
+        std::atomic<uint64_t> max{0};
+        std::array<std::atomic<uint32_t>, BUCKET_COUNT> counts{};
+    };
+
+    /// The slices of a window added up.
+    struct Merged {
+        std::array<uint64_t, BUCKET_COUNT> counts{};
+        uint64_t min = std::numeric_limits<uint64_t>::max();
+        uint64_t max = 0;
+        uint64_t total = 0;
+
+        /// Offset from Lowest, total must not be 0.
+        int64_t value_at(double percentile) const {
+            const auto rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(total - 1)) + 1;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < BUCKET_COUNT; i++) {
+                seen += counts[i];
+                if (seen >= rank) {
+                    return static_cast<int64_t>(std::clamp(histogram_detail::bucket_upper_bound(i), min, max));
+                }
+            }
+            return static_cast<int64_t>(max);
+        }
+    };
+
+    Merged merge(std::chrono::milliseconds window) const {
+        Merged merged;
+
+        const int64_t now = current_slice();
+        const int64_t slice_count = std::clamp<int64_t>(window / SLICE_DURATION, 1, SLICE_COUNT);
+
+        for (const Slice &slice : slices_) {
+            const int64_t index = slice.index.load(std::memory_order_acquire);
+            if (index <= now - slice_count || index > now) {
+                continue;
+            }
+            for (size_t i = 0; i < BUCKET_COUNT; i++) {
+                const uint64_t count = slice.counts[i].load(std::memory_order_relaxed);
+                merged.counts[i] += count;
+                merged.total += count;
+            }
+            merged.min = std::min(merged.min, slice.min.load(std::memory_order_relaxed));
+            merged.max = std::max(merged.max, slice.max.load(std::memory_order_relaxed));
+        }
+
+        return merged;
+    }
+
+    /// The slice for `slice_index`, emptied first if it still holds an older period.
+    /// Only the thread that swaps the old period for CLEARING empties the slice. Returns nullptr while another
+    /// thread empties it, or if it already holds a newer period. The value is dropped then.
+    Slice *acquire_slice(int64_t slice_index) {
+        Slice &slice = slices_[slice_index % SLICE_COUNT];
+
+        int64_t index = slice.index.load(std::memory_order_acquire);
+        if (index == slice_index) {
+            return &slice;
+        }
+        if (index == CLEARING || index > slice_index) {
+            return nullptr;
+        }
+        if (!slice.index.compare_exchange_strong(index, CLEARING, std::memory_order_acq_rel)) {
+            // Another thread got there first, and may have finished already.
+            return index == slice_index ? &slice : nullptr;
+        }
+
+        for (auto &count : slice.counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        slice.min.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+        slice.max.store(0, std::memory_order_relaxed);
+
+        slice.index.store(slice_index, std::memory_order_release);
+
+        return &slice;
+    }
+
+    std::array<Slice, SLICE_COUNT> slices_;
+};
+
+/// Distributions of the link, to see what the per-second means in SignalQualityCalculator hide,
+/// e.g. short fades that cost a few frames.
+struct LinkMetrics {
+    /// Ranges small enough to be counted exactly.
+    using RssiHistogram = Histogram<0, 127>;
+    using SnrHistogram = Histogram<-64, 63>;
+
+    /// Indexed by `wlan_idx * ANTENNA_COUNT + antenna`.
+    std::array<RssiHistogram, MAX_ADAPTER_COUNT * ANTENNA_COUNT> rssi;
+    std::array<SnrHistogram, MAX_ADAPTER_COUNT * ANTENNA_COUNT> snr;
+
+    /// Fragments recovered by FEC, for each block that needed it.
+    Histogram<0, 255> fec_recovered_per_block;
+
+    /// Time between two video frames from the air, all adapters together, in µs.
+    Histogram<0, 10'000'000> arrival_gap_us;
+
+    /// Time a recovered RTP packet waits between the aggregator and the decoder, in µs.
+    Histogram<0, 10'000'000> decoder_latency_us;
+
+    /// Time a decoded frame waits between the decoder and the screen, in µs. Also counts frames that did not come
+    /// over the air.
+    Histogram<0, 10'000'000> present_delay_us;
+
+    /// How long after USB RX a packet (or its access unit and frame) reached each later LatencyStage, in µs.
+    /// Indexed by stage - 1, use since_usb_rx(). Comparing neighbouring stages tells where the time goes.
+    std::array<Histogram<0, 10'000'000>, LATENCY_STAGE_COUNT - 1> since_usb_rx_us;
+
+    Histogram<0, 10'000'000> &since_usb_rx(LatencyStage stage) {
+        return since_usb_rx_us[static_cast<int>(stage) - 1];
+    }
+
+    const Histogram<0, 10'000'000> &since_usb_rx(LatencyStage stage) const {
+        return since_usb_rx_us[static_cast<int>(stage) - 1];
+    }
+
+    /// Records when `stage` was reached, if the stamps are traced and have it.
+    void record_latency(const LatencyStamps &stamps, const LatencyStage stage) {
+        if (!stamps.is_traced() || stage == LatencyStage::UsbRx || stamps[stage] == 0) {
+            return;
+        }
+        since_usb_rx(stage).record((stamps[stage] - stamps[LatencyStage::UsbRx]) / 1000);
+    }
+
+    void record_signal(uint8_t wlan_idx,
+                       const uint8_t (&rssi_values)[ANTENNA_COUNT],
+                       const int8_t (&snr_values)[ANTENNA_COUNT]) {
+        const int64_t slice = RssiHistogram::current_slice();
+        for (int i = 0; i < ANTENNA_COUNT; i++) {
+            rssi[wlan_idx * ANTENNA_COUNT + i].record(rssi_values[i], slice);
+            snr[wlan_idx * ANTENNA_COUNT + i].record(snr_values[i], slice);
+        }
+    }
+
+    void reset() {
+        for (auto &histogram : rssi) {
+            histogram.reset();
+        }
+        for (auto &histogram : snr) {
+            histogram.reset();
+        }
+        fec_recovered_per_block.reset();
+        arrival_gap_us.reset();
+        decoder_latency_us.reset();
+        present_delay_us.reset();
+        for (auto &histogram : since_usb_rx_us) {
+            histogram.reset();
+        }
+    }
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/// Counters bumped on the RX path and read by the GUI at its own pace.
+///
+/// Updates are relaxed atomic increments, nothing else happens on the RX thread. That costs about as much as the
+/// UpdateCount() calls it replaced did with no callback bound, and it stays that way when the GUI shows the counts.
+/// Every counter has its own cache line, so the USB threads of several adapters do not false-share.
+struct LinkStats {
+    struct alignas(64) Counter {
+        std::atomic<uint64_t> value{0};
+
+        void add(uint64_t n = 1) {
+            value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        uint64_t load() const {
+            return value.load(std::memory_order_relaxed);
+        }
+
+        void reset() {
+            value.store(0, std::memory_order_relaxed);
+        }
+    };
+
+    /// Number of received 802.11 frames
+    Counter wifiFrames;
+    /// Number of received wfb-ng frames
+    Counter wfbngFrames;
+    /// Number of received RTP packets
+    Counter rtpPackets;
+    /// Number of duplicate wfb-ng packets dropped before decryption
+    Counter decryptsSkipped;
+    /// Number of wfb-ng frames dropped because an aggregation worker fell behind
+    Counter queueDrops;
+    /// Number of video packets handed to the aggregator, copies from every adapter included
+    Counter fecPackets;
+    /// Number of video packets restored by FEC
+    Counter fecRecovered;
+    /// Number of video packets neither received nor restored
+    Counter fecLost;
+    /// Number of video packets that failed to decrypt
+    Counter decryptErrors;
+    /// Number of video blocks released with gaps because their FEC deadline passed
+    Counter fecTimeoutBlocks;
+
+    void reset() {
+        wifiFrames.reset();
+        wfbngFrames.reset();
+        rtpPackets.reset();
+        decryptsSkipped.reset();
+        queueDrops.reset();
+        fecPackets.reset();
+        fecRecovered.reset();
+        fecLost.reset();
+        decryptErrors.reset();
+        fecTimeoutBlocks.reset();
+    }
+};
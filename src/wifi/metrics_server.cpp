@@ -0,0 +1,383 @@
+#include "metrics_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+
+#include "link_events.h"
+#include "net_compat.h"
+#include "wfbng_link.h"
+
+namespace {
+
+/// How long the server thread waits for a connection before checking whether it should stop.
+constexpr int ACCEPT_POLL_MS = 200;
+
+/// A client that does not send its request or take the response within this is dropped.
+constexpr int CLIENT_TIMEOUT_MS = 1000;
+
+constexpr size_t MAX_REQUEST_SIZE = 4096;
+
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+bool wait_for(const int fd, const short events) {
+    pollfd pfd = {};
+    pfd.fd = fd;
+    pfd.events = events;
+    return wfb_poll(&pfd, 1, CLIENT_TIMEOUT_MS) > 0 && (pfd.revents & events);
+}
+
+bool send_all(const int fd, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        if (!wait_for(fd, POLLOUT)) {
+            return false;
+        }
+        const auto n = send(fd, data.data() + sent, static_cast<int>(data.size() - sent), SEND_FLAGS);
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+std::string http_response(const char *status, const char *content_type, const std::string &body) {
+    return std::format("HTTP/1.1 {}\r\nContent-Type: {}\r\nContent-Length: {}\r\nConnection: close\r\n\r\n{}",
+                       status,
+                       content_type,
+                       body.size(),
+                       body);
+}
+
+std::string quantile_labels(std::string_view labels, const char *quantile) {
+    if (labels.empty()) {
+        return std::format("quantile=\"{}\"", quantile);
+    }
+    return std::format("{},quantile=\"{}\"", labels, quantile);
+}
+
+/// p50/p95/p99/max of a LinkMetrics histogram as a gauge with a quantile label, scaled by `scale`.
+template <class Histogram>
+void write_quantiles(MetricsWriter &writer,
+                     std::string_view name,
+                     std::string_view help,
+                     const Histogram &histogram,
+                     std::string_view labels = {},
+                     double scale = 1.0) {
+    const auto summary = histogram.summarize(Histogram::MAX_WINDOW);
+    if (summary.count == 0) {
+        return;
+    }
+    writer.gauge(name, help, summary.p50 * scale, quantile_labels(labels, "0.5"));
+    writer.gauge(name, help, summary.p95 * scale, quantile_labels(labels, "0.95"));
+    writer.gauge(name, help, summary.p99 * scale, quantile_labels(labels, "0.99"));
+    writer.gauge(name, help, summary.max * scale, quantile_labels(labels, "1"));
+}
+
+} // namespace
+
+void MetricsWriter::counter(std::string_view name, std::string_view help, double value, std::string_view labels) {
+    add(name, help, "counter", value, labels);
+}
+
+void MetricsWriter::gauge(std::string_view name, std::string_view help, double value, std::string_view labels) {
+    add(name, help, "gauge", value, labels);
+}
+
+void MetricsWriter::add(std::string_view name,
+                        std::string_view help,
+                        const char *type,
+                        double value,
+                        std::string_view labels) {
+    auto family = std::ranges::find(families_, name, &Family::name);
+    if (family == families_.end()) {
+        families_.push_back({std::string(name), std::string(help), type, {}});
+        family = families_.end() - 1;
+    }
+
+    if (labels.empty()) {
+        family->samples.push_back(std::format("{} {}", name, value));
+    } else {
+        family->samples.push_back(std::format("{}{{{}}} {}", name, labels, value));
+    }
+}
+
+std::string MetricsWriter::render() const {
+    std::string text;
+    for (const auto &family : families_) {
+        text += std::format("# HELP {} {}\n# TYPE {} {}\n", family.name, family.help, family.name, family.type);
+        for (const auto &sample : family.samples) {
+            text += sample;
+            text += '\n';
+        }
+    }
+    return text;
+}
+
+MetricsServer::MetricsServer(LinkEvents &events) : events_(events) {
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        events_.PutLog(LogLevel::Error, "WSAStartup failed");
+    }
+#endif
+}
+
+MetricsServer::~MetricsServer() {
+    stop();
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+bool MetricsServer::start(const uint16_t port) {
+    if (thread_.joinable()) {
+        return true;
+    }
+
+    const int fd = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
+    if (fd < 0) {
+        events_.PutLog(LogLevel::Error, "Metrics server: socket creation failed");
+        return false;
+    }
+
+    int opt = 1;
+    wfb_setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&opt, sizeof(opt));
+
+    // Loopback only, the endpoint has no authentication.
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(fd, 4) != 0) {
+        events_.PutLog(LogLevel::Error, "Metrics server: unable to listen on 127.0.0.1:{}", port);
+        wfb_close(fd);
+        return false;
+    }
+
+    listen_fd_ = fd;
+    should_stop_ = false;
+    thread_ = std::thread([this] { run(); });
+
+    events_.PutLog(LogLevel::Info, "Serving metrics on http://127.0.0.1:{}/metrics", port);
+
+    return true;
+}
+
+void MetricsServer::stop() {
+    should_stop_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (listen_fd_ >= 0) {
+        wfb_close(listen_fd_);
+        listen_fd_ = -1;
+    }
+}
+
+void MetricsServer::add_collector(Collector collector) {
+    std::lock_guard lock(collectors_mutex_);
+    collectors_.push_back(std::move(collector));
+}
+
+void MetricsServer::run() {
+    while (!should_stop_) {
+        pollfd pfd = {};
+        pfd.fd = listen_fd_;
+        pfd.events = POLLIN;
+        if (wfb_poll(&pfd, 1, ACCEPT_POLL_MS) <= 0 || !(pfd.revents & POLLIN)) {
+            continue;
+        }
+
+        const int client_fd = static_cast<int>(accept(listen_fd_, nullptr, nullptr));
+        if (client_fd < 0) {
+            continue;
+        }
+
+        serve(client_fd);
+
+        wfb_close(client_fd);
+    }
+}
+
+void MetricsServer::serve(const int client_fd) {
+    std::string request;
+    while (request.find("\r\n\r\n") == std::string::npos) {
+        if (request.size() >= MAX_REQUEST_SIZE || !wait_for(client_fd, POLLIN)) {
+            return;
+        }
+        char buf[1024];
+        const auto n = recv(client_fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            return;
+        }
+        request.append(buf, static_cast<size_t>(n));
+    }
+
+    // Request line: "GET /metrics HTTP/1.1", a query string is ignored.
+    const auto method_end = request.find(' ');
+    const auto path_end = request.find_first_of(" ?", method_end + 1);
+    if (method_end == std::string::npos || path_end == std::string::npos) {
+        send_all(client_fd, http_response("400 Bad Request", "text/plain", "Bad request\n"));
+        return;
+    }
+    const std::string_view method(request.data(), method_end);
+    const std::string_view path(request.data() + method_end + 1, path_end - method_end - 1);
+
+    if (method != "GET") {
+        send_all(client_fd, http_response("405 Method Not Allowed", "text/plain", "Only GET is supported\n"));
+        return;
+    }
+    if (path != "/metrics") {
+        send_all(client_fd, http_response("404 Not Found", "text/plain", "Metrics are at /metrics\n"));
+        return;
+    }
+
+    MetricsWriter writer;
+    {
+        std::lock_guard lock(collectors_mutex_);
+        for (const auto &collector : collectors_) {
+            collector(writer);
+        }
+    }
+
+    send_all(client_fd, http_response("200 OK", "text/plain; version=0.0.4; charset=utf-8", writer.render()));
+}
+
+void write_link_metrics(MetricsWriter &writer,
+                        const LinkEvents &events,
+                        const std::vector<std::shared_ptr<WfbngLink>> &links) {
+    const LinkStats &stats = events.link_stats_;
+
+    writer.counter("aviateur_wifi_frames_total", "802.11 frames received from the adapters.", stats.wifiFrames.load());
+    writer.counter("aviateur_wfbng_frames_total", "wfb-ng frames among them.", stats.wfbngFrames.load());
+    writer.counter("aviateur_rtp_packets_total", "Video RTP packets after FEC.", stats.rtpPackets.load());
+    writer.counter("aviateur_queue_drops_total",
+                   "wfb-ng frames dropped because an aggregation worker fell behind.",
+                   stats.queueDrops.load());
+    writer.counter("aviateur_decrypts_skipped_total",
+                   "Duplicate video packets dropped before decryption.",
+                   stats.decryptsSkipped.load());
+    writer.counter("aviateur_fec_packets_total",
+                   "Video packets handed to the aggregator (count_p_all).",
+                   stats.fecPackets.load());
+    writer.counter("aviateur_fec_recovered_total",
+                   "Video packets restored by FEC (count_p_fec_recovered).",
+                   stats.fecRecovered.load());
+    writer.counter("aviateur_fec_lost_total",
+                   "Video packets neither received nor restored (count_p_lost).",
+                   stats.fecLost.load());
+    writer.counter("aviateur_decrypt_errors_total",
+                   "Video packets that failed to decrypt (count_p_dec_err).",
+                   stats.decryptErrors.load());
+    writer.counter("aviateur_fec_timeout_blocks_total",
+                   "Video blocks released with gaps because their FEC deadline passed (count_p_timeout).",
+                   stats.fecTimeoutBlocks.load());
+    writer.gauge("aviateur_alink_fec_level", "FEC level last asked from the drone.", events.drone_fec_level_.load());
+
+    const LinkMetrics &metrics = events.link_metrics_;
+
+    for (size_t i = 0; i < metrics.rssi.size(); i++) {
+        const auto labels = std::format("adapter=\"{}\",antenna=\"{}\"", i / ANTENNA_COUNT, i % ANTENNA_COUNT);
+        write_quantiles(writer, "aviateur_rssi", "RSSI reported by the adapter.", metrics.rssi[i], labels);
+        write_quantiles(writer, "aviateur_snr_db", "SNR reported by the adapter.", metrics.snr[i], labels);
+    }
+    write_quantiles(writer,
+                    "aviateur_fec_recovered_per_block",
+                    "Fragments recovered by FEC per block that needed it.",
+                    metrics.fec_recovered_per_block);
+    write_quantiles(writer,
+                    "aviateur_frame_gap_seconds",
+                    "Time between two video frames from the air.",
+                    metrics.arrival_gap_us,
+                    {},
+                    1e-6);
+    write_quantiles(writer,
+                    "aviateur_decoder_wait_seconds",
+                    "Time a video RTP packet waits between the aggregator and the decoder.",
+                    metrics.decoder_latency_us,
+                    {},
+                    1e-6);
+    write_quantiles(writer,
+                    "aviateur_present_delay_seconds",
+                    "Time a decoded video frame waits between the decoder and the screen.",
+                    metrics.present_delay_us,
+                    {},
+                    1e-6);
+    for (int stage = 1; stage < LATENCY_STAGE_COUNT; stage++) {
+        const auto latency_stage = static_cast<LatencyStage>(stage);
+        write_quantiles(writer,
+                        "aviateur_latency_since_usb_rx_seconds",
+                        "Time from USB RX until a video packet, or its access unit and frame, reached the stage.",
+                        metrics.since_usb_rx(latency_stage),
+                        std::format("stage=\"{}\"", latency_stage_name(latency_stage)),
+                        1e-6);
+    }
+
+    if (links.empty()) {
+        return;
+    }
+
+    if (const auto receiver = links.front()->get_receiver()) {
+        const auto write_queue = [&](const char *queue, const WfbngReceiver::QueueStats &queue_stats) {
+            const auto labels = std::format("queue=\"{}\"", queue);
+            writer.gauge("aviateur_rx_queue_depth", "Frames waiting for the worker.", queue_stats.depth, labels);
+            writer.gauge("aviateur_rx_queue_peak_depth",
+                         "Highest depth seen so far.",
+                         queue_stats.peak_depth,
+                         labels);
+        };
+        write_queue("video", receiver->get_video_queue_stats());
+        write_queue("udp", receiver->get_udp_queue_stats());
+
+        const std::chrono::duration<double> deadline = receiver->get_fec_release_deadline();
+        writer.gauge("aviateur_fec_release_deadline_seconds",
+                     "How long a video block with missing fragments is held for FEC.",
+                     deadline.count());
+    }
+
+    for (size_t i = 0; i < links.size(); i++) {
+        const TxStats tx = links[i]->get_tx_stats();
+        const auto labels = std::format("link=\"{}\"", i);
+
+        writer.counter("aviateur_tx_incoming_packets_total",
+                       "Uplink packets read from the local socket.",
+                       tx.packetsIncoming,
+                       labels);
+        writer.counter("aviateur_tx_injected_packets_total", "Uplink packets injected.", tx.packetsInjected, labels);
+        writer.counter("aviateur_tx_injected_bytes_total", "Uplink bytes injected.", tx.bytesInjected, labels);
+        writer.counter("aviateur_tx_dropped_packets_total",
+                       "Uplink packets dropped by the socket or the adapter.",
+                       tx.packetsDropped,
+                       labels);
+        writer.counter("aviateur_tx_fec_timeouts_total",
+                       "FEC blocks that were already closed when the FEC timeout hit.",
+                       tx.fecTimeouts,
+                       labels);
+
+        for (const auto &[key, antenna] : tx.antennas) {
+            const uint64_t count = antenna.countPacketsInjected + antenna.countPacketsDropped;
+            if (count == 0) {
+                continue;
+            }
+            // Key is (output << 8) | 0xff, output -1 is mirror mode.
+            const auto antenna_labels = std::format("{},output=\"{}\"", labels, static_cast<int64_t>(key) >> 8);
+            const auto latency = [&](const char *stat, double us) {
+                writer.gauge("aviateur_tx_inject_latency_seconds",
+                             "Injection latency over the last log interval.",
+                             us * 1e-6,
+                             std::format("{},stat=\"{}\"", antenna_labels, stat));
+            };
+            latency("min", static_cast<double>(antenna.latencyMin));
+            latency("avg", static_cast<double>(antenna.latencySum) / static_cast<double>(count));
+            latency("max", static_cast<double>(antenna.latencyMax));
+        }
+    }
+}
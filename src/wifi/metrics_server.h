@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class LinkEvents;
+class WfbngLink;
+
+/// Collects samples in the Prometheus text format (version 0.0.4).
+///
+/// Samples of one metric may be added in any order and from several collectors,
+/// they are grouped under a single HELP/TYPE header when rendered.
+class MetricsWriter {
+public:
+    /// Monotonic total, `name` should end in "_total".
+    void counter(std::string_view name, std::string_view help, double value, std::string_view labels = {});
+
+    void gauge(std::string_view name, std::string_view help, double value, std::string_view labels = {});
+
+    std::string render() const;
+
+private:
+    struct Family {
+        std::string name;
+        std::string help;
+        const char *type;
+        /// Complete sample lines.
+        std::vector<std::string> samples;
+    };
+
+    void add(std::string_view name, std::string_view help, const char *type, double value, std::string_view labels);
+
+    std::vector<Family> families_;
+};
+
+/// Serves GET /metrics on 127.0.0.1 so that a Prometheus agent (or curl) can watch the ground station.
+///
+/// A single thread accepts one connection at a time and renders the collectors on it, the RX path is never touched
+/// except through what the collectors read: relaxed atomics (LinkStats, LinkMetrics) and stats published by
+/// other threads at their own pace.
+class MetricsServer {
+public:
+    using Collector = std::function<void(MetricsWriter &writer)>;
+
+    /// `events` only receives the log, it has to outlive the server.
+    explicit MetricsServer(LinkEvents &events);
+
+    ~MetricsServer();
+
+    /// Listens on 127.0.0.1:`port`. Returns false if the port cannot be bound.
+    bool start(uint16_t port);
+
+    void stop();
+
+    /// Called on the server thread for every scrape. May be called while the server is running.
+    void add_collector(Collector collector);
+
+private:
+    void run();
+
+    void serve(int client_fd);
+
+    LinkEvents &events_;
+
+    int listen_fd_ = -1;
+    std::thread thread_;
+    std::atomic<bool> should_stop_{false};
+
+    std::mutex collectors_mutex_;
+    std::vector<Collector> collectors_;
+};
+
+/// Counters and percentiles of the link: LinkStats and LinkMetrics of `events`, the receive queues and the
+/// adaptive link uplink of `links`. The first link holds the receiver shared by the others.
+void write_link_metrics(MetricsWriter &writer,
+                        const LinkEvents &events,
+                        const std::vector<std::shared_ptr<WfbngLink>> &links);
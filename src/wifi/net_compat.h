@@ -20,6 +20,7 @@
     #include <io.h>
     #include <malloc.h>
     #include <errno.h>
+    #include <string.h>
     #include <time.h>
     #include <basetsd.h>
 
@@ -235,6 +236,14 @@
     inline const unsigned char* pcap_next(pcap_t *, struct pcap_pkthdr *) { return NULL; }
     inline void pcap_close(pcap_t *) {}
     inline char* pcap_geterr(pcap_t *) { return (char*)"pcap not supported on Windows"; }
+    typedef void pcap_dumper_t;
+    inline pcap_t* pcap_open_dead(int, int) { return NULL; }
+    inline pcap_t* pcap_open_offline(const char *, char *errbuf) { strcpy(errbuf, "pcap not supported on Windows"); return NULL; }
+    inline int pcap_next_ex(pcap_t *, struct pcap_pkthdr **, const unsigned char **) { return -2; }
+    inline pcap_dumper_t* pcap_dump_open(pcap_t *, const char *) { return NULL; }
+    inline void pcap_dump(unsigned char *, const struct pcap_pkthdr *, const unsigned char *) {}
+    inline int pcap_dump_flush(pcap_dumper_t *) { return -1; }
+    inline void pcap_dump_close(pcap_dumper_t *) {}
 
     #ifdef __cplusplus
     }
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+/// Wakes up the consumer of one or more PacketRings when a packet is pushed.
+///
+/// A consumer that drains several rings shares one doorbell between them, so that it can sleep until any of them
+/// has something to read.
+class RingDoorbell {
+public:
+    /// Producer side. Called once a packet has been published.
+    void ring() {
+        // Only touch the mutex if the consumer is (about to be) asleep.
+        if (consumer_waiting_.load(std::memory_order_seq_cst)) {
+            std::lock_guard lock(wait_mutex_);
+            wait_cv_.notify_one();
+        }
+    }
+
+    /// Consumer side. Blocks until `ready()` returns true, wake() is called or the timeout expires.
+    /// Returns what `ready()` returns then. `ready()` must load the ring heads with seq_cst.
+    template <typename Ready>
+    bool wait(std::chrono::milliseconds timeout, Ready ready) {
+        std::unique_lock lock(wait_mutex_);
+
+        consumer_waiting_.store(true, std::memory_order_seq_cst);
+        wait_cv_.wait_for(lock, timeout, [&] { return ready() || wake_requested_; });
+        consumer_waiting_.store(false, std::memory_order_relaxed);
+        wake_requested_ = false;
+
+        return ready();
+    }
+
+    /// Wakes up a consumer blocked in wait(), e.g. when playback is being stopped.
+    void wake() {
+        std::lock_guard lock(wait_mutex_);
+        wake_requested_ = true;
+        wait_cv_.notify_all();
+    }
+
+private:
+    std::atomic<bool> consumer_waiting_{false};
+    bool wake_requested_ = false;
+    std::mutex wait_mutex_;
+    std::condition_variable wait_cv_;
+};
+
+/// Single-producer single-consumer ring of datagrams.
+///
+/// Hands recovered RTP packets from the video aggregator straight to the decoder, so they do not
+/// have to take a round trip through a loopback socket, and raw frames from the USB threads to the
+/// aggregation workers. Push and pop are wait-free; the mutex is only taken to park (and wake) a
+/// consumer that found the ring empty.
+class PacketRing {
+public:
+    /// Must be a power of two.
+    static constexpr size_t SLOT_COUNT = 1024;
+    /// Large enough for any wfb-ng payload (MAX_PAYLOAD_SIZE).
+    static constexpr size_t SLOT_SIZE = 4096;
+
+    PacketRing() : PacketRing(nullptr) {}
+
+    /// Rings that share `doorbell` can be waited on together, see RingDoorbell. Uses a doorbell of its own if
+    /// `doorbell` is null, otherwise it has to outlive the ring.
+    explicit PacketRing(RingDoorbell *doorbell)
+        // Slots are left uninitialized, so that the memory of a ring is only committed once it is used.
+        : slots_(std::make_unique_for_overwrite<Slot[]>(SLOT_COUNT)),
+          doorbell_(doorbell ? doorbell : &own_doorbell_) {}
+
+    /// Producer side. Copies a packet into the ring, returns false if it had to be dropped because the consumer fell
+    /// behind. Counting drops is up to the caller.
+    bool push(const uint8_t *data, size_t size) {
+        return push(nullptr, 0, data, size);
+    }
+
+    /// Producer side. Same as above, with a fixed-size header (e.g. per-packet metadata) stored in front of the packet.
+    bool push(const void *header, size_t header_size, const uint8_t *data, size_t size) {
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+
+        if (header_size + size > SLOT_SIZE || head - tail_.load(std::memory_order_acquire) >= SLOT_COUNT) {
+            return false;
+        }
+
+        Slot &slot = slots_[head & (SLOT_COUNT - 1)];
+        if (header_size > 0) {
+            memcpy(slot.data, header, header_size);
+        }
+        memcpy(slot.data + header_size, data, size);
+        slot.size = static_cast<uint16_t>(header_size + size);
+
+        head_.store(head + 1, std::memory_order_seq_cst);
+        doorbell_->ring();
+
+        return true;
+    }
+
+    /// Consumer side. Returns the oldest packet, or nullptr if the ring is empty.
+    /// The pointer stays valid until pop() is called.
+    const uint8_t *front(size_t &size) const {
+        const uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+
+        const Slot &slot = slots_[tail & (SLOT_COUNT - 1)];
+        size = slot.size;
+        return slot.data;
+    }
+
+    /// Consumer side. Releases the packet returned by front().
+    void pop() {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /// Consumer side. Discards everything queued so far.
+    void clear() {
+        tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    /// Consumer side. Blocks until a packet is available, wake() is called or the timeout expires.
+    /// Returns true if there is something to read.
+    bool wait(std::chrono::milliseconds timeout) {
+        return doorbell_->wait(timeout, [this] { return !empty(); });
+    }
+
+    /// Wakes up a consumer blocked in wait(), e.g. when playback is being stopped.
+    void wake() {
+        doorbell_->wake();
+    }
+
+    bool empty() const {
+        return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_seq_cst);
+    }
+
+    size_t size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Slot {
+        uint16_t size;
+        uint8_t data[SLOT_SIZE];
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+
+    // Keep the indices on separate cache lines so producer and consumer do not false-share.
+    alignas(64) std::atomic<uint64_t> head_{0};
+    alignas(64) std::atomic<uint64_t> tail_{0};
+
+    RingDoorbell own_doorbell_;
+    RingDoorbell *doorbell_;
+};
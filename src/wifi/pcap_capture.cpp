@@ -0,0 +1,307 @@
+#include "pcap_capture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+constexpr int ANTENNAS_PER_ADAPTER = 2;
+
+constexpr size_t FCS_SIZE = 4;
+
+// Radiotap field indices, see https://www.radiotap.org/fields/defined
+constexpr int RADIOTAP_FLAGS = 1;
+constexpr int RADIOTAP_DBM_ANTSIGNAL = 5;
+constexpr int RADIOTAP_DBM_ANTNOISE = 6;
+constexpr int RADIOTAP_ANTENNA = 11;
+constexpr int RADIOTAP_RADIOTAP_NAMESPACE = 29;
+constexpr int RADIOTAP_VENDOR_NAMESPACE = 30;
+constexpr int RADIOTAP_EXT = 31;
+
+constexpr uint8_t RADIOTAP_F_FCS = 0x10;
+
+/// Alignment and size of the fields up to TIMESTAMP, in bit order.
+constexpr struct {
+    uint8_t align;
+    uint8_t size;
+} RADIOTAP_FIELDS[] = {
+    {8, 8},  // TSFT
+    {1, 1},  // FLAGS
+    {1, 1},  // RATE
+    {2, 4},  // CHANNEL
+    {1, 2},  // FHSS
+    {1, 1},  // DBM_ANTSIGNAL
+    {1, 1},  // DBM_ANTNOISE
+    {2, 2},  // LOCK_QUALITY
+    {2, 2},  // TX_ATTENUATION
+    {2, 2},  // DB_TX_ATTENUATION
+    {1, 1},  // DBM_TX_POWER
+    {1, 1},  // ANTENNA
+    {1, 1},  // DB_ANTSIGNAL
+    {1, 1},  // DB_ANTNOISE
+    {2, 2},  // RX_FLAGS
+    {2, 2},  // TX_FLAGS
+    {1, 1},  // RTS_RETRIES
+    {1, 1},  // DATA_RETRIES
+    {4, 8},  // XCHANNEL
+    {1, 3},  // MCS
+    {4, 8},  // AMPDU_STATUS
+    {2, 12}, // VHT
+    {8, 12}, // TIMESTAMP
+};
+
+void put_le16(std::vector<uint8_t> &out, uint16_t value) {
+    out.push_back(value & 0xff);
+    out.push_back(value >> 8);
+}
+
+void put_le32(std::vector<uint8_t> &out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((value >> (8 * i)) & 0xff);
+    }
+}
+
+uint32_t get_le32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+/// Signal of one antenna, as found in a radiotap header.
+struct RadiotapAntenna {
+    int antenna = -1;
+    int8_t signal = 0;
+    std::optional<int8_t> noise;
+};
+
+struct RadiotapInfo {
+    size_t header_size = 0;
+    bool has_fcs = false;
+    std::vector<RadiotapAntenna> antennas;
+};
+
+/// Parses the fields needed for replay. Returns false if the header is malformed.
+/// Fields after the first unknown one are skipped, only the header size is needed to find the frame.
+bool parse_radiotap(const uint8_t *data, size_t size, RadiotapInfo &info) {
+    if (size < 8 || data[0] != 0) {
+        return false;
+    }
+
+    info.header_size = data[2] | data[3] << 8;
+    if (info.header_size > size) {
+        return false;
+    }
+
+    // Presence words, chained by the EXT bit
+    std::vector<uint32_t> presence;
+    size_t offset = 4;
+    do {
+        if (offset + 4 > info.header_size) {
+            return false;
+        }
+        presence.push_back(get_le32(data + offset));
+        offset += 4;
+    } while (presence.back() & (1u << RADIOTAP_EXT));
+
+    bool radiotap_namespace = true;
+
+    for (const uint32_t word : presence) {
+        if (!radiotap_namespace) {
+            break;
+        }
+
+        RadiotapAntenna antenna;
+        bool has_signal = false;
+
+        for (int bit = 0; bit < RADIOTAP_RADIOTAP_NAMESPACE; bit++) {
+            if (!(word & (1u << bit))) {
+                continue;
+            }
+            if (bit >= static_cast<int>(std::size(RADIOTAP_FIELDS))) {
+                return true;
+            }
+
+            const auto field = RADIOTAP_FIELDS[bit];
+            offset = (offset + field.align - 1) & ~static_cast<size_t>(field.align - 1);
+            if (offset + field.size > info.header_size) {
+                return false;
+            }
+
+            const uint8_t value = data[offset];
+            if (bit == RADIOTAP_FLAGS) {
+                info.has_fcs = value & RADIOTAP_F_FCS;
+            } else if (bit == RADIOTAP_DBM_ANTSIGNAL) {
+                antenna.signal = static_cast<int8_t>(value);
+                has_signal = true;
+            } else if (bit == RADIOTAP_DBM_ANTNOISE) {
+                antenna.noise = static_cast<int8_t>(value);
+            } else if (bit == RADIOTAP_ANTENNA) {
+                antenna.antenna = value;
+            }
+
+            offset += field.size;
+        }
+
+        if (has_signal) {
+            info.antennas.push_back(antenna);
+        }
+
+        // A vendor namespace can not be parsed without knowing the vendor
+        radiotap_namespace = !(word & (1u << RADIOTAP_VENDOR_NAMESPACE));
+    }
+
+    return true;
+}
+
+} // namespace
+
+PcapRecorder::PcapRecorder(const std::string &path) {
+    pcap_ = pcap_open_dead(DLT_IEEE802_11_RADIO, 65535);
+    if (!pcap_) {
+        throw std::runtime_error("Unable to create a pcap handle");
+    }
+
+    dumper_ = pcap_dump_open(pcap_, path.c_str());
+    if (!dumper_) {
+        const std::string error = pcap_geterr(pcap_);
+        pcap_close(pcap_);
+        throw std::runtime_error("Unable to open " + path + ": " + error);
+    }
+}
+
+PcapRecorder::~PcapRecorder() {
+    pcap_dump_close(dumper_);
+    pcap_close(pcap_);
+}
+
+void PcapRecorder::write(const Packet &packet, const uint8_t wlan_idx) {
+    buffer_.clear();
+
+    // Header: version, padding, length, then the presence words.
+    // The first word carries the flags, each following one describes one antenna.
+    buffer_.push_back(0);
+    buffer_.push_back(0);
+    put_le16(buffer_, 0); // Patched below
+    put_le32(buffer_, 1u << RADIOTAP_FLAGS | 1u << RADIOTAP_RADIOTAP_NAMESPACE | 1u << RADIOTAP_EXT);
+
+    constexpr uint32_t antenna_fields = 1u << RADIOTAP_DBM_ANTSIGNAL | 1u << RADIOTAP_DBM_ANTNOISE |
+                                        1u << RADIOTAP_ANTENNA;
+    for (int i = 0; i < ANTENNAS_PER_ADAPTER; i++) {
+        const bool last = i == ANTENNAS_PER_ADAPTER - 1;
+        put_le32(buffer_, antenna_fields | (last ? 0 : (1u << RADIOTAP_RADIOTAP_NAMESPACE | 1u << RADIOTAP_EXT)));
+    }
+
+    // Fields, all of them are single bytes so no padding is needed
+    buffer_.push_back(RADIOTAP_F_FCS);
+
+    for (int i = 0; i < ANTENNAS_PER_ADAPTER; i++) {
+        const auto rssi = static_cast<int8_t>(packet.RxAtrib.rssi[i]);
+        buffer_.push_back(rssi);
+        buffer_.push_back(static_cast<int8_t>(rssi - packet.RxAtrib.snr[i]));
+        buffer_.push_back(wlan_idx * ANTENNAS_PER_ADAPTER + i);
+    }
+
+    const auto header_size = static_cast<uint16_t>(buffer_.size());
+    buffer_[2] = header_size & 0xff;
+    buffer_[3] = header_size >> 8;
+
+    buffer_.insert(buffer_.end(), packet.Data.begin(), packet.Data.end());
+
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+
+    pcap_pkthdr header{};
+    header.ts.tv_sec = static_cast<decltype(header.ts.tv_sec)>(us / 1000000);
+    header.ts.tv_usec = static_cast<decltype(header.ts.tv_usec)>(us % 1000000);
+    header.caplen = static_cast<uint32_t>(buffer_.size());
+    header.len = header.caplen;
+
+    pcap_dump(reinterpret_cast<u_char *>(dumper_), &header, buffer_.data());
+
+    frame_count_++;
+}
+
+PcapReplayer::PcapReplayer(const std::string &path) {
+    char errbuf[PCAP_ERRBUF_SIZE] = {};
+
+    pcap_ = pcap_open_offline(path.c_str(), errbuf);
+    if (!pcap_) {
+        throw std::runtime_error("Unable to open " + path + ": " + errbuf);
+    }
+
+    if (pcap_datalink(pcap_) != DLT_IEEE802_11_RADIO) {
+        pcap_close(pcap_);
+        throw std::runtime_error(path + " does not hold radiotap frames");
+    }
+}
+
+PcapReplayer::~PcapReplayer() {
+    pcap_close(pcap_);
+}
+
+uint64_t PcapReplayer::run(const FrameSink &sink, const bool realtime) {
+    uint64_t frame_count = 0;
+
+    std::chrono::steady_clock::time_point start_time;
+    int64_t first_ts_us = 0;
+
+    pcap_pkthdr *header;
+    const u_char *data;
+
+    while (!stop_requested_ && pcap_next_ex(pcap_, &header, &data) == 1) {
+        RadiotapInfo info;
+        if (!parse_radiotap(data, header->caplen, info)) {
+            continue;
+        }
+
+        if (realtime) {
+            const int64_t ts_us = static_cast<int64_t>(header->ts.tv_sec) * 1000000 + header->ts.tv_usec;
+            if (frame_count == 0) {
+                start_time = std::chrono::steady_clock::now();
+                first_ts_us = ts_us;
+            }
+
+            // Sleep in short steps, so that stop() does not have to wait for a long gap in the capture
+            const auto due = start_time + std::chrono::microseconds(ts_us - first_ts_us);
+            while (!stop_requested_ && std::chrono::steady_clock::now() < due) {
+                std::this_thread::sleep_until(
+                    std::min(due, std::chrono::steady_clock::now() + std::chrono::milliseconds(100)));
+            }
+        }
+
+        // The receive path expects the FCS at the end of the frame, as the adapters deliver it
+        frame_.assign(data + info.header_size, data + header->caplen);
+        if (!info.has_fcs) {
+            frame_.insert(frame_.end(), FCS_SIZE, 0);
+        }
+
+        Packet packet{};
+        packet.Data = std::span<uint8_t>(frame_.data(), frame_.size());
+
+        uint8_t wlan_idx = 0;
+        for (const auto &antenna : info.antennas) {
+            const auto set_signal = [&](int slot) {
+                packet.RxAtrib.rssi[slot] = antenna.signal;
+                packet.RxAtrib.snr[slot] = antenna.noise.has_value() ? antenna.signal - antenna.noise.value() : 0;
+            };
+
+            if (antenna.antenna < 0) {
+                // Combined signal of all antennas, e.g. in captures of other tools
+                for (int i = 0; i < ANTENNAS_PER_ADAPTER; i++) {
+                    set_signal(i);
+                }
+            } else {
+                wlan_idx = antenna.antenna / ANTENNAS_PER_ADAPTER;
+                set_signal(antenna.antenna % ANTENNAS_PER_ADAPTER);
+            }
+        }
+
+        sink(packet, wlan_idx);
+        frame_count++;
+    }
+
+    return frame_count;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "net_compat.h"
+
+// clang-format off
+#include "pcap/pcap.h"
+// clang-format on
+
+#include "RxPacket.h"
+
+/// Writes received 802.11 frames to a pcap file (DLT_IEEE802_11_RADIO), e.g. to reproduce a field problem later.
+///
+/// Every frame gets a radiotap header holding the RSSI/SNR reported by the adapter, one radiotap namespace per antenna.
+/// The antenna index is `wlan_idx * 2 + antenna`, so frames of several adapters can share one file.
+/// The file opens in Wireshark as is.
+class PcapRecorder {
+public:
+    /// Throws std::runtime_error if the file cannot be created.
+    explicit PcapRecorder(const std::string &path);
+
+    ~PcapRecorder();
+
+    /// Not thread-safe, the caller serializes adapters.
+    void write(const Packet &packet, uint8_t wlan_idx);
+
+    uint64_t frame_count() const {
+        return frame_count_;
+    }
+
+private:
+    pcap_t *pcap_ = nullptr;
+    pcap_dumper_t *dumper_ = nullptr;
+
+    std::vector<uint8_t> buffer_;
+    uint64_t frame_count_ = 0;
+};
+
+/// Feeds the frames of a radiotap pcap file (e.g. written by PcapRecorder) back into the receive path.
+class PcapReplayer {
+public:
+    using FrameSink = std::function<void(const Packet &packet, uint8_t wlan_idx)>;
+
+    /// Throws std::runtime_error if the file cannot be opened or does not hold radiotap frames.
+    explicit PcapReplayer(const std::string &path);
+
+    ~PcapReplayer();
+
+    /// Blocks until the end of the file or stop(). Returns the number of frames replayed.
+    /// With `realtime` the recorded timing is kept, otherwise frames are fed as fast as the sink takes them.
+    uint64_t run(const FrameSink &sink, bool realtime);
+
+    /// Can be called from any thread.
+    void stop() {
+        stop_requested_ = true;
+    }
+
+private:
+    pcap_t *pcap_ = nullptr;
+
+    std::atomic<bool> stop_requested_{false};
+
+    std::vector<uint8_t> frame_;
+};
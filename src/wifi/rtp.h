@@ -1,9 +1,23 @@
 ﻿#pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
 #if defined(_WIN32)
     #pragma pack(push, 1)
 #else
     #include <arpa/inet.h>
+    #include <sys/types.h>
+#endif
+
+#ifndef PACKED
+    #if defined(_WIN32)
+        #define PACKED
+    #else
+        #define PACKED __attribute__((packed))
+    #endif
 #endif
 
 class RtpHeader {
@@ -1,136 +1,187 @@
 #include "signal_quality.h"
 
 #include <chrono>
-#include <random>
+#include <cmath>
+#include <thread>
+#include <utility>
 
 namespace {
 
-std::string generate_random_string(size_t length) {
-    const std::string characters = "abcdefghijklmnopqrstuvwxyz";
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> distrib(0, characters.size() - 1);
+template <class Rng>
+uint32_t generate_random_code(Rng &gen) {
+    std::uniform_int_distribution<> distrib('a', 'z');
 
-    std::string result;
-    result.reserve(length);
-    for (size_t i = 0; i < length; ++i) {
-        result += characters[distrib(gen)];
+    uint32_t result = 0;
+    for (int i = 0; i < 4; ++i) {
+        result |= static_cast<uint32_t>(distrib(gen)) << (8 * i);
     }
     return result;
 }
 
-} // namespace
+std::string unpack_code(uint32_t code) {
+    std::string result(4, 'a');
+    for (int i = 0; i < 4; ++i) {
+        result[i] = static_cast<char>((code >> (8 * i)) & 0xff);
+    }
+    return result;
+}
 
-// Remove RSSI samples older than 1 second
-void SignalQualityCalculator::cleanup_old_rssi_data() {
-    const auto now = std::chrono::steady_clock::now();
-    const auto cutoff = now - averaging_window_;
+template <class T>
+void add_relaxed(std::atomic<T> &value, T n) {
+    // Single writer, a load and a store are enough.
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
 
-    // Erase-remove idiom for data older than cutoff
-    std::erase_if(rssi_data_, [&](const RssiEntry &entry) { return entry.timestamp < cutoff; });
+} // namespace
+
+int64_t SignalQualityCalculator::current_period() {
+    const auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(since_epoch) / BUCKET_DURATION;
 }
 
-void SignalQualityCalculator::cleanup_old_snr_data() {
-    const auto now = std::chrono::steady_clock::now();
-    const auto cutoff = now - averaging_window_;
+void SignalQualityCalculator::add(const std::initializer_list<std::pair<Field, int64_t>> samples) {
+    const int64_t now = current_period();
+
+    // Single writer, so the sequence only has to be published.
+    const uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (window_end_.load(std::memory_order_relaxed) != now) {
+        advance_window(now);
+    }
+
+    Bucket &bucket = buckets_[now % BUCKET_COUNT];
+    for (const auto &[field, value] : samples) {
+        add_relaxed(bucket.sums[field], value);
+        add_relaxed(totals_[field], value);
+    }
 
-    // Erase-remove idiom for data older than cutoff
-    std::erase_if(snr_data_, [&](const SnrEntry &entry) { return entry.timestamp < cutoff; });
+    sequence_.store(sequence + 2, std::memory_order_release);
 }
 
-void SignalQualityCalculator::cleanup_old_fec_data() {
-    const auto now = std::chrono::steady_clock::now();
-    const auto cutoff = now - averaging_window_;
+void SignalQualityCalculator::advance_window(const int64_t now) {
+    const int64_t end = window_end_.load(std::memory_order_relaxed);
+
+    if (end < 0 || now - end >= BUCKET_COUNT) {
+        for (auto &total : totals_) {
+            total.store(0, std::memory_order_relaxed);
+        }
+    } else {
+        for (int64_t period = std::max<int64_t>(end - BUCKET_COUNT + 1, 0); period <= now - BUCKET_COUNT; period++) {
+            const Bucket &bucket = buckets_[period % BUCKET_COUNT];
+            if (bucket.period.load(std::memory_order_relaxed) != period) {
+                continue;
+            }
+            for (int i = 0; i < FieldCount; i++) {
+                add_relaxed(totals_[i], -bucket.sums[i].load(std::memory_order_relaxed));
+            }
+        }
+    }
 
-    std::erase_if(fec_data_, [&](const FecEntry &entry) { return entry.timestamp < cutoff; });
+    // Whatever this bucket held has just left the window.
+    Bucket &bucket = buckets_[now % BUCKET_COUNT];
+    for (auto &sum : bucket.sums) {
+        sum.store(0, std::memory_order_relaxed);
+    }
+    bucket.period.store(now, std::memory_order_relaxed);
+
+    window_end_.store(now, std::memory_order_relaxed);
 }
 
-void SignalQualityCalculator::add_rssi(uint8_t ant1, uint8_t ant2) {
-    std::lock_guard lock(mutex_);
+SignalQualityCalculator::Sums SignalQualityCalculator::window_sums(const int64_t now) const {
+    Sums sums;
+
+    while (true) {
+        const uint32_t sequence = sequence_.load(std::memory_order_acquire);
+        if (sequence % 2 != 0) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        const int64_t end = window_end_.load(std::memory_order_relaxed);
+        if (end < 0 || now - end >= BUCKET_COUNT) {
+            sums.fill(0);
+        } else {
+            for (int i = 0; i < FieldCount; i++) {
+                sums[i] = totals_[i].load(std::memory_order_relaxed);
+            }
+            // Buckets that left the window since the last sample. None while samples keep coming.
+            for (int64_t period = std::max<int64_t>(end - BUCKET_COUNT + 1, 0); period <= now - BUCKET_COUNT;
+                 period++) {
+                const Bucket &bucket = buckets_[period % BUCKET_COUNT];
+                if (bucket.period.load(std::memory_order_relaxed) != period) {
+                    continue;
+                }
+                for (int i = 0; i < FieldCount; i++) {
+                    sums[i] -= bucket.sums[i].load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence_.load(std::memory_order_relaxed) == sequence) {
+            return sums;
+        }
+    }
+}
 
-    RssiEntry entry;
-    entry.timestamp = std::chrono::steady_clock::now();
-    entry.ant1 = ant1;
-    entry.ant2 = ant2;
-    rssi_data_.push_back(entry);
+void SignalQualityCalculator::add_rssi(uint8_t ant1, uint8_t ant2) {
+    add({{RssiSum0, ant1}, {RssiSum1, ant2}, {RssiCount, 1}});
 }
 
 void SignalQualityCalculator::add_snr(int8_t ant1, int8_t ant2) {
-    std::lock_guard lock(mutex_);
-
-    SnrEntry entry;
-    entry.timestamp = std::chrono::steady_clock::now();
-    entry.ant1 = ant1;
-    entry.ant2 = ant2;
-    snr_data_.push_back(entry);
+    add({{SnrSum0, ant1}, {SnrSum1, ant2}, {SnrCount, 1}});
 }
 
-SignalQualityCalculator::SignalQuality SignalQualityCalculator::calculate_signal_quality() {
+SignalQualityCalculator::SignalQuality SignalQualityCalculator::calculate_signal_quality() const {
     SignalQuality ret;
-    std::lock_guard lock(mutex_);
-
-    // Make sure we clean up old data first
-    cleanup_old_rssi_data();
-    cleanup_old_snr_data();
-    cleanup_old_fec_data();
 
-    auto avg_rssi = get_average(rssi_data_);
-    auto avg_snr = get_average(snr_data_);
+    const Sums sums = window_sums(current_period());
 
-    auto [p_recovered, p_lost, p_total] = get_accumulated_fec_data();
+    std::pair<float, float> avg_rssi{0.f, 0.f};
+    if (sums[RssiCount] > 0) {
+        const auto count = static_cast<float>(sums[RssiCount]);
+        avg_rssi = {static_cast<float>(sums[RssiSum0]) / count, static_cast<float>(sums[RssiSum1]) / count};
+    }
+    std::pair<float, float> avg_snr{0.f, 0.f};
+    if (sums[SnrCount] > 0) {
+        const auto count = static_cast<float>(sums[SnrCount]);
+        avg_snr = {static_cast<float>(sums[SnrSum0]) / count, static_cast<float>(sums[SnrSum1]) / count};
+    }
 
-    ret.lost_last_second = p_lost;
-    ret.recovered_last_second = p_recovered;
-    ret.total_last_second = p_total;
+    ret.lost_last_second = static_cast<int>(sums[FecLost]);
+    ret.recovered_last_second = static_cast<int>(sums[FecRecovered]);
+    ret.total_last_second = static_cast<int>(sums[FecAll]);
 
     ret.rssi[0] = round(avg_rssi.first);
     ret.rssi[1] = round(avg_rssi.second);
     ret.snr[0] = round(avg_snr.first);
     ret.snr[1] = round(avg_snr.second);
-    ret.idr_code = idr_code_;
-
-    // RSSI falls in range [0, 126], and we map it from range [0, 126] to [1000, 2000].
-    float rssi0 = map_range(avg_rssi.first, 50.f, 110.f, 1000.f, 2000.f);
-    float rssi1 = map_range(avg_rssi.second, 50.f, 110.f, 1000.f, 2000.f);
-
-    // SNR falls in range [0, 60], and we map it from range [0, 60] to [1000, 2000].
-    float snr0 = map_range(avg_snr.first, 20.f, 50.f, 1000.f, 2000.f);
-    float snr1 = map_range(avg_snr.second, 20.f, 50.f, 1000.f, 2000.f);
+    ret.idr_code = unpack_code(idr_code_.load(std::memory_order_relaxed));
 
-    // Link Score = (weight1 * RSSI) + (weight2 * SNR)
-    // See https://github.com/OpenIPC/adaptive-link
-    ret.link_score[0] = round(0.5f * rssi0 + 0.5f * snr0);
-    ret.link_score[1] = round(0.5f * rssi1 + 0.5f * snr1);
+    ret.link_score[0] = round(link_score(avg_rssi.first, avg_snr.first));
+    ret.link_score[1] = round(link_score(avg_rssi.second, avg_snr.second));
 
     return ret;
 }
 
-std::tuple<uint32_t, uint32_t, uint32_t> SignalQualityCalculator::get_accumulated_fec_data() const {
-    uint32_t p_recovered = 0;
-    uint32_t p_all = 0;
-    uint32_t p_lost = 0;
+float SignalQualityCalculator::link_score(const float rssi, const float snr) {
+    // RSSI falls in range [0, 126], and we map it from range [0, 126] to [1000, 2000].
+    const float rssi_score = map_range(rssi, 50.f, 110.f, 1000.f, 2000.f);
 
-    for (const auto &data : fec_data_) {
-        p_all += data.all;
-        p_recovered += data.recovered;
-        p_lost += data.lost;
-    }
+    // SNR falls in range [0, 60], and we map it from range [0, 60] to [1000, 2000].
+    const float snr_score = map_range(snr, 20.f, 50.f, 1000.f, 2000.f);
 
-    return {p_recovered, p_lost, p_all};
+    // Link Score = (weight1 * RSSI) + (weight2 * SNR)
+    // See https://github.com/OpenIPC/adaptive-link
+    return 0.5f * rssi_score + 0.5f * snr_score;
 }
 
 void SignalQualityCalculator::add_fec(uint32_t p_all, uint32_t p_recovered, uint32_t p_lost) {
-    std::lock_guard lock(mutex_);
-
-    FecEntry entry;
-    entry.timestamp = std::chrono::steady_clock::now();
-    entry.all = p_all;
-    entry.recovered = p_recovered;
-    entry.lost = p_lost;
+    add({{FecAll, p_all}, {FecRecovered, p_recovered}, {FecLost, p_lost}});
 
     if (p_lost > 0) {
-        idr_code_ = generate_random_string(4);
+        idr_code_.store(generate_random_code(idr_code_rng_), std::memory_order_relaxed);
     }
-
-    fec_data_.push_back(entry);
 }
@@ -1,11 +1,14 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
-#include <mutex>
+#include <initializer_list>
+#include <random>
+#include <string>
 #include <utility>
-#include <vector>
 
 inline double map_range(double input, double input_min, double input_max, double output_min, double output_max) {
     // 1. Clamp the input value first
@@ -15,6 +18,12 @@ inline double map_range(double input, double input_min, double input_max, double
     return output_min + (clamped_input - input_min) * (output_max - output_min) / (input_max - input_min);
 }
 
+/// RSSI, SNR and FEC statistics over the last second.
+///
+/// Samples are summed into a ring of 10 ms buckets and into running totals of the window. Adding one is O(1),
+/// and so is a query while samples keep coming: it reads the totals and takes off the buckets that left the
+/// window since the last sample. There must be only one thread adding samples, but any number of threads may
+/// query at the same time without locking. A query that overlaps a sample being added reads again.
 class SignalQualityCalculator {
 public:
     struct SignalQuality {
@@ -39,71 +48,60 @@ public:
     /// Add new FEC entry with current timestamp
     void add_fec(uint32_t p_all, uint32_t p_recovered, uint32_t p_lost);
 
-    template <class T>
-    std::pair<float, float> get_average(const T &array) {
-        std::lock_guard lock(mutex_);
-
-        float sum1 = 0.f;
-        float sum2 = 0.f;
-        int count = static_cast<int>(array.size());
-
-        if (count > 0) {
-            for (auto &entry : array) {
-                sum1 += entry.ant1;
-                sum2 += entry.ant2;
-            }
-            sum1 /= count;
-            sum2 /= count;
-        }
-
-        return {sum1, sum2};
-    }
-
     /// Calculate signal quality over the averaging window
-    SignalQuality calculate_signal_quality();
+    SignalQuality calculate_signal_quality() const;
+
+    /// Link score in [1000, 2000] of an antenna receiving with `rssi` and `snr`.
+    static float link_score(float rssi, float snr);
 
 private:
-    /// Sum up FEC data over the averaging window
-    std::tuple<uint32_t, uint32_t, uint32_t> get_accumulated_fec_data() const;
-
-    // Helper methods to remove old entries
-    void cleanup_old_rssi_data();
-    void cleanup_old_snr_data();
-    void cleanup_old_fec_data();
-
-    // We store a timestamp for each RSSI entry
-    struct RssiEntry {
-        std::chrono::steady_clock::time_point timestamp;
-        uint8_t ant1{};
-        uint8_t ant2{};
+    static constexpr int BUCKET_COUNT = 100;
+    static constexpr std::chrono::milliseconds BUCKET_DURATION{10};
+
+    /// What a bucket and the window totals add up.
+    enum Field {
+        RssiCount,
+        RssiSum0,
+        RssiSum1,
+        SnrCount,
+        SnrSum0,
+        SnrSum1,
+        FecAll,
+        FecRecovered,
+        FecLost,
+        FieldCount,
     };
 
-    // We store a timestamp for each RSSI entry
-    struct SnrEntry {
-        std::chrono::steady_clock::time_point timestamp;
-        int8_t ant1{};
-        int8_t ant2{};
-    };
+    using Sums = std::array<int64_t, FieldCount>;
 
-    // We store a timestamp for each FEC entry
-    struct FecEntry {
-        std::chrono::steady_clock::time_point timestamp;
-        uint32_t all{};
-        uint32_t recovered{};
-        uint32_t lost{};
+    struct Bucket {
+        /// Number of BUCKET_DURATION periods since the clock's epoch this bucket holds, -1 if unused.
+        std::atomic<int64_t> period{-1};
+        std::array<std::atomic<int64_t>, FieldCount> sums{};
     };
 
-private:
-    const std::chrono::seconds averaging_window_{std::chrono::seconds(1)};
+    static int64_t current_period();
+
+    /// Adds to the bucket of the current period and to the window totals.
+    void add(std::initializer_list<std::pair<Field, int64_t>> samples);
+
+    /// Takes the buckets that left the window off the totals and empties the bucket of `now`.
+    void advance_window(int64_t now);
 
-    mutable std::recursive_mutex mutex_;
+    /// The sums of the window ending with period `now`.
+    Sums window_sums(int64_t now) const;
 
-    std::vector<RssiEntry> rssi_data_;
+    std::array<Bucket, BUCKET_COUNT> buckets_;
 
-    std::vector<SnrEntry> snr_data_;
+    /// Sums of the buckets from window_end_ - BUCKET_COUNT + 1 to window_end_.
+    std::array<std::atomic<int64_t>, FieldCount> totals_{};
+    /// Period of the last sample, -1 before the first.
+    std::atomic<int64_t> window_end_{-1};
+    /// Odd while the writer changes the buckets or the totals, a seqlock for the readers.
+    std::atomic<uint32_t> sequence_{0};
 
-    std::vector<FecEntry> fec_data_;
+    // 4-character random string, packed so that it can be read without a lock
+    std::atomic<uint32_t> idr_code_{0x61616161}; // "aaaa"
 
-    // 4-character random string
-    std::string idr_code_{"aaaa"};
+    std::minstd_rand idr_code_rng_{std::random_device{}()};
 };
@@ -3,6 +3,7 @@
 
 #include <cinttypes>
 #include <cstring>
+#include <utility>
 
 #include "cross/endian.h"
 
@@ -309,7 +310,8 @@ void RawSocketTransmitter::dumpStats(FILE *fp,
                                      uint64_t ts,
                                      uint32_t &injectedPackets,
                                      uint32_t &droppedPackets,
-                                     uint32_t &injectedBytes) {
+                                     uint32_t &injectedBytes,
+                                     TxAntennaStat &antennaStats) {
     for (auto &kv : antennaStat_) {
         const auto &stats = kv.second;
         uint64_t countAll = stats.countPacketsInjected + stats.countPacketsDropped;
@@ -330,6 +332,7 @@ void RawSocketTransmitter::dumpStats(FILE *fp,
         injectedBytes += stats.countBytesInjected;
     }
 
+    antennaStats = std::move(antennaStat_);
     antennaStat_.clear();
 }
 #endif
@@ -417,7 +420,8 @@ void UsbTransmitter::dumpStats(FILE *fp,
                                uint64_t ts,
                                uint32_t &injectedPackets,
                                uint32_t &droppedPackets,
-                               uint32_t &injectedBytes) {
+                               uint32_t &injectedBytes,
+                               TxAntennaStat &antennaStats) {
     for (auto &kv : antennaStat_) {
         const auto &stats = kv.second;
         uint64_t countAll = stats.countPacketsInjected + stats.countPacketsDropped;
@@ -437,6 +441,7 @@ void UsbTransmitter::dumpStats(FILE *fp,
         droppedPackets += stats.countPacketsDropped;
         injectedBytes += stats.countBytesInjected;
     }
+    antennaStats = std::move(antennaStat_);
     antennaStat_.clear();
 }
 
@@ -480,3 +485,91 @@ void UsbTransmitter::injectPacket(const uint8_t *buf, const size_t size) {
     const uint64_t key = (static_cast<uint64_t>(currentOutput_) << 8) | 0xff;
     antennaStat_[key].logLatency(get_time_us() - startUs, result, static_cast<uint32_t>(size));
 }
+
+//-------------------------------------------------------------
+// SyntheticTransmitter
+//-------------------------------------------------------------
+
+SyntheticTransmitter::SyntheticTransmitter(int k,
+                                           int n,
+                                           const std::string &keypair,
+                                           uint64_t epoch,
+                                           uint32_t channelId,
+                                           std::vector<Source> sources,
+                                           FrameSink sink,
+                                           uint32_t seed)
+    : Transmitter(k, n, keypair, epoch, channelId), channelId_(channelId), currentOutput_(-1), ieee80211Sequence_(0),
+      sources_(std::move(sources)), sink_(std::move(sink)), random_(seed) {}
+
+void SyntheticTransmitter::selectOutput(int idx) {
+    currentOutput_ = idx;
+}
+
+void SyntheticTransmitter::dumpStats(FILE *fp,
+                                     uint64_t ts,
+                                     uint32_t &injectedPackets,
+                                     uint32_t &droppedPackets,
+                                     uint32_t &injectedBytes,
+                                     TxAntennaStat &antennaStats) {
+    for (const auto &kv : antennaStat_) {
+        const auto &stats = kv.second;
+
+        fprintf(fp,
+                "%" PRIu64 "\tTX_ANT\t%" PRIx64 "\t%u:%u\n",
+                ts,
+                kv.first,
+                stats.countPacketsInjected,
+                stats.countPacketsDropped);
+
+        injectedPackets += stats.countPacketsInjected;
+        droppedPackets += stats.countPacketsDropped;
+        injectedBytes += stats.countBytesInjected;
+    }
+    antennaStats = std::move(antennaStat_);
+    antennaStat_.clear();
+}
+
+void SyntheticTransmitter::injectPacket(const uint8_t *buf, size_t size) {
+    if (size > MAX_FORWARDER_PACKET_SIZE) {
+        throw std::runtime_error("SyntheticTransmitter::injectPacket - packet too large");
+    }
+
+    // 802.11 header + payload + FCS, as an adapter would hand it over
+    frame_.assign(ieee80211_header, ieee80211_header + sizeof(ieee80211_header));
+    frame_.insert(frame_.end(), buf, buf + size);
+    frame_.insert(frame_.end(), 4, 0);
+
+    frame_[0] = FRAME_TYPE_DATA;
+    const uint32_t channelIdBE = htonl(channelId_);
+    std::memcpy(frame_.data() + SRC_MAC_THIRD_BYTE, &channelIdBE, sizeof(uint32_t));
+    std::memcpy(frame_.data() + DST_MAC_THIRD_BYTE, &channelIdBE, sizeof(uint32_t));
+
+    frame_[FRAME_SEQ_LB] = static_cast<uint8_t>(ieee80211Sequence_ & 0xff);
+    frame_[FRAME_SEQ_HB] = static_cast<uint8_t>((ieee80211Sequence_ >> 8) & 0xff);
+    ieee80211Sequence_ += 16;
+
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    for (size_t i = 0; i < sources_.size(); i++) {
+        if (currentOutput_ >= 0 && static_cast<size_t>(currentOutput_) != i) {
+            continue;
+        }
+
+        const Source &source = sources_[i];
+        const bool delivered = chance(random_) >= source.lossRate;
+
+        if (delivered) {
+            Packet packet{};
+            packet.Data = std::span<uint8_t>(frame_.data(), frame_.size());
+            packet.RxAtrib.rssi[0] = source.rssi;
+            packet.RxAtrib.rssi[1] = source.rssi;
+            packet.RxAtrib.snr[0] = source.snr;
+            packet.RxAtrib.snr[1] = source.snr;
+
+            sink_(packet, static_cast<uint8_t>(i));
+        }
+
+        const uint64_t key = (static_cast<uint64_t>(i) << 8) | 0xff;
+        antennaStat_[key].logLatency(0, delivered, static_cast<uint32_t>(size));
+    }
+}
@@ -9,12 +9,15 @@ extern "C" {
 
 #include <algorithm>
 #include <atomic>
+#include <functional>
 #include <memory>
+#include <random>
 #include <unordered_map>
 #include <vector>
 
 #include "wfb-ng/wifibroadcast.hpp"
 #include "IRtlDevice.h"
+#include "RxPacket.h"
 
 #undef min
 #undef max
@@ -28,6 +31,53 @@ struct FecDeleter {
     }
 };
 
+/**
+ * @class TxAntennaItem
+ * @brief Tracks statistics for a single output interface/antenna.
+ */
+class TxAntennaItem {
+public:
+    TxAntennaItem()
+        : countPacketsInjected(0), countBytesInjected(0), countPacketsDropped(0), latencySum(0), latencyMin(0),
+          latencyMax(0) {}
+
+    /**
+     * @brief Logs packet latency and updates injection/dropping stats.
+     * @param latency Microseconds elapsed.
+     * @param succeeded True if packet was sent successfully, false if dropped.
+     * @param packetSize Number of bytes in the packet.
+     */
+    void logLatency(const uint64_t latency, const bool succeeded, const uint32_t packetSize) {
+        if ((countPacketsInjected + countPacketsDropped) == 0) {
+            latencyMin = latency;
+            latencyMax = latency;
+        } else {
+            latencyMin = std::min(latency, latencyMin);
+            latencyMax = std::max(latency, latencyMax);
+        }
+        latencySum += latency;
+
+        if (succeeded) {
+            ++countPacketsInjected;
+            countBytesInjected += packetSize;
+        } else {
+            ++countPacketsDropped;
+        }
+    }
+
+    // Stats
+    uint32_t countPacketsInjected;
+    uint32_t countBytesInjected;
+    uint32_t countPacketsDropped;
+
+    uint64_t latencySum;
+    uint64_t latencyMin;
+    uint64_t latencyMax;
+};
+
+/// Map: key = (antennaIndex << 8) | 0xff, value = TxAntennaItem
+typedef std::unordered_map<uint64_t, TxAntennaItem> TxAntennaStat;
+
 /**
  * @class Transmitter
  * @brief Base class providing FEC encoding, encryption, and session key management.
@@ -83,12 +133,14 @@ public:
      * @param injectedPackets [out] cumulative count of injected packets.
      * @param droppedPackets [out] cumulative count of dropped packets.
      * @param injectedBytes [out] cumulative count of injected bytes.
+     * @param antennaStats [out] per-output stats since the last call, replacing its contents.
      */
     virtual void dumpStats(FILE *fp,
                            uint64_t ts,
                            uint32_t &injectedPackets,
                            uint32_t &droppedPackets,
-                           uint32_t &injectedBytes) = 0;
+                           uint32_t &injectedBytes,
+                           TxAntennaStat &antennaStats) = 0;
 
 protected:
     /**
@@ -127,53 +179,6 @@ private:
     uint8_t sessionKeyPacket_[sizeof(wsession_hdr_t) + sizeof(wsession_data_t) + crypto_box_MACBYTES];
 };
 
-/**
- * @class TxAntennaItem
- * @brief Tracks statistics for a single output interface/antenna.
- */
-class TxAntennaItem {
-public:
-    TxAntennaItem()
-        : countPacketsInjected(0), countBytesInjected(0), countPacketsDropped(0), latencySum(0), latencyMin(0),
-          latencyMax(0) {}
-
-    /**
-     * @brief Logs packet latency and updates injection/dropping stats.
-     * @param latency Microseconds elapsed.
-     * @param succeeded True if packet was sent successfully, false if dropped.
-     * @param packetSize Number of bytes in the packet.
-     */
-    void logLatency(const uint64_t latency, const bool succeeded, const uint32_t packetSize) {
-        if ((countPacketsInjected + countPacketsDropped) == 0) {
-            latencyMin = latency;
-            latencyMax = latency;
-        } else {
-            latencyMin = std::min(latency, latencyMin);
-            latencyMax = std::max(latency, latencyMax);
-        }
-        latencySum += latency;
-
-        if (succeeded) {
-            ++countPacketsInjected;
-            countBytesInjected += packetSize;
-        } else {
-            ++countPacketsDropped;
-        }
-    }
-
-    // Stats
-    uint32_t countPacketsInjected;
-    uint32_t countBytesInjected;
-    uint32_t countPacketsDropped;
-
-    uint64_t latencySum;
-    uint64_t latencyMin;
-    uint64_t latencyMax;
-};
-
-/// Map: key = (antennaIndex << 8) | 0xff, value = TxAntennaItem
-typedef std::unordered_map<uint64_t, TxAntennaItem> TxAntennaStat;
-
 #ifdef __linux__
 /**
  * @class RawSocketTransmitter
@@ -204,7 +209,8 @@ public:
                    uint64_t ts,
                    uint32_t &injectedPackets,
                    uint32_t &droppedPackets,
-                   uint32_t &injectedBytes) override;
+                   uint32_t &injectedBytes,
+                   TxAntennaStat &antennaStats) override;
 
 private:
     void injectPacket(const uint8_t *buf, size_t size) override;
@@ -241,8 +247,10 @@ public:
                    uint64_t ts,
                    uint32_t &injectedPackets,
                    uint32_t &droppedPackets,
-                   uint32_t &injectedBytes) override {
+                   uint32_t &injectedBytes,
+                   TxAntennaStat &antennaStats) override {
         // No stats for UDP
+        antennaStats.clear();
     }
 
     void selectOutput(int idx) override;
@@ -282,7 +290,8 @@ public:
                    uint64_t ts,
                    uint32_t &injectedPackets,
                    uint32_t &droppedPackets,
-                   uint32_t &injectedBytes) override;
+                   uint32_t &injectedBytes,
+                   TxAntennaStat &antennaStats) override;
 
 private:
     void injectPacket(const uint8_t *buf, size_t size) override;
@@ -298,3 +307,57 @@ private:
     IRtlDevice *rtlDevice_;
     std::atomic<bool> stopped_{false};
 };
+
+/**
+ * @class SyntheticTransmitter
+ * @brief Hands packets to simulated adapters instead of a radio, so that receiving can be exercised without hardware.
+ *
+ * Every frame is offered to each simulated adapter, which misses it with its own loss rate and stamps it with its
+ * own RSSI/SNR. Point the sink at WfbngReceiver::handle_80211_frame to feed a diversity receiver.
+ */
+class SyntheticTransmitter : public Transmitter {
+public:
+    struct Source {
+        /// Probability [0, 1] that the adapter misses a frame.
+        double lossRate = 0.0;
+        uint8_t rssi = 100;
+        int8_t snr = 30;
+    };
+
+    /// Receives the complete 802.11 frame (header, payload and FCS) and the index of the adapter.
+    using FrameSink = std::function<void(const Packet &packet, uint8_t wlanIdx)>;
+
+    SyntheticTransmitter(int k,
+                         int n,
+                         const std::string &keypair,
+                         uint64_t epoch,
+                         uint32_t channelId,
+                         std::vector<Source> sources,
+                         FrameSink sink,
+                         uint32_t seed = 0);
+
+    ~SyntheticTransmitter() override = default;
+
+    /// Only deliver to adapter `idx`, or to all of them if -1.
+    void selectOutput(int idx) override;
+
+    void dumpStats(FILE *fp,
+                   uint64_t ts,
+                   uint32_t &injectedPackets,
+                   uint32_t &droppedPackets,
+                   uint32_t &injectedBytes,
+                   TxAntennaStat &antennaStats) override;
+
+private:
+    void injectPacket(const uint8_t *buf, size_t size) override;
+
+private:
+    const uint32_t channelId_;
+    int currentOutput_;
+    uint16_t ieee80211Sequence_;
+    TxAntennaStat antennaStat_;
+    std::vector<Source> sources_;
+    FrameSink sink_;
+    std::mt19937 random_;
+    std::vector<uint8_t> frame_;
+};
@@ -31,6 +31,11 @@ void TxFrame::stop() {
     }
 }
 
+TxStats TxFrame::getStats() const {
+    std::lock_guard lock(statsMutex_);
+    return stats_;
+}
+
 uint32_t TxFrame::extractRxqOverflow(struct msghdr *msg) {
 #ifdef __linux__
     for (cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(msg, cmsg)) {
@@ -180,7 +185,20 @@ void TxFrame::dataSource(std::shared_ptr<Transmitter> &transmitter,
         // Logging at intervals
         curTs = get_time_ms();
         if (curTs >= logSendTs) {
-            transmitter->dumpStats(stdout, curTs, countPInjected, countPDropped, countBInjected);
+            TxAntennaStat antennaStats;
+            transmitter->dumpStats(stdout, curTs, countPInjected, countPDropped, countBInjected, antennaStats);
+
+            {
+                std::lock_guard lock(statsMutex_);
+                stats_.packetsIncoming += countPIncoming;
+                stats_.bytesIncoming += countBIncoming;
+                stats_.packetsInjected += countPInjected;
+                stats_.bytesInjected += countBInjected;
+                stats_.packetsDropped += countPDropped;
+                stats_.packetsTruncated += countPTruncated;
+                stats_.fecTimeouts += countPFecTimeouts;
+                stats_.antennas = std::move(antennaStats);
+            }
 
             if (countPDropped) {
                 std::fprintf(stderr, "%u packets dropped\n", countPDropped);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "transmitter.h"
@@ -58,6 +59,23 @@ struct TxArgs {
     std::string keypair = "tx.key";
 };
 
+/**
+ * @struct TxStats
+ * @brief Totals of TxFrame::dataSource() since it started, published once per log interval.
+ */
+struct TxStats {
+    uint64_t packetsIncoming = 0;
+    uint64_t bytesIncoming = 0;
+    uint64_t packetsInjected = 0;
+    uint64_t bytesInjected = 0;
+    uint64_t packetsDropped = 0;
+    uint64_t packetsTruncated = 0;
+    uint64_t fecTimeouts = 0;
+
+    /// Injection stats per output, of the last log interval only.
+    TxAntennaStat antennas;
+};
+
 /**
  * @class TxFrame
  * @brief Orchestrates the receiving of inbound packets, the creation of Transmitter(s),
@@ -102,6 +120,11 @@ public:
      */
     void stop();
 
+    /**
+     * @brief Copy of the stats as of the last log interval. May be called from any thread.
+     */
+    TxStats getStats() const;
+
 private:
     bool shouldStop_ = false;
 
@@ -109,6 +132,9 @@ private:
 
     std::shared_ptr<Transmitter> transmitter_;
 
+    mutable std::mutex statsMutex_;
+    TxStats stats_;
+
     /**
      * @brief Create a UDP socket for receiving data
      * @param port UDP port to bind to
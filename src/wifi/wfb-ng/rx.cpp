@@ -268,9 +268,10 @@ void Receiver::loop_iter(void)
 
 
 Aggregator::Aggregator(const string &keypair, uint64_t epoch, uint32_t channel_id) : \
-    count_p_all(0), count_b_all(0), count_p_dec_err(0), count_p_session(0), count_p_data(0), count_p_fec_recovered(0),
-    count_p_lost(0), count_p_bad(0), count_p_override(0), count_p_outgoing(0), count_b_outgoing(0),
-    fec_p(NULL), fec_k(-1), fec_n(-1), seq(0), rx_ring{}, rx_ring_front(0), rx_ring_alloc(0),
+    count_p_all(0), count_b_all(0), count_p_dec_err(0), count_p_session(0), count_p_data(0), count_p_dec_skipped(0),
+    count_p_fec_recovered(0),
+    count_p_lost(0), count_p_bad(0), count_p_override(0), count_p_timeout(0), count_p_outgoing(0), count_b_outgoing(0),
+    rx_timestamp(0), sent_fragment_ts{}, fec_p(NULL), fec_k(-1), fec_n(-1), seq(0), rx_ring{}, rx_ring_size(RX_RING_SIZE), rx_ring_front(0), rx_ring_alloc(0), spare_fragment(NULL),
     last_known_block((uint64_t)-1), epoch(epoch), channel_id(channel_id)
 {
     memset(session_key, '\0', sizeof(session_key));
@@ -300,6 +301,108 @@ Aggregator::~Aggregator()
     {
         deinit_fec();
     }
+
+    free_fragments(0);
+    wfb_aligned_free(spare_fragment);
+}
+
+// Grows the fragment buffers of the first ring_size blocks to n fragments. They are kept until the ring
+// shrinks or the aggregator is destroyed, so a new session with the same or a smaller n allocates nothing.
+void Aggregator::reserve_fragments(int ring_size, int n)
+{
+    for(int ring_idx = 0; ring_idx < ring_size; ring_idx++)
+    {
+        rx_ring_item_t *p = &rx_ring[ring_idx];
+        if (p->fragments_alloc >= n) continue;
+
+        uint8_t **fragments = new uint8_t*[n];
+        for(int i=0; i < n; i++)
+        {
+            if (i < p->fragments_alloc)
+            {
+                fragments[i] = p->fragments[i];
+                continue;
+            }
+            int _rc = posix_memalign((void**)&fragments[i], ZFEX_SIMD_ALIGNMENT, ZFEX_ROUND_UP_SIMD(MAX_FEC_PAYLOAD));
+            assert(_rc == 0);
+        }
+
+        delete[] p->fragments;
+        p->fragments = fragments;
+        delete[] p->fragment_map;
+        p->fragment_map = new size_t[n]();
+        delete[] p->fragment_ts;
+        p->fragment_ts = new rx_fragment_ts_t[n]();
+        p->fragments_alloc = n;
+    }
+
+    if (spare_fragment == NULL)
+    {
+        int _rc = posix_memalign((void**)&spare_fragment, ZFEX_SIMD_ALIGNMENT, ZFEX_ROUND_UP_SIMD(MAX_FEC_PAYLOAD));
+        assert(_rc == 0);
+    }
+}
+
+void Aggregator::free_fragments(int from_ring_idx)
+{
+    for(int ring_idx = from_ring_idx; ring_idx < RX_RING_MAX_SIZE; ring_idx++)
+    {
+        rx_ring_item_t *p = &rx_ring[ring_idx];
+        for(int i=0; i < p->fragments_alloc; i++)
+        {
+            wfb_aligned_free(p->fragments[i]);
+        }
+        delete[] p->fragments;
+        p->fragments = NULL;
+        delete[] p->fragment_map;
+        p->fragment_map = NULL;
+        delete[] p->fragment_ts;
+        p->fragment_ts = NULL;
+        p->fragments_alloc = 0;
+    }
+}
+
+// Sends whatever the blocks in the ring hold, in order, and empties it
+void Aggregator::flush_ring(void)
+{
+    while(rx_ring_alloc > 0)
+    {
+        rx_ring_item_t *p = &rx_ring[rx_ring_front];
+
+        for(int f_idx=p->fragment_to_send_idx; f_idx < fec_k; f_idx++)
+        {
+            if(p->fragment_map[f_idx])
+            {
+                send_packet(rx_ring_front, f_idx);
+            }
+        }
+
+        rx_ring_front = modN(rx_ring_front + 1, rx_ring_size);
+        rx_ring_alloc -= 1;
+    }
+
+    rx_ring_front = 0;
+}
+
+int Aggregator::set_ring_size(int size)
+{
+    size = max(1, min(size, RX_RING_MAX_SIZE));
+    if (size == rx_ring_size) return size;
+
+    if (fec_p != NULL)
+    {
+        flush_ring();
+        reserve_fragments(size, fec_n);
+
+        for(int ring_idx = 0; ring_idx < size; ring_idx++)
+        {
+            memset(rx_ring[ring_idx].fragment_map, '\0', fec_n * sizeof(size_t));
+        }
+    }
+
+    free_fragments(size);
+    rx_ring_size = size;
+    return size;
 }
 
 void Aggregator::init_fec(int k, int n)
@@ -321,38 +424,23 @@ void Aggregator::init_fec(int k, int n)
     last_known_block = (uint64_t)-1;
     seq = 0;
 
-    for(int ring_idx = 0; ring_idx < RX_RING_SIZE; ring_idx++)
+    reserve_fragments(rx_ring_size, fec_n);
+
+    for(int ring_idx = 0; ring_idx < rx_ring_size; ring_idx++)
     {
         rx_ring[ring_idx].block_idx = 0;
+        rx_ring[ring_idx].arrival_ts = 0;
         rx_ring[ring_idx].fragment_to_send_idx = 0;
         rx_ring[ring_idx].has_fragments = 0;
-        rx_ring[ring_idx].fragments = new uint8_t*[fec_n];
-        for(int i=0; i < fec_n; i++)
-        {
-            int _rc = posix_memalign((void**)&rx_ring[ring_idx].fragments[i], ZFEX_SIMD_ALIGNMENT, ZFEX_ROUND_UP_SIMD(MAX_FEC_PAYLOAD));
-            assert(_rc == 0);
-        }
-        rx_ring[ring_idx].fragment_map = new size_t[fec_n];
         memset(rx_ring[ring_idx].fragment_map, '\0', fec_n * sizeof(size_t));
     }
 }
 
+// The fragment buffers stay for the next session, see reserve_fragments()
 void Aggregator::deinit_fec(void)
 {
     assert(fec_p != NULL);
 
-    for(int ring_idx = 0; ring_idx < RX_RING_SIZE; ring_idx++)
-    {
-        delete[] rx_ring[ring_idx].fragment_map;
-        rx_ring[ring_idx].fragment_map = NULL;
-        for(int i=0; i < fec_n; i++)
-        {
-            wfb_aligned_free(rx_ring[ring_idx].fragments[i]);
-        }
-        delete[] rx_ring[ring_idx].fragments;
-        rx_ring[ring_idx].fragments = NULL;
-    }
-
     zfex_status_code_t rc = fec_free(fec_p);
     assert(rc == ZFEX_SC_OK);
     fec_p = NULL;
@@ -419,9 +507,9 @@ Forwarder::~Forwarder()
 
 int Aggregator::rx_ring_push(void)
 {
-    if(rx_ring_alloc < RX_RING_SIZE)
+    if(rx_ring_alloc < rx_ring_size)
     {
-        int idx = modN(rx_ring_front + rx_ring_alloc, RX_RING_SIZE);
+        int idx = modN(rx_ring_front + rx_ring_alloc, rx_ring_size);
         rx_ring_alloc += 1;
         return idx;
     }
@@ -448,15 +536,15 @@ int Aggregator::rx_ring_push(void)
 
     // override last item in ring
     int ring_idx = rx_ring_front;
-    rx_ring_front = modN(rx_ring_front + 1, RX_RING_SIZE);
+    rx_ring_front = modN(rx_ring_front + 1, rx_ring_size);
     return ring_idx;
 }
 
 
-int Aggregator::get_block_ring_idx(uint64_t block_idx)
+int Aggregator::find_block_ring_idx(uint64_t block_idx)
 {
     // check if block is already in the ring
-    for(int i = rx_ring_front, c = rx_ring_alloc; c > 0; i = modN(i + 1, RX_RING_SIZE), c--)
+    for(int i = rx_ring_front, c = rx_ring_alloc; c > 0; i = modN(i + 1, rx_ring_size), c--)
     {
         if (rx_ring[i].block_idx == block_idx) return i;
     }
@@ -467,7 +555,16 @@ int Aggregator::get_block_ring_idx(uint64_t block_idx)
         return -1;
     }
 
-    int new_blocks = (int)min(last_known_block != (uint64_t)-1 ? block_idx - last_known_block : 1, (uint64_t)RX_RING_SIZE);
+    return -2;
+}
+
+
+int Aggregator::get_block_ring_idx(uint64_t block_idx)
+{
+    int found_idx = find_block_ring_idx(block_idx);
+    if (found_idx != -2) return found_idx;
+
+    int new_blocks = (int)min(last_known_block != (uint64_t)-1 ? block_idx - last_known_block : 1, (uint64_t)rx_ring_size);
     assert (new_blocks > 0);
 
     last_known_block = block_idx;
@@ -477,6 +574,7 @@ int Aggregator::get_block_ring_idx(uint64_t block_idx)
     {
         ring_idx = rx_ring_push();
         rx_ring[ring_idx].block_idx = block_idx + i + 1 - new_blocks;
+        rx_ring[ring_idx].arrival_ts = rx_timestamp;
         rx_ring[ring_idx].fragment_to_send_idx = 0;
         rx_ring[ring_idx].has_fragments = 0;
         memset(rx_ring[ring_idx].fragment_map, '\0', fec_n * sizeof(size_t));
@@ -491,6 +589,9 @@ void Aggregator::dump_stats(void)
 
     for(auto it = antenna_stat.begin(); it != antenna_stat.end(); it++)
     {
+        // Antenna didn't receive anything since the last dump
+        if (it->second.count_all == 0) continue;
+
         IPC_MSG("%" PRIu64 "\tRX_ANT\t%u:%u:%u\t%" PRIx64 "\t%d" ":%d:%d:%d" ":%d:%d:%d\n",
                 ts, it->first.freq, it->first.mcs_index, it->first.bandwidth, it->first.antenna_id, it->second.count_all,
                 it->second.rssi_min, it->second.rssi_sum / it->second.count_all, it->second.rssi_max,
@@ -501,7 +602,7 @@ void Aggregator::dump_stats(void)
             count_p_all, count_b_all,                    // incoming
             count_p_dec_err,                             // decryption
             count_p_session, count_p_data,               // classification
-            (uint32_t)count_p_uniq.size(),               // unique check
+            count_p_uniq.size(),                         // unique check
             count_p_fec_recovered, count_p_lost,         // fec recovering
             count_p_bad,                                 // internal errors
             count_p_outgoing, count_b_outgoing);         // outgoing
@@ -512,6 +613,11 @@ void Aggregator::dump_stats(void)
         WFB_ERR("%u block overrides\n", count_p_override);
     }
 
+    if(count_p_dec_skipped)
+    {
+        WFB_DBG("%u duplicates skipped before decryption\n", count_p_dec_skipped);
+    }
+
     if(count_p_lost)
     {
         WFB_ERR("%u packets lost\n", count_p_lost);
@@ -686,33 +792,19 @@ void Aggregator::process_packet(const uint8_t *buf, size_t size, uint8_t wlan_id
         return;
     }
 
-    uint8_t decrypted[MAX_FEC_PAYLOAD];
-    unsigned long long decrypted_len;
     wblock_hdr_t *block_hdr = (wblock_hdr_t*)buf;
+    uint64_t nonce = be64toh(block_hdr->data_nonce);
+    uint64_t block_idx = nonce >> 8;
+    uint8_t fragment_idx = (uint8_t)(nonce & 0xff);
 
-    if (crypto_aead_chacha20poly1305_decrypt(decrypted, &decrypted_len,
-                                             NULL,
-                                             buf + sizeof(wblock_hdr_t), size - sizeof(wblock_hdr_t),
-                                             buf,
-                                             sizeof(wblock_hdr_t),
-                                             (uint8_t*)(&(block_hdr->data_nonce)), session_key) != 0)
+    // No session yet, the packet can't be decrypted anyway
+    if (fec_p == NULL)
     {
-        WFB_ERR("Unable to decrypt packet #0x%" PRIx64 "\n", be64toh(block_hdr->data_nonce));
+        WFB_ERR("Unable to decrypt packet #0x%" PRIx64 "\n", nonce);
         count_p_dec_err += 1;
         return;
     }
 
-    count_p_data += 1;
-    log_rssi(sockaddr, wlan_idx, antenna, rssi, noise, freq, mcs_index, bandwidth);
-
-    assert(decrypted_len >= sizeof(wpacket_hdr_t));
-    assert(decrypted_len <= MAX_FEC_PAYLOAD);
-
-    uint64_t block_idx = be64toh(block_hdr->data_nonce) >> 8;
-    uint8_t fragment_idx = (uint8_t)(be64toh(block_hdr->data_nonce) & 0xff);
-
-    count_p_uniq.insert(be64toh(block_hdr->data_nonce));
-
     // Should never happend due to generating new session key on tx side
     if (block_idx > MAX_BLOCK_IDX)
     {
@@ -728,20 +820,70 @@ void Aggregator::process_packet(const uint8_t *buf, size_t size, uint8_t wlan_id
         return;
     }
 
-    int ring_idx = get_block_ring_idx(block_idx);
+    if (size - sizeof(wblock_hdr_t) - crypto_aead_chacha20poly1305_ABYTES > MAX_FEC_PAYLOAD)
+    {
+        WFB_ERR("Long packet (fec payload)\n");
+        count_p_bad += 1;
+        return;
+    }
 
-    //ignore already processed blocks
-    if (ring_idx < 0) return;
+    // The nonce is not authenticated yet, so only look the block up without touching the ring
+    int ring_idx = find_block_ring_idx(block_idx);
 
-    rx_ring_item_t *p = &rx_ring[ring_idx];
+    // Ignore already processed blocks and fragments before spending any time on decryption.
+    // A slot is only marked as filled after successful decryption, so a forged nonce can't shadow a real packet.
+    if (ring_idx == -1 || (ring_idx >= 0 && rx_ring[ring_idx].fragment_map[fragment_idx]))
+    {
+        // With several receivers the same fragment shows up once per wlan, account for the signal of every copy
+        if (ring_idx >= 0)
+        {
+            log_rssi(sockaddr, wlan_idx, antenna, rssi, noise, freq, mcs_index, bandwidth);
+        }
+        count_p_dec_skipped += 1;
+        return;
+    }
+
+    // Decrypt straight into a spare fragment buffer, it is swapped into the ring below
+    unsigned long long decrypted_len;
+
+    if (crypto_aead_chacha20poly1305_decrypt(spare_fragment, &decrypted_len,
+                                             NULL,
+                                             buf + sizeof(wblock_hdr_t), size - sizeof(wblock_hdr_t),
+                                             buf,
+                                             sizeof(wblock_hdr_t),
+                                             (uint8_t*)(&(block_hdr->data_nonce)), session_key) != 0)
+    {
+        WFB_ERR("Unable to decrypt packet #0x%" PRIx64 "\n", nonce);
+        count_p_dec_err += 1;
+        return;
+    }
+
+    uint64_t decrypted_ts = rx_timestamp ? get_timestamp() : 0;
+
+    count_p_data += 1;
+    log_rssi(sockaddr, wlan_idx, antenna, rssi, noise, freq, mcs_index, bandwidth);
+
+    assert(decrypted_len >= sizeof(wpacket_hdr_t));
+    assert(decrypted_len <= MAX_FEC_PAYLOAD);
+
+    count_p_uniq.insert(nonce);
 
-    //ignore already processed fragments
-    if (p->fragment_map[fragment_idx]) return;
+    // Authenticated, now it is safe to allocate new blocks
+    if (ring_idx < 0)
+    {
+        ring_idx = get_block_ring_idx(block_idx);
+        assert(ring_idx >= 0);
+    }
 
-    memset(p->fragments[fragment_idx], '\0', MAX_FEC_PAYLOAD);
-    memcpy(p->fragments[fragment_idx], decrypted, decrypted_len);
+    rx_ring_item_t *p = &rx_ring[ring_idx];
+
+    // All fragment buffers have the same size and alignment, so swap instead of copying.
+    // The tail is left as is, apply_fec() zeroes it when the fragment is used for recovery.
+    swap(p->fragments[fragment_idx], spare_fragment);
 
     p->fragment_map[fragment_idx] = decrypted_len;
+    p->fragment_ts[fragment_idx].received = rx_timestamp;
+    p->fragment_ts[fragment_idx].decrypted = decrypted_ts;
     p->has_fragments += 1;
 
     // Check if we use current (oldest) block
@@ -760,7 +902,7 @@ void Aggregator::process_packet(const uint8_t *buf, size_t size, uint8_t wlan_id
         // remove block if all K elements (without gaps) were sent
         if(p->fragment_to_send_idx == fec_k)
         {
-            rx_ring_front = modN(rx_ring_front + 1, RX_RING_SIZE);
+            rx_ring_front = modN(rx_ring_front + 1, rx_ring_size);
             rx_ring_alloc -= 1;
             assert(rx_ring_alloc >= 0);
             return;
@@ -772,7 +914,7 @@ void Aggregator::process_packet(const uint8_t *buf, size_t size, uint8_t wlan_id
     {
         // send all queued packets in all unfinished blocks before current
         // and then remove that blocks
-        int nrm = modN(ring_idx - rx_ring_front, RX_RING_SIZE);
+        int nrm = modN(ring_idx - rx_ring_front, rx_ring_size);
 
         while(nrm > 0)
         {
@@ -783,7 +925,7 @@ void Aggregator::process_packet(const uint8_t *buf, size_t size, uint8_t wlan_id
                     send_packet(rx_ring_front, f_idx);
                 }
             }
-            rx_ring_front = modN(rx_ring_front + 1, RX_RING_SIZE);
+            rx_ring_front = modN(rx_ring_front + 1, rx_ring_size);
             rx_ring_alloc -= 1;
             nrm -= 1;
         }
@@ -801,11 +943,16 @@ void Aggregator::process_packet(const uint8_t *buf, size_t size, uint8_t wlan_id
                 //Recover missed fragments using FEC
                 apply_fec(ring_idx);
 
+                // Recovered fragments count as received with the packet that completed the block
+                uint64_t recovered_ts = rx_timestamp ? get_timestamp() : 0;
+
                 // Count total number of recovered fragments
                 for(; f_idx < fec_k; f_idx++)
                 {
                     if(! p->fragment_map[f_idx])
                     {
+                        p->fragment_ts[f_idx].received = rx_timestamp;
+                        p->fragment_ts[f_idx].decrypted = recovered_ts;
                         fec_count += 1;
                     }
                 }
@@ -826,12 +973,61 @@ void Aggregator::process_packet(const uint8_t *buf, size_t size, uint8_t wlan_id
         }
 
         // remove block
-        rx_ring_front = modN(rx_ring_front + 1, RX_RING_SIZE);
+        rx_ring_front = modN(rx_ring_front + 1, rx_ring_size);
         rx_ring_alloc -= 1;
         assert(rx_ring_alloc >= 0);
     }
 }
 
+int Aggregator::flush_stale_blocks(uint64_t now, uint64_t timeout)
+{
+    int flushed = 0;
+
+    while(rx_ring_alloc > 0)
+    {
+        rx_ring_item_t *p = &rx_ring[rx_ring_front];
+
+        // Fragments that were only waiting for the block before go out first
+        while(p->fragment_to_send_idx < fec_k && p->fragment_map[p->fragment_to_send_idx])
+        {
+            send_packet(rx_ring_front, p->fragment_to_send_idx);
+            p->fragment_to_send_idx += 1;
+        }
+
+        if(p->fragment_to_send_idx < fec_k)
+        {
+            // A lone block without gaps holds nothing back, it may still be receiving
+            if(rx_ring_alloc == 1 && p->has_fragments == p->fragment_to_send_idx)
+            {
+                break;
+            }
+
+            if(p->arrival_ts == 0 || now < p->arrival_ts + timeout)
+            {
+                break;
+            }
+
+            WFB_DBG("AGG: Timeout block 0x%" PRIx64 " flush %d fragments\n", p->block_idx, p->has_fragments);
+
+            for(int f_idx=p->fragment_to_send_idx; f_idx < fec_k; f_idx++)
+            {
+                if(p->fragment_map[f_idx])
+                {
+                    send_packet(rx_ring_front, f_idx);
+                }
+            }
+
+            count_p_timeout += 1;
+            flushed += 1;
+        }
+
+        rx_ring_front = modN(rx_ring_front + 1, rx_ring_size);
+        rx_ring_alloc -= 1;
+    }
+
+    return flushed;
+}
+
 void Aggregator::send_packet(int ring_idx, int fragment_idx)
 {
     wpacket_hdr_t* packet_hdr = (wpacket_hdr_t*)(rx_ring[ring_idx].fragments[fragment_idx]);
@@ -855,6 +1051,7 @@ void Aggregator::send_packet(int ring_idx, int fragment_idx)
     }
     else if(!(flags & WFB_PACKET_FEC_ONLY))
     {
+        sent_fragment_ts = rx_ring[ring_idx].fragment_ts[fragment_idx];
         send_to_socket(payload, packet_size);
         count_p_outgoing += 1;
         count_b_outgoing += packet_size;
@@ -903,7 +1100,19 @@ void Aggregator::apply_fec(int ring_idx)
     assert(max_packet_size > 0);
     assert(max_packet_size <= MAX_FEC_PAYLOAD);
 
-    zfex_status_code_t rc = fec_decode_simd(fec_p, (const uint8_t**)in_blocks, out_blocks, index, ZFEX_ROUND_UP_SIMD(max_packet_size));
+    size_t block_size = ZFEX_ROUND_UP_SIMD(max_packet_size);
+
+    // Fragments aren't zeroed on receive, pad the FEC input up to the block size here
+    for(int i=0; i < fec_k; i++)
+    {
+        size_t fragment_size = rx_ring[ring_idx].fragment_map[index[i]];
+        if (fragment_size < block_size)
+        {
+            memset(in_blocks[i] + fragment_size, '\0', block_size - fragment_size);
+        }
+    }
+
+    zfex_status_code_t rc = fec_decode_simd(fec_p, (const uint8_t**)in_blocks, out_blocks, index, block_size);
     assert(rc == ZFEX_SC_OK);
 }
 
@@ -27,7 +27,6 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 
-#include <set>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
@@ -68,16 +67,26 @@ private:
 };
 
 
+// When a fragment was received and decrypted (or recovered), in the clock of Aggregator::get_timestamp()
+typedef struct {
+    uint64_t received;
+    uint64_t decrypted;
+} rx_fragment_ts_t;
+
 typedef struct {
     uint64_t block_idx;
     uint8_t** fragments;
     size_t *fragment_map;
+    rx_fragment_ts_t *fragment_ts;
+    uint64_t arrival_ts; // Aggregator::rx_timestamp of the packet that opened the block
     uint8_t fragment_to_send_idx;
     uint8_t has_fragments;
+    int fragments_alloc; // entries of fragments, fragment_map and fragment_ts, kept across sessions
 } rx_ring_item_t;
 
 
-#define RX_RING_SIZE 40
+#define RX_RING_SIZE 40 // default ring depth, see Aggregator::set_ring_size()
+#define RX_RING_MAX_SIZE 256
 
 static inline int modN(int x, int base)
 {
@@ -159,6 +168,65 @@ struct std::hash<rxAntennaKey>
 
 typedef std::unordered_map<rxAntennaKey, rxAntennaItem> rx_antenna_stat_t;
 
+// Counts unique packet nonces (block_idx << 8 | fragment_idx) without allocating.
+// Only the last RX_RING_MAX_SIZE blocks are remembered, which covers what rx_ring can still accept anyway.
+// clear() is O(1): slots tagged with an older generation are treated as empty.
+class rxUniqCounter
+{
+public:
+    rxUniqCounter(void) : slots{}, generation(1), count(0) {}
+
+    void insert(uint64_t nonce)
+    {
+        uint64_t block_idx = nonce >> 8;
+        uint8_t fragment_idx = (uint8_t)(nonce & 0xff);
+        slot_t &slot = slots[block_idx % RX_RING_MAX_SIZE];
+
+        if (slot.generation != generation || slot.block_idx < block_idx)
+        {
+            slot.generation = generation;
+            slot.block_idx = block_idx;
+            memset(slot.fragments, '\0', sizeof(slot.fragments));
+        }
+        else if (slot.block_idx > block_idx)
+        {
+            // Too old to tell, the slot has already been taken by a newer block
+            return;
+        }
+
+        uint64_t bit = (uint64_t)1 << (fragment_idx & 63);
+        uint64_t &word = slot.fragments[fragment_idx >> 6];
+
+        if (!(word & bit))
+        {
+            word |= bit;
+            count += 1;
+        }
+    }
+
+    uint32_t size(void) const
+    {
+        return count;
+    }
+
+    void clear(void)
+    {
+        generation += 1;
+        count = 0;
+    }
+
+private:
+    typedef struct {
+        uint64_t generation;
+        uint64_t block_idx;
+        uint64_t fragments[256 / 64];
+    } slot_t;
+
+    slot_t slots[RX_RING_MAX_SIZE];
+    uint64_t generation;
+    uint32_t count;
+};
+
 class Aggregator : public BaseAggregator
 {
 public:
@@ -169,20 +237,43 @@ public:
                                 uint8_t bandwidth, sockaddr_in *sockaddr);
     virtual void dump_stats(void);
 
+    // Sends what has arrived of a block that is holding up the stream and is older than `timeout`,
+    // leaving gaps for the missing fragments. Times are in the clock of rx_timestamp.
+    // Returns the number of blocks flushed this way.
+    int flush_stale_blocks(uint64_t now, uint64_t timeout);
+
+    // -1 until the first session packet
+    int get_fec_n(void) const { return fec_n; }
+
+    // Number of blocks kept open for FEC, clamped to 1..RX_RING_MAX_SIZE. Blocks in the ring are
+    // flushed as they are. Fragment buffers are only allocated here or for a larger FEC n, never on
+    // re-keying. Returns the applied size.
+    int set_ring_size(int size);
+    int get_ring_size(void) const { return rx_ring_size; }
+
+    // Blocks still waiting for fragments, the ones flush_stale_blocks() may have to release
+    int get_open_blocks(void) const { return rx_ring_alloc; }
+
     // Make stats public for android userspace receiver
     void clear_stats(void)
     {
-        antenna_stat.clear();
+        // Keep the keys, so that log_rssi doesn't have to allocate hash nodes again for every packet
+        for(auto it = antenna_stat.begin(); it != antenna_stat.end(); it++)
+        {
+            it->second = rxAntennaItem();
+        }
         count_p_all = 0;
         count_b_all = 0;
         count_p_dec_err = 0;
         count_p_session = 0;
         count_p_data = 0;
+        count_p_dec_skipped = 0;
         count_p_uniq.clear();
         count_p_fec_recovered = 0;
         count_p_lost = 0;
         count_p_bad = 0;
         count_p_override = 0;
+        count_p_timeout = 0;
         count_p_outgoing = 0;
         count_b_outgoing = 0;
     }
@@ -193,27 +284,44 @@ public:
     uint32_t count_p_dec_err;
     uint32_t count_p_session;
     uint32_t count_p_data;
-    std::set<uint64_t> count_p_uniq;
+    uint32_t count_p_dec_skipped; // duplicates dropped by nonce, before decryption
+    rxUniqCounter count_p_uniq;
     uint32_t count_p_fec_recovered;
     uint32_t count_p_lost;
     uint32_t count_p_bad;
     uint32_t count_p_override;
+    uint32_t count_p_timeout; // blocks flushed by flush_stale_blocks()
     uint32_t count_p_outgoing;
     uint32_t count_b_outgoing;
 
+    // Receive time of the next packet passed to process_packet(), 0 if unknown: latency isn't traced and
+    // blocks never time out then. It is kept with the fragment and handed back in sent_fragment_ts when the
+    // fragment is sent.
+    uint64_t rx_timestamp;
+
 protected:
     virtual void send_to_socket(const uint8_t *payload, uint16_t packet_size) = 0;
 
+    // Clock of rx_timestamp, only read while rx_timestamp is set
+    virtual uint64_t get_timestamp(void) { return 0; }
+
+    // Times of the fragment being passed to send_to_socket()
+    rx_fragment_ts_t sent_fragment_ts;
+
 private:
     Aggregator(const Aggregator&);
     Aggregator& operator=(const Aggregator&);
 
     void init_fec(int k, int n);
     void deinit_fec(void);
+    void reserve_fragments(int ring_size, int n);
+    void free_fragments(int from_ring_idx);
+    void flush_ring(void);
     void send_packet(int ring_idx, int fragment_idx);
     void apply_fec(int ring_idx);
     void log_rssi(const sockaddr_in *sockaddr, uint8_t wlan_idx, const uint8_t *ant, const int8_t *rssi,
                   const int8_t *noise, uint16_t freq, uint8_t mcs_index, uint8_t bandwidth);
+    int find_block_ring_idx(uint64_t block_idx);
     int get_block_ring_idx(uint64_t block_idx);
     int rx_ring_push(void);
     // cppcheck-suppress unusedPrivateFunction
@@ -224,9 +332,11 @@ private:
     int fec_n;  // RS total number of fragments in block
 
     uint32_t seq;
-    rx_ring_item_t rx_ring[RX_RING_SIZE];
+    rx_ring_item_t rx_ring[RX_RING_MAX_SIZE];
+    int rx_ring_size; // entries of rx_ring in use
     int rx_ring_front; // current packet
     int rx_ring_alloc; // number of allocated entries
+    uint8_t *spare_fragment; // decryption target, swapped with the ring fragment it ends up in
     uint64_t last_known_block;  //id of last known block
     uint64_t epoch; // current epoch
     const uint32_t channel_id; // (link_id << 8) + port_number
@@ -9,7 +9,25 @@
 #include <assert.h>
 #include <stdint.h>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#if (ZFEX_INTEL_DISPATCH_FEATURE == 1)
+#pragma message "Using runtime-dispatched SIMD FEC"
+const char* zfex_opt = "noaccel"; /* the selected kernel once fec_new() has run */
+#include <cpuid.h>
+#include <immintrin.h>
 #if (ZFEX_INTEL_SSSE3_FEATURE == 1)
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif
+
+
+#elif (ZFEX_INTEL_SSSE3_FEATURE == 1)
 #pragma message "Using SSSE3-accelerated FEC"
 const char* zfex_opt = "SSSE3";
 #include <emmintrin.h>
@@ -355,7 +373,7 @@ void _addmul1(register gf* ZFEX_RESTRICT dst, register const gf* ZFEX_RESTRICT s
 
 
 #define addmul_simd(dst, src, c, sz)                 \
-    if (c != 0) _addmul1_simd(dst, src, c, sz)
+    if (c != 0) addmul_simd_fn(dst, src, c, sz)
 
 static
 #if (ZFEX_INLINE_ADDMUL_SIMD_FEATURE == 1)
@@ -505,6 +523,265 @@ void _addmul1_simd(register gf * ZFEX_RESTRICT dst, register const gf * ZFEX_RES
 #endif
 }
 
+typedef void (*addmul_fn_t)(gf * ZFEX_RESTRICT dst, const gf * ZFEX_RESTRICT src, gf c, size_t sz);
+
+#if (ZFEX_INTEL_SSSE3_FEATURE == 1)
+#define ZFEX_BUILTIN_KERNEL ZFEX_KERNEL_SSSE3
+#elif (ZFEX_ARM_NEON_FEATURE == 1)
+#define ZFEX_BUILTIN_KERNEL ZFEX_KERNEL_NEON
+#else
+#define ZFEX_BUILTIN_KERNEL ZFEX_KERNEL_SCALAR
+#endif
+
+#if (ZFEX_INTEL_DISPATCH_FEATURE == 1)
+/*
+ * Kernels for what the CPU turns out to support. The nibble kernels look the
+ * products up with a byte shuffle, like the SSSE3 one above. The GFNI kernels
+ * multiply by c as an 8x8 bit matrix over GF(2): gf2p8mul itself is fixed to
+ * the AES polynomial, which is not the one of this field.
+ */
+static uint64_t gf_affine[256];
+
+static void
+_init_affine_table(void) {
+    int c, i, j;
+    for (c = 0; c < 256; c++) {
+        uint64_t m = 0;
+        for (i = 0; i < 8; i++) {
+            /* row 7 - i yields bit i of the product */
+            uint64_t row = 0;
+            for (j = 0; j < 8; j++)
+                row |= (uint64_t)((gf_mul_table[c][1 << j] >> i) & 1) << j;
+            m |= row << (8 * (7 - i));
+        }
+        gf_affine[c] = m;
+    }
+}
+
+static inline
+void _addmul1_tail(gf * ZFEX_RESTRICT dst, const gf * ZFEX_RESTRICT src, gf c, size_t sz)
+{
+    const gf *mulc = gf_mul_table[c];
+    size_t i;
+    for (i = 0; i < sz; i++)
+        dst[i] ^= mulc[src[i]];
+}
+
+__attribute__((target("ssse3")))
+static void
+_addmul1_ssse3(gf * ZFEX_RESTRICT dst, const gf * ZFEX_RESTRICT src, gf c, size_t sz)
+{
+    __m128i const vmul_lo = _mm_load_si128((__m128i const *)gf_mul_table[c]);
+    __m128i const vmul_hi = _mm_load_si128((__m128i const *)gf_mul_table_16[c]);
+    __m128i const mask0F = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+
+    for (; i + 16 <= sz; i += 16) {
+        __m128i const vsrc = _mm_loadu_si128((__m128i const *)(src + i));
+        __m128i const lo = _mm_shuffle_epi8(vmul_lo, _mm_and_si128(vsrc, mask0F));
+        __m128i const hi = _mm_shuffle_epi8(vmul_hi, _mm_and_si128(_mm_srli_epi16(vsrc, 4), mask0F));
+        __m128i const vdst = _mm_loadu_si128((__m128i const *)(dst + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(vdst, _mm_xor_si128(lo, hi)));
+    }
+    _addmul1_tail(dst + i, src + i, c, sz - i);
+}
+
+__attribute__((target("avx2")))
+static inline
+__m256i _mul_avx2(__m256i const vsrc, __m256i const vmul_lo, __m256i const vmul_hi, __m256i const mask0F)
+{
+    __m256i const lo = _mm256_shuffle_epi8(vmul_lo, _mm256_and_si256(vsrc, mask0F));
+    __m256i const hi = _mm256_shuffle_epi8(vmul_hi, _mm256_and_si256(_mm256_srli_epi16(vsrc, 4), mask0F));
+    return _mm256_xor_si256(lo, hi);
+}
+
+__attribute__((target("avx2")))
+static void
+_addmul1_avx2(gf * ZFEX_RESTRICT dst, const gf * ZFEX_RESTRICT src, gf c, size_t sz)
+{
+    __m256i const vmul_lo = _mm256_broadcastsi128_si256(_mm_load_si128((__m128i const *)gf_mul_table[c]));
+    __m256i const vmul_hi = _mm256_broadcastsi128_si256(_mm_load_si128((__m128i const *)gf_mul_table_16[c]));
+    __m256i const mask0F = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+
+    for (; i + 64 <= sz; i += 64) {
+        __m256i const s0 = _mm256_loadu_si256((__m256i const *)(src + i));
+        __m256i const s1 = _mm256_loadu_si256((__m256i const *)(src + i + 32));
+        __m256i const d0 = _mm256_loadu_si256((__m256i const *)(dst + i));
+        __m256i const d1 = _mm256_loadu_si256((__m256i const *)(dst + i + 32));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d0, _mul_avx2(s0, vmul_lo, vmul_hi, mask0F)));
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), _mm256_xor_si256(d1, _mul_avx2(s1, vmul_lo, vmul_hi, mask0F)));
+    }
+    for (; i + 32 <= sz; i += 32) {
+        __m256i const s0 = _mm256_loadu_si256((__m256i const *)(src + i));
+        __m256i const d0 = _mm256_loadu_si256((__m256i const *)(dst + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d0, _mul_avx2(s0, vmul_lo, vmul_hi, mask0F)));
+    }
+    _addmul1_tail(dst + i, src + i, c, sz - i);
+}
+
+__attribute__((target("avx2,gfni")))
+static void
+_addmul1_avx2_gfni(gf * ZFEX_RESTRICT dst, const gf * ZFEX_RESTRICT src, gf c, size_t sz)
+{
+    __m256i const matrix = _mm256_set1_epi64x((long long)gf_affine[c]);
+    size_t i = 0;
+
+    for (; i + 64 <= sz; i += 64) {
+        __m256i const s0 = _mm256_loadu_si256((__m256i const *)(src + i));
+        __m256i const s1 = _mm256_loadu_si256((__m256i const *)(src + i + 32));
+        __m256i const d0 = _mm256_loadu_si256((__m256i const *)(dst + i));
+        __m256i const d1 = _mm256_loadu_si256((__m256i const *)(dst + i + 32));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d0, _mm256_gf2p8affine_epi64_epi8(s0, matrix, 0)));
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), _mm256_xor_si256(d1, _mm256_gf2p8affine_epi64_epi8(s1, matrix, 0)));
+    }
+    for (; i + 32 <= sz; i += 32) {
+        __m256i const s0 = _mm256_loadu_si256((__m256i const *)(src + i));
+        __m256i const d0 = _mm256_loadu_si256((__m256i const *)(dst + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d0, _mm256_gf2p8affine_epi64_epi8(s0, matrix, 0)));
+    }
+    _addmul1_tail(dst + i, src + i, c, sz - i);
+}
+
+__attribute__((target("avx512f,avx512bw,gfni")))
+static void
+_addmul1_avx512_gfni(gf * ZFEX_RESTRICT dst, const gf * ZFEX_RESTRICT src, gf c, size_t sz)
+{
+    __m512i const matrix = _mm512_set1_epi64((long long)gf_affine[c]);
+    size_t i = 0;
+
+    for (; i + 64 <= sz; i += 64) {
+        __m512i const s0 = _mm512_loadu_si512((void const *)(src + i));
+        __m512i const d0 = _mm512_loadu_si512((void const *)(dst + i));
+        _mm512_storeu_si512((void *)(dst + i), _mm512_xor_si512(d0, _mm512_gf2p8affine_epi64_epi8(s0, matrix, 0)));
+    }
+    if (i < sz) {
+        __mmask64 const tail = ((__mmask64)1 << (sz - i)) - 1;
+        __m512i const s0 = _mm512_maskz_loadu_epi8(tail, (void const *)(src + i));
+        __m512i const d0 = _mm512_maskz_loadu_epi8(tail, (void const *)(dst + i));
+        _mm512_mask_storeu_epi8((void *)(dst + i), tail, _mm512_xor_si512(d0, _mm512_gf2p8affine_epi64_epi8(s0, matrix, 0)));
+    }
+}
+
+/* Bit per zfex_kernel_t, from CPUID and what the OS saves on context switches */
+static unsigned
+_cpu_kernels(void) {
+    unsigned eax, ebx, ecx, edx;
+    unsigned ebx7 = 0, ecx7 = 0;
+    unsigned kernels = 1u << ZFEX_KERNEL_SCALAR;
+    uint64_t xcr0 = 0;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return kernels;
+    if (ecx & bit_SSSE3)
+        kernels |= 1u << ZFEX_KERNEL_SSSE3;
+    if (ecx & bit_OSXSAVE) {
+        unsigned lo, hi;
+        __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        xcr0 = ((uint64_t)hi << 32) | lo;
+    }
+    if (__get_cpuid_max(0, NULL) >= 7)
+        __cpuid_count(7, 0, eax, ebx7, ecx7, edx);
+
+    int const ymm = (ecx & bit_AVX) && (xcr0 & 0x06) == 0x06;
+    int const zmm = ymm && (xcr0 & 0xe0) == 0xe0;
+    int const gfni = (ecx7 & (1u << 8)) != 0;
+
+    if (ymm && (ebx7 & bit_AVX2)) {
+        kernels |= 1u << ZFEX_KERNEL_AVX2;
+        if (gfni)
+            kernels |= 1u << ZFEX_KERNEL_AVX2_GFNI;
+    }
+    if (zmm && (ebx7 & bit_AVX512F) && (ebx7 & bit_AVX512BW) && gfni)
+        kernels |= 1u << ZFEX_KERNEL_AVX512_GFNI;
+
+    return kernels;
+}
+#endif /* ZFEX_INTEL_DISPATCH_FEATURE == 1 */
+
+static const char* const kernel_names[ZFEX_KERNEL_COUNT] = {
+    "noaccel", "SSSE3", "NEON", "AVX2", "AVX2+GFNI", "AVX-512+GFNI"
+};
+
+static addmul_fn_t addmul_simd_fn = _addmul1;
+static zfex_kernel_t selected_kernel = ZFEX_KERNEL_SCALAR;
+
+#if (ZFEX_INTEL_DISPATCH_FEATURE == 1)
+/* Kernels the CPU can run, set once by init_fec() */
+static unsigned cpu_kernels = 0;
+#endif
+
+static void _ensure_fec_initialized(void);
+
+static addmul_fn_t
+_kernel_fn(zfex_kernel_t kernel) {
+#if (ZFEX_INTEL_DISPATCH_FEATURE == 1)
+    if (kernel >= ZFEX_KERNEL_COUNT || !(cpu_kernels & (1u << kernel)))
+        return kernel == ZFEX_BUILTIN_KERNEL ? _addmul1_simd : NULL;
+    switch (kernel) {
+    case ZFEX_KERNEL_SCALAR: return _addmul1;
+    case ZFEX_KERNEL_SSSE3: return _addmul1_ssse3;
+    case ZFEX_KERNEL_AVX2: return _addmul1_avx2;
+    case ZFEX_KERNEL_AVX2_GFNI: return _addmul1_avx2_gfni;
+    case ZFEX_KERNEL_AVX512_GFNI: return _addmul1_avx512_gfni;
+    default: return NULL;
+    }
+#else
+    if (kernel == ZFEX_KERNEL_SCALAR)
+        return _addmul1;
+    return kernel == ZFEX_BUILTIN_KERNEL ? _addmul1_simd : NULL;
+#endif
+}
+
+const char*
+fec_kernel_name(zfex_kernel_t kernel) {
+    return kernel < ZFEX_KERNEL_COUNT ? kernel_names[kernel] : "unknown";
+}
+
+int
+fec_kernel_supported(zfex_kernel_t kernel) {
+    _ensure_fec_initialized();
+    return _kernel_fn(kernel) != NULL;
+}
+
+zfex_kernel_t
+fec_selected_kernel(void) {
+    _ensure_fec_initialized();
+    return selected_kernel;
+}
+
+/* init_fec() selects through here, it must not go through the once primitive again */
+static zfex_status_code_t
+_select_kernel(zfex_kernel_t kernel) {
+    addmul_fn_t const fn = _kernel_fn(kernel);
+    if (fn == NULL)
+        return ZFEX_SC_UNSUPPORTED_KERNEL;
+    addmul_simd_fn = fn;
+    selected_kernel = kernel;
+    zfex_opt = kernel_names[kernel];
+    return ZFEX_SC_OK;
+}
+
+zfex_status_code_t
+fec_select_kernel(zfex_kernel_t kernel) {
+    /* Otherwise the first fec_new() would replace the choice with the best kernel */
+    _ensure_fec_initialized();
+    return _select_kernel(kernel);
+}
+
+/* Fastest first */
+static void
+_select_best_kernel(void) {
+    static const zfex_kernel_t preference[] = {
+        ZFEX_KERNEL_AVX512_GFNI, ZFEX_KERNEL_AVX2_GFNI, ZFEX_KERNEL_AVX2,
+        ZFEX_KERNEL_SSSE3, ZFEX_KERNEL_NEON, ZFEX_KERNEL_SCALAR
+    };
+    size_t i;
+    for (i = 0; i < sizeof(preference) / sizeof(preference[0]); i++)
+        if (_select_kernel(preference[i]) == ZFEX_SC_OK)
+            return;
+}
+
 /*
  * computes C = AB where A is n*k, B is k*m, C is n*m
  */
@@ -540,10 +817,13 @@ _invert_mat(gf* src, size_t k)
     size_t icol = 0;
     size_t row, col, i, ix;
 
-    unsigned* indxc = (unsigned*) malloc (k * sizeof(unsigned));
-    unsigned* indxr = (unsigned*) malloc (k * sizeof(unsigned));
-    unsigned* ipiv = (unsigned*) malloc (k * sizeof(unsigned));
-    gf *id_row = NEW_GF_MATRIX (1, k);
+    /* On the stack, a decode cache miss must not allocate. fec_new() keeps k below 256. */
+    unsigned indxc[256];
+    unsigned indxr[256];
+    unsigned ipiv[256];
+    gf id_row[256];
+
+    assert (k < 256);
 
     memset (id_row, '\0', k * sizeof (gf));
     /*
@@ -626,10 +906,6 @@ _invert_mat(gf* src, size_t k)
         if (indxr[col-1] != indxc[col-1])
             for (row = 0; row < k; row++)
                 SWAP (src[row * k + indxr[col-1]], src[row * k + indxc[col-1]], gf);
-    free(indxc);
-    free(indxr);
-    free(ipiv);
-    free(id_row);
 #undef SWAP
 }
 
@@ -698,12 +974,45 @@ _invert_vdm (gf* src, unsigned k) {
     return;
 }
 
-static int fec_initialized = 0;
 static void
 init_fec (void) {
     generate_gf();
     _init_mul_table();
-    fec_initialized = 1;
+#if (ZFEX_INTEL_DISPATCH_FEATURE == 1)
+    _init_affine_table();
+    cpu_kernels = _cpu_kernels();
+#endif
+    _select_best_kernel();
+}
+
+/*
+ * The tables, the CPU kernels and the selected kernel are globals, so the
+ * first fec_new() or kernel query of several threads must not fill them at
+ * the same time. The once
+ * primitive also publishes them to every thread that passes through it.
+ */
+#ifdef _WIN32
+static INIT_ONCE fec_init_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK
+_init_fec_once(PINIT_ONCE once, PVOID param, PVOID *context) {
+    (void) once;
+    (void) param;
+    (void) context;
+    init_fec();
+    return TRUE;
+}
+#else
+static pthread_once_t fec_init_once = PTHREAD_ONCE_INIT;
+#endif
+
+static void
+_ensure_fec_initialized(void) {
+#ifdef _WIN32
+    InitOnceExecuteOnce(&fec_init_once, _init_fec_once, NULL, NULL);
+#else
+    pthread_once(&fec_init_once, init_fec);
+#endif
 }
 
 /*
@@ -713,10 +1022,90 @@ init_fec (void) {
  */
 
 
+/*
+ * Inverted decode matrices of the last erasure patterns seen, least recently
+ * used first out. The same few losses keep repeating on a link, and inverting
+ * the matrix costs about as much as decoding a packet.
+ */
+#ifndef ZFEX_DECODE_CACHE_SIZE
+#define ZFEX_DECODE_CACHE_SIZE 16
+#endif
+
+typedef struct
+{
+    uint32_t hash;
+    uint32_t last_use;         /* 0 if the entry is empty */
+    unsigned *index;           /* k block numbers, the key */
+    gf *matrix;                /* k*k */
+} fec_decode_cache_entry_t;
+
+struct fec_decode_cache_s
+{
+    uint32_t clock;
+    fec_decode_cache_entry_t entries[ZFEX_DECODE_CACHE_SIZE];
+};
+
+static struct fec_decode_cache_s*
+_new_decode_cache(uint16_t k)
+{
+    size_t const index_size = (size_t)k * sizeof(unsigned);
+    size_t const matrix_size = (size_t)k * (size_t)k;
+    struct fec_decode_cache_s *cache = (struct fec_decode_cache_s *)calloc(1, sizeof(*cache) + ZFEX_DECODE_CACHE_SIZE * (index_size + matrix_size));
+    unsigned *indices = (unsigned *)(cache + 1);
+    gf *matrices = (gf *)(indices + (size_t)ZFEX_DECODE_CACHE_SIZE * k);
+
+    for (int i = 0; i < ZFEX_DECODE_CACHE_SIZE; i++)
+    {
+        cache->entries[i].index = indices + (size_t)i * k;
+        cache->entries[i].matrix = matrices + (size_t)i * matrix_size;
+    }
+    return cache;
+}
+
+void
+build_decode_matrix_into_space(const fec_t* ZFEX_RESTRICT const code, const unsigned*const ZFEX_RESTRICT index, const uint16_t k, gf* ZFEX_RESTRICT const matrix);
+
+static gf const*
+_cached_decode_matrix(const fec_t *code, const unsigned *index)
+{
+    struct fec_decode_cache_s *cache = code->decode_cache;
+    size_t const index_size = (size_t)code->k * sizeof(unsigned);
+    fec_decode_cache_entry_t *victim = &cache->entries[0];
+    uint32_t hash = 2166136261u; /* FNV-1a */
+
+    for (uint16_t i = 0; i < code->k; i++)
+    {
+        hash = (hash ^ index[i]) * 16777619u;
+    }
+
+    cache->clock += 1;
+
+    for (int i = 0; i < ZFEX_DECODE_CACHE_SIZE; i++)
+    {
+        fec_decode_cache_entry_t *entry = &cache->entries[i];
+        if (entry->last_use != 0 && entry->hash == hash && memcmp(entry->index, index, index_size) == 0)
+        {
+            entry->last_use = cache->clock;
+            return entry->matrix;
+        }
+        if (entry->last_use < victim->last_use)
+        {
+            victim = entry;
+        }
+    }
+
+    build_decode_matrix_into_space(code, index, code->k, victim->matrix);
+    memcpy(victim->index, index, index_size);
+    victim->hash = hash;
+    victim->last_use = cache->clock;
+    return victim->matrix;
+}
+
 zfex_status_code_t
 fec_free (fec_t *p)
 {
     assert (p != NULL);
+    free (p->decode_cache);
     free (p->enc_matrix);
     free (p);
 
@@ -741,13 +1130,13 @@ fec_new(uint16_t k, uint16_t n, fec_t **out_fec_pp)
     assert(n < 256);
     assert(k <= n);
 
-    if (fec_initialized == 0)
-        init_fec ();
+    _ensure_fec_initialized();
 
     retval = (fec_t *) malloc (sizeof (fec_t));
     retval->k = k;
     retval->n = n;
     retval->enc_matrix = NEW_GF_MATRIX (n, k);
+    retval->decode_cache = _new_decode_cache(k);
     tmp_m = NEW_GF_MATRIX (n, k);
     /*
      * fill the matrix with powers of field elements, starting from 0.
@@ -890,7 +1279,7 @@ fec_decode_simd(
     unsigned int *index,
     size_t const sz)
 {
-    gf *m_dec = (gf *)alloca((size_t)code->k * (size_t)code->k);
+    gf const *m_dec;
     uint16_t outix = 0;
 
     zfex_status_code_t const shuffle_sc = shuffle(inpkts, index, code->k);
@@ -899,7 +1288,7 @@ fec_decode_simd(
         return shuffle_sc;
     }
 
-    build_decode_matrix_into_space(code, index, code->k, m_dec);
+    m_dec = _cached_decode_matrix(code, index);
 
     /* Verify input blocks addresses */
     for (uint16_t col = 0; col < code->k; ++col)
@@ -28,14 +28,44 @@ extern "C"
 
 typedef unsigned char gf;
 
+struct fec_decode_cache_s;
+
 typedef struct
 {
     uint16_t k, n;                     /* parameters of the code */
     gf* enc_matrix;
+    struct fec_decode_cache_s* decode_cache; /* inverted decode matrices by erasure pattern */
 } fec_t;
 
+/* Name of the selected kernel, see fec_select_kernel() */
 extern const char* zfex_opt;
 
+/*
+ * Implementations of the GF(2^8) multiply-add behind fec_encode_simd() and fec_decode_simd().
+ * The fastest one the CPU supports is selected by the first fec_new().
+ */
+typedef enum zfex_kernel_e
+{
+    ZFEX_KERNEL_SCALAR = 0,
+    ZFEX_KERNEL_SSSE3,
+    ZFEX_KERNEL_NEON,
+    ZFEX_KERNEL_AVX2,
+    ZFEX_KERNEL_AVX2_GFNI,
+    ZFEX_KERNEL_AVX512_GFNI,
+    ZFEX_KERNEL_COUNT
+} zfex_kernel_t;
+
+const char* fec_kernel_name(zfex_kernel_t kernel);
+int fec_kernel_supported(zfex_kernel_t kernel);
+zfex_kernel_t fec_selected_kernel(void);
+
+/**
+ * Switch to another kernel, e.g. to compare them. Not thread-safe: no encode or decode may run meanwhile.
+ *
+ * @return ZFEX_SC_UNSUPPORTED_KERNEL if this build or CPU lacks it
+ */
+zfex_status_code_t fec_select_kernel(zfex_kernel_t kernel);
+
 /**
  * param k the number of blocks required to reconstruct
  * param m the total number of blocks created
@@ -59,6 +89,8 @@ zfex_status_code_t fec_encode_simd(
     size_t sz);
 
 /**
+ * The inverted decode matrix is cached per erasure pattern in the code, so concurrent decodes need a fec_t each.
+ *
  * @param inpkts an array of packets (size k); If a primary block, i, is present then it must be at index i. Secondary blocks can appear anywhere.
  * @param outpkts an array of buffers into which the reconstructed output packets will be written (only packets which are not present in the inpkts input will be reconstructed and written to outpkts)
  * @param index an array of the blocknums of the packets in inpkts
@@ -61,6 +61,16 @@ extern "C"
 #define ZFEX_INTEL_SSSE3_FEATURE 0
 #endif
 
+/*
+ * SSSE3/AVX2/GFNI/AVX-512 kernels built with function target attributes and picked by CPUID at run time,
+ * so that the binary needs no -m flags. Needs GCC or Clang.
+ */
+#if (defined ZFEX_USE_INTEL_DISPATCH) && (ZFEX_HAS_INTEL == 1) && ((defined __GNUC__) || (defined __clang__))
+#define ZFEX_INTEL_DISPATCH_FEATURE 1
+#else
+#define ZFEX_INTEL_DISPATCH_FEATURE 0
+#endif
+
 
 #define ZFEX_IS_POWER_OF_2(x) ((x != 0) && !(x & (x - 1)))
 
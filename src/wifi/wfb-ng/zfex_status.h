@@ -24,6 +24,7 @@ typedef enum zfex_status_code_e
     ZFEX_SC_BAD_OUTPUT_BLOCK_ALIGNMENT,
     ZFEX_SC_NULL_POINTER_INPUT,
     ZFEX_SC_DECODE_INVALID_BLOCK_INDEX,
+    ZFEX_SC_UNSUPPORTED_KERNEL,
 } zfex_status_code_t;
 
 
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <array>
+#include <climits>
 #include <fstream>
 #include <iomanip>
 #include <map>
@@ -10,12 +11,13 @@
 #include <set>
 #include <sstream>
 
-#include "../gui_interface.h"
 #include "RxPacket.h"
 #include "UsbOpen.h"
 #include "WiFiDriver.h"
 #include "cross/endian.h"
+#include "link_events.h"
 #include "logger.h"
+#include "pcap_capture.h"
 #include "rtp.h"
 #include "rx_frame.h"
 #include "signal_quality.h"
@@ -51,13 +53,29 @@ public:
                 const std::string &keypair,
                 uint64_t epoch,
                 uint32_t channel_id,
-                int snd_buf_size)
-        : AggregatorUDPv4(client_addr, client_port, keypair, epoch, channel_id, snd_buf_size) {}
+                int snd_buf_size,
+                LinkEvents &events,
+                bool in_process = false)
+        : AggregatorUDPv4(client_addr, client_port, keypair, epoch, channel_id, snd_buf_size),
+          events_(events),
+          in_process(in_process) {}
 
 protected:
+    uint64_t get_timestamp() override {
+        return LatencyStamps::now();
+    }
+
     void send_to_socket(const uint8_t *payload, const uint16_t packet_size) override {
-        GuiInterface::Instance().rtpPktCount_++;
-        GuiInterface::Instance().UpdateCount();
+        events_.link_stats_.rtpPackets.add();
+
+        LatencyStamps stamps;
+        if (sent_fragment_ts.received != 0) {
+            stamps[LatencyStage::UsbRx] = static_cast<int64_t>(sent_fragment_ts.received);
+            stamps[LatencyStage::Decrypted] = static_cast<int64_t>(sent_fragment_ts.decrypted);
+            stamps.mark(LatencyStage::FecReleased);
+            events_.link_metrics_.record_latency(stamps, LatencyStage::Decrypted);
+            events_.link_metrics_.record_latency(stamps, LatencyStage::FecReleased);
+        }
 
         if (packet_size < 12) {
             return;
@@ -66,28 +84,32 @@ protected:
         auto *header = (RtpHeader *)payload;
         const uint16_t seq_num = be16toh(header->seq);
 
-        // GuiInterface::Instance().PutLog(LogLevel::Debug, "RTP sequence number: {}", seq_num);
-        // GuiInterface::Instance().PutLog(LogLevel::Debug, "RTP timestamp: {}", be32toh(header->stamp));
+        // events_.PutLog(LogLevel::Debug, "RTP sequence number: {}", seq_num);
+        // events_.PutLog(LogLevel::Debug, "RTP timestamp: {}", be32toh(header->stamp));
 
         if (!prev_seq_num.has_value()) {
             // Check H264 or H265
-            if (isH264(header->getPayloadData())) {
-                GuiInterface::Instance().playerCodec = "H264";
+            const std::string codec = isH264(header->getPayloadData()) ? "H264" : "H265";
+            events_.SetPlayerCodec(codec);
+
+            if (in_process) {
+                events_.NotifyInProcessRtpStream(codec);
             } else {
-                GuiInterface::Instance().playerCodec = "H265";
+                events_.NotifyRtpStream(header->pt, be32toh(header->ssrc), events_.playerPort, codec);
             }
-
-            GuiInterface::Instance().NotifyRtpStream(header->pt,
-                                                     be32toh(header->ssrc),
-                                                     GuiInterface::Instance().playerPort,
-                                                     GuiInterface::Instance().playerCodec);
         }
 
         if (prev_seq_num.has_value() && seq_num - prev_seq_num.value() > 1) {
-            GuiInterface::Instance().PutLog(LogLevel::Info, "RTP packets lost: {}", seq_num - prev_seq_num.value() - 1);
+            events_.PutLog(LogLevel::Info, "RTP packets lost: {}", seq_num - prev_seq_num.value() - 1);
         }
         prev_seq_num = seq_num;
 
+        // Hand the payload to the player directly, no need for a round trip through the loopback interface.
+        if (in_process) {
+            events_.PushRtpPacket(payload, packet_size, stamps);
+            return;
+        }
+
         // Send payload via socket.
         wfb_sendto(sockfd, (const char *)payload, packet_size, 0, (sockaddr *)&saddr, sizeof(saddr));
     }
@@ -96,7 +118,12 @@ private:
     AggregatorX(const AggregatorX &);
     AggregatorX &operator=(const AggregatorX &);
 
+    LinkEvents &events_;
+
     std::optional<uint16_t> prev_seq_num;
+
+    /// Deliver packets through LinkEvents::PushRtpPacket() instead of the UDP socket.
+    bool in_process;
 };
 
 namespace {
@@ -265,30 +292,50 @@ std::vector<DeviceId> WfbngLink::get_device_list() {
     return list;
 }
 
-bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidthMode, const std::string &kPath) {
-    GuiInterface::Instance().wifiFrameCount_ = 0;
-    GuiInterface::Instance().wfbngFrameCount_ = 0;
-    GuiInterface::Instance().rtpPktCount_ = 0;
-    GuiInterface::Instance().UpdateCount();
+bool WfbngLink::start(const DeviceId &deviceId,
+                      uint8_t channel,
+                      int channelWidthMode,
+                      const std::string &kPath,
+                      std::shared_ptr<WfbngReceiver> shared_receiver,
+                      const uint8_t wlan_idx) {
+    // Adapters joining a running receiver must not reset the counters of the others.
+    if (!shared_receiver) {
+        events_.link_stats_.reset();
+        events_.link_metrics_.reset();
+    }
 
     keyPath = kPath;
 
     if (usbThread) {
-        GuiInterface::Instance().PutLog(LogLevel::Error, "USB thread already exists");
+        events_.PutLog(LogLevel::Error, "USB thread already exists");
         return false;
     }
 
+    if (wlan_idx >= MAX_ADAPTER_COUNT) {
+        events_.PutLog(LogLevel::Error, "Too many adapters, at most {} are supported", MAX_ADAPTER_COUNT);
+        return false;
+    }
+
+    try {
+        receiver_ = shared_receiver ? std::move(shared_receiver)
+                                    : std::make_shared<WfbngReceiver>(keyPath, link_id, tun_enabled, events_);
+    } catch (const std::runtime_error &e) {
+        events_.PutLog(LogLevel::Error, e.what());
+        return false;
+    }
+    wlan_idx_ = wlan_idx;
+
     auto logger = std::make_shared<Logger>();
     logger->set_level(Logger::Level::Info);
 
     if (ctx) {
-        GuiInterface::Instance().PutLog(LogLevel::Error, "libusb context should be null");
+        events_.PutLog(LogLevel::Error, "libusb context should be null");
         return false;
     }
 
     int rc = libusb_init(&ctx);
     if (rc < 0) {
-        GuiInterface::Instance().PutLog(LogLevel::Error, "Failed to initialize libusb");
+        events_.PutLog(LogLevel::Error, "Failed to initialize libusb");
         return false;
     }
 
@@ -324,7 +371,7 @@ bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidt
     }
 
     if (!target_dev) {
-        GuiInterface::Instance().PutLog(LogLevel::Error, "Invalid device ID!");
+        events_.PutLog(LogLevel::Error, "Invalid device ID!");
         // Free the list of devices
         libusb_free_device_list(devs, 1);
         libusb_exit(ctx);
@@ -343,13 +390,13 @@ bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidt
         libusb_exit(ctx);
         ctx = nullptr;
 
-        GuiInterface::Instance().PutLog(LogLevel::Error,
-                                        "Cannot open device {:04x}:{:04x} at [{:}:{:}]",
-                                        deviceId.vendor_id,
-                                        deviceId.product_id,
-                                        deviceId.bus_num,
-                                        deviceId.port_num);
-        GuiInterface::Instance().ShowTip("invalid usb msg", true);
+        events_.PutLog(LogLevel::Error,
+                       "Cannot open device {:04x}:{:04x} at [{:}:{:}]",
+                       deviceId.vendor_id,
+                       deviceId.product_id,
+                       deviceId.bus_num,
+                       deviceId.port_num);
+        events_.ShowTip("invalid usb msg", true);
 
         return false;
     }
@@ -369,7 +416,7 @@ bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidt
         libusb_exit(ctx);
         ctx = nullptr;
 
-        GuiInterface::Instance().PutLog(LogLevel::Error, "Failed to claim interface: {}", rc);
+        events_.PutLog(LogLevel::Error, "Failed to claim interface: {}", rc);
 
         return false;
     }
@@ -427,7 +474,7 @@ bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidt
                 init_thread(usb_tx_thread, [&]() {
                     return std::make_unique<std::thread>([this, args] {
                         tx_frame->run(rtlDevice.get(), args.get());
-                        GuiInterface::Instance().PutLog(LogLevel::Info, "USB TX thread should stop");
+                        events_.PutLog(LogLevel::Info, "USB TX thread should stop");
                     });
                 });
             }
@@ -437,22 +484,18 @@ bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidt
                 start_link_quality_thread();
             }
 
-            rtlDevice->Init(
-                [this](const Packet &p) {
-                    handle_80211_frame(p);
-                    GuiInterface::Instance().UpdateCount();
-                },
-                SelectedChannel{
-                    .Channel = channel,
-                    .ChannelOffset = 0,
-                    .ChannelWidth = static_cast<ChannelWidth_t>(channelWidthMode),
-                });
+            rtlDevice->Init([this](const Packet &p) { handle_80211_frame(p); },
+                            SelectedChannel{
+                                .Channel = channel,
+                                .ChannelOffset = 0,
+                                .ChannelWidth = static_cast<ChannelWidth_t>(channelWidthMode),
+                            });
 
-            GuiInterface::Instance().PutLog(LogLevel::Info, "RTL device loop exited");
+            events_.PutLog(LogLevel::Info, "RTL device loop exited");
         } catch (const std::runtime_error &e) {
-            GuiInterface::Instance().PutLog(LogLevel::Error, e.what());
+            events_.PutLog(LogLevel::Error, e.what());
 
-            GuiInterface::Instance().ShowTip("invalid device", true);
+            events_.ShowTip("invalid device", true);
         } catch (...) {
         }
 
@@ -467,13 +510,13 @@ bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidt
 
         auto rc1 = libusb_release_interface(devHandle, iface);
         if (rc1 < 0) {
-            GuiInterface::Instance().PutLog(LogLevel::Error, "Failed to release interface");
+            events_.PutLog(LogLevel::Error, "Failed to release interface");
         }
 
         stop_adaptive_link();
         tx_frame->stop();
         destroy_thread(usb_tx_thread);
-        GuiInterface::Instance().PutLog(LogLevel::Info, "USB TX thread stopped");
+        events_.PutLog(LogLevel::Info, "USB TX thread stopped");
         // destroy_thread(usb_event_thread);
 
         libusb_close(devHandle);
@@ -482,10 +525,10 @@ bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidt
         devHandle = nullptr;
         ctx = nullptr;
 
-        GuiInterface::Instance().EmitWifiStopped();
+        events_.EmitWifiStopped();
         first_rtp_packet_received = false;
 
-        GuiInterface::Instance().PutLog(LogLevel::Info, "USB thread stopped");
+        events_.PutLog(LogLevel::Info, "USB thread stopped");
     });
     // usbThread->detach();
 
@@ -500,6 +543,60 @@ bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidt
     return true;
 }
 
+bool WfbngLink::start_replay(const std::string &pcap_path, const std::string &kPath, const bool realtime) {
+    events_.link_stats_.reset();
+    events_.link_metrics_.reset();
+
+    keyPath = kPath;
+
+    if (usbThread) {
+        events_.PutLog(LogLevel::Error, "USB thread already exists");
+        return false;
+    }
+
+    try {
+        replayer_ = std::make_unique<PcapReplayer>(pcap_path);
+        receiver_ = std::make_shared<WfbngReceiver>(keyPath, link_id, tun_enabled, events_);
+    } catch (const std::runtime_error &e) {
+        events_.PutLog(LogLevel::Error, e.what());
+        replayer_.reset();
+        return false;
+    }
+    wlan_idx_ = 0;
+
+    events_.PutLog(LogLevel::Info, "Replaying {}", pcap_path);
+
+    // Takes the place of the USB thread, so that stop() works the same.
+    usbThread = std::make_shared<std::thread>([this, realtime] {
+        const auto start_time = std::chrono::steady_clock::now();
+
+        const uint64_t frame_count = replayer_->run(
+            [this, realtime](const Packet &packet, const uint8_t wlan_idx) {
+                // A real adapter can not be held back, but a replay at full speed must not be measured by
+                // how many frames it manages to drop.
+                if (!realtime) {
+                    receiver_->wait_for_backlog(PacketRing::SLOT_COUNT / 2);
+                }
+                receiver_->handle_80211_frame(packet, wlan_idx);
+            },
+            realtime);
+
+        receiver_->wait_for_backlog(0);
+
+        const double seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        events_.PutLog(LogLevel::Info,
+                       "Replayed {} frames in {:.3f} s ({:.0f} frames/s)",
+                       frame_count,
+                       seconds,
+                       seconds > 0 ? frame_count / seconds : 0.0);
+
+        events_.EmitWifiStopped();
+    });
+
+    return true;
+}
+
 void WfbngLink::init_thread(std::unique_ptr<std::thread> &thread,
                             const std::function<std::unique_ptr<std::thread>()> &init_func) {
     std::unique_lock lock(thread_mutex);
@@ -516,7 +613,7 @@ void WfbngLink::destroy_thread(std::unique_ptr<std::thread> &thread) {
 }
 
 void WfbngLink::start_link_quality_thread() {
-    GuiInterface::Instance().PutLog(LogLevel::Info, "Start alink thread");
+    events_.PutLog(LogLevel::Info, "Start alink thread");
 
     auto thread_func = [this]() {
         std::this_thread::sleep_for(std::chrono::seconds(1));
@@ -556,13 +653,19 @@ void WfbngLink::start_link_quality_thread() {
         }
 
         while (!this->alink_should_stop) {
-            auto quality = signal_quality_calculator->calculate_signal_quality();
+            auto quality = receiver_->calculate_signal_quality();
 
             // Best values of the antennas.
             int best_rssi = std::max(quality.rssi[0], quality.rssi[1]);
             int best_snr = std::max(quality.snr[0], quality.snr[1]);
             int best_link_score = std::max(quality.link_score[0], quality.link_score[1]);
 
+            // The averages hide short fades, which are what break up the video. Report the score the link
+            // drops to in them instead, so that the drone backs off before the fades cost frames.
+            const int fade_penalty = receiver_->get_fade_penalty();
+            best_link_score = std::max(1000, best_link_score - fade_penalty);
+            const int num_ants = receiver_->get_active_antenna_count();
+
             time_t currentEpoch = time(nullptr);
 
             // Prepare & send a message
@@ -611,12 +714,12 @@ void WfbngLink::start_link_quality_thread() {
                 }
 
                 const int fec_lvl = fec_controller.value();
-                GuiInterface::Instance().drone_fec_level_ = fec_lvl;
+                events_.drone_fec_level_.store(fec_lvl, std::memory_order_relaxed);
 
                 // Prepare the TX message
                 snprintf(message + sizeof(len),
                          sizeof(message) - sizeof(len),
-                         "%ld:%d:%d:%d:%d:%d:%f:0:-1:%d:%s\n",
+                         "%ld:%d:%d:%d:%d:%d:%f:%d:%d:%d:%s\n",
                          static_cast<long>(currentEpoch),
                          best_link_score,
                          best_link_score,
@@ -624,6 +727,8 @@ void WfbngLink::start_link_quality_thread() {
                          quality.lost_last_second,
                          best_rssi,
                          (float)best_snr,
+                         num_ants,
+                         fade_penalty,
                          fec_lvl,
                          quality.idr_code.c_str());
 
@@ -659,11 +764,13 @@ void WfbngLink::start_link_quality_thread() {
 
     init_thread(link_quality_thread, [=]() { return std::make_unique<std::thread>(thread_func); });
 
-    rtlDevice->SetTxPower(static_cast<uint8_t>(alink_tx_power));
+    if (rtlDevice) {
+        rtlDevice->SetTxPower(static_cast<uint8_t>(alink_tx_power));
+    }
 }
 
 void WfbngLink::stop_adaptive_link() {
-    GuiInterface::Instance().PutLog(LogLevel::Info, "Stopping alink thread");
+    events_.PutLog(LogLevel::Info, "Stopping alink thread");
 
     std::unique_lock lock(thread_mutex);
 
@@ -674,123 +781,426 @@ void WfbngLink::stop_adaptive_link() {
     alink_should_stop = true;
     destroy_thread(link_quality_thread);
 
-    GuiInterface::Instance().PutLog(LogLevel::Info, "Alink thread stopped");
+    events_.PutLog(LogLevel::Info, "Alink thread stopped");
 }
 
-void WfbngLink::handle_80211_frame(const Packet &packet) {
-    GuiInterface::Instance().wifiFrameCount_++;
-    GuiInterface::Instance().UpdateCount();
+WfbngReceiver::ChannelPipeline::ChannelPipeline() {
+    for (auto &queue : queues) {
+        queue = std::make_unique<PacketRing>(&doorbell);
+    }
+}
 
-    const RxFrame frame(packet.Data);
-    if (!frame.IsValidWfbFrame()) {
-        return;
+WfbngReceiver::WfbngReceiver(const std::string &key_path,
+                             const uint32_t link_id,
+                             const bool tun_enabled,
+                             LinkEvents &events)
+    : events_(events), tun_enabled_(tun_enabled) {
+    constexpr uint8_t video_radio_port = 0;
+    constexpr uint8_t mavlink_radio_port = 0x10;
+    constexpr uint8_t udp_radio_port = WFB_RX_PORT;
+
+    constexpr uint64_t epoch = 0;
+    constexpr int udp_client_port = 8000;
+    const std::string client_addr = "127.0.0.1";
+
+    const uint32_t video_channel_id_f = (link_id << 8) + video_radio_port;
+    const uint32_t udp_channel_id_f = (link_id << 8) + udp_radio_port;
+
+    video_.channel_id_be = htobe32(video_channel_id_f);
+    udp_.channel_id_be = htobe32(udp_channel_id_f);
+    mavlink_channel_id_be_ = htobe32((link_id << 8) + mavlink_radio_port);
+
+    video_.aggregator = std::make_unique<AggregatorX>(client_addr,
+                                                      events_.playerPort,
+                                                      key_path,
+                                                      epoch,
+                                                      video_channel_id_f,
+                                                      0,
+                                                      events_,
+                                                      !events_.forward_port_.has_value());
+    video_.worker = std::thread([this] { run_worker(video_); });
+
+    // UDP frames are only of use with a TUN interface.
+#ifdef __linux__
+    if (tun_enabled_) {
+        udp_.aggregator =
+            std::make_unique<AggregatorX>(client_addr, udp_client_port, key_path, epoch, udp_channel_id_f, 0, events_);
+        udp_.worker = std::thread([this] { run_worker(udp_); });
     }
+#endif
+}
 
-    GuiInterface::Instance().wfbngFrameCount_++;
-    GuiInterface::Instance().UpdateCount();
+WfbngReceiver::~WfbngReceiver() {
+    workers_should_stop_ = true;
 
-    static uint8_t video_radio_port = 0;
-    static uint64_t epoch = 0;
+    for (ChannelPipeline *pipeline : {&video_, &udp_}) {
+        pipeline->doorbell.wake();
+        if (pipeline->worker.joinable()) {
+            pipeline->worker.join();
+        }
+    }
+}
 
-    static uint32_t video_channel_id_f = (link_id << 8) + video_radio_port;
-    static uint32_t video_channel_id_be = htobe32(video_channel_id_f);
+void WfbngReceiver::handle_80211_frame(const Packet &packet, const uint8_t wlan_idx) {
+    const int64_t rx_time = LatencyStamps::now();
 
-    static auto *video_channel_id_be8 = reinterpret_cast<uint8_t *>(&video_channel_id_be);
+    events_.link_stats_.wifiFrames.add();
 
-    int mavlink_client_port = 14550;
-    uint8_t mavlink_radio_port = 0x10;
-    uint32_t mavlink_channel_id_f = (link_id << 8) + mavlink_radio_port;
-    static uint32_t mavlink_channel_id_be = htobe32(mavlink_channel_id_f);
-    auto *mavlink_channel_id_be8 = reinterpret_cast<uint8_t *>(&mavlink_channel_id_be);
+    if (capturing_) {
+        std::lock_guard lock(capture_mutex_);
+        if (recorder_) {
+            recorder_->write(packet, wlan_idx);
+        }
+    }
 
-    int udp_client_port = 8000;
-    uint8_t udp_radio_port = WFB_RX_PORT;
-    uint32_t udp_channel_id_f = (link_id << 8) + udp_radio_port;
-    static uint32_t udp_channel_id_be = htobe32(udp_channel_id_f);
-    auto *udp_channel_id_be8 = reinterpret_cast<uint8_t *>(&udp_channel_id_be);
+    const RxFrame frame(packet.Data);
+    if (!frame.IsValidWfbFrame() || packet.Data.size() <= sizeof(ieee80211_header) + 4) {
+        return;
+    }
 
-    std::string client_addr = "127.0.0.1";
+    events_.link_stats_.wfbngFrames.add();
 
-    if (!video_aggregator) {
-        video_aggregator = std::make_unique<AggregatorX>(client_addr,
-                                                         GuiInterface::Instance().playerPort,
-                                                         keyPath.c_str(),
-                                                         epoch,
-                                                         video_channel_id_f,
-                                                         0);
-    }
-    if (!udp_aggregator) {
-        udp_aggregator =
-            std::make_unique<AggregatorX>(client_addr, udp_client_port, keyPath, epoch, udp_channel_id_f, 0);
+    if (wlan_idx >= MAX_ADAPTER_COUNT) {
+        return;
     }
 
-    static int8_t rssi[2] = {1, 1};
-    static uint8_t antenna[4] = {1, 1, 1, 1};
-    uint32_t freq = 0;
-    int8_t noise[4] = {1, 1, 1, 1};
+    const FrameInfo info = {
+        .rx_time = rx_time,
+        .wlan_idx = wlan_idx,
+        .rssi = {static_cast<uint8_t>(packet.RxAtrib.rssi[0]), static_cast<uint8_t>(packet.RxAtrib.rssi[1])},
+        .snr = {static_cast<int8_t>(packet.RxAtrib.snr[0]), static_cast<int8_t>(packet.RxAtrib.snr[1])},
+    };
 
-    std::lock_guard lock(agg_mutex);
+    // Strip the 802.11 header and the FCS.
+    const uint8_t *data = packet.Data.data() + sizeof(ieee80211_header);
+    const size_t size = packet.Data.size() - sizeof(ieee80211_header) - 4;
 
     // Video frame
-    if (frame.MatchesChannelID(video_channel_id_be8)) {
-        // Update signal quality
-        signal_quality_calculator->add_rssi(packet.RxAtrib.rssi[0], packet.RxAtrib.rssi[1]);
-        signal_quality_calculator->add_snr(packet.RxAtrib.snr[0], packet.RxAtrib.snr[1]);
-
-        video_aggregator->process_packet(packet.Data.data() + sizeof(ieee80211_header),
-                                         packet.Data.size() - sizeof(ieee80211_header) - 4,
-                                         0,
-                                         antenna,
-                                         rssi,
-                                         noise,
-                                         freq,
-                                         0,
-                                         0,
-                                         NULL);
-
-        signal_quality_calculator->add_fec(video_aggregator->count_p_all,
-                                           video_aggregator->count_p_fec_recovered,
-                                           video_aggregator->count_p_lost);
-
-        // This is necessary.
-        video_aggregator->clear_stats();
-
-        const auto quality = signal_quality_calculator->calculate_signal_quality();
-        link_score_[0] = quality.link_score[0];
-        link_score_[1] = quality.link_score[1];
-        packets_lost_ = quality.lost_last_second;
+    if (frame.MatchesChannelID(reinterpret_cast<const uint8_t *>(&video_.channel_id_be))) {
+        enqueue(video_, info, data, size);
     }
     // MAVLink frame
-    else if (frame.MatchesChannelID(mavlink_channel_id_be8)) {
-        // GuiInterface::Instance().PutLog(LogLevel::Warn, "Received a MAVLink frame, but we're unable to handle it!");
+    else if (frame.MatchesChannelID(reinterpret_cast<const uint8_t *>(&mavlink_channel_id_be_))) {
+        // events_.PutLog(LogLevel::Warn, "Received a MAVLink frame, but we're unable to handle it!");
     }
     // UDP frame
-    else if (frame.MatchesChannelID(udp_channel_id_be8)) {
-        // GuiInterface::Instance().PutLog(LogLevel::Warn, "Received a UDP frame, but we're unable to handle it!");
+    else if (frame.MatchesChannelID(reinterpret_cast<const uint8_t *>(&udp_.channel_id_be))) {
+        // events_.PutLog(LogLevel::Warn, "Received a UDP frame, but we're unable to handle it!");
 
-#ifdef __linux__
-        if (tun_enabled) {
-            udp_aggregator->process_packet(packet.Data.data() + sizeof(ieee80211_header),
-                                           packet.Data.size() - sizeof(ieee80211_header) - 4,
-                                           0,
-                                           antenna,
-                                           rssi,
-                                           noise,
-                                           freq,
-                                           0,
-                                           0,
-                                           NULL);
+        if (udp_.aggregator) {
+            enqueue(udp_, info, data, size);
+        }
+    }
+}
+
+void WfbngReceiver::enqueue(ChannelPipeline &pipeline, const FrameInfo &info, const uint8_t *data, size_t size) {
+    if (&pipeline == &video_) {
+        // Frames of two adapters may swap places here, the histogram takes that as a gap of 0.
+        const int64_t last_arrival = pipeline.last_arrival.exchange(info.rx_time, std::memory_order_relaxed);
+        if (last_arrival != 0) {
+            events_.link_metrics_.arrival_gap_us.record((info.rx_time - last_arrival) / 1000);
         }
-#endif
+    }
+
+    // The USB thread must never block, so a worker that falls behind loses the newest frames.
+    // FEC covers the occasional drop; a steady stream of them means the host is too slow.
+    if (!pipeline.queues[info.wlan_idx]->push(&info, sizeof(info), data, size)) {
+        events_.link_stats_.queueDrops.add();
     }
 }
 
+void WfbngReceiver::run_worker(ChannelPipeline &pipeline) {
+    const bool is_video = &pipeline == &video_;
+
+    // The queue to look at first, so that one busy adapter cannot hold back the others.
+    size_t next_queue = 0;
+
+    while (!workers_should_stop_) {
+        if (is_video) {
+            apply_fec_ring_depth();
+        }
+
+        PacketRing *queue = nullptr;
+        size_t size;
+        const uint8_t *data = nullptr;
+        for (size_t i = 0; i < pipeline.queues.size() && !data; i++) {
+            queue = pipeline.queues[next_queue].get();
+            data = queue->front(size);
+            next_queue = (next_queue + 1) % pipeline.queues.size();
+        }
+
+        if (!data) {
+            auto timeout = std::chrono::milliseconds(100);
+            // Without traffic nothing else releases a block that waits for fragments which never come.
+            // Only wake up early while there is such a block, an idle link would only spin.
+            if (is_video) {
+                flush_stale_video_blocks();
+                if (video_.aggregator->get_open_blocks() > 0) {
+                    const auto half_deadline = std::chrono::ceil<std::chrono::milliseconds>(fec_deadline_.value() / 2);
+                    timeout = std::min(timeout, half_deadline);
+                }
+            }
+            pipeline.doorbell.wait(timeout, [&pipeline] { return !pipeline.empty(); });
+            continue;
+        }
+
+        const size_t depth = pipeline.depth();
+        if (depth > pipeline.peak_depth.load(std::memory_order_relaxed)) {
+            pipeline.peak_depth.store(depth, std::memory_order_relaxed);
+        }
+
+        FrameInfo info;
+        memcpy(&info, data, sizeof(info));
+
+        if (is_video) {
+            process_video_packet(info, data + sizeof(info), size - sizeof(info));
+            flush_stale_video_blocks();
+        } else {
+            process_udp_packet(info, data + sizeof(info), size - sizeof(info));
+        }
+
+        queue->pop();
+    }
+}
+
+void WfbngReceiver::process_video_packet(const FrameInfo &info, const uint8_t *data, const size_t size) {
+    // Both antennas of the adapter, so that the aggregator keeps separate RSSI/SNR stats
+    // for each (wlan_idx, antenna) pair. The aggregator expects noise = rssi - snr.
+    const uint8_t antenna[RX_ANT_MAX] = {0, 1, 0xff, 0xff};
+    const int8_t rssi[RX_ANT_MAX] = {static_cast<int8_t>(info.rssi[0]),
+                                     static_cast<int8_t>(info.rssi[1]),
+                                     SCHAR_MIN,
+                                     SCHAR_MIN};
+    const int8_t noise[RX_ANT_MAX] = {static_cast<int8_t>(rssi[0] - info.snr[0]),
+                                      static_cast<int8_t>(rssi[1] - info.snr[1]),
+                                      SCHAR_MAX,
+                                      SCHAR_MAX};
+
+    // Update signal quality
+    SignalQualityCalculator &adapter_quality = adapter_quality_[info.wlan_idx];
+    adapter_quality.add_rssi(info.rssi[0], info.rssi[1]);
+    adapter_quality.add_snr(info.snr[0], info.snr[1]);
+    events_.link_metrics_.record_signal(info.wlan_idx, info.rssi, info.snr);
+
+    AggregatorX &aggregator = *video_.aggregator;
+
+    // A copy already delivered by another adapter is dropped here, before decryption.
+    aggregator.rx_timestamp = static_cast<uint64_t>(info.rx_time);
+    aggregator.process_packet(data, size, info.wlan_idx, antenna, rssi, noise, 0, 0, 0, NULL);
+
+    // Copies from other adapters would make the packets look closer together than they were sent.
+    if (aggregator.count_p_dec_skipped == 0 && aggregator.count_p_dec_err == 0) {
+        fec_deadline_.add_arrival(info.rx_time);
+    }
+
+    account_video_stats();
+}
+
+void WfbngReceiver::apply_fec_ring_depth() {
+    const int depth = events_.fec_ring_depth_.load(std::memory_order_relaxed);
+    if (depth == applied_fec_ring_depth_) {
+        return;
+    }
+    applied_fec_ring_depth_ = depth;
+
+    // Blocks still open are flushed as they are.
+    const int ring_size = video_.aggregator->set_ring_size(depth > 0 ? depth : RX_RING_SIZE);
+    account_video_stats();
+    events_.PutLog(LogLevel::Info, "FEC ring depth: {} blocks", ring_size);
+}
+
+void WfbngReceiver::flush_stale_video_blocks() {
+    AggregatorX &aggregator = *video_.aggregator;
+
+    const auto deadline = fec_deadline_.update(aggregator.get_fec_n());
+    const int flushed = aggregator.flush_stale_blocks(static_cast<uint64_t>(LatencyStamps::now()),
+                                                         static_cast<uint64_t>(deadline.count()));
+    if (flushed > 0) {
+        account_video_stats();
+    }
+}
+
+void WfbngReceiver::account_video_stats() {
+    AggregatorX &aggregator = *video_.aggregator;
+
+    stream_quality_.add_fec(aggregator.count_p_all, aggregator.count_p_fec_recovered, aggregator.count_p_lost);
+
+    // A block is recovered within the call that completes it.
+    if (aggregator.count_p_fec_recovered > 0) {
+        events_.link_metrics_.fec_recovered_per_block.record(aggregator.count_p_fec_recovered);
+    }
+
+    LinkStats &stats = events_.link_stats_;
+    stats.decryptsSkipped.add(aggregator.count_p_dec_skipped);
+    stats.fecPackets.add(aggregator.count_p_all);
+    stats.fecRecovered.add(aggregator.count_p_fec_recovered);
+    stats.fecLost.add(aggregator.count_p_lost);
+    stats.decryptErrors.add(aggregator.count_p_dec_err);
+    stats.fecTimeoutBlocks.add(aggregator.count_p_timeout);
+
+    // This is necessary.
+    aggregator.clear_stats();
+}
+
+void WfbngReceiver::process_udp_packet(const FrameInfo &info, const uint8_t *data, const size_t size) {
+    const uint8_t antenna[RX_ANT_MAX] = {0xff, 0xff, 0xff, 0xff};
+    const int8_t rssi[RX_ANT_MAX] = {SCHAR_MIN, SCHAR_MIN, SCHAR_MIN, SCHAR_MIN};
+    const int8_t noise[RX_ANT_MAX] = {SCHAR_MAX, SCHAR_MAX, SCHAR_MAX, SCHAR_MAX};
+
+    udp_.aggregator->process_packet(data, size, info.wlan_idx, antenna, rssi, noise, 0, 0, 0, NULL);
+}
+
+std::array<int, ANTENNA_COUNT> WfbngReceiver::get_link_score(const uint8_t wlan_idx) const {
+    if (wlan_idx >= MAX_ADAPTER_COUNT) {
+        return {};
+    }
+    const auto quality = adapter_quality_[wlan_idx].calculate_signal_quality();
+    return {quality.link_score[0], quality.link_score[1]};
+}
+
+int WfbngReceiver::get_packet_loss() const {
+    return stream_quality_.calculate_signal_quality().lost_last_second;
+}
+
+WfbngReceiver::QueueStats WfbngReceiver::get_queue_stats(const ChannelPipeline &pipeline) {
+    return {
+        .depth = pipeline.depth(),
+        .peak_depth = pipeline.peak_depth.load(std::memory_order_relaxed),
+    };
+}
+
+WfbngReceiver::QueueStats WfbngReceiver::get_video_queue_stats() const {
+    return get_queue_stats(video_);
+}
+
+WfbngReceiver::QueueStats WfbngReceiver::get_udp_queue_stats() const {
+    return get_queue_stats(udp_);
+}
+
+std::chrono::microseconds WfbngReceiver::get_fec_release_deadline() const {
+    return fec_deadline_.value();
+}
+
+void WfbngReceiver::wait_for_backlog(const size_t max_depth) const {
+    while (!workers_should_stop_ && (video_.depth() > max_depth || udp_.depth() > max_depth)) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+void WfbngReceiver::start_capture(const std::string &path) {
+    auto recorder = std::make_unique<PcapRecorder>(path);
+
+    std::lock_guard lock(capture_mutex_);
+    recorder_ = std::move(recorder);
+    capturing_ = true;
+
+    events_.PutLog(LogLevel::Info, "Capturing frames to {}", path);
+}
+
+void WfbngReceiver::stop_capture() {
+    std::lock_guard lock(capture_mutex_);
+    if (!recorder_) {
+        return;
+    }
+
+    events_.PutLog(LogLevel::Info, "Captured {} frames", recorder_->frame_count());
+
+    capturing_ = false;
+    recorder_.reset();
+}
+
+SignalQualityCalculator::SignalQuality WfbngReceiver::calculate_signal_quality() const {
+    auto quality = stream_quality_.calculate_signal_quality();
+
+    // The adapter with the best antenna speaks for the whole link.
+    int best_link_score = 0;
+    for (const auto &adapter_quality : adapter_quality_) {
+        const auto candidate = adapter_quality.calculate_signal_quality();
+        const int link_score = std::max(candidate.link_score[0], candidate.link_score[1]);
+        if (link_score > best_link_score) {
+            best_link_score = link_score;
+            std::copy(std::begin(candidate.rssi), std::end(candidate.rssi), std::begin(quality.rssi));
+            std::copy(std::begin(candidate.snr), std::end(candidate.snr), std::begin(quality.snr));
+            std::copy(std::begin(candidate.link_score), std::end(candidate.link_score), std::begin(quality.link_score));
+        }
+    }
+
+    return quality;
+}
+
+int WfbngReceiver::get_fade_penalty() const {
+    // Fewer samples than this make the tail too noisy to steer the drone with.
+    constexpr uint64_t MIN_SAMPLES = 20;
+    constexpr std::chrono::seconds WINDOW{1};
+
+    float best_mean_score = 0;
+    int best_antenna = -1;
+    for (int wlan_idx = 0; wlan_idx < MAX_ADAPTER_COUNT; wlan_idx++) {
+        const auto quality = adapter_quality_[wlan_idx].calculate_signal_quality();
+        for (int i = 0; i < ANTENNA_COUNT; i++) {
+            const float score = SignalQualityCalculator::link_score(quality.rssi[i], quality.snr[i]);
+            if (score > best_mean_score) {
+                best_mean_score = score;
+                best_antenna = wlan_idx * ANTENNA_COUNT + i;
+            }
+        }
+    }
+    if (best_antenna < 0) {
+        return 0;
+    }
+
+    const auto &metrics = events_.link_metrics_;
+    if (metrics.rssi[best_antenna].summarize(WINDOW).count < MIN_SAMPLES) {
+        return 0;
+    }
+    const auto rssi_tail = metrics.rssi[best_antenna].value_at_percentile(5, WINDOW);
+    const auto snr_tail = metrics.snr[best_antenna].value_at_percentile(5, WINDOW);
+    if (!rssi_tail || !snr_tail) {
+        return 0;
+    }
+
+    const float tail_score = SignalQualityCalculator::link_score(*rssi_tail, *snr_tail);
+
+    return std::max(0, static_cast<int>(round(best_mean_score - tail_score)));
+}
+
+int WfbngReceiver::get_active_antenna_count() const {
+    int count = 0;
+    for (const auto &histogram : events_.link_metrics_.rssi) {
+        if (histogram.summarize(std::chrono::seconds(1)).count > 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void WfbngLink::handle_80211_frame(const Packet &packet) {
+    receiver_->handle_80211_frame(packet, wlan_idx_);
+}
+
+std::shared_ptr<WfbngReceiver> WfbngLink::get_receiver() const {
+    return receiver_;
+}
+
+TxStats WfbngLink::get_tx_stats() const {
+    if (!tx_frame) {
+        return {};
+    }
+    return tx_frame->getStats();
+}
+
 std::array<int, ANTENNA_COUNT> WfbngLink::get_link_score() const {
-    return link_score_;
+    if (!receiver_) {
+        return {};
+    }
+    return receiver_->get_link_score(wlan_idx_);
 }
 
 int WfbngLink::get_packet_loss() const {
-    return packets_lost_;
+    if (!receiver_) {
+        return 0;
+    }
+    return receiver_->get_packet_loss();
 }
 
 void WfbngLink::stop() {
@@ -800,6 +1210,9 @@ void WfbngLink::stop() {
     if (rtlDevice) {
         rtlDevice->StopRxLoop();
     }
+    if (replayer_) {
+        replayer_->stop();
+    }
 #ifdef __linux__
     if (tun_) {
         tun_->stop();
@@ -811,6 +1224,8 @@ void WfbngLink::stop() {
         usbThread->join();
         usbThread.reset();
     }
+
+    replayer_.reset();
 }
 
 bool WfbngLink::get_alink_enabled() const {
@@ -841,31 +1256,29 @@ void WfbngLink::enable_alink(const bool enable) {
 
 void WfbngLink::set_alink_tx_power(const int tx_power) {
     if (tx_power <= 0) {
-        GuiInterface::Instance().PutLog(LogLevel::Warn, "Invalid alink tx power!");
+        events_.PutLog(LogLevel::Warn, "Invalid alink tx power!");
         return;
     }
     alink_tx_power = tx_power;
 
     // Change alink tx power during playing.
-    if (alink_enabled && link_quality_thread) {
-        GuiInterface::Instance().PutLog(LogLevel::Info, "Set alink tx power (live): {}", tx_power);
+    if (alink_enabled && link_quality_thread && rtlDevice) {
+        events_.PutLog(LogLevel::Info, "Set alink tx power (live): {}", tx_power);
 
         rtlDevice->SetTxPower(static_cast<uint8_t>(alink_tx_power));
     } else {
-        GuiInterface::Instance().PutLog(LogLevel::Info, "Set alink tx power: {}", tx_power);
+        events_.PutLog(LogLevel::Info, "Set alink tx power: {}", tx_power);
     }
 }
 
-WfbngLink::WfbngLink() {
+WfbngLink::WfbngLink(LinkEvents &events) : events_(events) {
 #ifdef _WIN32
     WSADATA wsaData;
     if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-        GuiInterface::Instance().PutLog(LogLevel::Error, "WSAStartup failed");
+        events_.PutLog(LogLevel::Error, "WSAStartup failed");
         return;
     }
 #endif
-
-    signal_quality_calculator = std::make_unique<SignalQualityCalculator>();
 }
 
 WfbngLink::~WfbngLink() {
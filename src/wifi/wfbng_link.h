@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <chrono>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -9,7 +10,9 @@
 #include <memory>
 #include <functional>
 
+#include "link_metrics.h"
 #include "net_compat.h"
+#include "packet_ring.h"
 #include "signal_quality.h"
 
 #if defined(_WIN32) || defined(__APPLE__)
@@ -29,6 +32,7 @@
 #include "RxPacket.h"
 #include "WiFiDriver.h"
 #include "fec_controller.h"
+#include "fec_deadline.h"
 #include "tx_frame.h"
 
 #ifdef __linux__
@@ -51,19 +55,182 @@ struct DeviceId {
 };
 
 class AggregatorX;
+class LinkEvents;
+class PcapRecorder;
+class PcapReplayer;
+
+/// Merges the frames of all adapters into one aggregator per radio port.
+///
+/// Every adapter tuned to the channel hands its frames to the same instance. The aggregator drops copies of a
+/// packet it has already stored before decrypting them, so the first intact copy wins (best-of-N), and packets
+/// missed by one adapter are filled in by the others instead of having to be recovered by FEC.
+///
+/// The USB threads only classify frames by channel ID and queue them. Decryption, FEC and forwarding run on one
+/// worker thread per channel, so a slow FEC decode does not hold up URB completion.
+class WfbngReceiver {
+public:
+    /// Throws std::runtime_error if the key cannot be read.
+    WfbngReceiver(const std::string &key_path, uint32_t link_id, bool tun_enabled, LinkEvents &events);
+    ~WfbngReceiver();
+
+    /// Process a 802.11 frame received by adapter `wlan_idx`.
+    void handle_80211_frame(const Packet &packet, uint8_t wlan_idx);
+
+    /// Link score of each antenna of adapter `wlan_idx`.
+    std::array<int, ANTENNA_COUNT> get_link_score(uint8_t wlan_idx) const;
+
+    /// Packets lost over the last second, after merging.
+    int get_packet_loss() const;
+
+    /// FEC statistics of the merged stream, RSSI/SNR/link score of the best adapter.
+    SignalQualityCalculator::SignalQuality calculate_signal_quality() const;
+
+    /// How far the link score of the best antenna drops in its fades (5th percentile of RSSI and SNR over the
+    /// last second) below its mean. 0 until the antenna has enough samples.
+    int get_fade_penalty() const;
+
+    /// Antennas of all adapters that received something within the last second.
+    int get_active_antenna_count() const;
 
-constexpr int ANTENNA_COUNT = 2;
+    struct QueueStats {
+        /// Frames waiting for the worker.
+        size_t depth = 0;
+        /// Highest depth seen so far.
+        size_t peak_depth = 0;
+    };
+
+    QueueStats get_video_queue_stats() const;
+
+    QueueStats get_udp_queue_stats() const;
+
+    /// How long a video block with missing fragments is held for FEC before it is released with gaps.
+    std::chrono::microseconds get_fec_release_deadline() const;
+
+    /// Blocks while a queue holds more than `max_depth` frames.
+    /// Lets a replay run at full speed without losing frames to backpressure.
+    void wait_for_backlog(size_t max_depth) const;
+
+    /// Write every frame seen by handle_80211_frame() to a pcap file, until stop_capture().
+    /// Throws std::runtime_error if the file cannot be created.
+    void start_capture(const std::string &path);
+
+    void stop_capture();
+
+private:
+    /// Stored in front of every queued frame.
+    struct FrameInfo {
+        /// When the USB RX callback handed the frame over, see LatencyStamps.
+        int64_t rx_time;
+        uint8_t wlan_idx;
+        uint8_t rssi[ANTENNA_COUNT];
+        int8_t snr[ANTENNA_COUNT];
+    };
+
+    /// Frames of one radio port, queued by the USB threads and aggregated by a worker thread.
+    struct ChannelPipeline {
+        ChannelPipeline();
+
+        bool empty() const {
+            for (const auto &queue : queues) {
+                if (!queue->empty()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /// Frames in all queues together.
+        size_t depth() const {
+            size_t depth = 0;
+            for (const auto &queue : queues) {
+                depth += queue->size();
+            }
+            return depth;
+        }
+
+        /// Channel ID in the byte order of the 802.11 header.
+        uint32_t channel_id_be = 0;
+        std::unique_ptr<AggregatorX> aggregator;
+        /// Wakes up the worker when any of the queues gets a frame.
+        RingDoorbell doorbell;
+        /// One per adapter, indexed by wlan_idx, so that each ring has the USB thread of its adapter as its single
+        /// producer. Hold wfb-ng packets, the 802.11 header and FCS are already stripped.
+        std::array<std::unique_ptr<PacketRing>, MAX_ADAPTER_COUNT> queues;
+        /// USB RX time of the last frame queued by any adapter, see LatencyStamps.
+        std::atomic<int64_t> last_arrival{0};
+        std::atomic<size_t> peak_depth{0};
+        std::thread worker;
+    };
+
+    void enqueue(ChannelPipeline &pipeline, const FrameInfo &info, const uint8_t *data, size_t size);
+
+    static QueueStats get_queue_stats(const ChannelPipeline &pipeline);
+
+    void run_worker(ChannelPipeline &pipeline);
+
+    void process_video_packet(const FrameInfo &info, const uint8_t *data, size_t size);
+
+    /// Resizes the video aggregator's ring when LinkEvents::fec_ring_depth_ has changed.
+    void apply_fec_ring_depth();
+
+    /// Releases video blocks that are past the FEC deadline, see FecDeadline.
+    void flush_stale_video_blocks();
+
+    /// Moves the counters of the video aggregator into the link stats.
+    void account_video_stats();
+
+    void process_udp_packet(const FrameInfo &info, const uint8_t *data, size_t size);
+
+    LinkEvents &events_;
+
+    std::atomic<bool> workers_should_stop_{false};
+
+    std::atomic<bool> capturing_{false};
+    /// Serializes the USB threads of several adapters.
+    std::mutex capture_mutex_;
+    std::unique_ptr<PcapRecorder> recorder_;
+
+    ChannelPipeline video_;
+    ChannelPipeline udp_;
+    /// MAVLink frames are recognized but not handled.
+    uint32_t mavlink_channel_id_be_;
+
+    bool tun_enabled_;
+
+    /// RSSI/SNR of every frame, per adapter. Duplicates count too, they still tell how good the adapter is.
+    /// Written by the video worker only, queried by the GUI and the alink thread.
+    std::array<SignalQualityCalculator, MAX_ADAPTER_COUNT> adapter_quality_;
+    /// FEC counters of the merged stream.
+    SignalQualityCalculator stream_quality_;
+    /// Written by the video worker only.
+    FecDeadline fec_deadline_;
+    /// Ring depth the video aggregator was last set to, as asked, written by the video worker only.
+    int applied_fec_ring_depth_ = 0;
+};
 
 /// Receive packets from a Wi-Fi adapter.
 class WfbngLink {
 public:
-    WfbngLink();
+    /// `events` has to outlive the link.
+    explicit WfbngLink(LinkEvents &events);
     ~WfbngLink();
 
     static std::vector<DeviceId> get_device_list();
 
     /// Start Wi-Fi monitoring with a device.
-    bool start(const DeviceId &deviceId, uint8_t channel, int channelWidth, const std::string &kPath);
+    /// Pass the receiver of an already running link to merge the frames of both adapters,
+    /// `wlan_idx` then has to be unique among the adapters sharing it.
+    bool start(const DeviceId &deviceId,
+               uint8_t channel,
+               int channelWidth,
+               const std::string &kPath,
+               std::shared_ptr<WfbngReceiver> shared_receiver = nullptr,
+               uint8_t wlan_idx = 0);
+
+    /// Feed the frames of a pcap file (see WfbngReceiver::start_capture) into the receive path, no adapter needed.
+    /// With `realtime` the recorded timing is kept, otherwise the file is replayed as fast as it can be processed
+    /// and the achieved throughput is logged.
+    bool start_replay(const std::string &pcap_path, const std::string &kPath, bool realtime);
 
     void stop();
 
@@ -78,11 +245,18 @@ public:
     /// Process a 802.11 frame.
     void handle_80211_frame(const Packet &packet);
 
+    std::shared_ptr<WfbngReceiver> get_receiver() const;
+
     std::array<int, ANTENNA_COUNT> get_link_score() const;
 
     int get_packet_loss() const;
 
+    /// Uplink stats of the adaptive link, empty if it never ran.
+    TxStats get_tx_stats() const;
+
 protected:
+    LinkEvents &events_;
+
     libusb_context *ctx{};
     libusb_device_handle *devHandle{};
 
@@ -100,14 +274,13 @@ protected:
     /// Use different values for separate links to avoid interference.
     uint32_t link_id = 7669206;
 
-    std::mutex agg_mutex;
-
-    std::unique_ptr<AggregatorX> video_aggregator;
-    std::unique_ptr<AggregatorX> udp_aggregator;
+    /// Possibly shared with the other adapters.
+    std::shared_ptr<WfbngReceiver> receiver_;
+    /// Index of this adapter in the receiver.
+    uint8_t wlan_idx_ = 0;
 
-    std::shared_ptr<SignalQualityCalculator> signal_quality_calculator;
-    std::array<int, ANTENNA_COUNT> link_score_ = {}; // Percentage
-    int packets_lost_ = 0;                           // Number over the last second
+    /// Stands in for the adapter when replaying a capture.
+    std::unique_ptr<PcapReplayer> replayer_;
 
     // --------------- Adaptive link
     std::unique_ptr<std::thread> usb_event_thread;